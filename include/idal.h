@@ -23,10 +23,65 @@ class iRecord;
 class psDBProfiles;
 class LogCSV;
 
+/**
+ * A query queued to the database workers with one of the Async functions
+ * of iDataConnection. It can be polled or waited for, or a callback can be
+ * given when queueing it.
+ */
+struct iAsyncQuery : public virtual iBase
+{
+    SCF_INTERFACE(iAsyncQuery, 0, 0, 2);
+
+    /// Returns whether a worker has run the query.
+    virtual bool IsDone()=0;
+
+    /// Blocks until a worker has run the query.
+    virtual void Wait()=0;
+
+    /// Returns whether the query ran without error. Only valid once done.
+    virtual bool Succeeded()=0;
+
+    /**
+     * Returns the rows of a select, or NULL for other queries or when the
+     * select failed. The result set is owned by the query.
+     */
+    virtual iResultSet* GetResultSet()=0;
+
+    /**
+     * Like GetResultSet(), but the result set is handed over to the caller,
+     * who has to release it. Later calls return NULL.
+     */
+    virtual iResultSet* TakeResultSet()=0;
+
+    /// Returns the number of rows affected by a command.
+    virtual unsigned long GetAffectedRows()=0;
+
+    /// Returns the id of the row added by an insert.
+    virtual uint64 GetInsertID()=0;
+
+    /// Returns the error of a failed query, or an empty string.
+    virtual const char* GetError()=0;
+
+    /// Returns the sql of the query.
+    virtual const char* GetQuery()=0;
+};
+
+/**
+ * Called when a query queued with a callback is done. Callbacks are not
+ * called from the worker threads but from the thread calling
+ * iDataConnection::DispatchCallbacks(), normally the main game thread.
+ */
+struct iAsyncQueryCallback : public virtual iBase
+{
+    SCF_INTERFACE(iAsyncQueryCallback, 0, 0, 1);
+
+    virtual void QueryDone(iAsyncQuery* query)=0;
+};
+
 struct iDataConnection : public virtual iBase
 {
 public:
-    SCF_INTERFACE(iDataConnection, 0, 0, 1);
+    SCF_INTERFACE(iDataConnection, 0, 3, 0);
 
     /// Returns whether this object is actually connected to the database.
     virtual int IsValid(void)=0;
@@ -106,6 +161,78 @@ public:
     
     virtual iRecord* NewUpdatePreparedStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line) =0;
     virtual iRecord* NewInsertPreparedStatement(const char* table, unsigned int count, const char* file, unsigned int line) = 0;
+
+    /**
+     * Opens a pool of extra connections, each used by its own worker
+     * thread, to run the queries queued by the Async functions. Must be
+     * called after Initialize(). Without workers the queries queued by the
+     * Async functions run right away on this connection.
+     *
+     * @param count The number of workers and connections.
+     * @return False if a connection could not be opened.
+     */
+    virtual bool StartWorkers(size_t count)=0;
+
+    /**
+     * Waits for the workers to run all queued queries and closes their
+     * connections. Callbacks not dispatched yet are dropped. Also done by
+     * Close().
+     */
+    virtual void StopWorkers()=0;
+
+    /**
+     * Queues a select to the workers. Queries start in the order they were
+     * queued, but with more than one worker they may finish in any order.
+     *
+     * @param callback Called with the query when it is done, may be NULL.
+     * @return The query, to poll or wait for.
+     */
+    virtual csPtr<iAsyncQuery> SelectAsync(iAsyncQueryCallback* callback, const char *sql, ...)=0;
+
+    /// Queues an insert, update or delete to the workers, see SelectAsync().
+    virtual csPtr<iAsyncQuery> CommandAsync(iAsyncQueryCallback* callback, const char *sql, ...)=0;
+
+    /**
+     * Queues the same insert as GenericInsertWithID() to the workers. The
+     * new id is returned by iAsyncQuery::GetInsertID().
+     */
+    virtual csPtr<iAsyncQuery> GenericInsertWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                        const char **fieldnames, psStringArray& fieldvalues)=0;
+
+    /// Queues the same update as GenericUpdateWithID() to the workers.
+    virtual csPtr<iAsyncQuery> GenericUpdateWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                        const char *idfield, const char *id,
+                                                        const char **fieldnames, psStringArray& fieldvalues)=0;
+
+    /**
+     * Calls the callbacks of the queries done since the last call, on the
+     * calling thread.
+     *
+     * @return The number of callbacks called.
+     */
+    virtual size_t DispatchCallbacks()=0;
+
+    /**
+     * Opens another connection with the settings of this one, for a thread
+     * that runs its own queries.
+     *
+     * @return The new connection, or NULL if it could not be opened.
+     */
+    virtual csPtr<iDataConnection> Connect()=0;
+
+    /**
+     * To be called by a thread that used a connection from Connect(), after
+     * releasing it and before the thread ends.
+     */
+    virtual void EndThread()=0;
+
+    /**
+     * Gets a checksum of the rows of a table, that changes when they do.
+     *
+     * @return False if there is no such table or the database can't
+     *         checksum tables.
+     */
+    virtual bool GetTableChecksum(const char *table, uint64 &checksum)=0;
 };
 
 
@@ -183,6 +310,12 @@ public:
      */
     virtual unsigned long Count(void)=0;
 
+    /// Returns the number of fields of the rows.
+    virtual int GetFieldCount()=0;
+
+    /// Returns the name of a field, or NULL for an out of bounds field.
+    virtual const char *GetFieldName(int whichfield)=0;
+
     /**
      * Deletes itself.  This must be a member of the plugin class rather
      * than letting the caller delete it due to a Windows assertion error
@@ -84,12 +84,25 @@ struct iCelHPath : public virtual iBase
 
 
 
+/**
+ * Statistics of the path cache of a hierarchical navigation structure.
+ */
+struct celHPathCacheStats
+{
+  size_t size;          ///< Most paths kept.
+  size_t entries;       ///< Paths kept now.
+  size_t lookups;       ///< Searches that looked in the cache.
+  size_t hits;          ///< Searches answered from the cache.
+  size_t evicted;       ///< Paths dropped to make room.
+  size_t invalidated;   ///< Paths dropped because a tile they cross was updated.
+};
+
 /**
  * Hierarchical navigation structure representing the navigable areas of a Map.
  */
 struct iCelHNavStruct : public virtual iBase
 {
-  SCF_INTERFACE (iCelHNavStruct, 1, 1, 0);
+  SCF_INTERFACE (iCelHNavStruct, 1, 3, 0);
 
   /**
    * Find the shortest path between two points.
@@ -113,6 +126,32 @@ struct iCelHNavStruct : public virtual iBase
    *          is destroyed.
    */
   virtual iCelHPath* ShortestPath (iMapNode* from, iMapNode* goal) = 0;
+
+  /**
+   * Find the shortest path between two points, like ShortestPath(), but
+   * without keeping the path.
+   * \remarks Following a path found this way may search the navigation
+   *          meshes too. The path references the sectors and navigation
+   *          meshes, so only search from the thread that uses them.
+   */
+  virtual csPtr<iCelHPath> FindPath (const csVector3& from, iSector* fromSector, const csVector3& goal,
+    iSector* goalSector) = 0;
+
+  /// Find the shortest path between two map nodes, see FindPath().
+  virtual csPtr<iCelHPath> FindPath (iMapNode* from, iMapNode* goal) = 0;
+
+  /**
+   * Set how many paths are cached. Searches between positions on the same
+   * polygons as a cached path follow that path, only the ends of it are
+   * moved. 0 turns the cache off.
+   */
+  virtual void SetPathCacheSize (size_t size) = 0;
+
+  /// Get the hit rate and size of the path cache.
+  virtual celHPathCacheStats GetPathCacheStats () = 0;
+
+  /// Count the statistics of the path cache from zero.
+  virtual void ResetPathCacheStats () = 0;
   
   /**
    * Update the tiles of the hierarchical navigation structure that intersect with an axis aligned bounding box.
@@ -172,7 +211,7 @@ struct iCelHNavStruct : public virtual iBase
  */
 struct iCelHNavStructBuilder : public virtual iBase
 {
-  SCF_INTERFACE (iCelHNavStructBuilder, 1, 0, 0);
+  SCF_INTERFACE (iCelHNavStructBuilder, 1, 1, 0);
 
   /**
    * Set the Sectors used to build the navigation structure.
@@ -208,6 +247,12 @@ struct iCelHNavStructBuilder : public virtual iBase
    * \remarks Should be called before iCelHNavStructBuilder::SetSectors().
    */
   virtual void SetNavMeshParams (const iCelNavMeshParams* parameters) = 0;
+
+  /**
+   * Set the number of threads building the tiles of each navigation mesh.
+   * \remarks The navigation meshes built do not depend on it. Defaults to 1.
+   */
+  virtual void SetThreadCount (int count) = 0;
 };
 
 #endif // __CEL_HPFAPI__
@@ -194,7 +194,7 @@ struct iCelNavMeshPath : public virtual iBase
  */
 struct iCelNavMesh : public virtual iBase
 {
-  SCF_INTERFACE (iCelNavMesh, 1, 0, 0);
+  SCF_INTERFACE (iCelNavMesh, 1, 2, 0);
 
   /**
    * Find the shortest path between two points.
@@ -206,6 +206,13 @@ struct iCelNavMesh : public virtual iBase
   virtual iCelNavMeshPath* ShortestPath (const csVector3& from, const csVector3& goal, 
                                          int maxPathSize = 32) = 0;
 
+  /**
+   * Find the shortest path between two points, like ShortestPath(), but
+   * without keeping the path, so several paths can be in use at once.
+   */
+  virtual csPtr<iCelNavMeshPath> FindPath (const csVector3& from, const csVector3& goal, 
+                                           int maxPathSize = 32) = 0;
+
   /**
    * Update the tiles of the navigation mesh that intersect with an axis aligned bounding box.
    * \param boundingBox Bounding box representing the area to be updated.
@@ -220,6 +227,17 @@ struct iCelNavMesh : public virtual iBase
    */
   virtual bool Update (const csOBB& boundingBox) = 0;
 
+  /**
+   * Get the reference of the polygon nearest to a position.
+   * \return 0 if there is no polygon within the polygon search box.
+   * \remarks The references of the polygons of a tile change when the tile is
+   *          rebuilt. Safe to call from several threads, like FindPath().
+   */
+  virtual uint GetPolygonRef (const csVector3& position) = 0;
+
+  /// Get the coordinates of the tile containing a position.
+  virtual void GetTileLocation (const csVector3& position, int& x, int& y) const = 0;
+
   /// Get navigation mesh sector
   virtual iSector* GetSector () const = 0;
 
@@ -268,7 +286,7 @@ struct iCelNavMesh : public virtual iBase
  */
 struct iCelNavMeshBuilder : public virtual iBase
 {
-  SCF_INTERFACE (iCelNavMeshBuilder, 1, 0, 0);
+  SCF_INTERFACE (iCelNavMeshBuilder, 1, 1, 0);
 
   /**
    * Set an iSector as the current working sector and loads it's triangles.
@@ -307,6 +325,16 @@ struct iCelNavMeshBuilder : public virtual iBase
   virtual void SetNavMeshParams (const iCelNavMeshParams* parameters) = 0;
 
   virtual iSector* GetSector () const = 0;
+
+  /**
+   * Set the number of threads building the tiles of a navigation mesh.
+   * \remarks The tiles are added to the mesh in the same order whatever the
+   *          count, so the mesh built does not depend on it. Defaults to 1.
+   */
+  virtual void SetThreadCount (int count) = 0;
+
+  /// Get the number of threads building the tiles of a navigation mesh.
+  virtual int GetThreadCount () const = 0;
  
 };
 
@@ -30,6 +30,7 @@
 #include "net/message.h"
 #include "net/messages.h"
 #include "net/clientmsghandler.h"
+#include "net/connection.h"
 
 #include "util/pserror.h"
 #include "util/log.h"
@@ -48,6 +49,7 @@
 #include "pscelclient.h"
 #include "psclientdr.h"
 #include "psengine.h"
+#include "psnetmanager.h"
 #include "pscharcontrol.h"
 #include "globals.h"
 
@@ -156,7 +158,7 @@ void psAuthenticationClient::HandleMessage(MsgEntry *me)
 bool psAuthenticationClient::Authenticate (const csString & user, const csString & pwd, const csString & pwd256)
 {
     Notify3( LOG_CONNECTIONS, "Prelog in as: (%s,%s)\n", user.GetData(), pwd.GetData() );    
-    psPreAuthenticationMessage request(0,PS_NETVERSION);
+    psPreAuthenticationMessage request(0,PS_NETVERSION,true);
     request.SendMessage();
     username = user;
     password = pwd;
@@ -204,6 +206,10 @@ void psAuthenticationClient::HandlePreAuth( MsgEntry* me )
 //after the second phase it will be removed.
     
     psPreAuthApprovedMessage msg(me);
+
+    // The server agreed to exchange compressed messages
+    if(msg.compression)
+        psengine->GetNetManager()->GetConnection()->EnableCompression(0);
             
     //if it's not a new user, encrypt password with clientnum
     csString passwordhashandclientnum (password256);
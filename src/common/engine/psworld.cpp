@@ -216,6 +216,21 @@ bool psWorld::Connected(const iSector* from, const iSector* to)
     return false;
 }
 
+void psWorld::GetConnectedSectors(const iSector* from, csArray<iSector*> &sectors)
+{
+    int i = engine->GetSectors()->Find((iSector*)from);
+    if(i == -1 || (size_t)i >= transarray.GetSize())
+        return;
+
+    csHash<csReversibleTransform*, csPtrKey<iSector> >::GlobalIterator it = transarray[i].GetIterator();
+    while(it.HasNext())
+    {
+        csPtrKey<iSector> sector;
+        it.Next(sector);
+        sectors.Push(sector);
+    }
+}
+
 float psWorld::Distance(const csVector3 &from_pos, const iSector* from_sector, csVector3 to_pos, const iSector* to_sector)
 {
     if(from_sector == to_sector)
@@ -120,6 +120,9 @@ public:
     /// Checks whether 2 sectors are connected via a warp portal.
     bool Connected(const iSector* from, const iSector* to);
 
+    /// Append all sectors connected to from via a warp portal to the list.
+    void GetConnectedSectors(const iSector* from, csArray<iSector*> &sectors);
+
     /// Calculate the distance between two to points either in same or different sectors.
     /// Return INFINITY_DISTANCE if no connection sectors where found
     float Distance(const csVector3 &from_pos, const iSector* from_sector, csVector3 to_pos, const iSector* to_sector);
@@ -233,6 +233,9 @@ void psNetConnection::Run ()
         }
         if (currentticks - laststatdisplay > STATDISPLAYCHECK)
         {
+            long totaltransferin, totaltransferout, totalcountin, totalcountout;
+            GetTransferTotals(totaltransferin, totaltransferout, totalcountin, totalcountout);
+
             kbpsin = (float)(totaltransferin - lasttotaltransferin) / (float)(currentticks - laststatdisplay);
             lasttotaltransferin = totaltransferin;
 
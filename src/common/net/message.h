@@ -37,6 +37,7 @@
 #include "util/log.h"
 #include "net/packing.h"
 #include "net/pstypes.h"
+#include "net/netbufferpool.h"
 #include "util/genrefqueue.h"
 
 using namespace CS::Threading;
@@ -144,7 +145,7 @@ class MsgEntry : public csSyncRefCount
 {
 public:
     MsgEntry (size_t datasize = 0, uint8_t msgpriority=PRIORITY_HIGH, uint8_t sequence=0)
-        : clientnum(0), priority((sequence << 2) | msgpriority), msgid(0), overrun(false)
+        : clientnum(0), priority((sequence << 2) | msgpriority), msgid(0), overrun(false), allowCompression(true)
     {
         if (sequence && msgpriority==PRIORITY_LOW)
         {
@@ -157,7 +158,7 @@ public:
             datasize=MAX_MESSAGE_SIZE;
         }
 
-        bytes = (psMessageBytes*) cs_malloc(sizeof(psMessageBytes) + datasize);
+        bytes = (psMessageBytes*) psNetBufferPool::Alloc(sizeof(psMessageBytes) + datasize);
         CS_ASSERT(bytes != NULL);
 
         current = 0;
@@ -165,7 +166,7 @@ public:
     }
 
     MsgEntry (const psMessageBytes* msg)
-        : clientnum(0), priority(PRIORITY_LOW), msgid(0), overrun(false)
+        : clientnum(0), priority(PRIORITY_LOW), msgid(0), overrun(false), allowCompression(true)
     {
         size_t msgsize = msg->GetTotalSize();
         if (msgsize > MAX_MESSAGE_SIZE)
@@ -176,7 +177,7 @@ public:
 
         current = 0;
 
-        bytes = (psMessageBytes*) cs_malloc(msgsize);
+        bytes = (psMessageBytes*) psNetBufferPool::Alloc(msgsize);
         CS_ASSERT(bytes != NULL);
 
         memcpy (bytes, msg, msgsize);
@@ -184,35 +185,32 @@ public:
         bytes->SetTotalSize(msgsize);
     }
 
+    /**
+     * Copy a message. The copy shares the payload with the original, so
+     * neither may be changed afterwards. Only clientnum, priority and msgid
+     * are the copy's own.
+     */
     MsgEntry (const MsgEntry* me)
     {
-        size_t msgsize = me->bytes->GetTotalSize();
-        if (msgsize > MAX_MESSAGE_SIZE)
-        {
-            Bug2("Call to MsgEntry copy constructor truncated data.  Source data > %u length.\n",MAX_MESSAGE_SIZE);
-            msgsize = MAX_MESSAGE_SIZE;
-        }
-        bytes = (psMessageBytes*) cs_malloc(msgsize);
-        CS_ASSERT(bytes != NULL);
-        memcpy (bytes, me->bytes, msgsize);
-
-        // If we truncated the message, make sure the size reflects that
-        bytes->SetTotalSize(msgsize);
+        bytes = me->bytes;
+        psNetBufferPool::AddRef(bytes);
 
         clientnum = me->clientnum;
         priority = me->priority;
         msgid = me->msgid;
         current = 0;
         overrun = false;
+        allowCompression = me->allowCompression;
     }
 
     virtual ~MsgEntry()
     {
-        cs_free ((void*) bytes);
+        psNetBufferPool::Release(bytes);
     }
 
     void ClipToCurrentSize()
     {
+        CS_ASSERT_MSG("Changing a shared message", !psNetBufferPool::IsShared(bytes));
         bytes->SetSize(current);
     }
 
@@ -1031,6 +1029,7 @@ public:
 
     void SetType(uint8_t type)
     {
+        CS_ASSERT_MSG("Changing a shared message", !psNetBufferPool::IsShared(bytes));
         bytes->type = type;
     }
     uint8_t GetType()
@@ -1072,6 +1071,9 @@ public:
     /** Indicates wether a read or write overrun has occured */
     bool overrun;
 
+    /** May the network layer deflate this message? False for data that is compressed already */
+    bool allowCompression;
+
 
     /** The message itself ie one block of memory with the
      * header and data following
@@ -111,14 +111,15 @@ csString psCharDeleteMessage::ToString(NetBase::AccessPointers* /*accessPointers
 PSF_IMPLEMENT_MSG_FACTORY(psPreAuthenticationMessage,MSGTYPE_PREAUTHENTICATE);
 
 psPreAuthenticationMessage::psPreAuthenticationMessage(uint32_t clientnum,
-        uint32_t version)
+        uint32_t version, bool compression)
 {
-    msg.AttachNew(new MsgEntry(sizeof(uint32_t)));
+    msg.AttachNew(new MsgEntry(sizeof(uint32_t) + sizeof(bool)));
 
     msg->SetType(MSGTYPE_PREAUTHENTICATE);
     msg->clientnum      = clientnum;
 
     msg->Add(version);
+    msg->Add(compression);
 
     // Sets valid flag based on message overrun state
     valid=!(msg->overrun);
@@ -130,6 +131,8 @@ psPreAuthenticationMessage::psPreAuthenticationMessage(MsgEntry* message)
         return;
 
     netversion = message->GetUInt32();
+    // Older clients don't send the compression flag
+    compression = message->HasMore() ? message->GetBool() : false;
 
     // Sets valid flag based on message overrun state
     valid=!(message->overrun);
@@ -144,7 +147,7 @@ csString psPreAuthenticationMessage::ToString(NetBase::AccessPointers* /*accessP
 {
     csString msgtext;
 
-    msgtext.AppendFmt("NetVersion: %d", netversion);
+    msgtext.AppendFmt("NetVersion: %d Compression: %s", netversion, compression ? "true" : "false");
 
     return msgtext;
 }
@@ -311,14 +314,15 @@ csString psAuthApprovedMessage::ToString(NetBase::AccessPointers* /*accessPointe
 
 PSF_IMPLEMENT_MSG_FACTORY(psPreAuthApprovedMessage,MSGTYPE_PREAUTHAPPROVED);
 
-psPreAuthApprovedMessage::psPreAuthApprovedMessage(uint32_t clientnum)
+psPreAuthApprovedMessage::psPreAuthApprovedMessage(uint32_t clientnum, bool compression)
 {
-    msg.AttachNew(new MsgEntry(sizeof(uint32_t)));
+    msg.AttachNew(new MsgEntry(sizeof(uint32_t) + sizeof(bool)));
 
     msg->SetType(MSGTYPE_PREAUTHAPPROVED);
     msg->clientnum      = clientnum;
 
     msg->Add(clientnum);
+    msg->Add(compression);
 
     // Sets valid flag based on message overrun state
     valid=!(msg->overrun);
@@ -330,6 +334,8 @@ psPreAuthApprovedMessage::psPreAuthApprovedMessage(MsgEntry* message)
         return;
 
     ClientNum = message->GetUInt32();
+    // Older servers don't send the compression flag
+    compression = message->HasMore() ? message->GetBool() : false;
 
     // Sets valid flag based on message overrun state
     valid=!(message->overrun);
@@ -339,7 +345,7 @@ csString psPreAuthApprovedMessage::ToString(NetBase::AccessPointers* /*accessPoi
 {
     csString msgtext;
 
-    msgtext.AppendFmt("CNUM: %d",ClientNum);
+    msgtext.AppendFmt("CNUM: %d Compression: %s",ClientNum, compression ? "true" : "false");
 
     return msgtext;
 }
@@ -3757,6 +3763,8 @@ psMsgStringsMessage::psMsgStringsMessage(uint32_t clientnum, csMD5::Digest &dige
     msg->Add(&digest, sizeof(csMD5::Digest));
     if(num_strings > 0)
     {
+        // The strings are deflated already
+        msg->allowCompression = false;
         msg->Add(false);
         msg->Add(num_strings);
         msg->Add(stringsdata, size);
@@ -56,7 +56,7 @@ class csStringHashReversible;
 // NPC Networking version is separate so we don't have to break compatibility
 // with clients to enhance the superclients.  Made it a large number to ensure
 // no inadvertent overlaps.
-#define PS_NPCNETVERSION 0x1035
+#define PS_NPCNETVERSION 0x1036
 
 enum Slot_Containers
 {
@@ -292,7 +292,9 @@ enum MSG_TYPES
 
     MSGTYPE_ATTACK_QUEUE,
     MSGTYPE_ATTACK_BOOK,
-    MSGTYPE_SPECCOMBATEVENT
+    MSGTYPE_SPECCOMBATEVENT,
+
+    MSGTYPE_COMPRESSED      ///< Deflated wrapper around another message, handled by NetBase.
 };
 
 class psMessageCracker;
@@ -556,10 +558,11 @@ class psPreAuthenticationMessage : public psMessageCracker
 {
 public:
     uint32_t  netversion;
+    bool      compression; ///< Does the client accept compressed messages?
     /**
      *  Creates a message for requesting auth from server
      */
-    psPreAuthenticationMessage(uint32_t clientnum,uint32_t version=PS_NETVERSION);
+    psPreAuthenticationMessage(uint32_t clientnum,uint32_t version=PS_NETVERSION,bool compression=false);
     /**
      * This constructor receives a PS Message struct and cracks it apart
      * to provide more easily usable fields.  It is intended for use on
@@ -673,8 +676,9 @@ class psPreAuthApprovedMessage : public psMessageCracker
 public:
 
     uint32_t  ClientNum;
+    bool      compression; ///< Will the server exchange compressed messages?
     /** Create psMessageBytes struct for outbound use */
-    psPreAuthApprovedMessage(uint32_t clientnum);
+    psPreAuthApprovedMessage(uint32_t clientnum,bool compression=false);
 
     /** Crack incoming psMessageBytes struct for inbound use */
     psPreAuthApprovedMessage(MsgEntry* message);
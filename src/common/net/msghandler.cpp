@@ -25,6 +25,7 @@
 
 #include "net/subscriber.h"
 #include "util/psconst.h"
+#include "util/zoneprofiler.h"
 
 class Client;
 
@@ -59,10 +60,13 @@ void MsgHandler::Publish(MsgEntry* me)
     netbase->LogMessages('R',me);
 
     csArray<Subscription> handlers;
+    const char* zoneName;
     {
         CS::Threading::ScopedReadLock lock(mutex);
         handlers = subscribers.GetAll(mtype);
+        zoneName = zoneNames.Get(mtype, "Unhandled message");
     }
+    PS_PROFILE_ZONE(zoneName);
 
     for(size_t i = 0; i < handlers.GetSize(); ++i)
     {
@@ -92,6 +96,11 @@ void MsgHandler::Subscribe(iNetSubscriber* subscriber, msgtype type, uint32_t fl
     CS::Threading::ScopedWriteLock lock(mutex);
     subscribers.Delete(type, subscriber);
     subscribers.Put(type, Subscription(subscriber, flags));
+
+    if(!zoneNames.Contains(type))
+    {
+        zoneNames.Put(type, psZoneProfiler::Intern(GetMsgTypeName(type)));
+    }
 }
 
 bool MsgHandler::Unsubscribe(iNetSubscriber* subscriber, msgtype type)
@@ -191,7 +191,8 @@ protected:
      * @brief Stores the hash of all subscribers and the message type they are subscribed to
      */
     csHash<Subscription, msgtype> subscribers;
-    CS::Threading::ReadWriteMutex mutex; /**< @brief Protects \ref subscribers */
+    csHash<const char*, msgtype> zoneNames; /**< @brief Profiler zone of each subscribed message type */
+    CS::Threading::ReadWriteMutex mutex; /**< @brief Protects \ref subscribers and \ref zoneNames */
 };
 
 /** @} */
@@ -36,9 +36,11 @@
 #include <ctype.h> 
 
 #include <fcntl.h>
+#include <zlib.h>
 #include "util/pserror.h"
 #include "net/netbase.h"
 #include "net/netpacket.h"
+#include "net/netbufferpool.h"
 #include "net/message.h"
 #include "net/messages.h"
 #include "util/psscf.h"
@@ -92,6 +94,19 @@ csStringID NetBase::AccessPointers::Request( const char* string) const
 }
 
 
+psNetFanOut::psNetFanOut(MsgEntry* me)
+    : msg(me), compressTried(false)
+{
+}
+
+psNetFanOut::~psNetFanOut()
+{
+    for (size_t i = 0; i < packets.GetSize(); i++)
+        psNetBufferPool::Release(packets[i]);
+    for (size_t i = 0; i < compressedPackets.GetSize(); i++)
+        psNetBufferPool::Release(compressedPackets[i]);
+}
+
 
 NetBase::NetBase(int outqueuesize)
 : senders(outqueuesize)
@@ -130,10 +145,9 @@ NetBase::NetBase(int outqueuesize)
     logmsgfiltersetting.receive = false;
     logmsgfiltersetting.send = false;
 
-    input_buffer = NULL;
     for(int i=0;i < NETAVGCOUNT;i++)
     {
-        sendStats[i].senders = sendStats[i].messages = sendStats[i].time = 0;
+        sendStats[i].senders = sendStats[i].messages = sendStats[i].syscalls = sendStats[i].time = 0;
     }
     for(int i =0;i < RESENDAVGCOUNT;i++)
         resends[i] = 0;
@@ -160,9 +174,6 @@ NetBase::~NetBase()
         delete randomgen;
     
     delete profs;
-
-    if (input_buffer)
-        cs_free(input_buffer);
 }
 
 
@@ -195,29 +206,24 @@ bool NetBase::CheckIn()
 {    
     // check for incoming packets
     SOCKADDR_IN addr;
-    memset (&addr, 0, sizeof(SOCKADDR_IN));
-    socklen_t len = sizeof(SOCKADDR_IN);
-
-    if (!input_buffer)
-    {
-        input_buffer = (char*) cs_malloc(MAXPACKETSIZE);
-
-        if (!input_buffer)
-        {
-            Error2("Failed to cs_malloc %d bytes for packet buffer!\n",MAXPACKETSIZE);
-            return false;
-        }
-    }
+    int packetlen;
 
     // Connection must be initialized!
     CS_ASSERT(ready);
-    
-    int packetlen = RecvFrom (&addr, &len, (void*) input_buffer, MAXPACKETSIZE);
 
-    if (packetlen <= 0)
+    // Read everything waiting on the socket at once, then hand out the
+    // packets one by one.
+    if (!recvBatch.HasNext() && !RecvBatch())
     {
         return false;
     }
+
+    char* input_buffer = recvBatch.Next(addr, packetlen);
+    if (packetlen <= 0)
+    {
+        return true; // Continue processing more packets if available
+    }
+
     // Identify the connection
     Connection* connection = GetConnByIP(&addr);
 
@@ -260,7 +266,7 @@ bool NetBase::CheckIn()
         }
         return true; // Continue processing more packets if available
     }
-    input_buffer = NULL; //input_buffer now hold by the bufpacket pointer.
+    recvBatch.TakeLast(); //input_buffer now hold by the bufpacket pointer.
 
     // Endian correction
     bufpacket->UnmarshallEndian();
@@ -623,7 +629,7 @@ void NetBase::CheckResendPkts()
 }
     
 
-bool NetBase::SendMergedPackets(NetPacketQueue *q)
+bool NetBase::SendMergedPackets(NetPacketQueue *q, psNetSendBatch* batch)
 {
     csRef<psNetPacketEntry> queueget;
     csRef<psNetPacketEntry> candidate, final;
@@ -652,7 +658,7 @@ bool NetBase::SendMergedPackets(NetPacketQueue *q)
         candidate = queueget;
         if (candidate->packet->GetSequence() != 0) // sequenced packet is following a non-sequenced packet
         {
-            SendSinglePacket(candidate); // Go ahead and send the sequenced one, but keep building the merged one.
+            SendSinglePacket(candidate, batch); // Go ahead and send the sequenced one, but keep building the merged one.
             if(connection && connection->IsWindowFull())
                 break;
 
@@ -664,7 +670,7 @@ bool NetBase::SendMergedPackets(NetPacketQueue *q)
             // A failed append means that the packet can't fit or is a resent packet.
             // Resent packets MUST NOT be merged because it circumvents clientside packet dup
             // detection
-            SendSinglePacket(final);
+            SendSinglePacket(final, batch);
             
             // Start the process again with the packet that wouldn't fit
             final = candidate;
@@ -675,15 +681,15 @@ bool NetBase::SendMergedPackets(NetPacketQueue *q)
     }
 
     // There is always data in final here
-    SendSinglePacket(final);  // this deletes if necessary
+    SendSinglePacket(final, batch);  // this deletes if necessary
 
     return true;
 }
 
 
-bool NetBase::SendSinglePacket(psNetPacketEntry* pkt)
+bool NetBase::SendSinglePacket(psNetPacketEntry* pkt, psNetSendBatch* batch)
 {
-    if (!SendFinalPacket (pkt))
+    if (!SendFinalPacket (pkt, batch))
     {
         return false;
     }
@@ -715,7 +721,7 @@ bool NetBase::SendSinglePacket(psNetPacketEntry* pkt)
 }
 
 
-bool NetBase::SendFinalPacket(psNetPacketEntry* pkt)
+bool NetBase::SendFinalPacket(psNetPacketEntry* pkt, psNetSendBatch* batch)
 {
     Connection* connection = GetConnByNum(pkt->clientnum);
     if (!connection)
@@ -729,14 +735,16 @@ bool NetBase::SendFinalPacket(psNetPacketEntry* pkt)
     }
     if(pkt->packet->pktid == 0)
     {
+        // The id is per connection, so a packet of a fan-out needs its own copy now
+        pkt->Unshare();
         pkt->packet->pktid = connection->GetNextPacketID();
     }
-    return SendFinalPacket(pkt,&(connection->addr));
+    return SendFinalPacket(pkt,&(connection->addr),batch);
     
 }
 
 
-bool NetBase::SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr)
+bool NetBase::SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr, psNetSendBatch* batch)
 {
     // send packet...
 #ifdef PACKETDEBUG
@@ -746,6 +754,19 @@ bool NetBase::SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr)
 
     // printf("Sending packet sequence %d, length %d on the wire.\n", pkt->packet->GetSequence(),pkt->packet->GetPacketSize() );
 
+    if (batch)
+    {
+        // The batch marshals its own copy, so the packet may be shared
+        batch->Add(addr, pkt->packet);
+
+        if (batch->IsFull())
+            return FlushBatch(batch);
+        return true;
+    }
+
+    // Marshalled in place below
+    pkt->Unshare();
+
     uint16_t size = (uint16_t)pkt->packet->GetPacketSize();
     void *data = pkt->GetData();
 
@@ -764,6 +785,17 @@ bool NetBase::SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr)
 }
 
 
+bool NetBase::FlushBatch(psNetSendBatch* batch)
+{
+    size_t bytes = 0;
+    size_t queued = batch->GetCount();
+    size_t sent = batch->Flush(mysocket, bytes);
+
+    CountTransfer(totaltransferout, totalcountout, (long)bytes, (long)sent);
+    return sent == queued;
+}
+
+
 bool NetBase::SendOut()
 {
     bool sent_anything = false;
@@ -771,8 +803,13 @@ bool NetBase::SendOut()
 
     CS_ASSERT(ready);
 
+    // Packets of all queues are collected and sent with as few calls as possible.
+    // SendOut can be called from other threads through Flush.
+    CS::Threading::MutexScopedLock lock(sendBatchMutex);
+    sendBatch.ResetSyscalls();
+
     // Part1: Client (This is only used when we're the client)
-    if (SendMergedPackets(NetworkQueue))  // client uses this queue
+    if (SendMergedPackets(NetworkQueue, &sendBatch))  // client uses this queue
     {
         sent_anything=true;
     }
@@ -785,7 +822,7 @@ bool NetBase::SendOut()
     while (q = senders.Get())
     {
         sentCount += q->Count();
-        if (SendMergedPackets(q))
+        if (SendMergedPackets(q, &sendBatch))
         {
             sent_anything = true;
         }
@@ -799,10 +836,14 @@ bool NetBase::SendOut()
     for(size_t i = 0; i < readd.GetSize(); i++)
         senders.Add(readd[i]);
 
+    if (!sendBatch.IsEmpty())
+        FlushBatch(&sendBatch);
+
     // Statistics updating
     csTicks timeTaken = csGetTicks() - begin;
     sendStats[avgIndex].senders = senderCount;
     sendStats[avgIndex].messages = sentCount;
+    sendStats[avgIndex].syscalls = (unsigned int)sendBatch.GetSyscalls();
     sendStats[avgIndex].time = timeTaken;
     
     if(senderCount > 0 && (avgIndex == 1 || timeTaken > 100))
@@ -814,6 +855,7 @@ bool NetBase::SendOut()
         float sendAvg = 0.0f;
         float messagesAvg = 0.0f;
         float timeAvg = 0.0f;
+        float syscallsAvg = 0.0f;
         // Calculate averages/peak data here
         for(int i = 0; i < NETAVGCOUNT; i++)
         {
@@ -822,12 +864,14 @@ bool NetBase::SendOut()
             peakMessagesPerSender = csMax(peakMessagesPerSender, (float) sendStats[i].messages / (float) sendStats[i].senders);
             messagesAvg += sendStats[i].messages;
             timeAvg += sendStats[i].time;
+            syscallsAvg += sendStats[i].syscalls;
             peakTime = csMax(peakTime, sendStats[i].time);
         }
 
         sendAvg /= NETAVGCOUNT;
         messagesAvg /= NETAVGCOUNT;
         timeAvg /= NETAVGCOUNT;
+        syscallsAvg /= NETAVGCOUNT;
         csString status;
         if(timeTaken > 50)
         {
@@ -835,7 +879,7 @@ bool NetBase::SendOut()
             CPrintf(CON_WARNING, "%s\n", (const char *) status.GetData());
         }
 
-        status.AppendFmt("Network average statistics for last %u ticks: %g senders, %g messages/sender, %g time per iteration. Peak %u senders, %g messages/sender %u time", csGetTicks() - lastSendReport, sendAvg, messagesAvg, timeAvg, peakSenders, peakMessagesPerSender, peakTime);
+        status.AppendFmt("Network average statistics for last %u ticks: %g senders, %g messages/sender, %g time and %g send calls per iteration. Peak %u senders, %g messages/sender %u time", csGetTicks() - lastSendReport, sendAvg, messagesAvg, timeAvg, syscallsAvg, peakSenders, peakMessagesPerSender, peakTime);
         
         if(LogCSV::GetSingletonPtr())
             LogCSV::GetSingleton().Write(CSV_STATUS, status);
@@ -1201,6 +1245,23 @@ bool NetBase::SendMessage(MsgEntry* me)
 bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue)
 {
     profs->AddSentMsg(me);
+    LogMessages('S',me);
+
+    // Big messages are deflated before they are split into packets
+    csRef<MsgEntry> compressed;
+    if (me->allowCompression && me->bytes->GetTotalSize() > NETCOMPRESS_THRESHOLD)
+    {
+        Connection* connection = GetConnByNum(me->clientnum);
+        if (connection && connection->compression)
+        {
+            compressed = CompressMessage(me);
+        }
+    }
+    if (compressed)
+    {
+        profs->AddCompressedMsg(me, compressed);
+        me = compressed;
+    }
 
     size_t bytesleft = me->bytes->GetTotalSize();
     size_t offset    = 0;
@@ -1208,8 +1269,6 @@ bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue)
 
     if (!queue)
         queue = NetworkQueue;
-
-    LogMessages('S',me);
     
     // fragments must have the same packet id, this needs to be fixed to use sequential numbering at some time in the future
     if (bytesleft > MAXPACKETSIZE-sizeof(struct psNetPacket))
@@ -1261,6 +1320,211 @@ bool NetBase::SendMessage(MsgEntry* me,NetPacketQueueRefCount *queue)
 }
 
 
+bool NetBase::SendFanOut(psNetFanOut& fanout, uint32_t clientnum, NetPacketQueueRefCount *queue)
+{
+    MsgEntry* me = fanout.msg;
+    me->clientnum = clientnum;
+
+    profs->AddSentMsg(me);
+    LogMessages('S',me);
+
+    csArray<psNetPacket*>* packets = &fanout.packets;
+    if (me->allowCompression && me->bytes->GetTotalSize() > NETCOMPRESS_THRESHOLD)
+    {
+        Connection* connection = GetConnByNum(clientnum);
+        if (connection && connection->compression)
+        {
+            // Deflated once for all the connections that support it
+            if (!fanout.compressTried)
+            {
+                fanout.compressTried = true;
+                fanout.compressed = CompressMessage(me);
+            }
+            if (fanout.compressed)
+            {
+                profs->AddCompressedMsg(me, fanout.compressed);
+                me = fanout.compressed;
+                packets = &fanout.compressedPackets;
+            }
+        }
+    }
+
+    if (packets->IsEmpty())
+        SplitMessage(me, *packets);
+
+    if (!queue)
+        queue = NetworkQueue;
+
+    for (size_t i = 0; i < packets->GetSize(); i++)
+    {
+        csRef<psNetPacketEntry> pNewPkt;
+        pNewPkt.AttachNew(new psNetPacketEntry(clientnum, packets->Get(i)));
+
+        if (!queue->Add(pNewPkt))
+        {
+            if(queue == NetworkQueue)
+            {
+                Error1("NetworkQueue full. Could not add packet.\n");
+            }
+            else
+            {
+                Error2("Target full. Could not add packet with clientnum %d.\n", clientnum);
+            }
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void NetBase::SplitMessage(MsgEntry* me, csArray<psNetPacket*> &packets)
+{
+    size_t total  = me->bytes->GetTotalSize();
+    size_t offset = 0;
+    uint32_t id = 0;
+
+    // fragments must have the same packet id, see SendMessage()
+    if (total > MAXPACKETSIZE-sizeof(struct psNetPacket))
+        id = GetRandomID();
+
+    while (offset < total)
+    {
+        size_t pktlen = csMin(MAXPACKETSIZE-sizeof(struct psNetPacket), total - offset);
+
+        psNetPacket* packet = (psNetPacket*) psNetBufferPool::Alloc(sizeof(psNetPacket) + pktlen);
+        CS_ASSERT(packet != NULL);
+        packet->flags   = me->priority;
+        packet->pktid   = id;
+        packet->offset  = (uint32_t)offset;
+        packet->pktsize = (uint16_t)pktlen;
+        packet->msgsize = (uint32_t)total;
+        memcpy(packet->data, ((char*) me->bytes) + offset, pktlen);
+
+        packets.Push(packet);
+        offset += pktlen;
+    }
+}
+
+
+void NetBase::EnableCompression(uint32_t clientnum)
+{
+    Connection* connection = GetConnByNum(clientnum);
+    if (connection)
+    {
+        connection->compression = true;
+    }
+}
+
+
+csPtr<MsgEntry> NetBase::CompressMessage(MsgEntry* me)
+{
+    size_t size = me->bytes->GetSize();
+
+    // Room for the original header and at most the original payload
+    csRef<MsgEntry> compressed;
+    compressed.AttachNew(new MsgEntry(sizeof(psMessageBytes) + size));
+    compressed->SetType(MSGTYPE_COMPRESSED);
+    compressed->clientnum = me->clientnum;
+    compressed->priority  = me->priority;
+    compressed->msgid     = me->msgid;
+
+    memcpy(compressed->bytes->payload, me->bytes, sizeof(psMessageBytes));
+
+    // Ready
+    z_stream z;
+    z.zalloc = NULL;
+    z.zfree = NULL;
+    z.opaque = NULL;
+    z.next_in = (Bytef*)me->bytes->payload;
+    z.avail_in = (uInt)size;
+    z.next_out = (Bytef*)compressed->bytes->payload + sizeof(psMessageBytes);
+    z.avail_out = (uInt)(compressed->bytes->GetSize() - sizeof(psMessageBytes));
+
+    // Set, speed matters more than size here
+    if (deflateInit(&z,Z_BEST_SPEED) != Z_OK)
+    {
+        return NULL;
+    }
+
+    // Go, the output buffer is full before the end if deflating doesn't help
+    int err = deflate(&z,Z_FINISH);
+    size_t deflated = z.total_out;
+    deflateEnd(&z);
+
+    if (err != Z_STREAM_END || sizeof(psMessageBytes) + deflated >= size)
+    {
+        return NULL;
+    }
+
+    compressed->bytes->SetSize(sizeof(psMessageBytes) + deflated);
+    return csPtr<MsgEntry>(compressed);
+}
+
+
+bool NetBase::InflateMessage(csRef<MsgEntry> &me, Connection* connection)
+{
+    if (me->bytes->type != MSGTYPE_COMPRESSED)
+    {
+        return true;
+    }
+
+    // Only accept compressed messages when we agreed on it
+    if (!connection || !connection->compression)
+    {
+        Debug2(LOG_NET,connection ? connection->clientnum : 0,"Dropping compressed message from connection without compression.\n");
+        return false;
+    }
+
+    size_t size = me->bytes->GetSize();
+    if (size < sizeof(psMessageBytes))
+    {
+        Debug1(LOG_NET,connection->clientnum,"Dropping compressed message too short to contain message header.\n");
+        return false;
+    }
+
+    const psMessageBytes* header = (const psMessageBytes*) me->bytes->payload;
+
+    csRef<MsgEntry> inflated;
+    inflated.AttachNew(new MsgEntry(header->GetSize()));
+    inflated->bytes->type = header->type;
+    inflated->clientnum   = me->clientnum;
+    inflated->priority    = me->priority;
+
+    // Ready
+    z_stream z;
+    z.zalloc = NULL;
+    z.zfree = NULL;
+    z.opaque = NULL;
+    z.next_in = (Bytef*)me->bytes->payload + sizeof(psMessageBytes);
+    z.avail_in = (uInt)(size - sizeof(psMessageBytes));
+    z.next_out = (Bytef*)inflated->bytes->payload;
+    z.avail_out = (uInt)inflated->bytes->GetSize();
+
+    // Set
+    if (inflateInit(&z) != Z_OK)
+    {
+        return false;
+    }
+
+    // Go
+    int err = inflate(&z,Z_FINISH);
+    size_t total = z.total_out;
+    inflateEnd(&z);
+
+    // The payload must fill the original message exactly
+    if (err != Z_STREAM_END || total != inflated->bytes->GetSize())
+    {
+        Debug3(LOG_NET,connection->clientnum,"Dropping invalid compressed message of type %s (error %d).\n",
+               GetMsgTypeName(header->type).GetData(), err);
+        return false;
+    }
+
+    me = inflated;
+    return true;
+}
+
+
 void NetBase::CheckFragmentTimeouts(void)
 {
     csRef<psNetPacketEntry> pkt;
@@ -1354,7 +1618,8 @@ bool NetBase::BuildMessage(psNetPacketEntry* pkt, Connection* &connection,
             csRef<MsgEntry> me;
             me.AttachNew(new MsgEntry(msg));
             me->priority = packet->flags;
-            HandleCompletedMessage(me, connection, addr,pkt);
+            if (InflateMessage(me, connection))
+                HandleCompletedMessage(me, connection, addr,pkt);
         }
         return false;
     }
@@ -1366,7 +1631,7 @@ bool NetBase::BuildMessage(psNetPacketEntry* pkt, Connection* &connection,
     // Build message from packet or add packet to existing partial message
     csRef<MsgEntry> me = 
         CheckCompleteMessage(pkt->clientnum,pkt->packet->pktid);
-    if (me)
+    if (me && InflateMessage(me, connection))
     {
         HandleCompletedMessage(me, connection, addr, pkt);
     }
@@ -1582,6 +1847,7 @@ NetBase::Connection::Connection(uint32_t num): sequence(1), packethistoryhash(MA
     devRTT = 0;
     sends = 0;
     resends = 0;
+    compression = false;
 
     RTO = PKTINITRTO;
 
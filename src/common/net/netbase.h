@@ -45,6 +45,7 @@
                                  // This must be set carefully and ideally should be at least the size
                                  // of the input queue
 #define NETAVGCOUNT 400
+#define NETCOMPRESS_THRESHOLD   1000  // Messages bigger than this are compressed, if the connection supports it.
 #define RESENDAVGCOUNT 200
 
 const unsigned int WINDOW_MAX_SIZE = 65536; // The size of the maximum reliable window in bytes.
@@ -64,6 +65,8 @@ const unsigned int WINDOW_MAX_SIZE = 65536; // The size of the maximum reliable
 #   include "net/sockuni.h"
 #endif
 
+#include "net/netbatch.h"
+
 // Jorrit: hack for mingw.
 #ifdef SendMessage
 #undef SendMessage
@@ -108,6 +111,35 @@ struct PublishDestination
 
 //-----------------------------------------------------------------------------
 
+/**
+ * A message split into packets once, to be queued for many clients with
+ * NetBase::SendFanOut(). The packets are shared by the queues of all those
+ * clients, only the psNetPacketEntry is made per client. A packet that has
+ * to get a packet id of its connection is copied when it is sent, see
+ * psNetPacketEntry::Unshare().
+ *
+ * Nothing but the clientnum of the message may change while it is sent.
+ */
+class psNetFanOut
+{
+public:
+    psNetFanOut(MsgEntry* me);
+    ~psNetFanOut();
+
+protected:
+    friend class NetBase;
+
+    csRef<MsgEntry> msg;
+    csArray<psNetPacket*> packets;              ///< Split on first use.
+
+    /// The deflated message, for connections that negotiated compression.
+    csRef<MsgEntry> compressed;
+    csArray<psNetPacket*> compressedPackets;
+    bool compressTried;
+};
+
+//-----------------------------------------------------------------------------
+
 /**
  * This class acts as a base for client/server net classes. It tries to define
  * as much common used code as possible while not trying to slow things down
@@ -171,6 +203,12 @@ public:
     virtual bool SendMessage (MsgEntry* me);
     virtual bool SendMessage (MsgEntry* me,NetPacketQueueRefCount *queue);
 
+    /**
+     * Put a message split by a psNetFanOut into the outgoing queue of one
+     * client. The message is only split and compressed for the first client.
+     */
+    bool SendFanOut (psNetFanOut& fanout, uint32_t clientnum, NetPacketQueueRefCount *queue);
+
     /**
      * Broadcast a message, DON'T USE this function, it's only for MsgHandler!
      */
@@ -227,6 +265,13 @@ public:
      */
     bool Flush(MsgQueue * queue);
 
+    /**
+     * Start sending compressed messages to the given client, and accept
+     * compressed messages from it. Both sides have to agree on this, see
+     * psPreAuthenticationMessage.
+     */
+    void EnableCompression(uint32_t clientnum);
+
     /** Binds the socket to the specified address (only needed on server */
     bool Bind(const char* addr, int port);
     bool Bind(const IN_ADDR &addr, int port);
@@ -429,8 +474,7 @@ protected:
 
         if (sentbytes>0)
         {
-            totaltransferout += size;
-            totalcountout++;
+            CountTransfer(totaltransferout, totalcountout, size, 1);
         }
         else
         {
@@ -445,16 +489,13 @@ protected:
     }
 
     /**
-     * small inliner for receiving packets... This just
-     * encapsulates the lowlevel socket funcs
+     * Wait up to the select timeout for incoming packets. Also returns
+     * early when woken up through the pipe.
+     *
+     * @return True if there are packets waiting on the socket.
      */
-    int RecvFrom (LPSOCKADDR_IN addr, socklen_t *socklen, void *buf,
-        unsigned int maxsize)
+    bool WaitForInput()
     {
-        #ifdef DEBUG
-        if (!addr || !buf)
-            Error1("wrong args");
-        #endif
         fd_set set;
 
         /* Initialize the file descriptor set. */
@@ -472,7 +513,7 @@ protected:
         if (SOCK_SELECT(csMax(mysocket, pipe_fd[0]) + 1, &set, NULL, NULL, &timeout) < 1)
         {
             timeout = prevTimeout;
-            return 0;
+            return false;
         }
 
 #ifndef CS_PLATFORM_WIN32
@@ -488,19 +529,53 @@ protected:
 
         timeout = prevTimeout;
 
-        if(!FD_ISSET(mysocket, &set))
+        return FD_ISSET(mysocket, &set) != 0;
+    }
+
+    /**
+     * small inliner for receiving packets... This just
+     * encapsulates the lowlevel socket funcs
+     */
+    int RecvFrom (LPSOCKADDR_IN addr, socklen_t *socklen, void *buf,
+        unsigned int maxsize)
+    {
+        #ifdef DEBUG
+        if (!addr || !buf)
+            Error1("wrong args");
+        #endif
+
+        if (!WaitForInput())
             return 0;
 
         int err = SOCK_RECVFROM (mysocket, buf, maxsize, 0,
             (LPSOCKADDR) addr, socklen);
         if (err>=0)
         {
-            totaltransferin += err;
-            totalcountin++;
+            CountTransfer(totaltransferin, totalcountin, err, 1);
         }
         return err;
     }
 
+    /**
+     * Read all packets waiting on the socket into recvBatch, after waiting
+     * for input like RecvFrom.
+     *
+     * @return True if any packet was read.
+     */
+    bool RecvBatch()
+    {
+        if (!WaitForInput())
+            return false;
+
+        size_t bytes = 0;
+        int received = recvBatch.Fill(mysocket, bytes);
+        if (received <= 0)
+            return false;
+
+        CountTransfer(totaltransferin, totalcountin, (long)bytes, received);
+        return true;
+    }
+
 
     /**
      * some helper functions... the getConnBy functions should be reimplemented
@@ -577,26 +652,59 @@ protected:
     bool CheckDoublePackets (Connection* connection, psNetPacketEntry* pkt);
 
 
+    /**
+     * Deflate a big message into a MSGTYPE_COMPRESSED message, which holds
+     * the header of the original message followed by the deflated payload.
+     *
+     * @return The compressed message, or NULL if it would not be smaller.
+     */
+    csPtr<MsgEntry> CompressMessage(MsgEntry* me);
+
+    /// Split a message into packets like SendMessage() does, for a psNetFanOut.
+    void SplitMessage(MsgEntry* me, csArray<psNetPacket*> &packets);
+
+    /**
+     * Replace a MSGTYPE_COMPRESSED message by the message it holds.
+     * Other messages are left alone.
+     *
+     * @return False if the message is compressed but invalid.
+     */
+    bool InflateMessage(csRef<MsgEntry> &me, Connection* connection);
+
     /**
      * This attempts to merge as many packets as possible into one before
      * sending.  It empties the passed queue.
+     *
+     * @param batch If given the packets are added to it instead of being
+     *              sent right away.
      */
-    bool SendMergedPackets(NetPacketQueue *q);
+    bool SendMergedPackets(NetPacketQueue *q, psNetSendBatch* batch = NULL);
 
     /**
      * This does the sending and puts the packet in "awaiting ack" if necessary.
      */
-    bool SendSinglePacket(psNetPacketEntry* pkt);
+    bool SendSinglePacket(psNetPacketEntry* pkt, psNetSendBatch* batch = NULL);
 
     /**
      * Send packet to the clientnum given by clientnum in psNetPacketEntry
      */
-    bool SendFinalPacket(psNetPacketEntry* pkt);
+    bool SendFinalPacket(psNetPacketEntry* pkt, psNetSendBatch* batch = NULL);
+
+    /**
+     * This only sends out a packet, or adds it to the batch if one is given.
+     * A full batch is flushed.
+     *
+     * @return False if the packet could not be sent, or if it filled the
+     *         batch and any packet of the batch could not be sent.
+     */
+    bool SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr, psNetSendBatch* batch = NULL);
 
     /**
-     * This only sends out a packet
+     * Send out the packets in the batch.
+     *
+     * @return False if any of the packets could not be sent.
      */
-    bool SendFinalPacket(psNetPacketEntry* pkt, LPSOCKADDR_IN addr);
+    bool FlushBatch(psNetSendBatch* batch);
 
     /** Outgoing message queue */
     csRef<NetPacketQueueRefCount> NetworkQueue;
@@ -616,15 +724,36 @@ protected:
     /** is the connection ready? */
     bool ready;
 
-    /** total bytes transferred by this object */
+    /** total bytes transferred by this object, only changed through CountTransfer() */
     long totaltransferin, totaltransferout;
-    /** total packages transferred by this object */
+    /** total packages transferred by this object, only changed through CountTransfer() */
     long totalcountin, totalcountout;
+    /** lock of the totals, they are counted by every thread that sends */
+    CS::Threading::Mutex transferMutex;
+
+    /** Add to the bytes and packets transferred, from any thread. */
+    void CountTransfer(long &transfer, long &count, long bytes, long packets)
+    {
+        CS::Threading::MutexScopedLock lock(transferMutex);
+        transfer += bytes;
+        count += packets;
+    }
+
+    /** A consistent copy of the totals, while other threads count. */
+    void GetTransferTotals(long &transferIn, long &transferOut, long &countIn, long &countOut)
+    {
+        CS::Threading::MutexScopedLock lock(transferMutex);
+        transferIn = totaltransferin;
+        transferOut = totaltransferout;
+        countIn = totalcountin;
+        countOut = totalcountout;
+    }
 
     /** Moving averages */
     typedef struct {
         unsigned int senders;
         unsigned int messages;
+        unsigned int syscalls;
         csTicks time;
     } SendQueueStats_t;
 
@@ -673,7 +802,12 @@ private:
 
     LogMsgFilterSetting_t logmsgfiltersetting;
 
-    char* input_buffer;
+    /** packets collected by SendOut, and the lock for it */
+    psNetSendBatch sendBatch;
+    CS::Threading::Mutex sendBatchMutex;
+
+    /** packets received but not processed yet by CheckIn */
+    psNetRecvBatch recvBatch;
 };
 
 
@@ -714,6 +848,8 @@ public:
     uint32_t sends;
     /** Number of resends */
     uint32_t resends;
+    /** Did the other side agree to exchange compressed messages? */
+    bool compression;
     
     // Reliable transmission window size
     uint32_t window;
@@ -0,0 +1,276 @@
+/*
+ * netbatch.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <errno.h>
+#include <string.h>
+
+#include "net/netbatch.h"
+#include "net/netbufferpool.h"
+#include "net/netbase.h"
+#include "util/log.h"
+
+/// Did the last socket call fail only because it would have blocked?
+static bool WouldBlock()
+{
+#ifdef CS_PLATFORM_WIN32
+    return WSAGetLastError() == EAGAIN || WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+static int LastError()
+{
+#ifdef CS_PLATFORM_WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+/// Wait until the socket can be written to again, or the select timeout passes.
+static void WaitWritable(SOCKET sock)
+{
+    fd_set wfds;
+    struct timeval timeout;
+
+    FD_ZERO(&wfds);
+    FD_SET(sock, &wfds);
+
+    memset(&timeout, 0, sizeof(struct timeval));
+    timeout.tv_sec = SENDTO_SELECT_TIMEOUT_SEC;
+    timeout.tv_usec = SENDTO_SELECT_TIMEOUT_USEC;
+
+    SOCK_SELECT(sock+1, NULL, &wfds, NULL, &timeout);
+}
+
+//-----------------------------------------------------------------------------
+
+psNetSendBatch::psNetSendBatch()
+{
+    buffer = (char*) cs_malloc(NETBATCH_SIZE * MAXPACKETSIZE);
+    count = 0;
+    syscalls = 0;
+
+#ifdef NETBATCH_MMSG
+    memset(msgs, 0, sizeof(msgs));
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        iovecs[i].iov_base = buffer + i * MAXPACKETSIZE;
+        iovecs[i].iov_len = 0;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+psNetSendBatch::~psNetSendBatch()
+{
+    cs_free(buffer);
+}
+
+void psNetSendBatch::Add(const SOCKADDR_IN* addr, const void* data, size_t size)
+{
+    CS_ASSERT(!IsFull() && size <= MAXPACKETSIZE);
+
+    memcpy(buffer + count * MAXPACKETSIZE, data, size);
+    addrs[count] = *addr;
+    sizes[count] = size;
+#ifdef NETBATCH_MMSG
+    iovecs[count].iov_len = size;
+#endif
+    count++;
+}
+
+void psNetSendBatch::Add(const SOCKADDR_IN* addr, const psNetPacket* packet)
+{
+    size_t size = packet->GetPacketSize();
+    CS_ASSERT(!IsFull() && size <= MAXPACKETSIZE);
+
+    packet->CopyMarshalled(buffer + count * MAXPACKETSIZE);
+    addrs[count] = *addr;
+    sizes[count] = size;
+#ifdef NETBATCH_MMSG
+    iovecs[count].iov_len = size;
+#endif
+    count++;
+}
+
+size_t psNetSendBatch::Flush(SOCKET sock, size_t &bytes)
+{
+    size_t index = 0;
+    size_t sent = 0;
+    int retries = 0;    // For the datagram at index
+
+    while(index < count)
+    {
+#ifdef NETBATCH_MMSG
+        int result = sendmmsg(sock, msgs + index, (unsigned int)(count - index), 0);
+        syscalls++;
+        if(result > 0)
+        {
+            for(int i = 0; i < result; i++)
+            {
+                bytes += sizes[index + i];
+            }
+            index += result;
+            sent += result;
+            retries = 0;
+            continue;
+        }
+#else
+        int result = SOCK_SENDTO(sock, buffer + index * MAXPACKETSIZE, (int)sizes[index], 0,
+                                 (LPSOCKADDR) &addrs[index], sizeof(SOCKADDR_IN));
+        syscalls++;
+        if(result > 0)
+        {
+            bytes += sizes[index];
+            index++;
+            sent++;
+            retries = 0;
+            continue;
+        }
+#endif
+
+        if(WouldBlock() && retries++ < SENDTO_MAX_RETRIES)
+        {
+            WaitWritable(sock);
+            continue;
+        }
+
+        // Skip this datagram, the caller sees it in the count sent.
+        Error2("psNetSendBatch::Flush() gave up trying to send a packet with errno=%d.", LastError());
+        index++;
+        retries = 0;
+    }
+
+    count = 0;
+    return sent;
+}
+
+//-----------------------------------------------------------------------------
+
+psNetRecvBatch::psNetRecvBatch()
+{
+    count = 0;
+    next = 0;
+    syscalls = 0;
+
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        buffers[i] = NULL;
+    }
+
+#ifdef NETBATCH_MMSG
+    memset(msgs, 0, sizeof(msgs));
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        iovecs[i].iov_base = NULL;
+        iovecs[i].iov_len = MAXPACKETSIZE;
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+psNetRecvBatch::~psNetRecvBatch()
+{
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        psNetBufferPool::Release(buffers[i]);
+    }
+}
+
+int psNetRecvBatch::Fill(SOCKET sock, size_t &bytes)
+{
+    count = 0;
+    next = 0;
+
+    // Replace the buffers that were taken over
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        if(!buffers[i])
+        {
+            buffers[i] = (char*) psNetBufferPool::Alloc(MAXPACKETSIZE);
+            if(!buffers[i])
+            {
+                Error2("Failed to allocate %d bytes for packet buffer!\n", MAXPACKETSIZE);
+                return -1;
+            }
+#ifdef NETBATCH_MMSG
+            iovecs[i].iov_base = buffers[i];
+#endif
+        }
+    }
+
+#ifdef NETBATCH_MMSG
+    for(size_t i = 0; i < NETBATCH_SIZE; i++)
+    {
+        msgs[i].msg_hdr.msg_namelen = sizeof(SOCKADDR_IN);
+    }
+
+    int result = recvmmsg(sock, msgs, NETBATCH_SIZE, MSG_DONTWAIT, NULL);
+    syscalls++;
+    if(result < 0)
+    {
+        return WouldBlock() ? 0 : -1;
+    }
+
+    for(int i = 0; i < result; i++)
+    {
+        sizes[i] = (int)msgs[i].msg_len;
+        bytes += sizes[i];
+    }
+    count = result;
+#else
+    socklen_t len = sizeof(SOCKADDR_IN);
+    int result = SOCK_RECVFROM(sock, buffers[0], MAXPACKETSIZE, 0, (LPSOCKADDR) &addrs[0], &len);
+    syscalls++;
+    if(result < 0)
+    {
+        return WouldBlock() ? 0 : -1;
+    }
+
+    sizes[0] = result;
+    bytes += result;
+    count = 1;
+#endif
+
+    return (int)count;
+}
+
+char* psNetRecvBatch::Next(SOCKADDR_IN &addr, int &size)
+{
+    CS_ASSERT(HasNext());
+
+    addr = addrs[next];
+    size = sizes[next];
+    return buffers[next++];
+}
+
+void psNetRecvBatch::TakeLast()
+{
+    CS_ASSERT(next > 0);
+
+    buffers[next-1] = NULL;
+}
@@ -0,0 +1,188 @@
+/*
+ * netbatch.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Batches of datagrams that are sent or received with as few system calls
+ * as the platform allows.
+ *
+ */
+
+#ifndef __NETBATCH_H__
+#define __NETBATCH_H__
+
+/* Include platform specific socket settings */
+#ifdef USE_WINSOCK
+#   include "net/sockwin.h"
+#endif
+#ifdef USE_UNISOCK
+#   include "net/sockuni.h"
+#endif
+
+#include "net/netpacket.h"
+
+/**
+ * \addtogroup common_net
+ * @{ */
+
+/// Linux can send and receive a whole batch with one call.
+#if defined(USE_UNISOCK) && defined(__linux__)
+#   define NETBATCH_MMSG
+#endif
+
+#define NETBATCH_SIZE   64    ///< Maximum number of datagrams in a batch.
+
+/**
+ * Outgoing datagrams collected to be sent together. The data is copied
+ * into the batch, so the packets can be changed or freed after Add().
+ */
+class psNetSendBatch
+{
+public:
+    psNetSendBatch();
+    ~psNetSendBatch();
+
+    bool IsEmpty() const
+    {
+        return count == 0;
+    }
+
+    bool IsFull() const
+    {
+        return count == NETBATCH_SIZE;
+    }
+
+    size_t GetCount() const
+    {
+        return count;
+    }
+
+    /**
+     * Copy a datagram into the batch. The batch must not be full.
+     *
+     * @param addr The destination.
+     * @param data The datagram, at most MAXPACKETSIZE bytes.
+     * @param size The size of the datagram.
+     */
+    void Add(const SOCKADDR_IN* addr, const void* data, size_t size);
+
+    /**
+     * Copy a packet into the batch, marshalled for the network. The packet
+     * itself is not changed, so it may be shared. The batch must not be full.
+     */
+    void Add(const SOCKADDR_IN* addr, const psNetPacket* packet);
+
+    /**
+     * Send all datagrams in the batch and empty it. Waits a bit and retries
+     * if the socket buffer is full, like NetBase::SendTo().
+     *
+     * @param sock  The socket to send on.
+     * @param bytes Increased by the number of bytes sent.
+     * @return The number of datagrams sent, less than GetCount() before the
+     *         call if some of them could not be sent.
+     */
+    size_t Flush(SOCKET sock, size_t &bytes);
+
+    /// Number of send calls made to the system since the last reset.
+    size_t GetSyscalls() const
+    {
+        return syscalls;
+    }
+
+    void ResetSyscalls()
+    {
+        syscalls = 0;
+    }
+
+protected:
+    char* buffer;                         ///< Room for NETBATCH_SIZE datagrams.
+    SOCKADDR_IN addrs[NETBATCH_SIZE];
+    size_t sizes[NETBATCH_SIZE];
+    size_t count;
+    size_t syscalls;
+
+#ifdef NETBATCH_MMSG
+    struct mmsghdr msgs[NETBATCH_SIZE];
+    struct iovec iovecs[NETBATCH_SIZE];
+#endif
+};
+
+/**
+ * Incoming datagrams read together. The buffers come from psNetBufferPool
+ * and can be taken over by the caller, as done when a psNetPacket is built
+ * on top of the buffer.
+ */
+class psNetRecvBatch
+{
+public:
+    psNetRecvBatch();
+    ~psNetRecvBatch();
+
+    /**
+     * Read the datagrams waiting on the socket, up to NETBATCH_SIZE, without
+     * blocking. Datagrams not yet returned by Next() are discarded.
+     *
+     * @param sock  The socket to read from.
+     * @param bytes Increased by the number of bytes read.
+     * @return The number of datagrams read, or -1 on error.
+     */
+    int Fill(SOCKET sock, size_t &bytes);
+
+    /// Are there datagrams left that Next() did not return yet?
+    bool HasNext() const
+    {
+        return next < count;
+    }
+
+    /**
+     * Get the next datagram. The buffer stays owned by the batch
+     * unless TakeLast() is called.
+     *
+     * @param addr Set to the sender of the datagram.
+     * @param size Set to the size of the datagram.
+     */
+    char* Next(SOCKADDR_IN &addr, int &size);
+
+    /// Take ownership of the buffer last returned by Next().
+    void TakeLast();
+
+    /// Number of receive calls made to the system since the last reset.
+    size_t GetSyscalls() const
+    {
+        return syscalls;
+    }
+
+    void ResetSyscalls()
+    {
+        syscalls = 0;
+    }
+
+protected:
+    char* buffers[NETBATCH_SIZE];
+    SOCKADDR_IN addrs[NETBATCH_SIZE];
+    int sizes[NETBATCH_SIZE];
+    size_t count;
+    size_t next;
+    size_t syscalls;
+
+#ifdef NETBATCH_MMSG
+    struct mmsghdr msgs[NETBATCH_SIZE];
+    struct iovec iovecs[NETBATCH_SIZE];
+#endif
+};
+
+/** @} */
+
+#endif
@@ -0,0 +1,379 @@
+/*
+ * netbatch_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <stdio.h>
+#include <string.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/array.h>
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netbatch.h"
+#include "net/netbufferpool.h"
+#include "util/genrefqueue.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+#define PACKETS_PER_TICK    128
+#define PACKET_SIZE         200
+#define FANOUT_CLIENTS      2000
+
+/// A pair of non blocking UDP sockets bound to the loopback interface.
+class LoopbackSockets
+{
+public:
+    SOCKET sender;
+    SOCKET receiver;
+    SOCKADDR_IN receiverAddr;
+
+    LoopbackSockets()
+    {
+        sender = Open();
+        receiver = Open();
+
+        // Room for a few ticks of packets so none are dropped
+        int size = 4 * 1024 * 1024;
+        setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, (const char*) &size, sizeof(size));
+
+        memset(&receiverAddr, 0, sizeof(receiverAddr));
+        receiverAddr.sin_family = AF_INET;
+        receiverAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        receiverAddr.sin_port = 0;
+        bind(receiver, (LPSOCKADDR) &receiverAddr, sizeof(receiverAddr));
+
+        socklen_t len = sizeof(receiverAddr);
+        getsockname(receiver, (LPSOCKADDR) &receiverAddr, &len);
+    }
+
+    ~LoopbackSockets()
+    {
+        SOCK_CLOSE(sender);
+        SOCK_CLOSE(receiver);
+    }
+
+    bool WaitForInput()
+    {
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(receiver, &set);
+        struct timeval timeout;
+        timeout.tv_sec = 1;
+        timeout.tv_usec = 0;
+        return SOCK_SELECT(receiver + 1, &set, NULL, NULL, &timeout) > 0;
+    }
+
+protected:
+    static SOCKET Open()
+    {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        unsigned long arg = 1;
+        SOCK_IOCTL(sock, FIONBIO, &arg);
+        return sock;
+    }
+};
+
+TEST(NetBatchTest, SendAndReceive)
+{
+    LoopbackSockets sockets;
+    psNetSendBatch send;
+    psNetRecvBatch recv;
+    char data[PACKET_SIZE];
+
+    for(int i = 0; i < 10; i++)
+    {
+        memset(data, i, sizeof(data));
+        send.Add(&sockets.receiverAddr, data, 10 + i);
+    }
+
+    size_t bytes = 0;
+    EXPECT_EQ(10u, send.Flush(sockets.sender, bytes));
+    EXPECT_EQ(145u, bytes);
+    EXPECT_TRUE(send.IsEmpty());
+
+    int received = 0;
+    bytes = 0;
+    while(received < 10 && sockets.WaitForInput())
+    {
+        ASSERT_GT(recv.Fill(sockets.receiver, bytes), 0);
+        while(recv.HasNext())
+        {
+            SOCKADDR_IN from;
+            int size;
+            char* buffer = recv.Next(from, size);
+            EXPECT_EQ(10 + received, size);
+            EXPECT_EQ(received, buffer[0]);
+            received++;
+
+            // Taken buffers are owned by the caller
+            if(received % 2)
+            {
+                recv.TakeLast();
+                psNetBufferPool::Release(buffer);
+            }
+        }
+    }
+    EXPECT_EQ(10, received);
+    EXPECT_EQ(145u, bytes);
+}
+
+/**
+ * Not really a test. Prints packets per second and system calls per tick
+ * when sending and receiving a tick worth of packets one by one and batched.
+ */
+TEST(NetBatchTest, LoopbackThroughput)
+{
+    const int ticks = 200;
+    LoopbackSockets sockets;
+    char data[PACKET_SIZE];
+    char buffer[MAXPACKETSIZE];
+    memset(data, 1, sizeof(data));
+
+    printf("%8s %14s %16s %16s\n", "mode", "packets/sec", "send calls/tick", "recv calls/tick");
+
+    for(int batched = 0; batched < 2; batched++)
+    {
+        psNetSendBatch send;
+        psNetRecvBatch recv;
+        size_t sendCalls = 0;
+        size_t recvCalls = 0;
+        size_t received = 0;
+
+        csMicroTicks start = csGetMicroTicks();
+        for(int tick = 0; tick < ticks; tick++)
+        {
+            size_t bytes = 0;
+            if(batched)
+            {
+                for(int i = 0; i < PACKETS_PER_TICK; i++)
+                {
+                    send.Add(&sockets.receiverAddr, data, sizeof(data));
+                    if(send.IsFull())
+                        send.Flush(sockets.sender, bytes);
+                }
+                if(!send.IsEmpty())
+                    send.Flush(sockets.sender, bytes);
+            }
+            else
+            {
+                for(int i = 0; i < PACKETS_PER_TICK; i++)
+                {
+                    SOCK_SENDTO(sockets.sender, data, sizeof(data), 0, (LPSOCKADDR) &sockets.receiverAddr,
+                                sizeof(SOCKADDR_IN));
+                    sendCalls++;
+                }
+            }
+
+            size_t expected = (size_t)(tick + 1) * PACKETS_PER_TICK;
+            while(received < expected && sockets.WaitForInput())
+            {
+                if(batched)
+                {
+                    int count = recv.Fill(sockets.receiver, bytes);
+                    if(count <= 0)
+                        break;
+                    received += count;
+                }
+                else
+                {
+                    SOCKADDR_IN from;
+                    socklen_t len = sizeof(from);
+                    int size;
+                    while((size = SOCK_RECVFROM(sockets.receiver, buffer, MAXPACKETSIZE, 0,
+                                                (LPSOCKADDR) &from, &len)) > 0)
+                    {
+                        recvCalls++;
+                        received++;
+                        len = sizeof(from);
+                    }
+                    recvCalls++;
+                }
+            }
+        }
+        csMicroTicks time = csGetMicroTicks() - start;
+
+        if(batched)
+        {
+            sendCalls = send.GetSyscalls();
+            recvCalls = recv.GetSyscalls();
+        }
+
+        EXPECT_EQ((size_t)ticks * PACKETS_PER_TICK, received);
+        printf("%8s %14.0f %16.1f %16.1f\n", batched ? "batched" : "single",
+               received * 1000000.0 / (time ? time : 1), float(sendCalls) / ticks, float(recvCalls) / ticks);
+    }
+}
+
+typedef GenericRefQueue<psNetPacketEntry> TestPacketQueue;
+
+/// Queue a copy of each packet of the message, as NetBase::SendMessage() does for each client.
+static void QueueCopies(TestPacketQueue* queue, uint32_t client, uint32_t id, const char* msg, size_t size)
+{
+    for(size_t offset = 0; offset < size; offset += MAXPACKETSIZE - sizeof(psNetPacket))
+    {
+        size_t pktlen = csMin(MAXPACKETSIZE - sizeof(psNetPacket), size - offset);
+        csRef<psNetPacketEntry> pkt;
+        pkt.AttachNew(new psNetPacketEntry(PRIORITY_LOW, client, id, (uint32_t)offset, (uint32_t)size,
+                                           (uint16_t)pktlen, msg + offset));
+        queue->Add(pkt);
+    }
+}
+
+/// Split the message once, as NetBase::SplitMessage() does for a psNetFanOut.
+static void Split(csArray<psNetPacket*> &packets, uint32_t id, const char* msg, size_t size)
+{
+    for(size_t offset = 0; offset < size; offset += MAXPACKETSIZE - sizeof(psNetPacket))
+    {
+        size_t pktlen = csMin(MAXPACKETSIZE - sizeof(psNetPacket), size - offset);
+        psNetPacket* packet = (psNetPacket*) psNetBufferPool::Alloc(sizeof(psNetPacket) + pktlen);
+        packet->flags = PRIORITY_LOW;
+        packet->pktid = id;
+        packet->offset = (uint32_t)offset;
+        packet->pktsize = (uint16_t)pktlen;
+        packet->msgsize = (uint32_t)size;
+        memcpy(packet->data, msg + offset, pktlen);
+        packets.Push(packet);
+    }
+}
+
+/// Send a packet like NetBase::SendFinalPacket(), the packet id is per client.
+static void SendPacket(psNetPacketEntry* pkt, uint32_t &nextID, psNetSendBatch &batch, LoopbackSockets &sockets,
+                       size_t &bytes)
+{
+    if(pkt->packet->pktid == 0)
+    {
+        pkt->Unshare();
+        pkt->packet->pktid = nextID++;
+    }
+    batch.Add(&sockets.receiverAddr, pkt->packet);
+    if(batch.IsFull())
+        batch.Flush(sockets.sender, bytes);
+}
+
+/// Merge and send the packets of a client like NetBase::SendMergedPackets().
+static void SendQueue(TestPacketQueue* queue, uint32_t &nextID, psNetSendBatch &batch, LoopbackSockets &sockets,
+                      size_t &bytes)
+{
+    csRef<psNetPacketEntry> final = queue->Get();
+    csRef<psNetPacketEntry> next;
+    while((next = queue->Get()))
+    {
+        if(!final->Append(next))
+        {
+            SendPacket(final, nextID, batch, sockets, bytes);
+            final = next;
+        }
+    }
+    if(final)
+        SendPacket(final, nextID, batch, sockets, bytes);
+}
+
+/**
+ * Not really a test. Prints the time to queue and send a few broadcasts
+ * to 2000 clients on the loopback interface, with a copy of the packets
+ * for each client and with packets shared by all clients.
+ */
+TEST(NetBatchTest, FanOutTo2000Clients)
+{
+    const int rounds = 20;
+    const size_t sizes[] = { 60, 200, 3000 };     // Chat, stats and a fragmented message
+    const size_t messages = sizeof(sizes) / sizeof(sizes[0]);
+
+    LoopbackSockets sockets;
+    char msg[3000];
+    memset(msg, 1, sizeof(msg));
+
+    csArray<TestPacketQueue*> queues;
+    for(int i = 0; i < FANOUT_CLIENTS; i++)
+        queues.Push(new TestPacketQueue(16));
+
+    printf("%8s %12s %12s\n", "mode", "queue ms", "send ms");
+
+    for(int shared = 0; shared < 2; shared++)
+    {
+        psNetSendBatch batch;
+        csArray<uint32_t> nextIDs;
+        nextIDs.SetSize(FANOUT_CLIENTS, 1);
+        csMicroTicks queueTime = 0;
+        csMicroTicks sendTime = 0;
+        size_t bytes = 0;
+
+        psNetBufferPool::ResetStats();
+
+        for(int round = 0; round < rounds; round++)
+        {
+            csMicroTicks start = csGetMicroTicks();
+            for(size_t m = 0; m < messages; m++)
+            {
+                uint32_t id = sizes[m] > MAXPACKETSIZE - sizeof(psNetPacket) ? (uint32_t)(round * messages + m + 1) : 0;
+                if(shared)
+                {
+                    csArray<psNetPacket*> packets;
+                    Split(packets, id, msg, sizes[m]);
+                    for(int c = 0; c < FANOUT_CLIENTS; c++)
+                    {
+                        for(size_t p = 0; p < packets.GetSize(); p++)
+                        {
+                            csRef<psNetPacketEntry> pkt;
+                            pkt.AttachNew(new psNetPacketEntry(c, packets[p]));
+                            queues[c]->Add(pkt);
+                        }
+                    }
+                    for(size_t p = 0; p < packets.GetSize(); p++)
+                        psNetBufferPool::Release(packets[p]);
+                }
+                else
+                {
+                    for(int c = 0; c < FANOUT_CLIENTS; c++)
+                        QueueCopies(queues[c], c, id, msg, sizes[m]);
+                }
+            }
+            queueTime += csGetMicroTicks() - start;
+
+            start = csGetMicroTicks();
+            for(int c = 0; c < FANOUT_CLIENTS; c++)
+                SendQueue(queues[c], nextIDs[c], batch, sockets, bytes);
+            if(!batch.IsEmpty())
+                batch.Flush(sockets.sender, bytes);
+            sendTime += csGetMicroTicks() - start;
+
+            // Nothing is read, the receiver just drops what doesn't fit
+        }
+
+        // The small messages are merged into one packet per client and round,
+        // only that one gets a packet id of the client
+        EXPECT_EQ((uint32_t)rounds + 1, nextIDs[0]);
+        EXPECT_EQ((uint32_t)rounds + 1, nextIDs[FANOUT_CLIENTS - 1]);
+
+        printf("%8s %12.1f %12.1f\n", shared ? "shared" : "copied", queueTime / 1000.0 / rounds,
+               sendTime / 1000.0 / rounds);
+        printf("%s", psNetBufferPool::Dump().GetData());
+    }
+
+    for(size_t i = 0; i < queues.GetSize(); i++)
+        delete queues[i];
+}
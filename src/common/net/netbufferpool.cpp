@@ -0,0 +1,239 @@
+/*
+ * netbufferpool.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <csutil/threading/atomicops.h>
+#include <csutil/threading/mutex.h>
+
+#include "net/netbufferpool.h"
+#include "util/poolallocator.h"
+
+/// Marks a buffer that came from the heap instead of a pool.
+#define NETBUFFER_HEAP  0xFFFFFFFF
+
+/// Hidden header in front of each buffer, 8 bytes to keep the buffer aligned.
+struct psNetBufferHeader
+{
+    int32 refcount;
+    uint32 sizeClass;
+};
+
+/// A block of one size class, header included.
+template <size_t SIZE>
+struct psNetBufferBlock
+{
+    char data[SIZE];
+};
+
+/// Statistics of one size class or the heap.
+struct psNetBufferStats
+{
+    size_t allocs;
+    size_t inUse;
+    size_t peak;
+};
+
+/// One size class, locked around the PoolAllocator which isn't threadsafe.
+class psNetBufferClassBase
+{
+public:
+    psNetBufferClassBase(size_t size) : size(size)
+    {
+        memset(&stats, 0, sizeof(stats));
+    }
+    virtual ~psNetBufferClassBase() {}
+
+    virtual void* Alloc() = 0;
+    virtual void Free(void* block) = 0;
+
+    size_t size;
+    CS::Threading::Mutex mutex;
+    psNetBufferStats stats;
+};
+
+template <size_t SIZE>
+class psNetBufferClass : public psNetBufferClassBase
+{
+public:
+    psNetBufferClass(int items) : psNetBufferClassBase(SIZE), pool(items) {}
+
+    virtual void* Alloc()
+    {
+        return pool.CallFromNew();
+    }
+
+    virtual void Free(void* block)
+    {
+        pool.CallFromDelete((psNetBufferBlock<SIZE>*) block);
+    }
+
+protected:
+    PoolAllocator<psNetBufferBlock<SIZE> > pool;
+};
+
+/// All size classes, smallest first, and the heap.
+struct psNetBuffers
+{
+    psNetBufferClassBase* classes[NETBUFFER_CLASSES];
+    CS::Threading::Mutex heapMutex;
+    psNetBufferStats heap;
+
+    psNetBuffers()
+    {
+        classes[0] = new psNetBufferClass<64>(1024);
+        classes[1] = new psNetBufferClass<256>(512);
+        classes[2] = new psNetBufferClass<1536>(128);
+        classes[3] = new psNetBufferClass<4096>(32);
+        memset(&heap, 0, sizeof(heap));
+    }
+};
+
+/**
+ * The pools are created on first use and never destroyed, since messages
+ * held by other static objects may be released after this file's statics
+ * are gone.
+ */
+static psNetBuffers* GetBuffers()
+{
+    static psNetBuffers* buffers = new psNetBuffers;
+    return buffers;
+}
+
+static inline psNetBufferHeader* GetHeader(const void* buffer)
+{
+    return ((psNetBufferHeader*) buffer) - 1;
+}
+
+static inline void CountAlloc(psNetBufferStats &stats)
+{
+    stats.allocs++;
+    stats.inUse++;
+    if(stats.inUse > stats.peak)
+        stats.peak = stats.inUse;
+}
+
+//-----------------------------------------------------------------------------
+
+void* psNetBufferPool::Alloc(size_t size)
+{
+    psNetBuffers* buffers = GetBuffers();
+    size_t total = size + sizeof(psNetBufferHeader);
+    psNetBufferHeader* header = NULL;
+    uint32 sizeClass = NETBUFFER_HEAP;
+
+    for(uint32 i = 0; i < NETBUFFER_CLASSES; i++)
+    {
+        psNetBufferClassBase* pool = buffers->classes[i];
+        if(total <= pool->size)
+        {
+            CS::Threading::MutexScopedLock lock(pool->mutex);
+            header = (psNetBufferHeader*) pool->Alloc();
+            if(header)
+                CountAlloc(pool->stats);
+            sizeClass = i;
+            break;
+        }
+    }
+
+    if(sizeClass == NETBUFFER_HEAP)
+    {
+        header = (psNetBufferHeader*) cs_malloc(total);
+        CS::Threading::MutexScopedLock lock(buffers->heapMutex);
+        if(header)
+            CountAlloc(buffers->heap);
+    }
+
+    if(!header)
+        return NULL;
+
+    header->refcount = 1;
+    header->sizeClass = sizeClass;
+    return header + 1;
+}
+
+void psNetBufferPool::AddRef(void* buffer)
+{
+    CS::Threading::AtomicOperations::Increment(&GetHeader(buffer)->refcount);
+}
+
+void psNetBufferPool::Release(void* buffer)
+{
+    if(!buffer)
+        return;
+
+    psNetBufferHeader* header = GetHeader(buffer);
+    if(CS::Threading::AtomicOperations::Decrement(&header->refcount) > 0)
+        return;
+
+    psNetBuffers* buffers = GetBuffers();
+    if(header->sizeClass == NETBUFFER_HEAP)
+    {
+        cs_free(header);
+        CS::Threading::MutexScopedLock lock(buffers->heapMutex);
+        buffers->heap.inUse--;
+        return;
+    }
+
+    CS_ASSERT(header->sizeClass < NETBUFFER_CLASSES);
+    psNetBufferClassBase* pool = buffers->classes[header->sizeClass];
+    CS::Threading::MutexScopedLock lock(pool->mutex);
+    pool->Free(header);
+    pool->stats.inUse--;
+}
+
+bool psNetBufferPool::IsShared(const void* buffer)
+{
+    return CS::Threading::AtomicOperations::Read(&GetHeader(buffer)->refcount) > 1;
+}
+
+csString psNetBufferPool::Dump()
+{
+    psNetBuffers* buffers = GetBuffers();
+    csString dump;
+    dump.AppendFmt("%10s %12s %10s %10s\n", "size", "allocs", "in use", "peak");
+
+    for(size_t i = 0; i < NETBUFFER_CLASSES; i++)
+    {
+        psNetBufferClassBase* pool = buffers->classes[i];
+        CS::Threading::MutexScopedLock lock(pool->mutex);
+        dump.AppendFmt("%10zu %12zu %10zu %10zu\n", pool->size - sizeof(psNetBufferHeader),
+                       pool->stats.allocs, pool->stats.inUse, pool->stats.peak);
+    }
+
+    CS::Threading::MutexScopedLock lock(buffers->heapMutex);
+    dump.AppendFmt("%10s %12zu %10zu %10zu\n", "heap",
+                   buffers->heap.allocs, buffers->heap.inUse, buffers->heap.peak);
+    return dump;
+}
+
+void psNetBufferPool::ResetStats()
+{
+    psNetBuffers* buffers = GetBuffers();
+    for(size_t i = 0; i < NETBUFFER_CLASSES; i++)
+    {
+        psNetBufferClassBase* pool = buffers->classes[i];
+        CS::Threading::MutexScopedLock lock(pool->mutex);
+        pool->stats.allocs = 0;
+        pool->stats.peak = pool->stats.inUse;
+    }
+
+    CS::Threading::MutexScopedLock lock(buffers->heapMutex);
+    buffers->heap.allocs = 0;
+    buffers->heap.peak = buffers->heap.inUse;
+}
@@ -0,0 +1,76 @@
+/*
+ * netbufferpool.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Pooled, reference counted buffers for messages and packets.
+ *
+ */
+
+#ifndef __NETBUFFERPOOL_H__
+#define __NETBUFFERPOOL_H__
+
+#include <csutil/csstring.h>
+
+/**
+ * \addtogroup common_net
+ * @{ */
+
+/*   Design notes:
+ *
+ *  Buffers are taken from a PoolAllocator per size class. The classes fit
+ *  small messages, bigger messages, whole packets and fragmented messages up
+ *  to a few packets. Bigger buffers come from the heap. Every buffer starts
+ *  with a small hidden header holding its size class and a reference count,
+ *  so buffers can be shared by several owners and go back to the right pool
+ *  when the last one releases them.
+ *
+ *  All functions are threadsafe. Each size class has its own lock, so the
+ *  network thread and the game thread rarely wait for each other.
+ *
+ *  A shared buffer must not be changed, as all owners see the change.
+ */
+
+#define NETBUFFER_CLASSES   4     ///< 64, 256, 1536 and 4096 bytes
+
+class psNetBufferPool
+{
+public:
+    /**
+     * Get a buffer of at least the given size, with one reference.
+     *
+     * @return The buffer or NULL if out of memory.
+     */
+    static void* Alloc(size_t size);
+
+    /// Add a reference to a buffer, so it can be shared.
+    static void AddRef(void* buffer);
+
+    /// Drop a reference, the buffer is recycled when the last one is dropped.
+    static void Release(void* buffer);
+
+    /// Is the buffer referenced more than once?
+    static bool IsShared(const void* buffer);
+
+    /// Statistics of all size classes, as a human readable table.
+    static csString Dump();
+
+    /// Clear the statistics, the number of buffers in use is kept.
+    static void ResetStats();
+};
+
+/** @} */
+
+#endif
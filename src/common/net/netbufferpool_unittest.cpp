@@ -0,0 +1,105 @@
+/*
+ * netbufferpool_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <stdio.h>
+#include <string.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netbufferpool.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+TEST(NetBufferPoolTest, SizesAndRecycling)
+{
+    const size_t sizes[] = { 1, 56, 57, 200, 1400, 4000, 70000 };
+
+    for(size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    {
+        char* buffer = (char*) psNetBufferPool::Alloc(sizes[i]);
+        ASSERT_TRUE(buffer != NULL);
+        EXPECT_FALSE(psNetBufferPool::IsShared(buffer));
+
+        // The whole buffer must be usable
+        memset(buffer, 0x55, sizes[i]);
+        psNetBufferPool::Release(buffer);
+
+        // A block of the same class is handed out again
+        char* again = (char*) psNetBufferPool::Alloc(sizes[i]);
+        if(sizes[i] <= 4000)
+            EXPECT_EQ(buffer, again);
+        psNetBufferPool::Release(again);
+    }
+}
+
+TEST(NetBufferPoolTest, SharedUntilLastRelease)
+{
+    char* buffer = (char*) psNetBufferPool::Alloc(100);
+    strcpy(buffer, "shared");
+
+    psNetBufferPool::AddRef(buffer);
+    EXPECT_TRUE(psNetBufferPool::IsShared(buffer));
+
+    psNetBufferPool::Release(buffer);
+    EXPECT_FALSE(psNetBufferPool::IsShared(buffer));
+    EXPECT_STREQ("shared", buffer);
+
+    psNetBufferPool::Release(buffer);
+}
+
+/**
+ * Not really a test. Prints the time to allocate and free message sized
+ * buffers from the pool and from the heap.
+ */
+TEST(NetBufferPoolTest, AllocationCost)
+{
+    const int count = 1000000;
+    const size_t size = 120;    // About a DR message
+    void* volatile sink;        // Keeps the compiler from dropping the heap calls
+
+    csMicroTicks start = csGetMicroTicks();
+    for(int i = 0; i < count; i++)
+    {
+        sink = psNetBufferPool::Alloc(size);
+        psNetBufferPool::Release(sink);
+    }
+    csMicroTicks poolTime = csGetMicroTicks() - start;
+
+    start = csGetMicroTicks();
+    for(int i = 0; i < count; i++)
+    {
+        sink = cs_malloc(size);
+        cs_free(sink);
+    }
+    csMicroTicks heapTime = csGetMicroTicks() - start;
+
+    printf("%8s %10.1f ns/buffer\n%8s %10.1f ns/buffer\n", "pool", poolTime * 1000.0 / count,
+           "heap", heapTime * 1000.0 / count);
+    printf("%s", psNetBufferPool::Dump().GetData());
+}
@@ -22,6 +22,7 @@
 
 #include "util/log.h"
 #include "net/netpacket.h"
+#include "net/netbufferpool.h"
 
 // #define PACKETDEBUG
 
@@ -42,7 +43,7 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
                     uint32_t totalsize, uint16_t sz,
                     psMessageBytes *msg)
 {
-    packet = (psNetPacket*) cs_malloc (sizeof(psNetPacket) + sz);
+    packet = (psNetPacket*) psNetBufferPool::Alloc(sizeof(psNetPacket) + sz);
     CS_ASSERT(packet != NULL);
     clientnum = cnum;
     packet->flags = pri;
@@ -62,7 +63,7 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
     uint32_t id, uint32_t off, uint32_t totalsize, uint16_t sz,
     const char *bytes)
 {
-    packet = (psNetPacket*) cs_malloc (sizeof(psNetPacket) + sz);
+    packet = (psNetPacket*) psNetBufferPool::Alloc(sizeof(psNetPacket) + sz);
     CS_ASSERT(packet != NULL);
     clientnum = cnum;
     packet->flags = pri;
@@ -78,10 +79,34 @@ psNetPacketEntry::psNetPacketEntry (uint8_t pri, uint32_t cnum,
 }
 
 
+psNetPacketEntry::psNetPacketEntry (uint32_t cnum, psNetPacket* shared)
+    : clientnum(cnum), packet(shared)
+{
+    psNetBufferPool::AddRef(packet);
+    timestamp = csGetTicks();
+    retransmitted = false;
+    RTO = 0;
+}
+
+
 psNetPacketEntry::~psNetPacketEntry()
 {
-    if (packet)
-        cs_free(packet);
+    psNetBufferPool::Release(packet);
+}
+
+
+void psNetPacketEntry::Unshare()
+{
+    if (!psNetBufferPool::IsShared(packet))
+        return;
+
+    size_t size = packet->GetPacketSize();
+    psNetPacket* copy = (psNetPacket*) psNetBufferPool::Alloc(size);
+    CS_ASSERT(copy != NULL);
+    memcpy(copy, packet, size);
+
+    psNetBufferPool::Release(packet);
+    packet = copy;
 }
 
 
@@ -121,7 +146,7 @@ bool psNetPacketEntry::Append(psNetPacketEntry* next)
         * or copy data more than once.  Only exact number of bytes will be
         * sent on the wire.
         */
-        merge = (psNetPacket*) cs_malloc (MAXPACKETSIZE);
+        merge = (psNetPacket*) psNetBufferPool::Alloc(MAXPACKETSIZE);
         CS_ASSERT(merge != NULL);
 
         /**
@@ -135,15 +160,12 @@ bool psNetPacketEntry::Append(psNetPacketEntry* next)
         merge->msgsize = merge->pktsize;
 
         /**
-        * After marshalling for network, copy entire first packet, with header, into data section
-        * of new packet.
+        * Copy entire first packet, with header, into data section of new packet
+        * and marshal the copy for network. The first packet may be shared.
         */
-        uint16_t size = (uint16_t)packet->GetPacketSize();
-        packet->MarshallEndian();
-        memcpy(merge->data, packet, size);
-        packet->UnmarshallEndian();
+        packet->CopyMarshalled(merge->data);
 
-        cs_free(packet);   // done with old packet
+        psNetBufferPool::Release(packet);   // done with old packet
         packet = merge;
     }
     else
@@ -159,14 +181,11 @@ bool psNetPacketEntry::Append(psNetPacketEntry* next)
     if (next->packet->GetPriority() == PRIORITY_HIGH)
         packet->flags = PRIORITY_HIGH | FLAG_MULTIPACKET; // HIGH overrides LOW but not vice versa
 
-    /* Copy size information temporarily, and pack the next packet for transmission.
-    * Do not reference the next->packet after MarshallEndian() has been called.
-    * copy the entire 2nd packet into 1st packet after existing data
+    /* Copy the entire 2nd packet into 1st packet after existing data and
+    * pack the copy for transmission. The 2nd packet may be shared.
     */
     uint16_t nextSize = (uint16_t)next->packet->GetPacketSize();
-    next->packet->MarshallEndian();
-    memcpy(packet->data+packet->pktsize, next->packet, nextSize);
-    next->packet->UnmarshallEndian();
+    next->packet->CopyMarshalled(packet->data+packet->pktsize);
 
     /**
     * now update length of outer packet
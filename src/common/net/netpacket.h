@@ -114,6 +114,15 @@ struct psNetPacket
         pktsize = csLittleEndian::UInt16(pktsize);
     }
 
+    /** Copy the whole packet to dest and endian-ize the copy. The packet
+     *  itself is left alone, so this is safe on a shared packet.
+     */
+    void CopyMarshalled(void* dest) const
+    {
+        memcpy(dest, this, GetPacketSize());
+        ((psNetPacket*) dest)->MarshallEndian();
+    }
+
     /*  The goal here is to verify fields that later parsing can't.
      *  Specifically we need to make sure the buffer can hold at least the 
      *  fields that must be present in every packet, and also that the reported
@@ -209,6 +218,12 @@ public:
                       uint32_t id, uint32_t off, uint32_t totalsize, uint16_t sz,
                       const char *bytes);
 
+    /** construct a new PacketEntry sharing a packet of a psNetFanOut. The
+     * packet is referenced, not copied, and must not be changed while it is
+     * shared. Call Unshare() first.
+     */
+    psNetPacketEntry (uint32_t cnum, psNetPacket* shared);
+
     psNetPacketEntry (psNetPacketEntry* )
     {
         CS_ASSERT(false);
@@ -217,6 +232,10 @@ public:
     ~psNetPacketEntry();
     
     bool Append(psNetPacketEntry* next);
+
+    /// Give this entry its own copy of the packet if it is shared.
+    void Unshare();
+
     csPtr<psNetPacketEntry> GetNextPacket(psNetPacket* &packetdata);
 
 
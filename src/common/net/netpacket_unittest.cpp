@@ -0,0 +1,112 @@
+/*
+ * netpacket_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <string.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/ref.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netpacket.h"
+#include "net/netbufferpool.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// A packet of a single message, filled with the given byte.
+static psNetPacket* MakePacket(uint32_t id, uint16_t size, char fill)
+{
+    psNetPacket* packet = (psNetPacket*) psNetBufferPool::Alloc(sizeof(psNetPacket) + size);
+    packet->flags = PRIORITY_LOW;
+    packet->pktid = id;
+    packet->offset = 0;
+    packet->pktsize = size;
+    packet->msgsize = size;
+    memset(packet->data, fill, size);
+    return packet;
+}
+
+TEST(NetPacketTest, CopyMarshalled)
+{
+    psNetPacket* packet = MakePacket(7, 30, 'x');
+    char copy[MAXPACKETSIZE];
+    char expected[MAXPACKETSIZE];
+
+    packet->CopyMarshalled(copy);
+
+    memcpy(expected, packet, packet->GetPacketSize());
+    ((psNetPacket*) expected)->MarshallEndian();
+
+    EXPECT_EQ(0, memcmp(expected, copy, packet->GetPacketSize()));
+    EXPECT_EQ(7u, packet->pktid);
+    EXPECT_EQ(30u, packet->pktsize);
+
+    psNetBufferPool::Release(packet);
+}
+
+TEST(NetPacketTest, SharedPacketIsNotChanged)
+{
+    psNetPacket* shared = MakePacket(0, 50, 'a');
+
+    csRef<psNetPacketEntry> first, second;
+    first.AttachNew(new psNetPacketEntry(1, shared));
+    second.AttachNew(new psNetPacketEntry(1, shared));
+    EXPECT_TRUE(first->packet == shared);
+    EXPECT_TRUE(second->packet == shared);
+
+    // Like the fan-out, give up the own reference once queued
+    char before[MAXPACKETSIZE];
+    memcpy(before, shared, shared->GetPacketSize());
+    psNetBufferPool::Release(shared);
+
+    // Merging moves the first entry to a packet of its own
+    const char other[20] = { 'b' };
+    csRef<psNetPacketEntry> next;
+    next.AttachNew(new psNetPacketEntry(PRIORITY_LOW, 1, 0, 0, sizeof(other), sizeof(other), other));
+    ASSERT_TRUE(first->Append(next));
+    EXPECT_TRUE(first->packet != shared);
+    EXPECT_TRUE(first->packet->IsMultiPacket());
+
+    char marshalled[MAXPACKETSIZE];
+    shared->CopyMarshalled(marshalled);
+    EXPECT_EQ(0, memcmp(marshalled, first->packet->data, shared->GetPacketSize()));
+
+    // The shared packet is as it was
+    EXPECT_TRUE(second->packet == shared);
+    EXPECT_EQ(0, memcmp(before, shared, shared->GetPacketSize()));
+
+    // The last user may keep it
+    second->Unshare();
+    EXPECT_TRUE(second->packet == shared);
+
+    // Other users get a copy
+    csRef<psNetPacketEntry> third;
+    third.AttachNew(new psNetPacketEntry(2, shared));
+    third->Unshare();
+    EXPECT_TRUE(third->packet != shared);
+    EXPECT_EQ(0, memcmp(before, third->packet, shared->GetPacketSize()));
+    EXPECT_FALSE(psNetBufferPool::IsShared(shared));
+}
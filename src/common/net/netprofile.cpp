@@ -51,18 +51,52 @@ void psNetMsgProfiles::AddReceivedMsg(MsgEntry * me)
     recvProfs[me->bytes->type]->AddConsumption(me->bytes->size);
 }
 
+void psNetMsgProfiles::AddCompressedMsg(MsgEntry * me, MsgEntry * compressed)
+{
+    size_t type = me->bytes->type;
+    if (type >= compressionStats.GetSize())
+    {
+        CompressionStats empty = { 0, 0, 0 };
+        compressionStats.SetSize(type + 1, empty);
+    }
+    compressionStats[type].count++;
+    compressionStats[type].original += me->bytes->GetTotalSize();
+    compressionStats[type].compressed += compressed->bytes->GetTotalSize();
+}
+
 csString psNetMsgProfiles::Dump()
 {
     csStringFast<50> header, list;
     
     psOperProfileSet::Dump("byte", header, list);
-    return "=================\nBandwidth profile\n=================\n" + header + list;
+    csString dump = "=================\nBandwidth profile\n=================\n" + header + list;
+
+    size_t totalSaved = 0;
+    csString compression;
+    for (size_t i = 0; i < compressionStats.GetSize(); i++)
+    {
+        const CompressionStats &stats = compressionStats[i];
+        if (!stats.count)
+            continue;
+
+        totalSaved += stats.original - stats.compressed;
+        compression.AppendFmt("count=%-5zu original=%-8zu compressed=%-8zu saved=%-8zu ratio=%.2f Name=%s\n",
+                              stats.count, stats.original, stats.compressed, stats.original - stats.compressed,
+                              double(stats.compressed)/stats.original, GetMsgTypeName((int)i).GetData());
+    }
+    if (totalSaved)
+    {
+        dump.AppendFmt("\nCompression saved %zu bytes\n", totalSaved);
+        dump += compression;
+    }
+    return dump;
 }
 
 void psNetMsgProfiles::Reset()
 {
     recvProfs.DeleteAll();
     sentProfs.DeleteAll();
+    compressionStats.DeleteAll();
     
     psOperProfileSet::Reset();
 }
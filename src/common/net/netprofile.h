@@ -37,6 +37,14 @@ class psNetMsgProfiles : public psOperProfileSet
 public:
     void AddSentMsg(MsgEntry * me);
     void AddReceivedMsg(MsgEntry * me);
+
+    /**
+     * Count a message that was compressed before it was sent.
+     *
+     * @param me         The original message.
+     * @param compressed The compressed message that was sent instead.
+     */
+    void AddCompressedMsg(MsgEntry * me, MsgEntry * compressed);
     csString Dump();
     void Reset();
 protected:
@@ -46,6 +54,19 @@ protected:
      * Statistics for receiving and sending of different message types.
      */
     csArray<psOperProfile*> recvProfs, sentProfs;
+
+    /// Bytes before and after compression of one message type.
+    struct CompressionStats
+    {
+        size_t count;
+        size_t original;
+        size_t compressed;
+    };
+
+    /**
+     * Compression statistics indexed by message type.
+     */
+    csArray<CompressionStats> compressionStats;
 };
 
 /** @} */
@@ -1197,26 +1197,136 @@ void psAllEntityPosMessage::SetLength(int elems, int client)
     msg->SetType(MSGTYPE_ALLENTITYPOS);
     msg->clientnum      = client;
 
-    msg->Add((int16_t)elems);
+    count = 0;
+    msg->Add((int16_t)0);
 }
 
-void psAllEntityPosMessage::Add(EID id, csVector3& pos, iSector*& sector, InstanceID instance, csStringSet* msgstrings, bool forced)
+void psAllEntityPosMessage::Finish()
 {
+    msg->ClipToCurrentSize();  // Actual Data size
+    msg->Reset();
+    // Now correct the first value, which is the count of following entities.
+    // SetLength has allready allocated the int16_t for this.
+    msg->Add((int16_t)count);
+}
+
+enum
+{
+    ALLENTITYPOS_KEYFRAME = 0x01,
+    ALLENTITYPOS_FORCED   = 0x02
+};
+
+bool psAllEntityPosMessage::Add(EID id, const csVector3& pos, iSector* sector, InstanceID instance,
+                                psEntityPosBaseline& baseline, bool keyframe, csStringSet* msgstrings, bool forced)
+{
+    int32_t x = psEntityPosBaseline::Quantize(pos.x);
+    int32_t y = psEntityPosBaseline::Quantize(pos.y);
+    int32_t z = psEntityPosBaseline::Quantize(pos.z);
+
+    // A move has to fit the int16 offsets and keep the sector and instance
+    if(!baseline.valid || sector != baseline.sector || instance != baseline.instance ||
+       x - baseline.x != (int16_t)(x - baseline.x) ||
+       y - baseline.y != (int16_t)(y - baseline.y) ||
+       z - baseline.z != (int16_t)(z - baseline.z))
+    {
+        keyframe = true;
+    }
+
+    baseline.seq++;
+
     msg->Add(id.Unbox());
-    msg->Add(pos);
-    msg->Add(sector, msgstrings);
-    msg->Add( (int32_t)instance );
-    msg->Add(forced);
+    msg->Add((uint8_t)((keyframe ? ALLENTITYPOS_KEYFRAME : 0) | (forced ? ALLENTITYPOS_FORCED : 0)));
+    msg->Add(baseline.seq);
+    if(keyframe)
+    {
+        msg->Add(x);
+        msg->Add(y);
+        msg->Add(z);
+        msg->Add(sector, msgstrings);
+        msg->Add((uint32_t)instance);
+    }
+    else
+    {
+        msg->Add((int16_t)(x - baseline.x));
+        msg->Add((int16_t)(y - baseline.y));
+        msg->Add((int16_t)(z - baseline.z));
+    }
+
+    baseline.x = x;
+    baseline.y = y;
+    baseline.z = z;
+    baseline.sector = sector;
+    baseline.instance = instance;
+    baseline.valid = true;
+    count++;
+    return keyframe;
 }
 
-EID psAllEntityPosMessage::Get(csVector3& pos, iSector*& sector, InstanceID& instance, bool &forced, csStringSet* msgstrings,
-                               csStringHashReversible* msgstringshash, iEngine *engine)
+EID psAllEntityPosMessage::Get(psEntityPosBaseline& entry, bool& keyframe, bool& forced, csStringSet* msgstrings,
+                               csStringHashReversible* msgstringshash, iEngine* engine)
 {
     EID eid(msg->GetUInt32());
-    pos = msg->GetVector3();
-    sector = msg->GetSector(msgstrings, msgstringshash, engine);
-    instance = msg->GetUInt32();
-    forced = msg->GetBool();
+    uint8_t flags = msg->GetUInt8();
+    keyframe = (flags & ALLENTITYPOS_KEYFRAME) != 0;
+    forced = (flags & ALLENTITYPOS_FORCED) != 0;
+    entry.seq = msg->GetUInt8();
+    if(keyframe)
+    {
+        entry.x = msg->GetInt32();
+        entry.y = msg->GetInt32();
+        entry.z = msg->GetInt32();
+        entry.sector = msg->GetSector(msgstrings, msgstringshash, engine);
+        entry.instance = msg->GetUInt32();
+    }
+    else
+    {
+        entry.x = msg->GetInt16();
+        entry.y = msg->GetInt16();
+        entry.z = msg->GetInt16();
+    }
+    return eid;
+}
+
+EID psAllEntityPosMessage::Get(csVector3& pos, iSector*& sector, InstanceID& instance, bool& forced,
+                               csHash<psEntityPosBaseline, EID>& baselines, csStringSet* msgstrings,
+                               csStringHashReversible* msgstringshash, iEngine* engine)
+{
+    psEntityPosBaseline entry;
+    bool keyframe;
+    EID eid = Get(entry, keyframe, forced, msgstrings, msgstringshash, engine);
+
+    psEntityPosBaseline* baseline = baselines.GetElementPointer(eid);
+    if(keyframe)
+    {
+        entry.valid = true;
+        if(baseline)
+        {
+            *baseline = entry;
+        }
+        else
+        {
+            baselines.Put(eid, entry);
+            baseline = baselines.GetElementPointer(eid);
+        }
+    }
+    else
+    {
+        // A move only applies to the update right before it
+        if(!baseline || !baseline->valid || baseline->seq != (uint8_t)(entry.seq - 1))
+        {
+            if(baseline)
+                baseline->valid = false;
+            return EID();
+        }
+        baseline->x += entry.x;
+        baseline->y += entry.y;
+        baseline->z += entry.z;
+        baseline->seq = entry.seq;
+    }
+
+    pos = baseline->GetPosition();
+    sector = baseline->sector;
+    instance = baseline->instance;
     return eid;
 }
 
@@ -1227,14 +1337,21 @@ csString psAllEntityPosMessage::ToString(NetBase::AccessPointers * accessPointer
     msgtext.AppendFmt("Count: %d",count);
     for (int i = 0; i < count; i++)
     {
-        csVector3 pos;
-        iSector* sector;
-        InstanceID instance;
+        psEntityPosBaseline entry;
+        bool keyframe;
         bool forced;
         
-        EID eid = Get(pos, sector, instance, forced, accessPointers->msgstrings, 0, accessPointers->engine);
+        EID eid = Get(entry, keyframe, forced, accessPointers->msgstrings, 0, accessPointers->engine);
 
-        msgtext.AppendFmt(" ID: %s Pos: %s Inst: %d", ShowID(eid), toString(pos,sector).GetDataSafe(), instance);
+        if(keyframe)
+        {
+            msgtext.AppendFmt(" ID: %s Pos: %s Inst: %d", ShowID(eid),
+                              toString(entry.GetPosition(),entry.sector).GetDataSafe(), entry.instance);
+        }
+        else
+        {
+            msgtext.AppendFmt(" ID: %s Move: %s", ShowID(eid), toString(entry.GetPosition()).GetDataSafe());
+        }
     }
 
     return msgtext;
@@ -23,6 +23,7 @@
 #include "net/messages.h"
 #include <csutil/csstring.h>
 #include <csutil/databuf.h>
+#include <csutil/hash.h>
 #include <csgeom/vector3.h>
 #include "util/psstring.h"
 
@@ -295,13 +296,48 @@ public:
 
 
 //helpers for message splitting
-#define ALLENTITYPOS_SIZE_PER_ENTITY (4 * sizeof(float) + sizeof(bool) + sizeof(uint32_t) + 100*sizeof(char))
+#define ALLENTITYPOS_SIZE_PER_ENTITY (sizeof(uint32_t) + 2*sizeof(uint8_t) + 3*sizeof(int32_t) + 2*sizeof(uint32_t) + 100*sizeof(char))
 #define ALLENTITYPOS_MAX_AMOUNT  (MAX_MESSAGE_SIZE-2)/ALLENTITYPOS_SIZE_PER_ENTITY
 
+/// Positions are sent in steps of 1/ALLENTITYPOS_UNITS_PER_METER meters.
+#define ALLENTITYPOS_UNITS_PER_METER 100
+
+/**
+ * The last position of an entity sent in a psAllEntityPosMessage, quantized
+ * as it was sent. The server keeps one per entity to encode the moves of the
+ * entity against it, the superclient keeps one per entity to decode them.
+ */
+struct psEntityPosBaseline
+{
+    int32_t x, y, z;          ///< Position in 1/ALLENTITYPOS_UNITS_PER_METER meters.
+    iSector* sector;
+    InstanceID instance;
+    uint8_t seq;              ///< Counts the updates of the entity, so moves out of order are noticed.
+    bool valid;               ///< False until the first keyframe.
+
+    psEntityPosBaseline() : x(0), y(0), z(0), sector(NULL), instance(0), seq(0), valid(false) {}
+
+    static int32_t Quantize(float value)
+    {
+        return (int32_t)floorf(value * ALLENTITYPOS_UNITS_PER_METER + 0.5f);
+    }
+
+    csVector3 GetPosition() const
+    {
+        return csVector3(float(x), float(y), float(z)) / ALLENTITYPOS_UNITS_PER_METER;
+    }
+};
+
 /**
 * The message sent from server to superclient every 2.5 seconds.
 * This message is the positions (and sectors) of every person
-* in the game.
+* in the game that moved.
+*
+* An entity is sent either as a keyframe, with its full position, sector
+* and instance, or as a move relative to the last update of it. Both are
+* quantized to 1/ALLENTITYPOS_UNITS_PER_METER meters, so the sender and the
+* receiver keep the same baseline. The sector is sent as a common string id
+* and only in keyframes.
 */
 class psAllEntityPosMessage: public psMessageCracker
 {
@@ -328,11 +364,46 @@ public:
     /// Sets the max size of the buffer
     void SetLength(int size,int client);
 
-    /// Add a new entity's position to the data buffer
-    void Add(EID id, csVector3 & pos, iSector* & sector, InstanceID instance, csStringSet* msgstrings, bool forced = false);
+    /// Is there room for another entity in the buffer?
+    bool IsFull() const
+    {
+        return msg->current + ALLENTITYPOS_SIZE_PER_ENTITY > msg->GetSize();
+    }
+
+    /// Write the number of entities added and clip the buffer to the data.
+    void Finish();
 
-    /// Get the next entity and position from the buffer
-    EID Get(csVector3 & pos, iSector* & sector, InstanceID & instance, bool &forced, csStringSet* msgstrings,
+    /**
+     * Add a new entity's position to the data buffer. It is sent as a move
+     * when the baseline allows it, else as a keyframe. The baseline is
+     * updated to what the superclients will decode.
+     *
+     * @param baseline The last position sent of the entity.
+     * @param keyframe Send the full position even if a move would do.
+     * @return True if it was sent as a keyframe.
+     */
+    bool Add(EID id, const csVector3 & pos, iSector* sector, InstanceID instance, psEntityPosBaseline & baseline,
+             bool keyframe, csStringSet* msgstrings, bool forced = false);
+
+    /**
+     * Get the next entity from the buffer as it was sent. For a move entry
+     * holds the offsets from the previous update, and the sector and the
+     * instance are left as they are.
+     *
+     * @return The entity, keyframe tells if entry holds a full position.
+     */
+    EID Get(psEntityPosBaseline & entry, bool &keyframe, bool &forced, csStringSet* msgstrings,
+        csStringHashReversible* msgstringshash, iEngine* engine);
+
+    /**
+     * Get the next entity and position from the buffer, decoding moves
+     * against the baseline of the entity in baselines.
+     *
+     * @return The entity, or an invalid id for a move that has no baseline
+     *         to apply to. It is dropped until the next keyframe.
+     */
+    EID Get(csVector3 & pos, iSector* & sector, InstanceID & instance, bool &forced,
+        csHash<psEntityPosBaseline, EID> & baselines, csStringSet* msgstrings,
         csStringHashReversible* msgstringshash, iEngine* engine);
 };
 
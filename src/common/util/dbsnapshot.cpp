@@ -0,0 +1,440 @@
+/*
+ * dbsnapshot.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <csutil/csendian.h>
+#include <csutil/databuf.h>
+
+#include "util/consoleout.h"
+#include "dbsnapshot.h"
+
+static const char SNAPSHOT_MAGIC[8] = { 'P', 'S', 'D', 'B', 'S', 'N', 'A', 'P' };
+static const uint32 SNAPSHOT_NULL = (uint32)~0;
+
+// The header after the magic, then the size of the entries in words
+enum
+{
+    HEADER_VERSION,
+    HEADER_SIZE,
+    HEADER_TABLE_COUNT,
+    HEADER_TABLES,
+    HEADER_RESULT_COUNT,
+    HEADER_RESULTS,
+    HEADER_WORDS
+};
+static const uint32 HEADER_BYTES = sizeof(SNAPSHOT_MAGIC) + HEADER_WORDS * 4;
+static const uint32 TABLE_WORDS = 3;
+static const uint32 RESULT_WORDS = 5;
+
+/*---------------------------------------------------------------------------*/
+
+/// A row of a result set of the snapshot, reads the cells where they are.
+class psDBSnapshotRow : public iResultRow
+{
+public:
+    psDBSnapshotRow() : base(NULL), names(NULL), cells(NULL), max(0) {}
+
+    void SetMaxFields(int fields)
+    {
+        max = fields;
+    }
+
+    void SetResultSet(void*) {}
+
+    /// The snapshot and the offsets of the names and of the cells of the row.
+    void Set(const char* base, const uint32* names, const uint32* cells)
+    {
+        this->base = base;
+        this->names = names;
+        this->cells = cells;
+    }
+
+    int Fetch(int)
+    {
+        return 0;
+    }
+
+    const char* operator[](int whichfield)
+    {
+        if(whichfield < 0 || whichfield >= max)
+            return "";
+        uint32 offset = csLittleEndian::UInt32(cells[whichfield]);
+        return offset == SNAPSHOT_NULL ? NULL : base + offset;
+    }
+
+    const char* operator[](const char* fieldname)
+    {
+        for(int i = 0; i < max; i++)
+        {
+            if(!strcasecmp(base + csLittleEndian::UInt32(names[i]), fieldname))
+                return (*this)[i];
+        }
+
+        CPrintf(CON_BUG, "Could not find field %s in the snapshot!\n", fieldname);
+        return "";
+    }
+
+    const char* GetString(int whichfield)
+    {
+        return (*this)[whichfield];
+    }
+
+    const char* GetString(const char* fieldname)
+    {
+        return (*this)[fieldname];
+    }
+
+    int GetInt(int whichfield)
+    {
+        const char* ptr = (*this)[whichfield];
+        return ptr ? atoi(ptr) : 0;
+    }
+
+    int GetInt(const char* fieldname)
+    {
+        const char* ptr = (*this)[fieldname];
+        return ptr ? atoi(ptr) : 0;
+    }
+
+    unsigned long GetUInt32(int whichfield)
+    {
+        const char* ptr = (*this)[whichfield];
+        return ptr ? strtoul(ptr, NULL, 10) : 0;
+    }
+
+    unsigned long GetUInt32(const char* fieldname)
+    {
+        const char* ptr = (*this)[fieldname];
+        return ptr ? strtoul(ptr, NULL, 10) : 0;
+    }
+
+    float GetFloat(int whichfield)
+    {
+        const char* ptr = (*this)[whichfield];
+        return ptr ? atof(ptr) : 0;
+    }
+
+    float GetFloat(const char* fieldname)
+    {
+        const char* ptr = (*this)[fieldname];
+        return ptr ? atof(ptr) : 0;
+    }
+
+    uint64 GetUInt64(int whichfield)
+    {
+        const char* ptr = (*this)[whichfield];
+        return ptr ? stringtouint64(ptr) : 0;
+    }
+
+    uint64 GetUInt64(const char* fieldname)
+    {
+        const char* ptr = (*this)[fieldname];
+        return ptr ? stringtouint64(ptr) : 0;
+    }
+
+    uint64 stringtouint64(const char* stringbuf)
+    {
+        uint64 result = 0;
+        for(; *stringbuf >= '0' && *stringbuf <= '9'; stringbuf++)
+        {
+            result = result * 10 + (uint64)(*stringbuf - '0');
+        }
+        return result;
+    }
+
+protected:
+    const char* base;
+    const uint32* names;
+    const uint32* cells;
+    int max;
+};
+
+/**
+ * A result set of the snapshot. Keeps the buffer of the snapshot, so it may
+ * outlive the psDBSnapshot.
+ */
+class psDBSnapshotResult : public iResultSet
+{
+public:
+    psDBSnapshotResult(iDataBuffer* data, uint32 rows, uint32 fields, uint32 names, uint32 cells)
+        : data(data), rows(rows), fields(fields)
+    {
+        base = data->GetData();
+        this->names = (const uint32*)(base + names);
+        this->cells = (const uint32*)(base + cells);
+        row.SetMaxFields(fields);
+    }
+
+    iResultRow &operator[](unsigned long whichrow)
+    {
+        if(whichrow < rows)
+        {
+            row.SetMaxFields(fields);
+            row.Set(base, names, cells + whichrow * fields);
+        }
+        else
+        {
+            row.SetMaxFields(0); // no fields will make operator[]'s safe
+        }
+        return row;
+    }
+
+    unsigned long Count()
+    {
+        return rows;
+    }
+
+    int GetFieldCount()
+    {
+        return fields;
+    }
+
+    const char* GetFieldName(int whichfield)
+    {
+        if(whichfield < 0 || whichfield >= (int)fields)
+            return NULL;
+        return base + csLittleEndian::UInt32(names[whichfield]);
+    }
+
+    void Release()
+    {
+        delete this;
+    }
+
+protected:
+    csRef<iDataBuffer> data;
+    const char* base;
+    const uint32* names;
+    const uint32* cells;
+    uint32 rows;
+    uint32 fields;
+    psDBSnapshotRow row;
+};
+
+/*---------------------------------------------------------------------------*/
+
+uint32 psDBSnapshot::Read(uint32 offset) const
+{
+    return csLittleEndian::UInt32(*(const uint32*)(data->GetData() + offset));
+}
+
+const char* psDBSnapshot::String(uint32 offset) const
+{
+    return data->GetData() + offset;
+}
+
+bool psDBSnapshot::Load(iDataBuffer* buffer)
+{
+    data = NULL;
+    tables.Empty();
+    results.Empty();
+
+    if(!buffer || buffer->GetSize() < HEADER_BYTES + 1 || buffer->GetSize() >= SNAPSHOT_NULL ||
+            memcmp(buffer->GetData(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)))
+        return false;
+
+    // Every string ends before the end of the snapshot, so it can't run past it
+    uint32 size = (uint32)buffer->GetSize();
+    if(buffer->GetData()[size - 1])
+        return false;
+
+    data = buffer;
+    uint32 header = sizeof(SNAPSHOT_MAGIC);
+    uint32 tableCount = Read(header + HEADER_TABLE_COUNT * 4);
+    uint32 tableStart = Read(header + HEADER_TABLES * 4);
+    uint32 resultCount = Read(header + HEADER_RESULT_COUNT * 4);
+    uint32 resultStart = Read(header + HEADER_RESULTS * 4);
+
+    bool valid = Read(header + HEADER_VERSION * 4) == PSDBSNAPSHOT_VERSION &&
+                 Read(header + HEADER_SIZE * 4) == size &&
+                 tableStart % 4 == 0 && (uint64)tableStart + (uint64)tableCount * TABLE_WORDS * 4 <= size &&
+                 resultStart % 4 == 0 && (uint64)resultStart + (uint64)resultCount * RESULT_WORDS * 4 <= size;
+
+    for(uint32 t = 0; valid && t < tableCount; t++)
+    {
+        uint32 entry = tableStart + t * TABLE_WORDS * 4;
+        valid = Read(entry) < size;
+        if(valid)
+            tables.PutUnique(String(Read(entry)), entry);
+    }
+
+    for(uint32 r = 0; valid && r < resultCount; r++)
+    {
+        uint32 entry = resultStart + r * RESULT_WORDS * 4;
+        uint32 sql = Read(entry);
+        uint64 rows = Read(entry + 4);
+        uint64 fields = Read(entry + 8);
+        uint32 names = Read(entry + 12);
+        uint32 cells = Read(entry + 16);
+
+        valid = sql < size && names % 4 == 0 && cells % 4 == 0 &&
+                names + fields * 4 <= size && cells + rows * fields * 4 <= size;
+        for(uint32 i = 0; valid && i < fields; i++)
+        {
+            valid = Read(names + i * 4) < size;
+        }
+        for(uint64 i = 0; valid && i < rows * fields; i++)
+        {
+            uint32 cell = Read(cells + (uint32)i * 4);
+            valid = cell < size || cell == SNAPSHOT_NULL;
+        }
+        if(valid)
+            results.PutUnique(String(sql), entry);
+    }
+
+    if(!valid)
+    {
+        data = NULL;
+        tables.Empty();
+        results.Empty();
+    }
+    return valid;
+}
+
+bool psDBSnapshot::GetTableChecksum(const char* table, uint64 &checksum) const
+{
+    const uint32* entry = tables.GetElementPointer(table);
+    if(!entry)
+        return false;
+
+    checksum = ((uint64)Read(*entry + 8) << 32) | Read(*entry + 4);
+    return true;
+}
+
+iResultSet* psDBSnapshot::Select(const char* sql) const
+{
+    const uint32* entry = results.GetElementPointer(sql);
+    if(!entry)
+        return NULL;
+
+    return new psDBSnapshotResult(data, Read(*entry + 4), Read(*entry + 8), Read(*entry + 12), Read(*entry + 16));
+}
+
+/*---------------------------------------------------------------------------*/
+
+psDBSnapshotWriter::psDBSnapshotWriter()
+{
+    // The pool is never empty, so the snapshot always ends with a 0
+    AddString("");
+}
+
+uint32 psDBSnapshotWriter::AddString(const char* str)
+{
+    if(!str)
+        return SNAPSHOT_NULL;
+
+    const uint32* offset = pooled.GetElementPointer(str);
+    if(offset)
+        return *offset;
+
+    uint32 added = (uint32)pool.Length();
+    pool.Append(str, strlen(str) + 1);
+    pooled.Put(str, added);
+    return added;
+}
+
+void psDBSnapshotWriter::AddTable(const char* table, uint64 checksum)
+{
+    Table entry;
+    entry.name = AddString(table);
+    entry.checksum = checksum;
+    tables.Push(entry);
+}
+
+void psDBSnapshotWriter::AddResult(const char* sql, iResultSet* result)
+{
+    SavedResult &entry = results.GetExtend(results.GetSize());
+    entry.sql = AddString(sql);
+    entry.rows = (uint32)result->Count();
+    entry.fields = (uint32)result->GetFieldCount();
+    entry.strings.SetCapacity((entry.rows + 1) * entry.fields);
+
+    for(uint32 i = 0; i < entry.fields; i++)
+    {
+        entry.strings.Push(AddString(result->GetFieldName(i)));
+    }
+    for(uint32 r = 0; r < entry.rows; r++)
+    {
+        iResultRow &row = (*result)[r];
+        for(uint32 i = 0; i < entry.fields; i++)
+        {
+            entry.strings.Push(AddString(row[(int)i]));
+        }
+    }
+}
+
+csPtr<iDataBuffer> psDBSnapshotWriter::Save() const
+{
+    uint32 tableStart = HEADER_BYTES;
+    uint32 resultStart = tableStart + (uint32)tables.GetSize() * TABLE_WORDS * 4;
+    uint32 stringStart = resultStart + (uint32)results.GetSize() * RESULT_WORDS * 4;
+    uint32 poolStart = stringStart;
+    for(size_t r = 0; r < results.GetSize(); r++)
+    {
+        poolStart += (uint32)results[r].strings.GetSize() * 4;
+    }
+    uint32 size = poolStart + (uint32)pool.Length();
+
+    csDataBuffer* buffer = new csDataBuffer(size);
+    char* base = buffer->GetData();
+    uint32* words = (uint32*)base;
+    memcpy(base, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+
+    // Strings are pool offsets until here
+    size_t w = sizeof(SNAPSHOT_MAGIC) / 4;
+    words[w + HEADER_VERSION] = csLittleEndian::UInt32(PSDBSNAPSHOT_VERSION);
+    words[w + HEADER_SIZE] = csLittleEndian::UInt32(size);
+    words[w + HEADER_TABLE_COUNT] = csLittleEndian::UInt32((uint32)tables.GetSize());
+    words[w + HEADER_TABLES] = csLittleEndian::UInt32(tableStart);
+    words[w + HEADER_RESULT_COUNT] = csLittleEndian::UInt32((uint32)results.GetSize());
+    words[w + HEADER_RESULTS] = csLittleEndian::UInt32(resultStart);
+
+    w = tableStart / 4;
+    for(size_t t = 0; t < tables.GetSize(); t++)
+    {
+        words[w++] = csLittleEndian::UInt32(poolStart + tables[t].name);
+        words[w++] = csLittleEndian::UInt32((uint32)tables[t].checksum);
+        words[w++] = csLittleEndian::UInt32((uint32)(tables[t].checksum >> 32));
+    }
+
+    uint32 strings = stringStart;
+    for(size_t r = 0; r < results.GetSize(); r++)
+    {
+        const SavedResult &result = results[r];
+        words[w++] = csLittleEndian::UInt32(poolStart + result.sql);
+        words[w++] = csLittleEndian::UInt32(result.rows);
+        words[w++] = csLittleEndian::UInt32(result.fields);
+        words[w++] = csLittleEndian::UInt32(strings);
+        words[w++] = csLittleEndian::UInt32(strings + result.fields * 4);
+        strings += (uint32)result.strings.GetSize() * 4;
+    }
+
+    for(size_t r = 0; r < results.GetSize(); r++)
+    {
+        const csArray<uint32> &offsets = results[r].strings;
+        for(size_t i = 0; i < offsets.GetSize(); i++)
+        {
+            uint32 offset = offsets[i] == SNAPSHOT_NULL ? SNAPSHOT_NULL : poolStart + offsets[i];
+            words[w++] = csLittleEndian::UInt32(offset);
+        }
+    }
+
+    memcpy(base + poolStart, pool.GetData(), pool.Length());
+    return csPtr<iDataBuffer>(buffer);
+}
@@ -0,0 +1,141 @@
+/*
+ * dbsnapshot.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Result sets saved to a file, to be used again instead of their queries.
+ *
+ */
+
+#ifndef __DBSNAPSHOT_H__
+#define __DBSNAPSHOT_H__
+
+#include <csutil/array.h>
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+#include <csutil/ref.h>
+#include <iutil/databuff.h>
+
+#include <idal.h>      // Database Abstraction Layer Interface
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/// Changes whenever the layout of the snapshot does.
+#define PSDBSNAPSHOT_VERSION 1
+
+/**
+ * Result sets and the checksums of the tables they were selected from, as
+ * saved by a psDBSnapshotWriter. The snapshot is used as it was saved,
+ * without parsing or copying, so the buffer may be a memory mapped file.
+ *
+ * The layout, all numbers 32 bit little endian and all offsets from the
+ * start of the snapshot:
+ *
+ * - "PSDBSNAP", version, size, table count, table offset, result count,
+ *   result offset
+ * - The tables: name, low and high half of the checksum
+ * - The results: query, rows, fields, offset of the field names, offset of
+ *   the cells
+ * - The field names and cells of the results, the offset of a string each,
+ *   ~0 for NULL
+ * - The strings, each ending with a 0
+ */
+class psDBSnapshot
+{
+public:
+    /**
+     * Use the contents of a snapshot.
+     *
+     * @return False if the buffer is not a snapshot of this version or is
+     *         damaged.
+     */
+    bool Load(iDataBuffer* data);
+
+    /// The checksum saved for a table, false if the snapshot has none.
+    bool GetTableChecksum(const char* table, uint64 &checksum) const;
+
+    /// Is a result saved for the query?
+    bool HasResult(const char* sql) const
+    {
+        return results.Contains(sql);
+    }
+
+    /**
+     * The result saved for the query, NULL if there is none. Has to be
+     * released by the caller like any result set.
+     */
+    iResultSet* Select(const char* sql) const;
+
+protected:
+    uint32 Read(uint32 offset) const;
+    const char* String(uint32 offset) const;
+
+    csRef<iDataBuffer> data;
+    csHash<uint32, csString> tables;    ///< Offsets of the table entries by name.
+    csHash<uint32, csString> results;   ///< Offsets of the result entries by query.
+};
+
+/**
+ * Collects result sets and table checksums and saves them in the layout
+ * read by psDBSnapshot. Equal strings are saved once.
+ */
+class psDBSnapshotWriter
+{
+public:
+    psDBSnapshotWriter();
+
+    void AddTable(const char* table, uint64 checksum);
+
+    /// Copy the rows of a result set, the rows fetched last changes.
+    void AddResult(const char* sql, iResultSet* result);
+
+    /// The number of result sets added.
+    size_t GetResultCount() const
+    {
+        return results.GetSize();
+    }
+
+    /// The snapshot of everything added.
+    csPtr<iDataBuffer> Save() const;
+
+protected:
+    struct Table
+    {
+        uint32 name;
+        uint64 checksum;
+    };
+
+    struct SavedResult
+    {
+        uint32 sql;
+        uint32 rows;
+        uint32 fields;
+        csArray<uint32> strings;        ///< The field names, then the cells row by row.
+    };
+
+    /// The offset of the string in the string pool, ~0 for NULL.
+    uint32 AddString(const char* str);
+
+    csArray<Table> tables;
+    csArray<SavedResult> results;
+    csString pool;
+    csHash<uint32, csString> pooled;
+};
+
+/** @} */
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * dbsnapshot_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/databuf.h>
+#include <csutil/stringarray.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/dbsnapshot.h"
+#include "util/psdatabase.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Rows of strings, a cell of "NULL" is NULL.
+class FakeResultSet : public iResultSet, public iResultRow
+{
+public:
+    FakeResultSet(const char* fields) : current(0)
+    {
+        names.SplitString(fields, ",");
+    }
+
+    void AddRow(const char* row)
+    {
+        csStringArray values;
+        values.SplitString(row, ",");
+        cells.Push(values);
+    }
+
+    // iResultSet
+    iResultRow &operator[](unsigned long whichrow)
+    {
+        current = whichrow;
+        return *this;
+    }
+    unsigned long Count() { return cells.GetSize(); }
+    int GetFieldCount() { return (int)names.GetSize(); }
+    const char* GetFieldName(int whichfield) { return names[whichfield]; }
+    void Release() {}
+
+    // iResultRow
+    void SetMaxFields(int) {}
+    void SetResultSet(void*) {}
+    int Fetch(int) { return 0; }
+    const char* operator[](int whichfield)
+    {
+        const char* cell = cells[current][whichfield];
+        return strcmp(cell, "NULL") ? cell : NULL;
+    }
+    const char* operator[](const char* fieldname) { return (*this)[(int)names.Find(fieldname)]; }
+    const char* GetString(int whichfield) { return (*this)[whichfield]; }
+    const char* GetString(const char* fieldname) { return (*this)[fieldname]; }
+    int GetInt(int whichfield) { return atoi((*this)[whichfield]); }
+    int GetInt(const char* fieldname) { return atoi((*this)[fieldname]); }
+    unsigned long GetUInt32(int whichfield) { return strtoul((*this)[whichfield], NULL, 10); }
+    unsigned long GetUInt32(const char* fieldname) { return strtoul((*this)[fieldname], NULL, 10); }
+    float GetFloat(int whichfield) { return atof((*this)[whichfield]); }
+    float GetFloat(const char* fieldname) { return atof((*this)[fieldname]); }
+    uint64 GetUInt64(int whichfield) { return GetUInt32(whichfield); }
+    uint64 GetUInt64(const char* fieldname) { return GetUInt32(fieldname); }
+    uint64 stringtouint64(const char* stringbuf) { return strtoul(stringbuf, NULL, 10); }
+
+    csStringArray names;
+    csArray<csStringArray> cells;
+    unsigned long current;
+};
+
+static csRef<iDataBuffer> SaveItems()
+{
+    FakeResultSet items("id,name,weight");
+    items.AddRow("1,Sword,3.5");
+    items.AddRow("2,Shield,NULL");
+    items.AddRow("3,Sword,1");
+
+    psDBSnapshotWriter writer;
+    writer.AddTable("items", 0x123456789abcdefULL);
+    writer.AddResult("SELECT * from items", &items);
+    return csRef<iDataBuffer>(writer.Save());
+}
+
+TEST(DBSnapshotTest, RoundTrip)
+{
+    psDBSnapshot snapshot;
+    ASSERT_TRUE(snapshot.Load(SaveItems()));
+
+    uint64 checksum = 0;
+    EXPECT_TRUE(snapshot.GetTableChecksum("items", checksum));
+    EXPECT_EQ(0x123456789abcdefULL, checksum);
+    EXPECT_FALSE(snapshot.GetTableChecksum("spells", checksum));
+    EXPECT_FALSE(snapshot.HasResult("SELECT * from spells"));
+    EXPECT_EQ(NULL, snapshot.Select("SELECT * from spells"));
+    EXPECT_TRUE(snapshot.HasResult("SELECT * from items"));
+
+    Result result(snapshot.Select("SELECT * from items"));
+    ASSERT_TRUE(result.IsValid());
+    ASSERT_EQ(3u, result.Count());
+    EXPECT_EQ(3, result.rs->GetFieldCount());
+    EXPECT_STREQ("weight", result.rs->GetFieldName(2));
+    EXPECT_EQ(NULL, result.rs->GetFieldName(3));
+
+    EXPECT_EQ(2u, result[1].GetUInt32("id"));
+    EXPECT_STREQ("Shield", result[1]["NAME"]);
+    EXPECT_EQ(NULL, result[1]["weight"]);
+    EXPECT_FLOAT_EQ(3.5f, result[0].GetFloat("weight"));
+    EXPECT_STREQ("Sword", result[2][1]);
+    EXPECT_STREQ("", result[2][3]);
+}
+
+TEST(DBSnapshotTest, SavesAgain)
+{
+    psDBSnapshot snapshot;
+    ASSERT_TRUE(snapshot.Load(SaveItems()));
+    Result items(snapshot.Select("SELECT * from items"));
+
+    // Saved from the snapshot the rows take the same room again
+    psDBSnapshotWriter writer;
+    writer.AddTable("items", 1);
+    writer.AddResult("SELECT * from items", items.rs);
+    csRef<iDataBuffer> again = writer.Save();
+    EXPECT_EQ(SaveItems()->GetSize(), again->GetSize());
+
+    psDBSnapshot copy;
+    ASSERT_TRUE(copy.Load(again));
+    Result result(copy.Select("SELECT * from items"));
+    ASSERT_EQ(3u, result.Count());
+    EXPECT_EQ(NULL, result[1]["weight"]);
+    EXPECT_STREQ("Sword", result[2]["name"]);
+}
+
+TEST(DBSnapshotTest, RejectsDamaged)
+{
+    csRef<iDataBuffer> data = SaveItems();
+    psDBSnapshot snapshot;
+
+    csRef<iDataBuffer> cut;
+    cut.AttachNew(new csDataBuffer(data->GetSize() - 4));
+    memcpy(cut->GetData(), data->GetData(), cut->GetSize());
+    EXPECT_FALSE(snapshot.Load(cut));
+
+    csRef<iDataBuffer> version;
+    version.AttachNew(new csDataBuffer(data->GetSize()));
+    memcpy(version->GetData(), data->GetData(), data->GetSize());
+    version->GetData()[8]++;
+    EXPECT_FALSE(snapshot.Load(version));
+    EXPECT_EQ(NULL, snapshot.Select("SELECT * from items"));
+
+    EXPECT_FALSE(snapshot.Load(NULL));
+    EXPECT_TRUE(snapshot.Load(data));
+}
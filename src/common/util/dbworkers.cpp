@@ -0,0 +1,453 @@
+/*
+ * dbworkers.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <csutil/sysfunc.h>
+#include <csutil/threading/thread.h>
+
+#include "util/log.h"
+#include "util/zoneprofiler.h"
+#include "dbworkers.h"
+
+/*---------------------------------------------------------------------------*/
+
+/**
+ * Opens its own connection and runs queries from the queue of the pool
+ * until the pool is stopped.
+ */
+class psDBWorker : public CS::Threading::Runnable
+{
+public:
+    psDBWorker(psDBWorkerPool* pool)
+    {
+        this->pool = pool;
+        ready = false;
+        connected = false;
+    }
+
+    /// Start the thread and wait until it opened its connection.
+    bool Start()
+    {
+        thread.AttachNew(new CS::Threading::Thread(this));
+        thread->Start();
+
+        CS::Threading::MutexScopedLock lock(mutex);
+        while(!ready)
+        {
+            condition.Wait(mutex);
+        }
+        return connected;
+    }
+
+    /// Wait for the thread to end, after the pool was stopped.
+    void Join()
+    {
+        thread->Wait();
+        thread = NULL;
+    }
+
+    virtual void Run()
+    {
+        psZoneProfiler::SetThreadName("DBWorker");
+
+        csRef<iDataConnection> conn = pool->connector->Connect();
+        {
+            CS::Threading::MutexScopedLock lock(mutex);
+            connected = conn.IsValid();
+            ready = true;
+            condition.NotifyOne();
+        }
+
+        if(conn)
+        {
+            while(true)
+            {
+                csRef<psAsyncQuery> query = pool->Next();
+                if(!query)
+                    break;
+
+                csTicks start = csGetTicks();
+                query->Run(conn);
+                pool->Done(query, csGetTicks() - start);
+            }
+            conn = NULL;
+        }
+
+        pool->connector->EndThread();
+    }
+
+protected:
+    psDBWorkerPool* pool;
+    csRef<CS::Threading::Thread> thread;
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition condition;
+    bool ready;
+    bool connected;
+};
+
+/*---------------------------------------------------------------------------*/
+
+psAsyncQuery::psAsyncQuery(psAsyncQueryType type, const char* sql, iAsyncQueryCallback* callback)
+    : scfImplementationType(this), type(type), sql(sql), callback(callback)
+{
+    queued = 0;
+    done = false;
+    succeeded = false;
+    result = NULL;
+    affected = 0;
+    insertID = 0;
+}
+
+psAsyncQuery::~psAsyncQuery()
+{
+    if(result)
+        result->Release();
+}
+
+void psAsyncQuery::Run(iDataConnection* conn)
+{
+    iResultSet* rs = NULL;
+    unsigned long rows = 0;
+    uint64 id = 0;
+    bool ok = false;
+
+    switch(type)
+    {
+        case ASYNC_SELECT:
+            rs = conn->Select("%s", sql.GetData());
+            ok = (rs != NULL);
+            break;
+
+        case ASYNC_COMMAND:
+            rows = conn->Command("%s", sql.GetData());
+            ok = (rows != QUERY_FAILED);
+            break;
+
+        case ASYNC_INSERT:
+            rows = conn->Command("%s", sql.GetData());
+            ok = (rows == 1);
+            if(ok)
+                id = conn->GetLastInsertID();
+            break;
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    succeeded = ok;
+    result = rs;
+    affected = ok ? rows : 0;
+    insertID = id;
+    if(!ok)
+        error = conn->GetLastError();
+    done = true;
+    condition.NotifyAll();
+}
+
+bool psAsyncQuery::IsDone()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    return done;
+}
+
+void psAsyncQuery::Wait()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    while(!done)
+    {
+        condition.Wait(mutex);
+    }
+}
+
+bool psAsyncQuery::Succeeded()
+{
+    return succeeded;
+}
+
+iResultSet* psAsyncQuery::GetResultSet()
+{
+    return result;
+}
+
+iResultSet* psAsyncQuery::TakeResultSet()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    iResultSet* taken = result;
+    result = NULL;
+    return taken;
+}
+
+unsigned long psAsyncQuery::GetAffectedRows()
+{
+    return affected;
+}
+
+uint64 psAsyncQuery::GetInsertID()
+{
+    return insertID;
+}
+
+const char* psAsyncQuery::GetError()
+{
+    return error.GetDataSafe();
+}
+
+const char* psAsyncQuery::GetQuery()
+{
+    return sql.GetDataSafe();
+}
+
+/*---------------------------------------------------------------------------*/
+
+psDBWorkerPool::psDBWorkerPool(iDataConnection* owner, psDBConnector* connector)
+{
+    this->owner = owner;
+    this->connector = connector;
+    stop = false;
+
+    queuedCount = 0;
+    failedCount = 0;
+    peakPending = 0;
+    totalWait = 0;
+    totalRun = 0;
+}
+
+psDBWorkerPool::~psDBWorkerPool()
+{
+    Stop();
+}
+
+bool psDBWorkerPool::Start(size_t count)
+{
+    for(size_t i = 0; i < count; i++)
+    {
+        csRef<psDBWorker> worker;
+        worker.AttachNew(new psDBWorker(this));
+        if(!worker->Start())
+        {
+            worker->Join();
+            Stop();
+            return false;
+        }
+
+        CS::Threading::MutexScopedLock lock(mutex);
+        workers.Push(worker);
+    }
+    return true;
+}
+
+void psDBWorkerPool::Stop()
+{
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        stop = true;
+        condition.NotifyAll();
+    }
+
+    for(size_t i = 0; i < workers.GetSize(); i++)
+    {
+        workers[i]->Join();
+    }
+
+    // Anything queued while the last workers were ending
+    csRefArray<psAsyncQuery> left;
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        workers.Empty();
+        left = pending;
+        pending.Empty();
+        stop = false;
+    }
+
+    for(size_t i = 0; i < left.GetSize(); i++)
+    {
+        left[i]->Run(owner);
+        Done(left[i], csGetTicks() - left[i]->queued);
+    }
+
+    // Nobody may dispatch them after this
+    DispatchCallbacks();
+}
+
+csPtr<iAsyncQuery> psDBWorkerPool::Queue(psAsyncQueryType type, iAsyncQueryCallback* callback, const char* sql)
+{
+    psAsyncQuery* query = new psAsyncQuery(type, sql, callback);
+    query->queued = csGetTicks();
+
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        queuedCount++;
+
+        if(!workers.IsEmpty())
+        {
+            pending.Push(query);
+            if(pending.GetSize() > peakPending)
+                peakPending = pending.GetSize();
+            condition.NotifyOne();
+            return csPtr<iAsyncQuery>(query);
+        }
+    }
+
+    // No workers, so the caller has to wait after all
+    query->Run(owner);
+    Done(query, csGetTicks() - query->queued);
+    return csPtr<iAsyncQuery>(query);
+}
+
+csPtr<psAsyncQuery> psDBWorkerPool::Next()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    while(pending.IsEmpty() && !stop)
+    {
+        condition.Wait(mutex);
+    }
+
+    if(pending.IsEmpty())
+        return csPtr<psAsyncQuery>(NULL);
+
+    psAsyncQuery* query = pending[0];
+    query->IncRef();
+    pending.DeleteIndex(0);
+
+    totalWait += csGetTicks() - query->queued;
+    return csPtr<psAsyncQuery>(query);
+}
+
+void psDBWorkerPool::Done(psAsyncQuery* query, csTicks runTime)
+{
+    if(!query->Succeeded())
+    {
+        Error3("Queued query failed: %s\nQuery: %s", query->GetError(), query->GetQuery());
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    totalRun += runTime;
+    if(!query->Succeeded())
+        failedCount++;
+
+    if(query->GetCallback())
+        finished.Push(query);
+}
+
+size_t psDBWorkerPool::DispatchCallbacks()
+{
+    csRefArray<psAsyncQuery> done;
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        if(finished.IsEmpty())
+            return 0;
+        done = finished;
+        finished.Empty();
+    }
+
+    for(size_t i = 0; i < done.GetSize(); i++)
+    {
+        done[i]->GetCallback()->QueryDone(done[i]);
+    }
+    return done.GetSize();
+}
+
+csString psDBWorkerPool::DumpStats()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    size_t run = queuedCount - pending.GetSize();
+    csString dump;
+    dump.Format("Queued queries: %zu workers, %zu queued, %zu failed, %zu pending (peak %zu), "
+                "average wait %.1f ms, average run %.1f ms\n",
+                workers.GetSize(), queuedCount, failedCount, pending.GetSize(), peakPending,
+                run ? float(totalWait) / run : 0.0f, run ? float(totalRun) / run : 0.0f);
+    return dump;
+}
+
+csString psDBWorkerPool::BuildInsert(iDataConnection* db, const char* table, const char** fieldnames,
+                                     psStringArray &fieldvalues)
+{
+    csString command;
+    const size_t count = fieldvalues.GetSize();
+
+    command = "INSERT INTO ";
+    command.Append(table);
+    command.Append(" (");
+    for(size_t i = 0; i < count; i++)
+    {
+        if(i > 0)
+            command.Append(",");
+        command.Append(fieldnames[i]);
+    }
+
+    command.Append(") VALUES (");
+    for(size_t i = 0; i < count; i++)
+    {
+        if(i > 0)
+            command.Append(",");
+        if(fieldvalues[i] != NULL)
+        {
+            csString escape;
+            db->Escape(escape, fieldvalues[i]);
+            command.Append("'");
+            command.Append(escape);
+            command.Append("'");
+        }
+        else
+        {
+            command.Append("NULL");
+        }
+    }
+    command.Append(")");
+
+    return command;
+}
+
+csString psDBWorkerPool::BuildUpdate(iDataConnection* db, const char* table, const char* idfield, const char* id,
+                                     const char** fieldnames, psStringArray &fieldvalues)
+{
+    csString command;
+    const size_t count = fieldvalues.GetSize();
+
+    command = "UPDATE ";
+    command.Append(table);
+    command.Append(" SET ");
+    for(size_t i = 0; i < count; i++)
+    {
+        if(i > 0)
+            command.Append(",");
+        command.Append(fieldnames[i]);
+        if(fieldvalues[i] != NULL)
+        {
+            csString escape;
+            db->Escape(escape, fieldvalues[i]);
+            command.Append("='");
+            command.Append(escape);
+            command.Append("'");
+        }
+        else
+        {
+            command.Append("=NULL");
+        }
+    }
+
+    csString escape;
+    db->Escape(escape, id);
+    command.Append(" where ");
+    command.Append(idfield);
+    command.Append("='");
+    command.Append(escape);
+    command.Append("'");
+
+    return command;
+}
@@ -0,0 +1,185 @@
+/*
+ * dbworkers.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Worker threads running queued queries for the database plugins.
+ *
+ */
+
+#ifndef __DBWORKERS_H__
+#define __DBWORKERS_H__
+
+#include <csutil/csstring.h>
+#include <csutil/refarr.h>
+#include <csutil/scf_implementation.h>
+#include <csutil/threading/condition.h>
+#include <csutil/threading/mutex.h>
+
+#include <idal.h>      // Database Abstraction Layer Interface
+
+class psDBWorker;
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/**
+ * Opens the connections of the database workers. Implemented by each
+ * database plugin, as only the plugin knows how to open another connection
+ * like its own. Both functions are called from the thread of the worker.
+ */
+class psDBConnector
+{
+public:
+    virtual ~psDBConnector() {}
+
+    /// Open a connection with the settings of the main connection, NULL on failure.
+    virtual csPtr<iDataConnection> Connect() = 0;
+
+    /// Called after the worker released its connection, before its thread ends.
+    virtual void EndThread() {}
+};
+
+enum psAsyncQueryType
+{
+    ASYNC_SELECT,
+    ASYNC_COMMAND,
+    ASYNC_INSERT        ///< A command that also gets the id of the new row.
+};
+
+/**
+ * A query waiting for or run by a worker.
+ */
+class psAsyncQuery : public scfImplementation1<psAsyncQuery, iAsyncQuery>
+{
+public:
+    psAsyncQuery(psAsyncQueryType type, const char* sql, iAsyncQueryCallback* callback);
+    virtual ~psAsyncQuery();
+
+    /// Run the query on the given connection and wake up anyone waiting for it.
+    void Run(iDataConnection* conn);
+
+    iAsyncQueryCallback* GetCallback()
+    {
+        return callback;
+    }
+
+    virtual bool IsDone();
+    virtual void Wait();
+    virtual bool Succeeded();
+    virtual iResultSet* GetResultSet();
+    virtual iResultSet* TakeResultSet();
+    virtual unsigned long GetAffectedRows();
+    virtual uint64 GetInsertID();
+    virtual const char* GetError();
+    virtual const char* GetQuery();
+
+    csTicks queued;     ///< When the query was queued.
+
+protected:
+    psAsyncQueryType type;
+    csString sql;
+    csRef<iAsyncQueryCallback> callback;
+
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition condition;
+    bool done;
+
+    bool succeeded;
+    iResultSet* result;
+    unsigned long affected;
+    uint64 insertID;
+    csString error;
+};
+
+/**
+ * The workers of one database plugin and the queue of queries they share.
+ * Each worker has its own connection, opened by the psDBConnector, and runs
+ * the queries one at a time in the order they were queued. The callbacks
+ * of finished queries are kept until DispatchCallbacks() is called.
+ */
+class psDBWorkerPool
+{
+    friend class psDBWorker;
+
+public:
+    /**
+     * @param owner     The main connection, it runs the queries while there
+     *                  are no workers.
+     * @param connector Opens the connections of the workers.
+     */
+    psDBWorkerPool(iDataConnection* owner, psDBConnector* connector);
+    ~psDBWorkerPool();
+
+    /**
+     * Start workers, each with its own connection.
+     *
+     * @return False if a connection could not be opened, no workers are
+     *         left running then.
+     */
+    bool Start(size_t count);
+
+    /**
+     * Let the workers run the queued queries and stop them. The callbacks
+     * still waiting for DispatchCallbacks() are called from here.
+     */
+    void Stop();
+
+    /// Queue a query, or run it right away if there are no workers.
+    csPtr<iAsyncQuery> Queue(psAsyncQueryType type, iAsyncQueryCallback* callback, const char* sql);
+
+    /// Call the callbacks of the queries done so far.
+    size_t DispatchCallbacks();
+
+    /// The number of queries queued and run, and the time they took, as text.
+    csString DumpStats();
+
+    /// Build the insert run by iDataConnection::GenericInsertWithID().
+    static csString BuildInsert(iDataConnection* db, const char* table, const char** fieldnames,
+                                psStringArray &fieldvalues);
+
+    /// Build the update run by iDataConnection::GenericUpdateWithID().
+    static csString BuildUpdate(iDataConnection* db, const char* table, const char* idfield, const char* id,
+                                const char** fieldnames, psStringArray &fieldvalues);
+
+protected:
+    /// Get the next query to run, waiting for one. NULL once stopped and nothing is left.
+    csPtr<psAsyncQuery> Next();
+
+    /// Called by the worker after running a query.
+    void Done(psAsyncQuery* query, csTicks runTime);
+
+    iDataConnection* owner;
+    psDBConnector* connector;
+    csRefArray<psDBWorker> workers;
+
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition condition;
+    csRefArray<psAsyncQuery> pending;
+    csRefArray<psAsyncQuery> finished;     ///< Done, waiting for their callback.
+    bool stop;
+
+    // Statistics
+    size_t queuedCount;
+    size_t failedCount;
+    size_t peakPending;
+    uint64 totalWait;                      ///< Ticks spent in the queue.
+    uint64 totalRun;                       ///< Ticks spent running.
+};
+
+/** @} */
+
+#endif
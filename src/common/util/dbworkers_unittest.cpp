@@ -0,0 +1,167 @@
+/*
+ * dbworkers_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/scf_implementation.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/dbworkers.h"
+#include "fakeconnection_unittest.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+/// Counts the queries it was called for.
+class CountingCallback : public scfImplementation1<CountingCallback, iAsyncQueryCallback>
+{
+public:
+    CountingCallback() : scfImplementationType(this), count(0) {}
+
+    virtual void QueryDone(iAsyncQuery* query)
+    {
+        EXPECT_TRUE(query->IsDone());
+        count++;
+    }
+
+    int count;
+};
+
+TEST(DBWorkersTest, RunsRightAwayWithoutWorkers)
+{
+    csRef<FakeConnection> conn;
+    conn.AttachNew(new FakeConnection(0));
+    csRef<CountingCallback> callback;
+    callback.AttachNew(new CountingCallback);
+
+    psDBWorkerPool pool(conn, conn);
+    csRef<iAsyncQuery> query = pool.Queue(ASYNC_COMMAND, callback, "UPDATE x SET y=1");
+
+    EXPECT_TRUE(query->IsDone());
+    EXPECT_TRUE(query->Succeeded());
+    EXPECT_EQ(1u, query->GetAffectedRows());
+    EXPECT_EQ(1, conn->commands);
+
+    // Callbacks wait for the dispatch
+    EXPECT_EQ(0, callback->count);
+    EXPECT_EQ(1u, pool.DispatchCallbacks());
+    EXPECT_EQ(1, callback->count);
+    EXPECT_EQ(0u, pool.DispatchCallbacks());
+}
+
+TEST(DBWorkersTest, WorkersRunEverything)
+{
+    const int queries = 200;
+
+    csRef<FakeConnection> conn;
+    conn.AttachNew(new FakeConnection(0));
+    csRef<CountingCallback> callback;
+    callback.AttachNew(new CountingCallback);
+
+    psDBWorkerPool pool(conn, conn);
+    ASSERT_TRUE(pool.Start(4));
+    EXPECT_EQ(4, conn->connections);
+
+    csRefArray<iAsyncQuery> queued;
+    for(int i = 0; i < queries; i++)
+    {
+        csRef<iAsyncQuery> query = pool.Queue(ASYNC_INSERT, callback, "INSERT INTO x VALUES(1)");
+        queued.Push(query);
+    }
+
+    for(int i = 0; i < queries; i++)
+    {
+        queued[i]->Wait();
+        EXPECT_TRUE(queued[i]->Succeeded());
+
+        // Ran by a worker, so the id is that of a worker connection
+        EXPECT_GE(queued[i]->GetInsertID(), 1u);
+        EXPECT_LE(queued[i]->GetInsertID(), 4u);
+    }
+    EXPECT_EQ(0, conn->commands);
+
+    EXPECT_EQ(size_t(queries), pool.DispatchCallbacks());
+    EXPECT_EQ(queries, callback->count);
+
+    pool.Stop();
+
+    // Without workers the main connection takes over
+    csRef<iAsyncQuery> query = pool.Queue(ASYNC_INSERT, NULL, "INSERT INTO x VALUES(1)");
+    EXPECT_TRUE(query->IsDone());
+    EXPECT_EQ(0u, query->GetInsertID());
+}
+
+TEST(DBWorkersTest, StopCallsWaitingCallbacks)
+{
+    csRef<FakeConnection> conn;
+    conn.AttachNew(new FakeConnection(0));
+    csRef<CountingCallback> callback;
+    callback.AttachNew(new CountingCallback);
+
+    psDBWorkerPool pool(conn, conn);
+    ASSERT_TRUE(pool.Start(2));
+
+    for(int i = 0; i < 20; i++)
+    {
+        csRef<iAsyncQuery> query = pool.Queue(ASYNC_COMMAND, callback, "UPDATE x SET y=1");
+    }
+
+    pool.Stop();
+    EXPECT_EQ(20, callback->count);
+    EXPECT_EQ(0u, pool.DispatchCallbacks());
+}
+
+TEST(DBWorkersTest, FailedQueryKeepsError)
+{
+    csRef<FakeConnection> conn;
+    conn.AttachNew(new FakeConnection(0));
+
+    psDBWorkerPool pool(conn, conn);
+    ASSERT_TRUE(pool.Start(1));
+
+    csRef<iAsyncQuery> query = pool.Queue(ASYNC_SELECT, NULL, "SELECT * FROM x");
+    query->Wait();
+    EXPECT_FALSE(query->Succeeded());
+    EXPECT_TRUE(query->GetResultSet() == NULL);
+    EXPECT_STREQ("no rows", query->GetError());
+    EXPECT_STREQ("SELECT * FROM x", query->GetQuery());
+}
+
+TEST(DBWorkersTest, BuildsGenericStatements)
+{
+    csRef<FakeConnection> conn;
+    conn.AttachNew(new FakeConnection(0));
+
+    const char* fields[] = { "name", "note" };
+    psStringArray values;
+    values.Push("bob");
+    values.Push(NULL);
+
+    EXPECT_STREQ("INSERT INTO people (name,note) VALUES ('bob',NULL)",
+                 psDBWorkerPool::BuildInsert(conn, "people", fields, values).GetData());
+    EXPECT_STREQ("UPDATE people SET name='bob',note=NULL where id='7'",
+                 psDBWorkerPool::BuildUpdate(conn, "people", "id", "7", fields, values).GetData());
+}
@@ -17,9 +17,12 @@
 *
 */
 #include <psconfig.h>
+#include <math.h>
+#include <string.h>
 
 #include "gameevent.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 #include "net/messages.h"
 #include "eventmanager.h"
@@ -29,13 +32,137 @@
 
 /*---------------------------------------------------------------------------*/
 
+EventTimeHistogram::EventTimeHistogram()
+{
+    Reset();
+}
+
+void EventTimeHistogram::Reset()
+{
+    memset(buckets, 0, sizeof(buckets));
+    count = 0;
+    max = 0;
+}
+
+void EventTimeHistogram::Add(uint32 value)
+{
+    // Bucket i > 0 holds the values from 2^(i-1) to 2^i - 1
+    size_t bucket = 0;
+    for(uint32 v = value; v; v >>= 1)
+    {
+        bucket++;
+    }
+
+    buckets[bucket]++;
+    count++;
+    if(value > max)
+    {
+        max = value;
+    }
+}
+
+void EventTimeHistogram::Merge(const EventTimeHistogram &other)
+{
+    for(size_t i = 0; i < EVENTSTATS_BUCKETS; i++)
+    {
+        buckets[i] += other.buckets[i];
+    }
+    count += other.count;
+    if(other.max > max)
+    {
+        max = other.max;
+    }
+}
+
+uint32 EventTimeHistogram::GetPercentile(float fraction) const
+{
+    uint32 wanted = (uint32)ceilf(count * fraction);
+    uint32 seen = 0;
+
+    for(size_t i = 0; i < EVENTSTATS_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if(seen && seen >= wanted)
+        {
+            uint32 upper = i ? (uint32)((((uint64)1) << i) - 1) : 0;
+            return csMin(upper, max);
+        }
+    }
+    return max;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void EventStatsTable::Add(const char* type, uint32 triggerTime, uint32 lag)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    // Types are nearly always distinct by hash, the names are compared
+    // only to handle a collision.
+    uint32 key = csHashCompute(type);
+    Entry* entry = NULL;
+    csHash<size_t, uint32>::Iterator it(index.GetIterator(key));
+    while(it.HasNext())
+    {
+        Entry &candidate = entries[it.Next()];
+        if(!strcmp(candidate.type, type))
+        {
+            entry = &candidate;
+            break;
+        }
+    }
+
+    if(!entry)
+    {
+        index.Put(key, entries.GetSize());
+        entry = &entries.GetExtend(entries.GetSize());
+        strncpy(entry->type, type, sizeof(entry->type) - 1);
+        entry->type[sizeof(entry->type) - 1] = '\0';
+    }
+
+    entry->stats.triggerTime.Add(triggerTime);
+    entry->stats.lag.Add(lag);
+    entry->stats.total += triggerTime;
+}
+
+void EventStatsTable::MergeInto(csHash<EventTypeStats, csString> &stats)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    for(size_t i = 0; i < entries.GetSize(); i++)
+    {
+        csString type(entries[i].type);
+        EventTypeStats* merged = stats.GetElementPointer(type);
+        if(merged)
+        {
+            merged->Merge(entries[i].stats);
+        }
+        else
+        {
+            stats.Put(type, entries[i].stats);
+        }
+    }
+}
+
+void EventStatsTable::Reset()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    entries.Empty();
+    index.DeleteAll();
+}
+
+/*---------------------------------------------------------------------------*/
+
 EventManager::EventManager()
+    : eventqueue(csGetTicks())
 {
     // Setting up the static pointer in psGameEvent. Used so
     // that an event can be fired without needing to look up 
     // the event manager first.
     lastTick = 0;
     stop = false;
+    statsStart = csGetTicks();
+    statsInterval = 0;
     psGameEvent::eventmanager = this;
 }
 
@@ -44,7 +171,7 @@ EventManager::~EventManager()
     // Clean up the event queue
     while (eventqueue.Length())
     {
-        delete eventqueue.DeleteMin();
+        delete eventqueue.DeleteAny();
     }
 }
 
@@ -72,6 +199,8 @@ void EventManager::Push(psGameEvent *event)
 
 csTicks EventManager::ProcessEventQueue()
 {
+    PS_PROFILE_ZONE("EventManager::ProcessEventQueue");
+
     csTicks now = csGetTicks();
 
     static int lastid;
@@ -86,14 +215,13 @@ csTicks EventManager::ProcessEventQueue()
         {
             CS::Threading::MutexScopedLock lock(mutex);
 
-            event = eventqueue.FindMin();
+            event = eventqueue.DeleteDue(now);
 
-            if (!event || event->triggerticks > now)
+            if (!event)
             {
                 // Empty event queue or not time for event yet
                 break;
             }
-            eventqueue.DeleteMin();
 
             /*check if events arrive in order*/
             if (event->triggerticks < lastTick)
@@ -113,27 +241,8 @@ csTicks EventManager::ProcessEventQueue()
             }
 
         }
-        
 
         events++;
-        csTicks start = csGetTicks();
-
-        if (event->CheckTrigger())
-        {
-            event->Trigger();
-        }
-
-        csTicks timeTaken = csGetTicks() - start;
-
-        if(timeTaken > 1000)
-        {
-            csString status;
-            status.Format("Event type %s:%s has taken %u time to process\n", event->GetType(), 
-                          event->ToString().GetDataSafe(),timeTaken);
-            CPrintf(CON_WARNING, "%s\n", status.GetData());
-            if(LogCSV::GetSingletonPtr())
-                LogCSV::GetSingleton().Write(CSV_STATUS, status);
-        }
 
         if (lastid == event->id)
         {
@@ -142,24 +251,142 @@ csTicks EventManager::ProcessEventQueue()
         lastid    = event->id;
 
         count++;
+
+        TriggerEvent(event);
+
 //        if (count % 100 == 0)
 //        {
 //            CPrintf(CON_DEBUG, "Went through event loop 100 times in one timeslice for %d events.  This means we either have duplicate events, "
 //                "bugs in event generation or bugs in deleting events from the event tree. "
 //                "Last event: %s:%s took %u time\n", events, event->GetType(), event->ToString().GetDataSafe(), timeTaken);
 //        }
+    }
 
-        delete event;
+    if (statsInterval && now - statsStart >= statsInterval)
+    {
+        WriteEventStatsCSV();
+        ResetEventStats();
     }
 
-    if (event)
+    // Report when we would like to be called again, at least
+    // every PROCESS_EVENT ticks.
+    CS::Threading::MutexScopedLock lock(mutex);
+    return eventqueue.NextTrigger(now, PROCESS_EVENT);
+}
+
+void EventManager::TriggerEvent(psGameEvent* event)
+{
+    csTicks now = csGetTicks();
+    csTicks lag = (int32)(now - event->triggerticks) > 0 ? now - event->triggerticks : 0;
+    csMicroTicks start = csGetMicroTicks();
+
+    if (event->CheckTrigger())
+    {
+        event->Trigger();
+    }
+
+    uint32 timeTaken = (uint32)(csGetMicroTicks() - start);
+
+    if(timeTaken > 1000000)
     {
-        // We have a event so report when we would like to be
-        // called again
-        return csMin(event->triggerticks, PROCESS_EVENT + now);
+        csString status;
+        status.Format("Event type %s:%s has taken %u time to process\n", event->GetType(), 
+                      event->ToString().GetDataSafe(), timeTaken / 1000);
+        CPrintf(CON_WARNING, "%s\n", status.GetData());
+        if(LogCSV::GetSingletonPtr())
+            LogCSV::GetSingleton().Write(CSV_STATUS, status);
     }
 
-    return PROCESS_EVENT; // Process events at least every PROCESS_EVENT ticks
+    stats.Add(event->GetType(), timeTaken, lag);
+
+    delete event;
+}
+
+struct EventStatsRow
+{
+    csString type;
+    EventTypeStats stats;
+};
+
+static int CompareEventStatsRows(EventStatsRow const& a, EventStatsRow const& b)
+{
+    // Most expensive first
+    if (a.stats.total == b.stats.total)
+        return 0;
+    return a.stats.total > b.stats.total ? -1 : 1;
+}
+
+void EventManager::GetEventStats(csHash<EventTypeStats, csString> &eventStats)
+{
+    stats.MergeInto(eventStats);
+}
+
+/// Take a copy of the statistics sorted by total trigger time.
+static void GetEventStatsRows(csHash<EventTypeStats, csString> &eventStats, csArray<EventStatsRow> &rows)
+{
+    csHash<EventTypeStats, csString>::GlobalIterator it(eventStats.GetIterator());
+    while (it.HasNext())
+    {
+        EventStatsRow row;
+        row.stats = it.Next(row.type);
+        rows.Push(row);
+    }
+    rows.Sort(CompareEventStatsRows);
+}
+
+csString EventManager::DumpEventStats()
+{
+    csHash<EventTypeStats, csString> eventStats;
+    GetEventStats(eventStats);
+    csTicks since = csGetTicks() - statsStart;
+
+    csArray<EventStatsRow> rows;
+    GetEventStatsRows(eventStats, rows);
+
+    csString dump;
+    dump.Format("Events triggered in the last %u seconds. Trigger times in us, lag in ms:\n", since / 1000);
+    dump.AppendFmt("%-32s %8s %10s %8s %8s %8s %8s %8s %8s\n", "Type", "Count", "Total ms",
+                   "p50", "p99", "max", "lag p50", "lag p99", "lag max");
+    for (size_t i = 0; i < rows.GetSize(); i++)
+    {
+        const EventTypeStats &stats = rows[i].stats;
+        dump.AppendFmt("%-32s %8u %10u %8u %8u %8u %8u %8u %8u\n", rows[i].type.GetData(),
+                       stats.triggerTime.GetCount(), (uint32)(stats.total / 1000),
+                       stats.triggerTime.GetPercentile(0.5f), stats.triggerTime.GetPercentile(0.99f),
+                       stats.triggerTime.GetMax(), stats.lag.GetPercentile(0.5f),
+                       stats.lag.GetPercentile(0.99f), stats.lag.GetMax());
+    }
+    return dump;
+}
+
+void EventManager::ResetEventStats()
+{
+    stats.Reset();
+    statsStart = csGetTicks();
+}
+
+void EventManager::WriteEventStatsCSV()
+{
+    if(!LogCSV::GetSingletonPtr())
+        return;
+
+    csHash<EventTypeStats, csString> eventStats;
+    GetEventStats(eventStats);
+
+    csArray<EventStatsRow> rows;
+    GetEventStatsRows(eventStats, rows);
+
+    for (size_t i = 0; i < rows.GetSize(); i++)
+    {
+        const EventTypeStats &stats = rows[i].stats;
+        csString line;
+        line.Format("%s, %u, %llu, %u, %u, %u, %u, %u, %u", rows[i].type.GetData(),
+                    stats.triggerTime.GetCount(), (unsigned long long)stats.total,
+                    stats.triggerTime.GetPercentile(0.5f), stats.triggerTime.GetPercentile(0.99f),
+                    stats.triggerTime.GetMax(), stats.lag.GetPercentile(0.5f),
+                    stats.lag.GetPercentile(0.99f), stats.lag.GetMax());
+        LogCSV::GetSingleton().Write(CSV_EVENTS, line);
+    }
 }
 
 void EventManager::TrackEventTimes(csTicks timeTaken,MsgEntry *msg)
@@ -204,6 +431,8 @@ void EventManager::Run ()
 {
     csRef<MsgEntry> msg = 0;
 
+    psZoneProfiler::SetThreadName("EventManager");
+
     csTicks nextEvent = csGetTicks() + PROCESS_EVENT;
 
     while (!stop)
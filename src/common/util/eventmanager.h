@@ -20,7 +20,10 @@
 #ifndef __EVENTMANAGER_H__
 #define __EVENTMANAGER_H__
 
-#include "util/heap.h"
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+
+#include "util/timerwheel.h"
 #include "net/msghandler.h"
 
 class psGameEvent;
@@ -30,6 +33,89 @@ class MsgHandler;
  * \addtogroup common_util
  * @{ */
 
+/// Number of buckets of a EventTimeHistogram, enough for any 32 bit value.
+#define EVENTSTATS_BUCKETS  33
+
+/**
+ * Histogram of times with power of two sized buckets. Percentiles are
+ * reported as the upper bound of the bucket they fall in, so they are
+ * at most twice the real value.
+ */
+class EventTimeHistogram
+{
+public:
+    EventTimeHistogram();
+
+    void Reset();
+
+    void Add(uint32 value);
+
+    /// Add all values of another histogram.
+    void Merge(const EventTimeHistogram &other);
+
+    /// Get a value that the given fraction of the added values does not exceed.
+    uint32 GetPercentile(float fraction) const;
+
+    uint32 GetCount() const
+    {
+        return count;
+    }
+
+    uint32 GetMax() const
+    {
+        return max;
+    }
+
+protected:
+    uint32 buckets[EVENTSTATS_BUCKETS];
+    uint32 count;
+    uint32 max;
+};
+
+/// Statistics of all events of one type.
+struct EventTypeStats
+{
+    EventTypeStats() : total(0) {}
+
+    void Merge(const EventTypeStats &other)
+    {
+        triggerTime.Merge(other.triggerTime);
+        lag.Merge(other.lag);
+        total += other.total;
+    }
+
+    EventTimeHistogram triggerTime;  ///< Microseconds taken by CheckTrigger and Trigger.
+    EventTimeHistogram lag;          ///< Ticks between the trigger time and the actual trigger.
+    uint64 total;                    ///< Total microseconds taken.
+};
+
+/**
+ * Statistics by event type. Adding a event does not build any strings and
+ * the lock is only contended while the statistics are dumped or reset.
+ */
+class EventStatsTable
+{
+public:
+    /// Count a triggered event of the given type.
+    void Add(const char* type, uint32 triggerTime, uint32 lag);
+
+    /// Add the statistics to a table by type name.
+    void MergeInto(csHash<EventTypeStats, csString> &stats);
+
+    void Reset();
+
+protected:
+    struct Entry
+    {
+        char type[32];
+        EventTypeStats stats;
+    };
+
+    CS::Threading::Mutex mutex;
+    csArray<Entry> entries;
+    csHash<size_t, uint32> index;    ///< Entries by the hash of their type.
+};
+
 /**
  * This class handles all queueing and invoking of timed events, such as
  * combat, spells, NPC dialog responses, range weapons, or NPC respawning.
@@ -41,16 +127,34 @@ class EventManager : public MsgHandler, public Singleton<EventManager>
 {
 protected:
     CS::Threading::Mutex mutex;
-    Heap<psGameEvent> eventqueue;
+    TimerWheel<psGameEvent> eventqueue;
 
     csTicks lastTick;
 
+    /// Statistics of the events triggered.
+    EventStatsTable stats;
+    csTicks statsStart;           ///< When the statistics were last reset.
+    csTicks statsInterval;        ///< Ticks between CSV dumps, 0 to disable.
+
     /// A flag indicating the server is shutting down.
     bool stop;
     
 	/// Helper function to keep a running average of the last 50 events.
 	void TrackEventTimes(csTicks timeTaken,MsgEntry *msg);
 
+    /**
+     * Trigger a event that is due, track the time it takes and delete it.
+     *
+     * @param event The event to trigger.
+     */
+    void TriggerEvent(psGameEvent* event);
+
+    /// Get the statistics by event type.
+    void GetEventStats(csHash<EventTypeStats, csString> &stats);
+
+    /// Write the statistics of each event type to the events CSV log.
+    void WriteEventStatsCSV();
+
 public:
     EventManager();
     virtual ~EventManager();
@@ -67,6 +171,26 @@ public:
     /// Check Event Queue for scheduled events which are due
     csTicks ProcessEventQueue();
 
+    /**
+     * Get a table of the number, trigger times and lag of the events
+     * triggered since the last reset, by event type.
+     */
+    csString DumpEventStats();
+
+    /// Clear the event statistics.
+    void ResetEventStats();
+
+    /**
+     * Set how often the event statistics are written to the events CSV
+     * log and reset.
+     *
+     * @param interval Ticks between dumps, 0 to never dump them.
+     */
+    void SetEventStatsInterval(csTicks interval)
+    {
+        statsInterval = interval;
+    }
+
     /// Allows sending of a message not immediately, but after a short delay
     virtual void SendMessageDelayed(MsgEntry *msg,csTicks msecDelay);
 };
@@ -0,0 +1,146 @@
+/*
+ * fakeconnection_unittest.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Database connection for the tests of the code using one.
+ *
+ */
+
+#ifndef __FAKECONNECTION_UNITTEST_H__
+#define __FAKECONNECTION_UNITTEST_H__
+
+#include <stdarg.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/scf_implementation.h>
+#include <csutil/stringarray.h>
+#include <csutil/threading/atomicops.h>
+#include <csutil/threading/mutex.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include <idal.h>
+#include "util/dbworkers.h"
+
+/// Commands run by all connections of a test, in order.
+struct CommandLog
+{
+    CS::Threading::Mutex mutex;
+    csStringArray commands;
+
+    size_t GetSize()
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        return commands.GetSize();
+    }
+
+    csString Get(size_t i)
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        return commands[i];
+    }
+};
+
+/**
+ * Connection that runs nothing. Commands containing "bad" fail, the others
+ * affect one row. Inserts get the id of the connection and selects fail,
+ * as there are no rows. With a log the commands are recorded, prefixed by
+ * "thread: " for the connections opened by Connect().
+ */
+class FakeConnection : public scfImplementation1<FakeConnection, iDataConnection>, public psDBConnector
+{
+public:
+    FakeConnection(int id, CommandLog* log = NULL, const char* prefix = "")
+        : scfImplementationType(this), id(id), connections(0), commands(0), log(log), prefix(prefix) {}
+
+    // psDBConnector
+    virtual csPtr<iDataConnection> Connect()
+    {
+        int next = CS::Threading::AtomicOperations::Increment(&connections);
+        return csPtr<iDataConnection>(new FakeConnection(next, log, "thread: "));
+    }
+    virtual void EndThread() {}
+
+    // iDataConnection
+    virtual int IsValid() { return 1; }
+    virtual bool Initialize(const char*, unsigned int, const char*, const char*, const char*, LogCSV*) { return true; }
+    virtual bool Close() { return true; }
+    virtual void Escape(csString& to, const char *from) { to = from; }
+    virtual iResultSet *Select(const char*, ...) { error = "no rows"; return NULL; }
+    virtual int SelectSingleNumber(const char*, ...) { return 0; }
+
+    virtual unsigned long Command(const char* sql, ...)
+    {
+        csString command;
+        va_list args;
+        va_start(args, sql);
+        command.FormatV(sql, args);
+        va_end(args);
+
+        commands++;
+        if(log)
+        {
+            CS::Threading::MutexScopedLock lock(log->mutex);
+            log->commands.Push(prefix + command);
+        }
+
+        if(command.Find("bad") != (size_t)-1)
+        {
+            error = "bad command";
+            return QUERY_FAILED;
+        }
+        return 1;
+    }
+
+    virtual unsigned long CommandPump(const char*, ...) { return 1; }
+    virtual uint64 GenericInsertWithID(const char*, const char**, psStringArray&) { return 0; }
+    virtual bool GenericUpdateWithID(const char*, const char*, const char*, const char**, psStringArray&) { return true; }
+    virtual const char *GetLastError() { return error; }
+    virtual const char *GetLastQuery() { return ""; }
+    virtual uint64 GetLastInsertID() { return id; }
+    virtual const char *uint64tostring(uint64, csString& recv) { return recv; }
+    virtual const char* DumpProfile() { return ""; }
+    virtual void ResetProfile() {}
+    virtual iRecord* NewUpdatePreparedStatement(const char*, const char*, unsigned int, const char*, unsigned int) { return NULL; }
+    virtual iRecord* NewInsertPreparedStatement(const char*, unsigned int, const char*, unsigned int) { return NULL; }
+    virtual bool StartWorkers(size_t) { return false; }
+    virtual void StopWorkers() {}
+    virtual csPtr<iAsyncQuery> SelectAsync(iAsyncQueryCallback*, const char*, ...) { return csPtr<iAsyncQuery>(NULL); }
+    virtual csPtr<iAsyncQuery> CommandAsync(iAsyncQueryCallback*, const char*, ...) { return csPtr<iAsyncQuery>(NULL); }
+    virtual csPtr<iAsyncQuery> GenericInsertWithIDAsync(iAsyncQueryCallback*, const char*, const char**, psStringArray&)
+    {
+        return csPtr<iAsyncQuery>(NULL);
+    }
+    virtual csPtr<iAsyncQuery> GenericUpdateWithIDAsync(iAsyncQueryCallback*, const char*, const char*, const char*,
+                                                        const char**, psStringArray&)
+    {
+        return csPtr<iAsyncQuery>(NULL);
+    }
+    virtual size_t DispatchCallbacks() { return 0; }
+    virtual bool GetTableChecksum(const char*, uint64&) { return false; }
+
+    int id;
+    int32 connections;
+    int commands;
+    csString error;
+    CommandLog* log;
+    csString prefix;
+};
+
+#endif
@@ -361,6 +361,9 @@ LogCSV::LogCSV(iConfigManager* configmanager, iVFS* vfs)
                                                                              " PosZ, Direction\n");
     logs[CSV_SQL] = std::make_pair(configmanager->GetStr("PlaneShift.LogCSV.File.SQL"),
                                      "Date/Time, Query, Time taken");
+    logs[CSV_EVENTS] = std::make_pair(configmanager->GetStr("PlaneShift.LogCSV.File.Events"),
+                                      "Date/Time, Event type, Count, Total us, p50 us, p99 us, Max us,"
+                                      " Lag p50 ms, Lag p99 ms, Lag max ms\n");
 
     for(int i = 0;i < MAX_CSV;i++)
     {
@@ -157,6 +157,7 @@ enum
     CSV_ECONOMY,
     CSV_STUCK,
     CSV_SQL,
+    CSV_EVENTS,
     MAX_CSV
 };
 
@@ -38,6 +38,7 @@
 
 #include "util/mathscript.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 //support for limited compilers
 #ifdef _MSC_VER
@@ -431,7 +432,495 @@ double MathStatement::Evaluate(MathEnvironment *env) const
 
 //----------------------------------------------------------------------------
 
+/**
+ * A MathScript compiled into one list of instructions. The blocks of if,
+ * else and while become jumps, and every variable of the script becomes
+ * a slot, so running it looks up each variable once per run instead of
+ * once per line it's used in.
+ *
+ * The flat arrays a run keeps its slots in are reused from a pool. Like
+ * the parsers of its lines, a program must not run in several threads at
+ * once; it may run again from within itself though, e.g. through a
+ * method of a scriptable object.
+ */
+class MathProgram
+{
+public:
+    /// Compile a parsed script, returns NULL if its blocks are not as expected.
+    static MathProgram* Compile(const MathScript* script);
+
+    ~MathProgram();
+
+    /// Run the program, same as MathScript::Interpret.
+    double Run(MathEnvironment* env) const;
+
+protected:
+    enum Opcode
+    {
+        OP_EVAL,        // evaluate the expression
+        OP_ASSIGN,      // evaluate the expression and assign it to the slot
+        OP_JUMP,        // go to the target
+        OP_JUMP_IF_NOT, // go to the target if the expression is 0
+        OP_RETURN       // end the block, go to the target, or to negTarget if negative
+    };
+
+    struct Instruction
+    {
+        Opcode op;
+        const MathExpression* exp;
+        size_t slot;
+        size_t target;
+        size_t negTarget;
+        bool result;                 ///< a return to target gives the result of the script
+        bool negResult;              ///< a return to negTarget gives the result of the script
+
+        // The operands of the expression, in the order of its parser
+        size_t firstVar, varCount;   ///< in varSlots
+        size_t firstObj, objCount;   ///< in objSlots
+        size_t firstProp, propCount; ///< in props
+    };
+
+    struct Property
+    {
+        size_t slot;      ///< of the object
+        const char* name;
+    };
+
+    /// The slots of one run.
+    struct Frame
+    {
+        MathEnvironment* env;
+        csArray<MathVar*> vars;            ///< NULL until looked up
+        csArray<iScriptableVar*> objects;  ///< resolved objects
+        csArray<double> objectValues;      ///< the variable values they were resolved from
+        csArray<double> args;              ///< arguments for the parser of a line
+    };
+
+    MathProgram() : exitSlot(0), maxArgs(0) {}
+
+    size_t GetSlot(const csString& name);
+    size_t NewLabel();
+    void SetLabel(size_t label);
+    void Emit(Opcode op, const MathExpression* exp, size_t target = 0, size_t negTarget = 0, size_t slot = 0);
+
+    /**
+     * Compile the lines of a block the way MathScript::Interpret runs them.
+     *
+     * @param block     The block.
+     * @param endLabel  Where a return of a value that is not negative goes.
+     * @param negLabel  Where a return of a negative value goes.
+     * @param endResult Whether a return to endLabel is the result of the script.
+     * @param negResult Whether a return to negLabel is the result of the script.
+     */
+    bool CompileBlock(const MathScript* block, size_t endLabel, size_t negLabel, bool endResult, bool negResult);
+
+    Frame* AllocFrame() const;
+    void FreeFrame(Frame* frame) const;
+
+    MathVar* Bind(Frame* frame, size_t slot) const;
+    void Store(Frame* frame, size_t slot, double value) const;
+    iScriptableVar* GetObject(Frame* frame, size_t slot, const MathExpression* exp) const;
+    double Evaluate(const Instruction& in, Frame* frame) const;
+
+    csArray<Instruction> code;
+    csArray<size_t> varSlots;
+    csArray<size_t> objSlots;
+    csArray<Property> props;
+    csArray<size_t> labels;              ///< position of each label, while compiling
+
+    csArray<csString> names;             ///< of the slots
+    csHash<size_t, csString> slotIndex;  ///< name to slot
+    size_t exitSlot;
+    size_t maxArgs;
+
+    mutable csArray<Frame*> frames;      ///< pool of unused frames
+};
+
+MathProgram::~MathProgram()
+{
+    for(size_t i = 0; i < frames.GetSize(); i++)
+    {
+        delete frames[i];
+    }
+}
+
+MathProgram* MathProgram::Compile(const MathScript* script)
+{
+    MathProgram* program = new MathProgram;
+    program->exitSlot = program->GetSlot("exit");
+
+    size_t end = program->NewLabel();
+    if(!program->CompileBlock(script, end, end, true, true))
+    {
+        delete program;
+        return NULL;
+    }
+    program->SetLabel(end);
+
+    // Labels become positions
+    for(size_t i = 0; i < program->code.GetSize(); i++)
+    {
+        Instruction& in = program->code[i];
+        in.target = program->labels[in.target];
+        in.negTarget = program->labels[in.negTarget];
+    }
+    program->labels.DeleteAll();
+
+    return program;
+}
+
+size_t MathProgram::GetSlot(const csString& name)
+{
+    size_t* slot = slotIndex.GetElementPointer(name);
+    if(slot)
+        return *slot;
+
+    size_t index = names.Push(name);
+    slotIndex.Put(name, index);
+    return index;
+}
+
+size_t MathProgram::NewLabel()
+{
+    return labels.Push(0);
+}
+
+void MathProgram::SetLabel(size_t label)
+{
+    labels[label] = code.GetSize();
+}
+
+void MathProgram::Emit(Opcode op, const MathExpression* exp, size_t target, size_t negTarget, size_t slot)
+{
+    Instruction in;
+    in.op = op;
+    in.exp = exp;
+    in.slot = slot;
+    in.target = target;
+    in.negTarget = negTarget;
+    in.result = false;
+    in.negResult = false;
+    in.firstVar = varSlots.GetSize();
+    in.firstObj = objSlots.GetSize();
+    in.firstProp = props.GetSize();
+
+    if(exp)
+    {
+        // Same order as the variables given to the parser in MathExpression::Parse
+        csSet<csString>::GlobalIterator it(exp->requiredVars.GetIterator());
+        while(it.HasNext())
+        {
+            varSlots.Push(GetSlot(it.Next()));
+        }
+
+        it = exp->requiredObjs.GetIterator();
+        while(it.HasNext())
+        {
+            objSlots.Push(GetSlot(it.Next()));
+        }
+
+        csSet<MathExpression::PropertyRef>::GlobalIterator propIt(exp->propertyRefs.GetIterator());
+        while(propIt.HasNext())
+        {
+            const MathExpression::PropertyRef& ref = propIt.Next();
+            Property prop = { GetSlot(ref.object), ref.property.GetData() };
+            props.Push(prop);
+        }
+    }
+
+    in.varCount = varSlots.GetSize() - in.firstVar;
+    in.objCount = objSlots.GetSize() - in.firstObj;
+    in.propCount = props.GetSize() - in.firstProp;
+    maxArgs = csMax(maxArgs, in.varCount + in.propCount);
+
+    code.Push(in);
+}
+
+bool MathProgram::CompileBlock(const MathScript* block, size_t endLabel, size_t negLabel, bool endResult,
+                               bool negResult)
+{
+    const csArray<MathExpression*>& lines = block->scriptLines;
+    for(size_t i = 0; i < lines.GetSize(); i++)
+    {
+        const MathExpression* s = lines[i];
+        size_t op = s->GetOpcode();
+
+        // "do { }" and "while { }"
+        if(op & MathExpression::MATH_LOOP)
+        {
+            if(i + 1 >= lines.GetSize() || !lines[i+1]->IsScript())
+                return false;
+
+            size_t head = NewLabel();
+            size_t next = NewLabel();
+            size_t done = NewLabel();
+
+            SetLabel(head);
+            if(op & MathExpression::MATH_EXP)
+                Emit(OP_JUMP_IF_NOT, s, done);
+
+            // A negative return breaks the loop, any other ends the iteration
+            if(!CompileBlock(static_cast<const MathScript*>(lines[i+1]), next, done, false, false))
+                return false;
+            SetLabel(next);
+            Emit(OP_JUMP, NULL, head);
+            SetLabel(done);
+
+            i++;
+        }
+        // "return x;"
+        else if(op & MathExpression::MATH_BREAK)
+        {
+            Emit(OP_RETURN, s, endLabel, negLabel);
+            code.Top().result = endResult;
+            code.Top().negResult = negResult;
+        }
+        // "if { } [ else { } ]"
+        else if(op == MathExpression::MATH_IF)
+        {
+            bool hasElse = i + 3 < lines.GetSize() && lines[i+2]->GetOpcode() == MathExpression::MATH_ELSE;
+            if(i + 1 >= lines.GetSize() || !lines[i+1]->IsScript() || (hasElse && !lines[i+3]->IsScript()))
+                return false;
+
+            size_t otherwise = NewLabel();
+            size_t done = NewLabel();
+
+            // A negative return ends the enclosing block too
+            Emit(OP_JUMP_IF_NOT, s, otherwise);
+            if(!CompileBlock(static_cast<const MathScript*>(lines[i+1]), done, negLabel, false, negResult))
+                return false;
+
+            if(hasElse)
+            {
+                Emit(OP_JUMP, NULL, done);
+                SetLabel(otherwise);
+                if(!CompileBlock(static_cast<const MathScript*>(lines[i+3]), done, negLabel, false, negResult))
+                    return false;
+                i += 3;
+            }
+            else
+            {
+                SetLabel(otherwise);
+                i++;
+            }
+            SetLabel(done);
+        }
+        // regular expressions, assignments and plain blocks
+        else if(op & MathExpression::MATH_EXP)
+        {
+            if(s->IsScript())
+            {
+                // Whatever it returns is ignored
+                size_t done = NewLabel();
+                if(!CompileBlock(static_cast<const MathScript*>(s), done, done, false, false))
+                    return false;
+                SetLabel(done);
+            }
+            else if(op & MathExpression::MATH_ASSIGN)
+            {
+                Emit(OP_ASSIGN, s, 0, 0, GetSlot(static_cast<const MathStatement*>(s)->assignee));
+            }
+            else
+            {
+                Emit(OP_EVAL, s);
+            }
+        }
+    }
+    return true;
+}
+
+MathProgram::Frame* MathProgram::AllocFrame() const
+{
+    Frame* frame;
+    if(frames.IsEmpty())
+    {
+        frame = new Frame;
+        frame->vars.SetSize(names.GetSize());
+        frame->objects.SetSize(names.GetSize());
+        frame->objectValues.SetSize(names.GetSize());
+        frame->args.SetSize(maxArgs + 1);
+    }
+    else
+    {
+        frame = frames.Pop();
+    }
+
+    for(size_t i = 0; i < names.GetSize(); i++)
+    {
+        frame->vars[i] = NULL;
+        frame->objects[i] = NULL;
+        frame->objectValues[i] = 0.0;
+    }
+    return frame;
+}
+
+void MathProgram::FreeFrame(Frame* frame) const
+{
+    frames.Push(frame);
+}
+
+MathVar* MathProgram::Bind(Frame* frame, size_t slot) const
+{
+    // Variables missing now may be defined later in the run
+    MathVar* var = frame->vars[slot];
+    if(!var)
+    {
+        var = frame->env->Lookup(names[slot]);
+        frame->vars[slot] = var;
+    }
+    return var;
+}
+
+void MathProgram::Store(Frame* frame, size_t slot, double value) const
+{
+    MathVar* var = Bind(frame, slot);
+    if(var)
+    {
+        var->SetValue(value);
+    }
+    else
+    {
+        frame->env->Define(names[slot], value);
+        frame->vars[slot] = frame->env->Lookup(names[slot]);
+    }
+}
+
+iScriptableVar* MathProgram::GetObject(Frame* frame, size_t slot, const MathExpression* exp) const
+{
+    MathVar* var = frame->vars[slot];
+    CS_ASSERT(var); // bound as part of requiredVars
+
+    // Only resolve the object again if the variable changed
+    double value = var->GetValue();
+    if(memcmp(&value, &frame->objectValues[slot], sizeof(double)) != 0)
+    {
+        if(var->Type() != VARTYPE_OBJ) // invalid type
+        {
+            csString msg;
+            msg.Format("Error in >%s<: Type inference requires >%s< to be an iScriptableVar, but it isn't.", exp->name, names[slot].GetData());
+            CS_ASSERT_MSG(msg.GetData(),false);
+            Error2("%s",msg.GetData());
+            return NULL;
+        }
+
+        frame->objects[slot] = var->GetObject();
+        frame->objectValues[slot] = value;
+    }
+
+    if(!frame->objects[slot]) // invalid object
+    {
+        csString msg;
+        msg.Format("Error in >%s<: Given a NULL iScriptableVar* for >%s<.", exp->name, names[slot].GetData());
+        CS_ASSERT_MSG(msg.GetData(),false);
+        Error2("%s",msg.GetData());
+    }
+    return frame->objects[slot];
+}
+
+double MathProgram::Evaluate(const Instruction& in, Frame* frame) const
+{
+    const MathExpression* exp = in.exp;
+    double* args = frame->args.GetArray();
+
+    for(size_t i = 0; i < in.varCount; i++)
+    {
+        size_t slot = varSlots[in.firstVar + i];
+        MathVar* var = Bind(frame, slot);
+        if(!var) // invalid variable
+        {
+            csString msg;
+            msg.Format("Error in >%s<: Required variable >%s< not supplied in environment.", exp->name, names[slot].GetData());
+            CS_ASSERT_MSG(msg.GetData(),false);
+            Error2("%s",msg.GetData());
+            return 0.0;
+        }
+        args[i] = var->GetValue();
+    }
+
+    for(size_t i = 0; i < in.objCount; i++)
+    {
+        if(!GetObject(frame, objSlots[in.firstObj + i], exp))
+            return 0.0;
+    }
+
+    for(size_t i = 0; i < in.propCount; i++)
+    {
+        const Property& prop = props[in.firstProp + i];
+        args[in.varCount + i] = frame->objects[prop.slot]->GetProperty(frame->env, prop.name);
+    }
+
+    return exp->fp.Eval(args);
+}
+
+double MathProgram::Run(MathEnvironment* env) const
+{
+    Frame* frame = AllocFrame();
+    frame->env = env;
+
+    // clear exit condition before running, creating it if it doesn't exist
+    Store(frame, exitSlot, 0.0);
+    MathVar* exitsignal = frame->vars[exitSlot];
+
+    const size_t end = code.GetSize();
+    double result = 0.0;
+    size_t pc = 0;
+    while(pc < end)
+    {
+        const Instruction& in = code[pc];
+        switch(in.op)
+        {
+            case OP_EVAL:
+                Evaluate(in, frame);
+                pc = exitsignal->GetValue() != 0.0 ? end : pc + 1;
+                break;
+
+            case OP_ASSIGN:
+                Store(frame, in.slot, Evaluate(in, frame));
+                pc = exitsignal->GetValue() != 0.0 ? end : pc + 1;
+                break;
+
+            case OP_JUMP:
+                pc = in.target;
+                break;
+
+            case OP_JUMP_IF_NOT:
+                pc = Evaluate(in, frame) ? pc + 1 : in.target;
+                break;
+
+            case OP_RETURN:
+            {
+                double value = Evaluate(in, frame);
+                bool negative = value < 0;
+                if(negative ? in.negResult : in.result)
+                    result = value;
+                pc = negative ? in.negTarget : in.target;
+                break;
+            }
+        }
+    }
+
+    FreeFrame(frame);
+    return result;
+}
+
+//----------------------------------------------------------------------------
+
 MathScript* MathScript::Create(const char *name, const csString & script)
+{
+    MathScript* s = CreateBlock(name, script);
+    if (s)
+    {
+        s->zoneName = psZoneProfiler::Intern(name);
+        s->program = MathProgram::Compile(s);
+        if (!s->program)
+        {
+            Error2("Failed to compile MathScript >%s<, it will be interpreted.", name);
+        }
+    }
+    return s;
+}
+
+MathScript* MathScript::CreateBlock(const char *name, const csString & script)
 {
     MathScript* s = new MathScript(name);
 
@@ -575,7 +1064,7 @@ MathScript* MathScript::Create(const char *name, const csString & script)
                 nextBlockStart = script.FindFirst('{', nextBlockStart);
             }
 
-            st = MathScript::Create(name, script.Slice(blockStart, blockEnd - blockStart));
+            st = MathScript::CreateBlock(name, script.Slice(blockStart, blockEnd - blockStart));
             if (!st)
             {
                 Error3("Failed to create MathScript >%s<. "
@@ -626,6 +1115,7 @@ void MathScript::Destroy(MathScript* &mathScript)
 
 MathScript::~MathScript()
 {
+    delete program;
     while (scriptLines.GetSize())
     {
         delete scriptLines.Pop();
@@ -635,10 +1125,24 @@ MathScript::~MathScript()
 void MathScript::CopyAndDestroy(MathScript* other)
 {
     other->scriptLines.TransferTo(scriptLines);
+
+    delete program;
+    program = other->program;
+    other->program = NULL;
     delete other;
 }
 
 double MathScript::Evaluate(MathEnvironment *env) const
+{
+    PS_PROFILE_ZONE(zoneName);
+
+    if (program)
+        return program->Run(env);
+
+    return Interpret(env);
+}
+
+double MathScript::Interpret(MathEnvironment *env) const
 {
     MathVar *exitsignal = env->Lookup("exit");
     if (exitsignal)
@@ -35,6 +35,7 @@ double round(double value);
 
 class MathScript;
 class MathVar;
+class MathProgram;
 struct iDataConnection;
 
 /**
@@ -351,6 +352,12 @@ protected:
 
     bool Parse(const char *expression);
 
+    /// Is this a block of lines, i.e. a MathScript?
+    virtual bool IsScript() const
+    {
+        return false;
+    }
+
     struct PropertyRef
     {
         csString object; // name of the object this property refers to
@@ -376,6 +383,8 @@ protected:
 
     const char *name; // used for debugging
 
+    friend class MathProgram;
+
 public:
     virtual ~MathExpression() {} /// Empty destructor
     static MathExpression* Create(const char *expression, const char *name = "");
@@ -408,6 +417,8 @@ protected:
 
     csString assignee; ///< variable the result will be assinged to
 
+    friend class MathProgram;
+
 public:
     static MathStatement* Create(const csString & expression, const char *name);
     double Evaluate(MathEnvironment *env) const;
@@ -438,13 +449,29 @@ public:
  *  in the form of:  \<var\> = \<formula\>.  When
  *  it parses, it makes a hashmap of all the variables
  *  for quick access.
+ *
+ *  Once parsed, the script is compiled into a MathProgram, which runs
+ *  all lines and blocks as one list of instructions and binds each
+ *  variable once per run instead of looking it up for every line.
  */
 class MathScript : private MathExpression
 {
 protected:
-    MathScript(const char *name) : name(name) { } // may only be constructed using MathScript::Create
+    MathScript(const char *name) : name(name), program(NULL), zoneName("MathScript") { } // may only be constructed using MathScript::Create
     csString name;
     csArray<MathExpression*> scriptLines;
+    MathProgram* program; ///< the compiled script, NULL for blocks
+    const char* zoneName; ///< the name of the script in the zone profiler
+
+    /// Parse a script or a block of one, without compiling it.
+    static MathScript* CreateBlock(const char *name, const csString & script);
+
+    bool IsScript() const
+    {
+        return true;
+    }
+
+    friend class MathProgram;
 
 public:
     static MathScript* Create(const char *name, const csString & script);
@@ -459,7 +486,15 @@ public:
 
     void CopyAndDestroy(MathScript* other);
 
+    /// Run the compiled program, or interpret the lines if there is none.
     double Evaluate(MathEnvironment *env) const;
+
+    /**
+     * Run the lines one by one, looking up their variables by name.
+     * This is how blocks are run, and how scripts were run before they
+     * were compiled, so it's kept as a reference for the program.
+     */
+    double Interpret(MathEnvironment *env) const;
 };
 
 /** @} */
@@ -18,6 +18,7 @@
  */
 
 #include <psconfig.h>
+#include <csutil/sysfunc.h>
 
 //=============================================================================
 // Project Includes
@@ -75,21 +76,21 @@ TEST(MathScriptTest, BasicScript)
 class Foo : public iScriptableVar
 {
 public:
-    virtual double GetProperty(const char *prop)
+    virtual double GetProperty(MathEnvironment* /*env*/, const char *prop)
     {
         if (strcmp(prop, "TheAnswer") == 0)
             return 42;
 
         return 0.0;
     }
-    virtual double CalcFunction(const char *function, const double *params)
+    virtual double CalcFunction(MathEnvironment* env, const char *function, const double *params)
     {
         if (strcmp(function, "Multiply") == 0)
             return params[0]*params[1];
 
         if (strcmp(function, "GetSkillRank") == 0)
         {
-            csString skill(MathScriptEngine::GetString(params[0]));
+            csString skill(env->GetString(params[0]));
             if (skill == "Lah'ar")
                 return 77;
             if (skill == "Sword")
@@ -370,3 +371,171 @@ TEST(MathScriptTest, RandomGenTest)
    randomgentest(0);  //should always be 0 :)
    //randomgentest(-1); //this will test rnd(), which should limit at 1, but is NOT IMPLEMENTED
 }
+
+/**
+ * Run a script compiled and interpreted, each in its own environment,
+ * and check both end with the same variables.
+ */
+static void ExpectSameAsInterpreted(MathScript* script, const char* const* vars, double expectedResult)
+{
+    Foo foo;
+    MathEnvironment compiled;
+    MathEnvironment interpreted;
+    compiled.Define("Quux", &foo);
+    interpreted.Define("Quux", &foo);
+
+    EXPECT_EQ(expectedResult, script->Evaluate(&compiled));
+    EXPECT_EQ(expectedResult, script->Interpret(&interpreted));
+
+    for (size_t i = 0; vars[i]; i++)
+    {
+        MathVar* c = compiled.Lookup(vars[i]);
+        MathVar* in = interpreted.Lookup(vars[i]);
+        ASSERT_EQ(c == NULL, in == NULL) << vars[i];
+        if (c)
+            EXPECT_EQ(in->GetValue(), c->GetValue()) << vars[i];
+    }
+}
+
+TEST(MathScriptTest, CompiledLoopAndElse)
+{
+    MathScript *script = MathScript::Create("CompiledLoopAndElse", "\
+        X = 0;\
+        Y = 0;\
+        while(X < 5)\
+        {\
+            X = X + 1;\
+            if(X = 3) { Y = Y + 10; } else { Y = Y + 1; }\
+        }\
+        Z = Quux:Multiply(X, Y);\
+    ");
+    ASSERT_NE(script, NULL);
+
+    MathEnvironment env;
+    Foo foo;
+    env.Define("Quux", &foo);
+    script->Evaluate(&env);
+    EXPECT_EQ(5, env.Lookup("X")->GetValue());
+    EXPECT_EQ(14, env.Lookup("Y")->GetValue());
+    EXPECT_EQ(70, env.Lookup("Z")->GetValue());
+
+    const char* vars[] = { "X", "Y", "Z", "exit", NULL };
+    ExpectSameAsInterpreted(script, vars, 0);
+    MathScript::Destroy(script);
+}
+
+TEST(MathScriptTest, CompiledExit)
+{
+    MathScript *script = MathScript::Create("CompiledExit", "A = 1; if(A) { exit = 1; } B = 2;");
+    ASSERT_NE(script, NULL);
+
+    const char* vars[] = { "A", "B", "exit", NULL };
+    ExpectSameAsInterpreted(script, vars, 0);
+
+    // exit is cleared before each run
+    MathEnvironment env;
+    env.Define("exit", 1.0);
+    script->Evaluate(&env);
+    EXPECT_EQ(1, env.Lookup("A")->GetValue());
+    EXPECT_EQ(NULL, env.Lookup("B"));
+    MathScript::Destroy(script);
+}
+
+TEST(MathScriptTest, CompiledReturn)
+{
+    // A negative return breaks the loop, any other ends the block only
+    MathScript *script = MathScript::Create("CompiledReturn", "\
+        X = 0;\
+        while(1) { X = X + 1; if(X > 2) { return -1; } }\
+        if(1) { return 5; }\
+        Y = X;\
+        return Y + 4;\
+        Z = 1;\
+    ");
+    ASSERT_NE(script, NULL);
+
+    const char* vars[] = { "X", "Y", "Z", NULL };
+    ExpectSameAsInterpreted(script, vars, 7);
+
+    MathEnvironment env;
+    EXPECT_EQ(7, script->Evaluate(&env));
+    EXPECT_EQ(3, env.Lookup("Y")->GetValue());
+    EXPECT_EQ(NULL, env.Lookup("Z"));
+    MathScript::Destroy(script);
+
+    // Negative returns leave nested ifs up to the script
+    script = MathScript::Create("CompiledNestedReturn", "if(1) { if(1) { return -2; } X = 1; } X = 2;");
+    ASSERT_NE(script, NULL);
+    const char* nested[] = { "X", NULL };
+    ExpectSameAsInterpreted(script, nested, -2);
+    MathScript::Destroy(script);
+
+    // A block ending the script does not make its return the result
+    script = MathScript::Create("CompiledLastReturn", "X = 1; if(X > 0) { return 3; }");
+    ASSERT_NE(script, NULL);
+    ExpectSameAsInterpreted(script, nested, 0);
+    MathScript::Destroy(script);
+
+    script = MathScript::Create("CompiledLastLoop", "X = 0; while(1) { X = X + 1; return -1; }");
+    ASSERT_NE(script, NULL);
+    ExpectSameAsInterpreted(script, nested, 0);
+    MathScript::Destroy(script);
+}
+
+TEST(MathScriptTest, CompiledParentEnvironment)
+{
+    MathScript *script = MathScript::Create("CompiledParentEnvironment", "Total = Total + Bonus; Local = 1;");
+    ASSERT_NE(script, NULL);
+
+    MathEnvironment parent;
+    parent.Define("Total", 10.0);
+    MathEnvironment child(&parent);
+    child.Define("Bonus", 5.0);
+    script->Evaluate(&child);
+
+    // Variables of the parent are assigned in the parent, like Define does
+    EXPECT_EQ(15, parent.Lookup("Total")->GetValue());
+    EXPECT_EQ(NULL, parent.Lookup("Local"));
+    EXPECT_NE(NULL, child.Lookup("Local"));
+    MathScript::Destroy(script);
+}
+
+TEST(MathScriptTest, CompiledVsInterpretedBenchmark)
+{
+    const int runs = 20000;
+    MathScript *script = MathScript::Create("Benchmark", "\
+        Roll = 0.5;\
+        Skill = Quux:Multiply(Quux:TheAnswer, 2);\
+        Bonus = if(Skill > 50, Skill * 0.1, 0);\
+        Damage = 0;\
+        I = 0;\
+        while(I < 3) { I = I + 1; Damage = Damage + Skill * Roll + Bonus; }\
+        if(Damage > 100) { Result = Damage; } else { Result = 0; }\
+    ");
+    ASSERT_NE(script, NULL);
+
+    Foo foo;
+    double results[2];
+
+    printf("%12s %12s\n", "engine", "us per run");
+    for (int compiled = 0; compiled < 2; compiled++)
+    {
+        csMicroTicks start = csGetMicroTicks();
+        for (int i = 0; i < runs; i++)
+        {
+            MathEnvironment env;
+            env.Define("Quux", &foo);
+            if (compiled)
+                script->Evaluate(&env);
+            else
+                script->Interpret(&env);
+            results[compiled] = env.Lookup("Result")->GetValue();
+        }
+        csMicroTicks time = csGetMicroTicks() - start;
+        printf("%12s %12.2f\n", compiled ? "compiled" : "interpreted", float(time) / runs);
+    }
+
+    EXPECT_DOUBLE_EQ(151.2, results[1]);
+    EXPECT_EQ(results[0], results[1]);
+    MathScript::Destroy(script);
+}
@@ -47,6 +47,7 @@
 #define DEF_PROX_DIST   100        ///< 100m is trial distance here
 #define DEF_UPDATE_DIST   5        ///<  30m is trial (default) delta to update
 #define PROX_LIST_ANY_RANGE 0.0      ///< range of 0 means all members of proxlist in multicast.
+#define DEF_GRID_CELL_SIZE 25.0f     ///< Side of the cells of the server entity grids, in meters.
 /** @name Dynamic proxlist range settings.
  *   The dynamic proxlist shrinks range in steps (maximum of 1 step per proxlist update)
  *   if the number of player entities on the proxlist exceeds PROX_LIST_SHRINK_THRESHOLD.
@@ -28,6 +28,7 @@
 #include "log.h"
 #include "strutil.h"
 #include "psconst.h"
+#include "gameevent.h"
 
 // This should be in header file somewhere...
 #define PSAPP   "planeshift.application.server"
@@ -42,6 +43,33 @@
 
 iDataConnection *db;
 
+/**
+ * Calls the callbacks of the queries the database workers finished, from
+ * the game thread, until the database is closed.
+ */
+class psDBCallbackEvent : public psGameEvent
+{
+public:
+    psDBCallbackEvent(csTicks interval)
+        : psGameEvent(0, interval, "psDBCallbackEvent")
+    {
+        this->interval = interval;
+    }
+
+    virtual void Trigger()
+    {
+        if(!db)
+            return;
+
+        db->DispatchCallbacks();
+        psDBCallbackEvent* next = new psDBCallbackEvent(interval);
+        next->QueueEvent();
+    }
+
+protected:
+    csTicks interval;
+};
+
 psDatabase::psDatabase(iObjectRegistry *objectreg)
 {
     object_reg = objectreg;
@@ -73,7 +101,38 @@ bool psDatabase::Initialize(const char* host, unsigned int port, const char* use
         db = NULL;
         return false;
     }
-        
+
+    writeBehind.AttachNew(new psWriteBehindQueue(db));
+    return true;
+}
+
+bool psDatabase::StartWorkers(size_t count, csTicks interval)
+{
+    if(!db)
+        return false;
+
+    // Callbacks are dispatched even without workers
+    psDBCallbackEvent* event = new psDBCallbackEvent(interval);
+    event->QueueEvent();
+
+    if(count && !db->StartWorkers(count))
+    {
+        SetLastError("Could not connect the database workers");
+        return false;
+    }
+    return true;
+}
+
+bool psDatabase::StartWriteBehind(csTicks window, size_t maxBatch)
+{
+    if(!writeBehind)
+        return false;
+
+    if(window && !writeBehind->Start(window, maxBatch))
+    {
+        SetLastError("Could not connect the write behind thread");
+        return false;
+    }
     return true;
 }
 
@@ -103,6 +162,10 @@ const char *psDatabase::GetLastQuery()
 
 void psDatabase::Close()
 {
+    // Nothing queued may be lost, later saves are run right away
+    if (writeBehind)
+        writeBehind->Stop();
+
     if (db)
     {
         db->Close();
@@ -111,5 +174,23 @@ void psDatabase::Close()
     db = NULL;
 }
 
+ResultIndex::ResultIndex(Result &result, const char* field) : result(result)
+{
+    if (!result.IsValid())
+        return;
 
+    for (unsigned long i = 0; i < result.Count(); i++)
+    {
+        uint32 key = result[i].GetUInt32(field);
+        csArray<size_t>* keyRows = rows.GetElementPointer(key);
+        if (!keyRows)
+            keyRows = &rows.Put(key, csArray<size_t>());
+        keyRows->Push(i);
+    }
+}
 
+const csArray<size_t> &ResultIndex::Get(uint32 key) const
+{
+    const csArray<size_t>* keyRows = rows.GetElementPointer(key);
+    return keyRows ? *keyRows : none;
+}
@@ -23,7 +23,11 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <csutil/array.h>
+#include <csutil/hash.h>
+
 #include <idal.h>      // Database Abstraction Layer Interface
+#include "util/writebehind.h"
 
 struct iObjectRegistry;
 class psAdminResponseList;
@@ -74,7 +78,29 @@ public:
     virtual bool Initialize(const char* host, unsigned int port, const char* user,
                             const char* password, const char* database);
 
-    /// Closes sql database connection.
+    /** Start the database workers and dispatch the callbacks of their
+     * queries from the event manager.
+     *
+     * @param count: The number of workers, 0 to run queued queries on the main connection.
+     * @param interval: Ticks between dispatches of the callbacks.
+     * @return Returns false if the workers could not connect.
+     * @see iDataConnection::StartWorkers()
+     */
+    bool StartWorkers(size_t count, csTicks interval);
+
+    /** Start the thread writing the queued row updates.
+     *
+     * @param window: Ticks an update may wait for more updates of its row, 0 to write them right away.
+     * @param maxBatch: Updates written in one transaction at most.
+     * @return Returns false if the thread could not connect.
+     * @see psWriteBehindQueue
+     */
+    bool StartWriteBehind(csTicks window, size_t maxBatch);
+
+    /// The queue of row updates written later, runs them right away unless started.
+    psWriteBehindQueue* GetWriteBehind() { return writeBehind; }
+
+    /// Closes sql database connection, after writing the queued row updates.
     void Close();
 
     /// Utility functions
@@ -111,6 +137,7 @@ public:
     
     iObjectRegistry *object_reg;
     csRef<iDataConnection> mysql;
+    csRef<psWriteBehindQueue> writeBehind;
 
     /// Contains a string that describes the last error that happened.
     csString lasterror;
@@ -153,6 +180,34 @@ struct Result
     unsigned long Count(void) { return rs->Count(); }
 };
 
+/**
+ * The rows of a result set by the value of one of its fields. Lets the
+ * result of one query for all the keys be used in place of a query per key.
+ * The rows of a key are kept in the order of the result set.
+ */
+class ResultIndex
+{
+public:
+    /**
+     * @param result The result set, must outlive the index.
+     * @param field  The field to index the rows by, an unsigned number.
+     */
+    ResultIndex(Result &result, const char* field);
+
+    /// The rows with the given value, none if there are no such rows.
+    const csArray<size_t> &Get(uint32 key) const;
+
+    Result &GetResult()
+    {
+        return result;
+    }
+
+protected:
+    Result &result;
+    csHash<csArray<size_t>, uint32> rows;
+    csArray<size_t> none;
+};
+
 
 
 /** @} */
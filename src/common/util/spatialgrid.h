@@ -0,0 +1,320 @@
+/*
+ * spatialgrid.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * A template class used to index objects by position in a uniform grid.
+ *
+ */
+
+#ifndef __SPATIALGRID_H__
+#define __SPATIALGRID_H__
+
+#include <math.h>
+
+#include <csgeom/vector3.h>
+#include <csutil/array.h>
+#include <csutil/hash.h>
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/*   Design notes:
+ *
+ *  The grid covers the XZ plane with square cells of a fixed size. Only cells
+ *  that hold at least one object are allocated, so a grid can cover a whole
+ *  sector without any knowledge of the sector bounds. Y is not used to select
+ *  cells but is taken into account when filtering query results, so a query
+ *  returns the same objects as a sphere test against the stored positions.
+ *
+ *  Objects are stored by pointer and have to be removed from the grid before
+ *  they are deleted. The grid does not track movement by itself, the owner
+ *  has to call Move() whenever the position of an object change.
+ *
+ *  Query cost is proportional to the number of cells overlapped by the query
+ *  radius plus the number of objects stored in those cells, and does not
+ *  depend on the total number of objects in the grid.
+ *
+ *  THIS IS NOT THREADSAFE!!
+ */
+
+#define SPATIALGRID_DEFAULT_CELL_SIZE    32.0f
+
+template <class T>
+class psSpatialGrid
+{
+public:
+    /// Key identifying a cell of the grid.
+    typedef uint64 CellKey;
+
+protected:
+    /// A object stored in a cell together with the position it was stored with.
+    struct CellEntry
+    {
+        T* object;
+        csVector3 pos;
+    };
+
+    /// Where to find a object in the grid.
+    struct ObjectEntry
+    {
+        CellKey cell;
+        size_t index;
+    };
+
+    float cellSize;
+    float invCellSize;
+
+    csHash<csArray<CellEntry>*, CellKey> cells;     ///< Allocated cells.
+    csHash<ObjectEntry, csPtrKey<T> > objects;     ///< Location of each object in the grid.
+    csArray<csArray<CellEntry>*> freeCells;         ///< Emptied cells kept for reuse.
+
+    int ToCell(float coord) const
+    {
+        return (int)floorf(coord * invCellSize);
+    }
+
+    csArray<CellEntry>* GetOrCreateCell(CellKey key)
+    {
+        csArray<CellEntry>* cell = cells.Get(key, NULL);
+        if(!cell)
+        {
+            if(freeCells.GetSize())
+            {
+                cell = freeCells.Pop();
+            }
+            else
+            {
+                cell = new csArray<CellEntry>(0, 8);
+            }
+            cells.Put(key, cell);
+        }
+        return cell;
+    }
+
+    void AddToCell(T* object, const csVector3 &pos, CellKey key)
+    {
+        csArray<CellEntry>* cell = GetOrCreateCell(key);
+
+        CellEntry entry;
+        entry.object = object;
+        entry.pos = pos;
+
+        ObjectEntry location;
+        location.cell = key;
+        location.index = cell->Push(entry);
+        objects.PutUnique(object, location);
+    }
+
+    void RemoveFromCell(const ObjectEntry &location)
+    {
+        csArray<CellEntry>* cell = cells.Get(location.cell, NULL);
+        CS_ASSERT(cell && location.index < cell->GetSize());
+
+        // Move the last entry into the hole so the cell stays packed.
+        size_t last = cell->GetSize() - 1;
+        if(location.index != last)
+        {
+            cell->Put(location.index, cell->Get(last));
+            ObjectEntry* moved = objects.GetElementPointer(cell->Get(location.index).object);
+            moved->index = location.index;
+        }
+        cell->Truncate(last);
+
+        if(cell->IsEmpty())
+        {
+            cells.Delete(location.cell, cell);
+            freeCells.Push(cell);
+        }
+    }
+
+public:
+    /**
+     * Create an empty grid.
+     *
+     * @param size The length of the side of each cell. Should be in the same
+     *             order as the radius of the typical query.
+     */
+    psSpatialGrid(float size = SPATIALGRID_DEFAULT_CELL_SIZE)
+    {
+        cellSize = size;
+        invCellSize = 1.0f / size;
+    }
+
+    ~psSpatialGrid()
+    {
+        typename csHash<csArray<CellEntry>*, CellKey>::GlobalIterator it(cells.GetIterator());
+        while(it.HasNext())
+        {
+            delete it.Next();
+        }
+        for(size_t i = 0; i < freeCells.GetSize(); i++)
+        {
+            delete freeCells[i];
+        }
+    }
+
+    /// Get the key of the cell that contains the given position.
+    CellKey GetCellKey(const csVector3 &pos) const
+    {
+        return MakeCellKey(ToCell(pos.x), ToCell(pos.z));
+    }
+
+    static CellKey MakeCellKey(int x, int z)
+    {
+        return (((CellKey)(uint32)x) << 32) | (CellKey)(uint32)z;
+    }
+
+    float GetCellSize() const
+    {
+        return cellSize;
+    }
+
+    /// Number of objects stored in the grid.
+    size_t GetObjectCount() const
+    {
+        return objects.GetSize();
+    }
+
+    /// Number of cells that holds at least one object.
+    size_t GetCellCount() const
+    {
+        return cells.GetSize();
+    }
+
+    bool Contains(T* object) const
+    {
+        return objects.Contains(object);
+    }
+
+    /**
+     * Add a object to the grid or update the position of a object already in it.
+     *
+     * @return True if the object entered a new cell (or the grid).
+     */
+    bool Move(T* object, const csVector3 &pos)
+    {
+        CellKey key = GetCellKey(pos);
+
+        ObjectEntry* location = objects.GetElementPointer(object);
+        if(location)
+        {
+            if(location->cell == key)
+            {
+                cells.Get(key, NULL)->Get(location->index).pos = pos;
+                return false;
+            }
+            ObjectEntry old = *location;
+            RemoveFromCell(old);
+        }
+
+        AddToCell(object, pos, key);
+        return true;
+    }
+
+    /**
+     * Remove a object from the grid.
+     *
+     * @return True if the object was found in the grid.
+     */
+    bool Remove(T* object)
+    {
+        ObjectEntry* location = objects.GetElementPointer(object);
+        if(!location)
+            return false;
+
+        ObjectEntry old = *location;
+        RemoveFromCell(old);
+        objects.DeleteAll(object);
+        return true;
+    }
+
+    /**
+     * Remove all objects from the grid. The cells are kept for reuse.
+     */
+    void Clear()
+    {
+        typename csHash<csArray<CellEntry>*, CellKey>::GlobalIterator it(cells.GetIterator());
+        while(it.HasNext())
+        {
+            csArray<CellEntry>* cell = it.Next();
+            cell->Truncate(0);
+            freeCells.Push(cell);
+        }
+        cells.DeleteAll();
+        objects.DeleteAll();
+    }
+
+    /**
+     * Append all objects within radius of the position to the list.
+     *
+     * @param pos    The center of the query.
+     * @param radius The radius of the query sphere.
+     * @param list   Array that found objects are pushed on.
+     * @return The number of objects found.
+     */
+    size_t Query(const csVector3 &pos, float radius, csArray<T*> &list) const
+    {
+        size_t found = 0;
+        float radiusSq = radius*radius;
+
+        int minX = ToCell(pos.x - radius);
+        int maxX = ToCell(pos.x + radius);
+        int minZ = ToCell(pos.z - radius);
+        int maxZ = ToCell(pos.z + radius);
+
+        for(int x = minX; x <= maxX; x++)
+        {
+            for(int z = minZ; z <= maxZ; z++)
+            {
+                const csArray<CellEntry>* cell = cells.Get(MakeCellKey(x, z), NULL);
+                if(!cell)
+                    continue;
+
+                for(size_t i = 0; i < cell->GetSize(); i++)
+                {
+                    const CellEntry &entry = cell->Get(i);
+                    if((entry.pos - pos).SquaredNorm() <= radiusSq)
+                    {
+                        list.Push(entry.object);
+                        found++;
+                    }
+                }
+            }
+        }
+
+        return found;
+    }
+
+    /**
+     * Append all objects in the grid to the list.
+     */
+    void GetAll(csArray<T*> &list) const
+    {
+        typename csHash<ObjectEntry, csPtrKey<T> >::ConstGlobalIterator it(objects.GetIterator());
+        while(it.HasNext())
+        {
+            csPtrKey<T> key;
+            it.Next(key);
+            list.Push(key);
+        }
+    }
+};
+
+/** @} */
+
+#endif
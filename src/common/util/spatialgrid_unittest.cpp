@@ -0,0 +1,182 @@
+/*
+ * spatialgrid_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <stdio.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/randomgen.h>
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/spatialgrid.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+struct GridObject
+{
+    csVector3 pos;
+};
+
+static csVector3 RandomPos(csRandomGen &rng, float size)
+{
+    return csVector3(rng.Get()*size - size/2, rng.Get()*10.0f, rng.Get()*size - size/2);
+}
+
+static size_t BruteForceQuery(csArray<GridObject> &objects, const csVector3 &pos, float radius)
+{
+    size_t found = 0;
+    for(size_t i = 0; i < objects.GetSize(); i++)
+    {
+        if((objects[i].pos - pos).SquaredNorm() <= radius*radius)
+            found++;
+    }
+    return found;
+}
+
+TEST(SpatialGridTest, MoveAndRemove)
+{
+    psSpatialGrid<GridObject> grid(10.0f);
+    GridObject a, b;
+
+    EXPECT_TRUE(grid.Move(&a, csVector3(1, 0, 1)));
+    EXPECT_TRUE(grid.Move(&b, csVector3(2, 0, 2)));
+    EXPECT_FALSE(grid.Move(&a, csVector3(3, 0, 3)));   // Same cell
+    EXPECT_TRUE(grid.Move(&a, csVector3(-3, 0, 3)));   // Crossed into a new cell
+    EXPECT_EQ(2u, grid.GetObjectCount());
+    EXPECT_EQ(2u, grid.GetCellCount());
+
+    csArray<GridObject*> list;
+    grid.Query(csVector3(0, 0, 0), 5.0f, list);
+    EXPECT_EQ(2u, list.GetSize());
+
+    EXPECT_TRUE(grid.Remove(&a));
+    EXPECT_FALSE(grid.Remove(&a));
+    EXPECT_FALSE(grid.Contains(&a));
+    EXPECT_EQ(1u, grid.GetCellCount());
+
+    list.Empty();
+    grid.Query(csVector3(0, 0, 0), 5.0f, list);
+    ASSERT_EQ(1u, list.GetSize());
+    EXPECT_EQ(&b, list[0]);
+}
+
+TEST(SpatialGridTest, Clear)
+{
+    psSpatialGrid<GridObject> grid(10.0f);
+    GridObject a, b;
+
+    grid.Move(&a, csVector3(1, 0, 1));
+    grid.Move(&b, csVector3(50, 0, 50));
+    grid.Clear();
+    EXPECT_EQ(0u, grid.GetObjectCount());
+    EXPECT_EQ(0u, grid.GetCellCount());
+    EXPECT_FALSE(grid.Contains(&a));
+
+    // Usable again after a clear
+    EXPECT_TRUE(grid.Move(&b, csVector3(1, 0, 1)));
+    csArray<GridObject*> list;
+    grid.Query(csVector3(0, 0, 0), 5.0f, list);
+    ASSERT_EQ(1u, list.GetSize());
+    EXPECT_EQ(&b, list[0]);
+}
+
+TEST(SpatialGridTest, MatchesBruteForce)
+{
+    csRandomGen rng(42);
+    psSpatialGrid<GridObject> grid(25.0f);
+    csArray<GridObject> objects;
+    objects.SetSize(2000);
+
+    for(size_t i = 0; i < objects.GetSize(); i++)
+    {
+        objects[i].pos = RandomPos(rng, 1000.0f);
+        grid.Move(&objects[i], objects[i].pos);
+    }
+
+    for(int q = 0; q < 100; q++)
+    {
+        // Move some objects around between queries
+        for(size_t i = q % 5; i < objects.GetSize(); i += 5)
+        {
+            objects[i].pos = RandomPos(rng, 1000.0f);
+            grid.Move(&objects[i], objects[i].pos);
+        }
+
+        csVector3 pos = RandomPos(rng, 1000.0f);
+        float radius = rng.Get()*150.0f;
+
+        csArray<GridObject*> list;
+        grid.Query(pos, radius, list);
+        EXPECT_EQ(BruteForceQuery(objects, pos, radius), list.GetSize());
+    }
+}
+
+/**
+ * Not really a test. Prints the cost of a 100m query, as done for
+ * proxlist updates, against the number of objects in a 1km square.
+ */
+TEST(SpatialGridTest, QueryCostByDensity)
+{
+    const int queries = 1000;
+    const float radius = 100.0f;
+    csRandomGen rng(1);
+
+    printf("%8s %14s %14s %10s\n", "objects", "grid us/query", "brute us/query", "found");
+    for(size_t count = 100; count <= 12800; count *= 2)
+    {
+        psSpatialGrid<GridObject> grid(25.0f);
+        csArray<GridObject> objects;
+        objects.SetSize(count);
+        for(size_t i = 0; i < count; i++)
+        {
+            objects[i].pos = RandomPos(rng, 1000.0f);
+            grid.Move(&objects[i], objects[i].pos);
+        }
+
+        size_t found = 0;
+        csArray<GridObject*> list;
+        csMicroTicks start = csGetMicroTicks();
+        for(int q = 0; q < queries; q++)
+        {
+            list.Empty();
+            found += grid.Query(objects[q % count].pos, radius, list);
+        }
+        csMicroTicks gridTime = csGetMicroTicks() - start;
+
+        size_t bruteFound = 0;
+        start = csGetMicroTicks();
+        for(int q = 0; q < queries; q++)
+        {
+            bruteFound += BruteForceQuery(objects, objects[q % count].pos, radius);
+        }
+        csMicroTicks bruteTime = csGetMicroTicks() - start;
+
+        EXPECT_EQ(bruteFound, found);
+        printf("%8zu %14.2f %14.2f %10zu\n", count, float(gridTime)/queries,
+               float(bruteTime)/queries, found/queries);
+    }
+}
@@ -0,0 +1,257 @@
+/*
+ * timerwheel.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ *
+ * A hierarchical timer wheel used to order timed objects.
+ *
+ */
+
+#ifndef __TIMERWHEEL_H__
+#define __TIMERWHEEL_H__
+
+#include <csutil/array.h>
+
+#include "util/heap.h"
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/*   Design notes:
+ *
+ *  Objects are stored in T* and must have a csTicks triggerticks member and the
+ *  comparison operators needed by Heap<T>.
+ *
+ *  Time is divided in slots of TIMERWHEEL_SLOT_TICKS. Objects due within
+ *  TIMERWHEEL_LEVEL0_SLOTS slots are stored unordered in the slot they trigger
+ *  in, objects due within TIMERWHEEL_LEVEL1_SLOTS blocks of level 0 slots are
+ *  stored in the block they trigger in, and are moved down to level 0 when that
+ *  block starts. Anything later than that is kept in a overflow heap.
+ *
+ *  When time advances past a level 0 slot, its objects are moved to a small
+ *  heap of due objects. So inserting is constant time for all common delays,
+ *  only the objects about to trigger are ever sorted, and objects still come
+ *  out strictly ordered by trigger time and id like from a plain Heap<T>.
+ *
+ *  THIS IS NOT THREADSAFE!! The owner has to lock around all calls.
+ */
+
+#define TIMERWHEEL_SLOT_BITS      4                                   ///< 16 ticks per slot
+#define TIMERWHEEL_LEVEL0_BITS    8                                   ///< 256 slots, about 4 seconds
+#define TIMERWHEEL_LEVEL1_BITS    6                                   ///< 64 blocks, about 4 minutes
+
+#define TIMERWHEEL_SLOT_TICKS     (1 << TIMERWHEEL_SLOT_BITS)
+#define TIMERWHEEL_LEVEL0_SLOTS   (1 << TIMERWHEEL_LEVEL0_BITS)
+#define TIMERWHEEL_LEVEL1_SLOTS   (1 << TIMERWHEEL_LEVEL1_BITS)
+#define TIMERWHEEL_LEVEL0_TICKS   (TIMERWHEEL_SLOT_TICKS * TIMERWHEEL_LEVEL0_SLOTS)
+#define TIMERWHEEL_LEVEL1_TICKS   (TIMERWHEEL_LEVEL0_TICKS * TIMERWHEEL_LEVEL1_SLOTS)
+
+template <class T>
+class TimerWheel
+{
+protected:
+    csArray<T*> level0[TIMERWHEEL_LEVEL0_SLOTS];
+    csArray<T*> level1[TIMERWHEEL_LEVEL1_SLOTS];
+    Heap<T> due;              ///< Objects of slots already passed, ordered.
+    Heap<T> overflow;         ///< Objects beyond the reach of level 1, ordered.
+
+    csTicks currentTicks;     ///< Start of the next level 0 slot to pass.
+    size_t count;             ///< Total number of objects stored.
+
+    static size_t Level0Index(csTicks ticks)
+    {
+        return (ticks >> TIMERWHEEL_SLOT_BITS) & (TIMERWHEEL_LEVEL0_SLOTS - 1);
+    }
+
+    static size_t Level1Index(csTicks ticks)
+    {
+        return (ticks >> (TIMERWHEEL_SLOT_BITS + TIMERWHEEL_LEVEL0_BITS)) & (TIMERWHEEL_LEVEL1_SLOTS - 1);
+    }
+
+    /// Put a object where it belongs relative to currentTicks.
+    void Place(T* what)
+    {
+        int32 delta = (int32)(what->triggerticks - currentTicks);
+
+        if(delta < 0)
+        {
+            due.Insert(what);
+        }
+        else if(delta < TIMERWHEEL_LEVEL0_TICKS)
+        {
+            level0[Level0Index(what->triggerticks)].Push(what);
+        }
+        else if(delta < TIMERWHEEL_LEVEL1_TICKS)
+        {
+            level1[Level1Index(what->triggerticks)].Push(what);
+        }
+        else
+        {
+            overflow.Insert(what);
+        }
+    }
+
+    /// Move the objects of all slots starting at or before now to the due heap.
+    void Advance(csTicks now)
+    {
+        while((int32)(now - currentTicks) >= 0)
+        {
+            csArray<T*> &slot = level0[Level0Index(currentTicks)];
+            for(size_t i = 0; i < slot.GetSize(); i++)
+            {
+                due.Insert(slot[i]);
+            }
+            slot.Empty();
+
+            currentTicks += TIMERWHEEL_SLOT_TICKS;
+
+            // Entered a new level 1 block, so spread it over level 0.
+            if(Level0Index(currentTicks) == 0)
+            {
+                csArray<T*> block;
+                block = level1[Level1Index(currentTicks)];
+                level1[Level1Index(currentTicks)].Empty();
+                for(size_t i = 0; i < block.GetSize(); i++)
+                {
+                    Place(block[i]);
+                }
+
+                while(overflow.FindMin() &&
+                      (int32)(overflow.FindMin()->triggerticks - currentTicks) < TIMERWHEEL_LEVEL1_TICKS)
+                {
+                    Place(overflow.DeleteMin());
+                }
+            }
+        }
+    }
+
+public:
+    /**
+     * Create an empty wheel.
+     *
+     * @param now The current ticks.
+     */
+    TimerWheel(csTicks now)
+    {
+        currentTicks = now & ~(TIMERWHEEL_SLOT_TICKS - 1);
+        count = 0;
+    }
+
+    size_t Length() const
+    {
+        return count;
+    }
+
+    /// Add a object to the wheel.
+    void Insert(T* what)
+    {
+        Place(what);
+        count++;
+    }
+
+    /**
+     * Remove and return the first object with a trigger time at or before now.
+     *
+     * @return The object or NULL if no object is due.
+     */
+    T* DeleteDue(csTicks now)
+    {
+        Advance(now);
+
+        T* first = due.FindMin();
+        if(!first || (int32)(now - first->triggerticks) < 0)
+        {
+            return NULL;
+        }
+
+        count--;
+        return due.DeleteMin();
+    }
+
+    /**
+     * Get a time at which the next object might be due. Never later than
+     * the real trigger time of the next object.
+     *
+     * @param now The current ticks.
+     * @param limit Do not look further than this many ticks from now.
+     */
+    csTicks NextTrigger(csTicks now, csTicks limit)
+    {
+        T* first = due.FindMin();
+        if(first)
+        {
+            return first->triggerticks;
+        }
+
+        csTicks end = now + limit;
+        for(csTicks slot = currentTicks; (int32)(end - slot) > 0; slot += TIMERWHEEL_SLOT_TICKS)
+        {
+            // Past this point the level 0 slots would belong to the next turn.
+            if((int32)(slot - currentTicks) >= TIMERWHEEL_LEVEL0_TICKS)
+            {
+                break;
+            }
+
+            if(!level0[Level0Index(slot)].IsEmpty())
+            {
+                return slot;
+            }
+
+            // A level 1 block not spread over level 0 yet starts here.
+            if(slot != currentTicks && Level0Index(slot) == 0 &&
+               !level1[Level1Index(slot)].IsEmpty())
+            {
+                return slot;
+            }
+        }
+        return end;
+    }
+
+    /**
+     * Remove and return any object, regardless of trigger time.
+     * Used to clean up.
+     */
+    T* DeleteAny()
+    {
+        if(!count)
+            return NULL;
+
+        count--;
+        if(due.Length())
+            return due.DeleteMin();
+        if(overflow.Length())
+            return overflow.DeleteMin();
+        for(size_t i = 0; i < TIMERWHEEL_LEVEL0_SLOTS; i++)
+        {
+            if(!level0[i].IsEmpty())
+                return level0[i].Pop();
+        }
+        for(size_t i = 0; i < TIMERWHEEL_LEVEL1_SLOTS; i++)
+        {
+            if(!level1[i].IsEmpty())
+                return level1[i].Pop();
+        }
+
+        CS_ASSERT_MSG("TimerWheel count out of sync", false);
+        count++;
+        return NULL;
+    }
+};
+
+/** @} */
+
+#endif
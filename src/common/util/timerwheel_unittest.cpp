@@ -0,0 +1,137 @@
+/*
+ * timerwheel_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/randomgen.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/timerwheel.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+struct TimedObject
+{
+    csTicks triggerticks;
+    int id;
+
+    bool operator<(const TimedObject &other) const
+    {
+        if(triggerticks == other.triggerticks)
+            return id < other.id;
+        return triggerticks < other.triggerticks;
+    }
+    bool operator>(const TimedObject &other) const
+    {
+        return other < *this;
+    }
+};
+
+/**
+ * Insert objects with a mix of short and long delays while time advances,
+ * starting close to the ticks wraparound, and check they come out in order
+ * and never early.
+ */
+TEST(TimerWheelTest, OrderedAndNeverEarly)
+{
+    csRandomGen rng(7);
+    csTicks now = 0xFFFF0000;
+    TimerWheel<TimedObject> wheel(now);
+    int nextid = 0;
+    size_t inserted = 0;
+    size_t removed = 0;
+    TimedObject last = { 0, -1 };
+
+    for(int step = 0; step < 50000; step++)
+    {
+        int count = rng.Get(3);
+        for(int i = 0; i < count; i++)
+        {
+            TimedObject* object = new TimedObject;
+            uint32 kind = rng.Get(10);
+            csTicks delay = kind < 6 ? rng.Get(3000) : kind < 9 ? rng.Get(200000) : rng.Get(2000000);
+            object->triggerticks = now + delay;
+            object->id = nextid++;
+            wheel.Insert(object);
+            inserted++;
+        }
+
+        now += 1 + rng.Get(40);
+
+        TimedObject* object;
+        while((object = wheel.DeleteDue(now)))
+        {
+            EXPECT_GE((int32)(now - object->triggerticks), 0);
+            if(last.id >= 0)
+            {
+                EXPECT_FALSE((int32)(object->triggerticks - last.triggerticks) < 0);
+            }
+            last = *object;
+            removed++;
+            delete object;
+        }
+    }
+
+    EXPECT_EQ(inserted - removed, wheel.Length());
+    while(wheel.Length())
+    {
+        delete wheel.DeleteAny();
+    }
+}
+
+/**
+ * NextTrigger may be early but never later than the first object.
+ */
+TEST(TimerWheelTest, NextTriggerNotLate)
+{
+    csRandomGen rng(3);
+
+    for(int trial = 0; trial < 2000; trial++)
+    {
+        csTicks now = rng.Get();
+        TimerWheel<TimedObject> wheel(now);
+        TimedObject objects[20];
+        for(int i = 0; i < 20; i++)
+        {
+            objects[i].triggerticks = now + rng.Get(20000);
+            objects[i].id = i;
+            wheel.Insert(&objects[i]);
+        }
+
+        now += rng.Get(10000);
+        while(wheel.DeleteDue(now))
+            ;
+
+        csTicks first = now + 250;
+        for(int i = 0; i < 20; i++)
+        {
+            if((int32)(objects[i].triggerticks - now) > 0 && (int32)(objects[i].triggerticks - first) < 0)
+                first = objects[i].triggerticks;
+        }
+        EXPECT_LE((int32)(wheel.NextTrigger(now, 250) - first), 0);
+    }
+}
@@ -0,0 +1,435 @@
+/*
+ * writebehind.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <csutil/sysfunc.h>
+
+#include "util/log.h"
+#include "util/dbworkers.h"
+#include "util/zoneprofiler.h"
+#include "writebehind.h"
+
+psWriteBehindQueue::psWriteBehindQueue(iDataConnection* db)
+{
+    this->db = db;
+    window = 0;
+    maxBatch = 0;
+    ready = false;
+    connected = false;
+    stop = false;
+    flushNow = false;
+    queuedSeq = 0;
+    writingSeq = 0;
+    ResetStats();
+}
+
+psWriteBehindQueue::~psWriteBehindQueue()
+{
+    Stop();
+}
+
+bool psWriteBehindQueue::Start(csTicks window, size_t maxBatch)
+{
+    if(thread)
+        return true;
+
+    this->window = window;
+    this->maxBatch = maxBatch ? maxBatch : 1;
+
+    ready = false;
+    stop = false;
+    thread.AttachNew(new CS::Threading::Thread(this));
+    thread->Start();
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    while(!ready)
+    {
+        condition.Wait(mutex);
+    }
+
+    if(!connected)
+    {
+        thread->Wait();
+        thread = NULL;
+    }
+    return connected;
+}
+
+void psWriteBehindQueue::Stop()
+{
+    if(!thread)
+        return;
+
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        stop = true;
+        condition.NotifyAll();
+    }
+
+    thread->Wait();
+    thread = NULL;
+}
+
+csString psWriteBehindQueue::MakeKey(const char* table, uint32 id)
+{
+    csString key;
+    key.Format("%s:%u", table, id);
+    return key;
+}
+
+bool psWriteBehindQueue::Update(const char* table, uint32 id, const char* sql)
+{
+    if(!thread)
+    {
+        // Nobody to write it later
+        if(db->Command("%s", sql) == QUERY_FAILED)
+        {
+            Error3("Failed to update %s: %s", MakeKey(table, id).GetData(), db->GetLastError());
+            CS::Threading::MutexScopedLock lock(mutex);
+            failedCount++;
+            return false;
+        }
+        return true;
+    }
+
+    csString key = MakeKey(table, id);
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    queuedSeq++;
+    queuedCount++;
+
+    size_t* found = index.GetElementPointer(key);
+    if(found)
+    {
+        // The older update is not needed anymore, it keeps its place in the queue
+        pending[*found].sql = sql;
+        coalescedCount++;
+        return true;
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.sql = sql;
+    entry.queued = csGetTicks();
+    entry.seq = queuedSeq;
+    index.Put(key, pending.Push(entry));
+
+    if(pending.GetSize() > peakDepth)
+        peakDepth = pending.GetSize();
+
+    // Wake up the thread to start the window, or to write a full batch
+    if(pending.GetSize() == 1 || pending.GetSize() >= maxBatch)
+        condition.NotifyAll();
+
+    return true;
+}
+
+void psWriteBehindQueue::Cancel(const char* table, uint32 id)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    csString key = MakeKey(table, id);
+    size_t* found = index.GetElementPointer(key);
+    if(!found)
+        return;
+
+    Remove(*found);
+    cancelledCount++;
+}
+
+void psWriteBehindQueue::Flush(const char* table, uint32 id)
+{
+    csString key = MakeKey(table, id);
+    csString sql;
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+
+        // An older update of the row being written must not land after this one
+        while(writing.Contains(key))
+        {
+            condition.Wait(mutex);
+        }
+
+        size_t* found = index.GetElementPointer(key);
+        if(!found)
+            return;
+
+        sql = pending[*found].sql;
+        Remove(*found);
+        flushedCount++;
+    }
+
+    bool ok = db->Command("%s", sql.GetData()) != QUERY_FAILED;
+    if(!ok)
+    {
+        Error3("Failed to update %s: %s", key.GetData(), db->GetLastError());
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    if(ok)
+        writtenCount++;
+    else
+        failedCount++;
+}
+
+void psWriteBehindQueue::Remove(size_t position)
+{
+    pending.DeleteIndex(position);
+    index.DeleteAll();
+    for(size_t i = 0; i < pending.GetSize(); i++)
+    {
+        index.Put(pending[i].key, i);
+    }
+
+    // It may have been the last entry someone in Barrier() waited for
+    if(pending.IsEmpty())
+        flushNow = false;
+    condition.NotifyAll();
+}
+
+bool psWriteBehindQueue::IsWritten(uint64 seq)
+{
+    // Entries are written in the order they were queued
+    return (pending.IsEmpty() || pending[0].seq > seq) && (writingSeq == 0 || writingSeq > seq);
+}
+
+void psWriteBehindQueue::Barrier()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    uint64 target = queuedSeq;
+    if(!thread || IsWritten(target))
+        return;
+
+    barrierCount++;
+    while(!IsWritten(target))
+    {
+        flushNow = true;
+        condition.NotifyAll();
+        condition.Wait(mutex);
+    }
+}
+
+void psWriteBehindQueue::Run()
+{
+    psZoneProfiler::SetThreadName("WriteBehind");
+
+    csRef<iDataConnection> conn = db->Connect();
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        connected = conn.IsValid();
+        ready = true;
+        condition.NotifyAll();
+    }
+
+    while(conn)
+    {
+        csArray<Entry> batch;
+        {
+            CS::Threading::MutexScopedLock lock(mutex);
+            while(true)
+            {
+                if(pending.IsEmpty())
+                {
+                    if(stop)
+                        break;
+                    condition.Wait(mutex);
+                    continue;
+                }
+
+                // Leave the window open for more updates of the same rows
+                csTicks age = csGetTicks() - pending[0].queued;
+                if(stop || flushNow || age >= window || pending.GetSize() >= maxBatch)
+                    break;
+                condition.Wait(mutex, window - age);
+            }
+
+            if(pending.IsEmpty())
+                break;
+
+            size_t count = csMin(pending.GetSize(), maxBatch);
+            for(size_t i = 0; i < count; i++)
+            {
+                batch.Push(pending[i]);
+                writing.AddNoTest(pending[i].key);
+            }
+            pending.DeleteRange(0, count - 1);
+
+            index.DeleteAll();
+            for(size_t i = 0; i < pending.GetSize(); i++)
+            {
+                index.Put(pending[i].key, i);
+            }
+
+            if(pending.IsEmpty())
+                flushNow = false;
+            writingSeq = batch[0].seq;
+        }
+
+        csTicks start = csGetTicks();
+        {
+            PS_PROFILE_ZONE("psWriteBehindQueue::Write");
+            Write(conn, batch);
+        }
+        csTicks time = csGetTicks() - start;
+
+        CS::Threading::MutexScopedLock lock(mutex);
+        batchCount++;
+        writingSeq = 0;
+        writing.DeleteAll();
+        totalFlush += time;
+        if(time > maxFlush)
+            maxFlush = time;
+        condition.NotifyAll();
+    }
+
+    conn = NULL;
+    db->EndThread();
+}
+
+void psWriteBehindQueue::Write(iDataConnection* conn, csArray<Entry> &batch)
+{
+    bool ok = conn->Command("BEGIN") != QUERY_FAILED;
+    for(size_t i = 0; ok && i < batch.GetSize(); i++)
+    {
+        ok = conn->Command("%s", batch[i].sql.GetData()) != QUERY_FAILED;
+    }
+
+    if(ok && conn->Command("COMMIT") != QUERY_FAILED)
+    {
+        CS::Threading::MutexScopedLock lock(mutex);
+        writtenCount += batch.GetSize();
+        return;
+    }
+
+    // One failed update must not lose the others, so write them one by one
+    conn->Command("ROLLBACK");
+    size_t written = 0;
+    size_t failed = 0;
+    for(size_t i = 0; i < batch.GetSize(); i++)
+    {
+        if(conn->Command("%s", batch[i].sql.GetData()) == QUERY_FAILED)
+        {
+            Error3("Failed to update %s: %s", batch[i].key.GetData(), conn->GetLastError());
+            failed++;
+        }
+        else
+        {
+            written++;
+        }
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    writtenCount += written;
+    failedCount += failed;
+}
+
+csString psWriteBehindQueue::DumpStats()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    csString dump;
+    dump.Format("Write behind: %s, window %u ms, %zu queued (peak %zu)\n"
+                "%zu updates, %zu coalesced, %zu cancelled, %zu flushed, %zu written, %zu failed\n"
+                "%zu batches, average flush %.1f ms, max flush %u ms, %zu barriers\n",
+                thread ? "running" : "stopped", window, pending.GetSize(), peakDepth,
+                queuedCount, coalescedCount, cancelledCount, flushedCount, writtenCount, failedCount,
+                batchCount, batchCount ? float(totalFlush) / batchCount : 0.0f, maxFlush, barrierCount);
+    return dump;
+}
+
+void psWriteBehindQueue::ResetStats()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    queuedCount = 0;
+    coalescedCount = 0;
+    cancelledCount = 0;
+    flushedCount = 0;
+    writtenCount = 0;
+    failedCount = 0;
+    batchCount = 0;
+    barrierCount = 0;
+    peakDepth = pending.GetSize();
+    totalFlush = 0;
+    maxFlush = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+psWriteBehindRecord::psWriteBehindRecord(psWriteBehindQueue* queue, iDataConnection* db, const char* table,
+                                         const char* idfield)
+    : queue(queue), db(db), table(table), idfield(idfield)
+{
+}
+
+void psWriteBehindRecord::AddField(const char* fname, float fValue)
+{
+    names.Push(fname);
+    values.FormatPush("%.9g", fValue);
+}
+
+void psWriteBehindRecord::AddField(const char* fname, int iValue)
+{
+    names.Push(fname);
+    values.FormatPush("%d", iValue);
+}
+
+void psWriteBehindRecord::AddField(const char* fname, unsigned int uiValue)
+{
+    names.Push(fname);
+    values.FormatPush("%u", uiValue);
+}
+
+void psWriteBehindRecord::AddField(const char* fname, unsigned short usValue)
+{
+    names.Push(fname);
+    values.FormatPush("%u", (unsigned int)usValue);
+}
+
+void psWriteBehindRecord::AddField(const char* fname, const char* sValue)
+{
+    names.Push(fname);
+    values.Push(sValue ? sValue : "");
+}
+
+void psWriteBehindRecord::AddFieldNull(const char* fname)
+{
+    names.Push(fname);
+    values.Push(NULL);
+}
+
+bool psWriteBehindRecord::Execute(uint32 uid)
+{
+    csArray<const char*> fieldnames;
+    for(size_t i = 0; i < names.GetSize(); i++)
+    {
+        fieldnames.Push(names[i]);
+    }
+
+    csString id;
+    id.Format("%u", uid);
+    csString sql = psDBWorkerPool::BuildUpdate(db, table, idfield, id, fieldnames.GetArray(), values);
+
+    return queue->Update(table, uid, sql);
+}
+
+void psWriteBehindRecord::Reset()
+{
+    names.Empty();
+    values.Empty();
+}
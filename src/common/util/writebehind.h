@@ -0,0 +1,198 @@
+/*
+ * writebehind.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Row updates written to the database later, from a thread of their own.
+ *
+ */
+
+#ifndef __WRITEBEHIND_H__
+#define __WRITEBEHIND_H__
+
+#include <csutil/csstring.h>
+#include <csutil/hash.h>
+#include <csutil/ref.h>
+#include <csutil/set.h>
+#include <csutil/threading/condition.h>
+#include <csutil/threading/mutex.h>
+#include <csutil/threading/thread.h>
+
+#include <idal.h>      // Database Abstraction Layer Interface
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/**
+ * Updates of whole rows, like the save of an item or a character, queued
+ * to be written by a thread with its own connection. An update replaces
+ * any update of the same row still in the queue, so a row saved many
+ * times in a short while is only written once.
+ *
+ * The thread waits until the oldest update has been queued for the write
+ * window, then writes everything queued in one transaction. Barrier()
+ * waits until everything queued so far is written, for when the rows are
+ * about to be read again. Flush() writes the update of one row right away,
+ * for when some columns of it are about to be updated directly.
+ *
+ * Until Start() is called, and after Stop(), updates are run right away
+ * on the main connection.
+ */
+class psWriteBehindQueue : public CS::Threading::Runnable
+{
+public:
+    psWriteBehindQueue(iDataConnection* db);
+    virtual ~psWriteBehindQueue();
+
+    /**
+     * Open the connection of the thread and start it.
+     *
+     * @param window   Ticks an update may wait for more updates.
+     * @param maxBatch Updates written in one transaction at most.
+     * @return False if the connection could not be opened.
+     */
+    bool Start(csTicks window, size_t maxBatch);
+
+    /// Write everything queued and stop the thread.
+    void Stop();
+
+    bool IsRunning()
+    {
+        return thread.IsValid();
+    }
+
+    /**
+     * Queue an update of a row.
+     *
+     * @param table The table of the row.
+     * @param id    The id of the row, updates with the same table and id are coalesced.
+     * @param sql   The statement that writes the whole row.
+     * @return True once queued. A queued update that fails later is logged
+     *         and counted as failed in DumpStats(). False only if the queue
+     *         is not running and the update, run right away, failed.
+     */
+    bool Update(const char* table, uint32 id, const char* sql);
+
+    /// Drop a queued update of a row, as the row is deleted.
+    void Cancel(const char* table, uint32 id);
+
+    /// Wait until all updates queued so far are written.
+    void Barrier();
+
+    /**
+     * Write the queued update of a row now, on the main connection. Call
+     * it before updating columns of the row directly, or the queued update
+     * written later overwrites them with the old values.
+     *
+     * @param table The table of the row.
+     * @param id    The id of the row.
+     */
+    void Flush(const char* table, uint32 id);
+
+    /// Queue depth, coalesced updates and flush latency, as text.
+    csString DumpStats();
+    void ResetStats();
+
+    virtual void Run();
+
+protected:
+    struct Entry
+    {
+        csString key;
+        csString sql;
+        csTicks queued;
+        uint64 seq;                        ///< When it was first queued.
+    };
+
+    static csString MakeKey(const char* table, uint32 id);
+
+    /// Is everything queued up to seq written? Call with the mutex locked.
+    bool IsWritten(uint64 seq);
+
+    /// Take an entry out of the queue. Call with the mutex locked.
+    void Remove(size_t position);
+
+    /// Write the batch in one transaction, failures are retried one by one.
+    void Write(iDataConnection* conn, csArray<Entry> &batch);
+
+    iDataConnection* db;
+    csRef<CS::Threading::Thread> thread;
+    csTicks window;
+    size_t maxBatch;
+
+    CS::Threading::Mutex mutex;
+    CS::Threading::Condition condition;
+    csArray<Entry> pending;
+    csHash<size_t, csString> index;        ///< Key to the position in pending.
+    bool ready;
+    bool connected;
+    bool stop;
+    bool flushNow;                         ///< Someone waits in Barrier().
+    uint64 queuedSeq;                      ///< Updates queued so far.
+    uint64 writingSeq;                     ///< Oldest entry being written, 0 if none.
+    csSet<csString> writing;               ///< Keys of the entries being written.
+
+    // Statistics
+    size_t queuedCount;
+    size_t coalescedCount;
+    size_t cancelledCount;
+    size_t flushedCount;
+    size_t writtenCount;
+    size_t failedCount;
+    size_t batchCount;
+    size_t barrierCount;
+    size_t peakDepth;
+    csTicks totalFlush;
+    csTicks maxFlush;
+};
+
+/**
+ * An iRecord that hands its update to a psWriteBehindQueue instead of
+ * running it, so saves can fill it like a prepared statement.
+ */
+class psWriteBehindRecord : public iRecord
+{
+public:
+    psWriteBehindRecord(psWriteBehindQueue* queue, iDataConnection* db, const char* table, const char* idfield);
+
+    virtual void AddField(const char* fname, float fValue);
+    virtual void AddField(const char* fname, int iValue);
+    virtual void AddField(const char* fname, unsigned int uiValue);
+    virtual void AddField(const char* fname, unsigned short usValue);
+    virtual void AddField(const char* fname, const char* sValue);
+    virtual void AddFieldNull(const char* fname);
+
+    /**
+     * Queue the update of the row with the given id. Unlike other records
+     * true only means the update was queued, see psWriteBehindQueue::Update().
+     */
+    virtual bool Execute(uint32 uid);
+
+    virtual void Reset();
+
+protected:
+    psWriteBehindQueue* queue;
+    iDataConnection* db;
+    const char* table;
+    const char* idfield;
+
+    csStringArray names;
+    psStringArray values;
+};
+
+/** @} */
+
+#endif
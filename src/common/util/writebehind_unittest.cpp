@@ -0,0 +1,187 @@
+/*
+ * writebehind_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/writebehind.h"
+#include "fakeconnection_unittest.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+class WriteBehindTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        conn.AttachNew(new FakeConnection(0, &log, "main: "));
+        queue.AttachNew(new psWriteBehindQueue(conn));
+    }
+
+    virtual void TearDown()
+    {
+        queue->Stop();
+    }
+
+    CommandLog log;
+    csRef<FakeConnection> conn;
+    csRef<psWriteBehindQueue> queue;
+};
+
+TEST_F(WriteBehindTest, RunsRightAwayWithoutThread)
+{
+    EXPECT_TRUE(queue->Update("items", 1, "UPDATE items SET a=1"));
+    ASSERT_EQ(1u, log.GetSize());
+    EXPECT_STREQ("main: UPDATE items SET a=1", log.Get(0).GetData());
+
+    // Run right away the failure can still be reported
+    EXPECT_FALSE(queue->Update("items", 2, "UPDATE items SET bad=1"));
+}
+
+TEST_F(WriteBehindTest, CoalescesUpdatesOfARow)
+{
+    ASSERT_TRUE(queue->Start(100000, 100));
+
+    queue->Update("items", 1, "UPDATE items SET a=1");
+    queue->Update("items", 2, "UPDATE items SET b=1");
+    queue->Update("items", 1, "UPDATE items SET a=2");
+    queue->Update("characters", 1, "UPDATE characters SET c=1");
+    EXPECT_EQ(0u, log.GetSize());
+
+    queue->Barrier();
+    ASSERT_EQ(5u, log.GetSize());
+    EXPECT_STREQ("thread: BEGIN", log.Get(0).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET a=2", log.Get(1).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET b=1", log.Get(2).GetData());
+    EXPECT_STREQ("thread: UPDATE characters SET c=1", log.Get(3).GetData());
+    EXPECT_STREQ("thread: COMMIT", log.Get(4).GetData());
+
+    // Nothing left to wait for
+    queue->Barrier();
+    EXPECT_EQ(5u, log.GetSize());
+}
+
+TEST_F(WriteBehindTest, CancelDropsTheUpdate)
+{
+    ASSERT_TRUE(queue->Start(100000, 100));
+
+    queue->Update("items", 1, "UPDATE items SET a=1");
+    queue->Update("items", 2, "UPDATE items SET b=1");
+    queue->Update("items", 3, "UPDATE items SET c=1");
+    queue->Cancel("items", 2);
+    queue->Cancel("items", 4);
+
+    // The rows after the cancelled one are still coalesced
+    queue->Update("items", 3, "UPDATE items SET c=2");
+
+    queue->Stop();
+    ASSERT_EQ(4u, log.GetSize());
+    EXPECT_STREQ("thread: UPDATE items SET a=1", log.Get(1).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET c=2", log.Get(2).GetData());
+}
+
+TEST_F(WriteBehindTest, FullBatchDoesNotWaitForTheWindow)
+{
+    ASSERT_TRUE(queue->Start(100000, 2));
+
+    queue->Update("items", 1, "UPDATE items SET a=1");
+    queue->Update("items", 2, "UPDATE items SET b=1");
+
+    for(int i = 0; i < 500 && log.GetSize() < 4; i++)
+    {
+        csSleep(10);
+    }
+    ASSERT_EQ(4u, log.GetSize());
+    EXPECT_STREQ("thread: COMMIT", log.Get(3).GetData());
+}
+
+TEST_F(WriteBehindTest, FailedBatchIsWrittenOneByOne)
+{
+    ASSERT_TRUE(queue->Start(100000, 100));
+
+    queue->Update("items", 1, "UPDATE items SET a=1");
+    // Queued, the failure only shows up later
+    EXPECT_TRUE(queue->Update("items", 2, "UPDATE items SET bad=1"));
+    queue->Update("items", 3, "UPDATE items SET c=1");
+    queue->Barrier();
+
+    ASSERT_EQ(7u, log.GetSize());
+    EXPECT_STREQ("thread: UPDATE items SET bad=1", log.Get(2).GetData());
+    EXPECT_STREQ("thread: ROLLBACK", log.Get(3).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET a=1", log.Get(4).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET bad=1", log.Get(5).GetData());
+    EXPECT_STREQ("thread: UPDATE items SET c=1", log.Get(6).GetData());
+}
+
+TEST_F(WriteBehindTest, RecordBuildsTheUpdate)
+{
+    psWriteBehindRecord record(queue, conn, "items", "id");
+    record.AddField("count", 3);
+    record.AddField("name", "sword");
+    record.AddFieldNull("parent");
+    EXPECT_TRUE(record.Execute(7));
+
+    ASSERT_EQ(1u, log.GetSize());
+    EXPECT_STREQ("main: UPDATE items SET count='3',name='sword',parent=NULL where id='7'", log.Get(0).GetData());
+
+    record.Reset();
+    record.AddField("x", 0.5f);
+    record.Execute(8);
+    EXPECT_STREQ("main: UPDATE items SET x='0.5' where id='8'", log.Get(1).GetData());
+}
+
+TEST_F(WriteBehindTest, FlushKeepsDirectUpdates)
+{
+    ASSERT_TRUE(queue->Start(100000, 100));
+
+    queue->Update("characters", 1, "UPDATE characters SET money='1',name='a' where id='1'");
+    queue->Update("characters", 2, "UPDATE characters SET money='5',name='b' where id='2'");
+
+    // A direct update of some columns, like psCharacter::SaveMoney()
+    queue->Flush("characters", 1);
+    conn->Command("UPDATE characters SET money='2' where id='1'");
+
+    queue->Barrier();
+    ASSERT_EQ(5u, log.GetSize());
+    EXPECT_STREQ("main: UPDATE characters SET money='1',name='a' where id='1'", log.Get(0).GetData());
+    EXPECT_STREQ("thread: UPDATE characters SET money='5',name='b' where id='2'", log.Get(3).GetData());
+
+    // The full row is not written again over the direct update
+    csString last;
+    for(size_t i = 0; i < log.GetSize(); i++)
+    {
+        if(log.Get(i).Find("id='1'") != (size_t)-1)
+            last = log.Get(i);
+    }
+    EXPECT_STREQ("main: UPDATE characters SET money='2' where id='1'", last.GetData());
+
+    // Nothing queued for the row anymore
+    queue->Flush("characters", 1);
+    EXPECT_EQ(5u, log.GetSize());
+}
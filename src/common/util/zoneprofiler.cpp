@@ -0,0 +1,293 @@
+/*
+ * zoneprofiler.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+#include <iutil/objreg.h>
+#include <csutil/hash.h>
+#include <csutil/stringarray.h>
+#include <csutil/strset.h>
+
+#include "zoneprofiler.h"
+
+psZoneRing::psZoneRing(size_t size, CS::Threading::ThreadID thread, int number)
+    : thread(thread), number(number), depth(0), written(0)
+{
+    uint32 rounded = 1;
+    while(rounded < size)
+    {
+        rounded <<= 1;
+    }
+    samples = new psZoneSample[rounded];
+    mask = rounded - 1;
+}
+
+psZoneRing::~psZoneRing()
+{
+    delete[] samples;
+}
+
+void psZoneRing::Snapshot(csArray<psZoneSample> &copy, csMicroTicks since)
+{
+    uint32 size = mask + 1;
+    uint32 end = GetWritten();
+    uint32 count = csMin(end, size);
+
+    csArray<psZoneSample> taken(count);
+    for(uint32 i = end - count; i != end; i++)
+    {
+        taken.Push(samples[i & mask]);
+    }
+
+    // The thread went on adding, drop what it may have written over
+    uint32 now = GetWritten();
+    for(uint32 i = 0; i < count; i++)
+    {
+        uint32 index = end - count + i;
+        if(now - index < size && taken[i].start >= since)
+        {
+            copy.Push(taken[i]);
+        }
+    }
+}
+
+//-----------------------------------------------------------------------------
+
+psZoneProfiler* psZoneProfiler::instance = NULL;
+
+psZoneProfiler::psZoneProfiler(size_t ringSize)
+    : scfImplementationType(this), ringSize(ringSize ? ringSize : 1), enabled(true), since(0), ringCount(0)
+{
+}
+
+psZoneProfiler::~psZoneProfiler()
+{
+    if(instance == this)
+        instance = NULL;
+
+    for(int32 i = 0; i < ringCount; i++)
+    {
+        delete rings[i];
+    }
+}
+
+void psZoneProfiler::Register(iObjectRegistry* objreg)
+{
+    if(objreg)
+        objreg->Register(this, "PlaneShift.ZoneProfiler");
+    instance = this;
+}
+
+void psZoneProfiler::Attach(iObjectRegistry* objreg)
+{
+    csRef<iZoneProfiler> profiler = csQueryRegistryTagInterface<iZoneProfiler>(objreg, "PlaneShift.ZoneProfiler");
+    if(profiler)
+        instance = profiler->GetProfiler();
+}
+
+psZoneRing* psZoneProfiler::GetThreadRing()
+{
+    psZoneProfiler* profiler = instance;
+    if(!profiler || !profiler->enabled)
+        return NULL;
+
+    CS::Threading::ThreadID thread = CS::Threading::Thread::GetThreadID();
+    int32 count = CS::Threading::AtomicOperations::Read(&profiler->ringCount);
+    for(int32 i = 0; i < count; i++)
+    {
+        if(profiler->rings[i]->thread == thread)
+            return profiler->rings[i];
+    }
+
+    return profiler->CreateRing(thread);
+}
+
+psZoneRing* psZoneProfiler::CreateRing(CS::Threading::ThreadID thread)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    if(ringCount == ZONEPROFILER_MAX_THREADS)
+        return NULL;
+
+    // Only the thread itself creates its ring, so it can't exist yet
+    psZoneRing* ring = new psZoneRing(ringSize, thread, ringCount + 1);
+    ring->name.Format("thread %d", ring->number);
+    rings[ringCount] = ring;
+    CS::Threading::AtomicOperations::Set(&ringCount, ringCount + 1);
+    return ring;
+}
+
+void psZoneProfiler::SetThreadName(const char* name)
+{
+    psZoneRing* ring = GetThreadRing();
+    if(!ring)
+        return;
+
+    CS::Threading::MutexScopedLock lock(instance->mutex);
+    ring->name = name;
+}
+
+const char* psZoneProfiler::Intern(const char* name)
+{
+    static CS::Threading::Mutex internMutex;
+    static csStringSet names;
+
+    CS::Threading::MutexScopedLock lock(internMutex);
+    return names.Request(names.Request(name));
+}
+
+/// JSON string contents of a zone or thread name.
+static csString EscapeJSON(const char* name)
+{
+    csString escaped;
+    for(const char* c = name; *c; c++)
+    {
+        if(*c == '"' || *c == '\\')
+            escaped.Append('\\');
+        if((unsigned char)*c >= ' ')
+            escaped.Append(*c);
+    }
+    return escaped;
+}
+
+csString psZoneProfiler::ExportChromeTrace()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    csString trace("{\"traceEvents\":[");
+    const char* separator = "\n";
+    for(int32 r = 0; r < ringCount; r++)
+    {
+        psZoneRing* ring = rings[r];
+        csArray<psZoneSample> samples;
+        ring->Snapshot(samples, since);
+
+        trace.AppendFmt("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        separator, ring->number, EscapeJSON(ring->name).GetData());
+        separator = ",\n";
+
+        for(size_t i = 0; i < samples.GetSize(); i++)
+        {
+            trace.AppendFmt(",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%u}",
+                            EscapeJSON(samples[i].name).GetData(), ring->number,
+                            (long long)samples[i].start, samples[i].duration);
+        }
+    }
+    trace.Append("\n]}\n");
+    return trace;
+}
+
+/// Parents before their children.
+static int CompareZoneStart(psZoneSample const &a, psZoneSample const &b)
+{
+    if(a.start != b.start)
+        return a.start < b.start ? -1 : 1;
+    return a.depth < b.depth ? -1 : (a.depth > b.depth ? 1 : 0);
+}
+
+/// A zone of the stack rebuilt for the collapsed export.
+struct psOpenZone
+{
+    csString path;
+    uint32 depth;
+    csMicroTicks end;
+};
+
+csString psZoneProfiler::ExportCollapsed()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    // Own time of each stack, the time of the zone less that of its children
+    csHash<int64, csString> self;
+    for(int32 r = 0; r < ringCount; r++)
+    {
+        psZoneRing* ring = rings[r];
+        csArray<psZoneSample> samples;
+        ring->Snapshot(samples, since);
+        samples.Sort(CompareZoneStart);
+
+        csArray<psOpenZone> stack;
+        for(size_t i = 0; i < samples.GetSize(); i++)
+        {
+            const psZoneSample &sample = samples[i];
+            csMicroTicks end = sample.start + sample.duration;
+            while(stack.GetSize() && (stack.Top().depth >= sample.depth || stack.Top().end < end))
+            {
+                stack.Pop();
+            }
+
+            // The parent may be gone from the ring already, then start at the thread
+            psOpenZone zone;
+            bool parent = stack.GetSize() && stack.Top().depth + 1 == sample.depth;
+            zone.path = parent ? stack.Top().path : ring->name;
+            zone.path.Append(';');
+            zone.path.Append(sample.name);
+            zone.depth = sample.depth;
+            zone.end = end;
+
+            self.PutUnique(zone.path, self.Get(zone.path, 0) + sample.duration);
+            if(parent)
+            {
+                self.PutUnique(stack.Top().path, self.Get(stack.Top().path, 0) - sample.duration);
+            }
+            stack.Push(zone);
+        }
+    }
+
+    csStringArray lines;
+    csHash<int64, csString>::GlobalIterator iter(self.GetIterator());
+    while(iter.HasNext())
+    {
+        csString path;
+        int64 time = iter.Next(path);
+        if(time > 0)
+        {
+            csString line;
+            line.Format("%s %lld\n", path.GetData(), (long long)time);
+            lines.Push(line);
+        }
+    }
+    lines.Sort();
+
+    csString collapsed;
+    for(size_t i = 0; i < lines.GetSize(); i++)
+    {
+        collapsed.Append(lines[i]);
+    }
+    return collapsed;
+}
+
+csString psZoneProfiler::DumpStats()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    csString dump;
+    dump.Format("Zone profiler: %s, %zu samples per thread, %d threads\n",
+                enabled ? "on" : "off", ringSize, (int)ringCount);
+    for(int32 r = 0; r < ringCount; r++)
+    {
+        dump.AppendFmt("%3d %-20s %10u samples\n", rings[r]->number, rings[r]->name.GetData(),
+                       rings[r]->GetWritten());
+    }
+    return dump;
+}
+
+void psZoneProfiler::Reset()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    since = csGetMicroTicks();
+}
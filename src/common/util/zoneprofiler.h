@@ -0,0 +1,228 @@
+/*
+ * zoneprofiler.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ * Timing of nested code zones, kept per thread for trace and flame graph
+ * exports.
+ *
+ */
+
+#ifndef __ZONEPROFILER_H__
+#define __ZONEPROFILER_H__
+
+#include <csutil/array.h>
+#include <csutil/csstring.h>
+#include <csutil/scf_implementation.h>
+#include <csutil/sysfunc.h>
+#include <csutil/threading/atomicops.h>
+#include <csutil/threading/mutex.h>
+#include <csutil/threading/thread.h>
+
+struct iObjectRegistry;
+class psZoneProfiler;
+
+/**
+ * \addtogroup common_util
+ * @{ */
+
+/// Most threads that get a ring of their own.
+#define ZONEPROFILER_MAX_THREADS 64
+
+/**
+ * The profiler as registered in the object registry, so the plugins that
+ * link their own copy of psutil record to the one of the application.
+ */
+struct iZoneProfiler : public virtual iBase
+{
+    SCF_INTERFACE(iZoneProfiler, 0, 0, 1);
+
+    virtual psZoneProfiler* GetProfiler() = 0;
+};
+
+/// One run of a zone.
+struct psZoneSample
+{
+    const char* name;
+    csMicroTicks start;
+    uint32 duration;        ///< In microseconds.
+    uint32 depth;           ///< Zones of the thread that were open around it.
+};
+
+/**
+ * The last zones run by one thread. Only that thread adds to it, so adding
+ * needs no lock; readers drop the samples that may have been overwritten
+ * while they copied.
+ */
+class psZoneRing
+{
+public:
+    psZoneRing(size_t size, CS::Threading::ThreadID thread, int number);
+    ~psZoneRing();
+
+    void Add(const char* name, csMicroTicks start, uint32 duration)
+    {
+        psZoneSample &sample = samples[written & mask];
+        sample.name = name;
+        sample.start = start;
+        sample.duration = duration;
+        sample.depth = depth;
+        CS::Threading::AtomicOperations::Set(&written, (int32)((uint32)written + 1));
+    }
+
+    /// Copy the samples that started at since or later, oldest first.
+    void Snapshot(csArray<psZoneSample> &copy, csMicroTicks since);
+
+    /// Samples added since the ring was created.
+    uint32 GetWritten()
+    {
+        return (uint32)CS::Threading::AtomicOperations::Read(&written);
+    }
+
+    CS::Threading::ThreadID thread;
+    int number;
+    csString name;
+    uint32 depth;           ///< Zones open right now.
+
+protected:
+    psZoneSample* samples;
+    uint32 mask;
+    int32 written;
+};
+
+/**
+ * Profiler of scoped zones, cheap enough to be always on. A zone is timed
+ * from the PS_PROFILE_ZONE() in a scope to the end of it, and stored with
+ * its nesting depth in the ring of the thread. The rings can be exported
+ * as a Chrome trace (chrome://tracing) or as collapsed stacks for the
+ * flame graph tools.
+ *
+ * Zone names are not copied, they must be literals or come from Intern().
+ */
+class psZoneProfiler : public scfImplementation1<psZoneProfiler, iZoneProfiler>
+{
+public:
+    /**
+     * @param ringSize Samples kept per thread, rounded up to a power of two.
+     */
+    psZoneProfiler(size_t ringSize);
+    virtual ~psZoneProfiler();
+
+    virtual psZoneProfiler* GetProfiler()
+    {
+        return this;
+    }
+
+    /**
+     * Make this the profiler of the application and of the plugins loaded
+     * later. Without an object registry only this module records to it.
+     */
+    void Register(iObjectRegistry* objreg);
+
+    /// Record to the profiler registered by the application, if there is one.
+    static void Attach(iObjectRegistry* objreg);
+
+    static psZoneProfiler* GetInstance()
+    {
+        return instance;
+    }
+
+    void SetEnabled(bool enable)
+    {
+        enabled = enable;
+    }
+
+    bool IsEnabled() const
+    {
+        return enabled;
+    }
+
+    /// Get the ring of the calling thread, NULL if nothing is profiled.
+    static psZoneRing* GetThreadRing();
+
+    /// Name the calling thread in the exports.
+    static void SetThreadName(const char* name);
+
+    /// Get a lasting copy of a zone name that is not a literal.
+    static const char* Intern(const char* name);
+
+    /// Export the samples as Chrome trace event JSON.
+    csString ExportChromeTrace();
+
+    /**
+     * Export the samples as collapsed stacks, one line per stack with its
+     * own time in microseconds.
+     */
+    csString ExportCollapsed();
+
+    /// Threads and samples, as text.
+    csString DumpStats();
+
+    /// Leave the samples taken so far out of the exports.
+    void Reset();
+
+protected:
+    psZoneRing* CreateRing(CS::Threading::ThreadID thread);
+
+    static psZoneProfiler* instance;
+
+    size_t ringSize;
+    volatile bool enabled;
+    csMicroTicks since;
+
+    CS::Threading::Mutex mutex;                      ///< Serializes the creation of rings.
+    psZoneRing* rings[ZONEPROFILER_MAX_THREADS];
+    int32 ringCount;
+};
+
+/// Times a zone from its construction to its destruction.
+class psProfileZone
+{
+public:
+    psProfileZone(const char* name) : name(name)
+    {
+        ring = psZoneProfiler::GetThreadRing();
+        if(ring)
+        {
+            ring->depth++;
+            start = csGetMicroTicks();
+        }
+    }
+
+    ~psProfileZone()
+    {
+        if(ring)
+        {
+            uint32 duration = (uint32)(csGetMicroTicks() - start);
+            ring->depth--;
+            ring->Add(name, start, duration);
+        }
+    }
+
+private:
+    const char* name;
+    psZoneRing* ring;
+    csMicroTicks start;
+};
+
+#define PS_PROFILE_ZONE_JOIN2(a, b) a##b
+#define PS_PROFILE_ZONE_JOIN(a, b) PS_PROFILE_ZONE_JOIN2(a, b)
+
+/// Profile the rest of the scope as the named zone.
+#define PS_PROFILE_ZONE(name) psProfileZone PS_PROFILE_ZONE_JOIN(profileZone, __LINE__)(name)
+
+/** @} */
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * zoneprofiler_unittest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/zoneprofiler.h"
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include <gtest/gtest.h>
+
+static bool Contains(const csString &text, const char* part)
+{
+    return text.Find(part) != (size_t)-1;
+}
+
+class ZoneProfilerTest : public ::testing::Test
+{
+protected:
+    void Start(size_t ringSize)
+    {
+        profiler.AttachNew(new psZoneProfiler(ringSize));
+        profiler->Register(NULL);
+        psZoneProfiler::SetThreadName("test");
+    }
+
+    virtual void TearDown()
+    {
+        profiler = NULL;
+        EXPECT_TRUE(psZoneProfiler::GetInstance() == NULL);
+    }
+
+    csRef<psZoneProfiler> profiler;
+};
+
+TEST_F(ZoneProfilerTest, NothingRecordedWithoutProfiler)
+{
+    PS_PROFILE_ZONE("outer");
+    EXPECT_TRUE(psZoneProfiler::GetThreadRing() == NULL);
+}
+
+TEST_F(ZoneProfilerTest, CollapsedStacksNest)
+{
+    Start(64);
+    {
+        PS_PROFILE_ZONE("outer");
+        csSleep(2);
+        {
+            PS_PROFILE_ZONE("inner");
+            csSleep(2);
+        }
+        {
+            PS_PROFILE_ZONE("inner");
+        }
+    }
+    {
+        PS_PROFILE_ZONE("other");
+        csSleep(1);
+    }
+
+    csString collapsed = profiler->ExportCollapsed();
+    EXPECT_TRUE(Contains(collapsed, "test;outer;inner ")) << collapsed.GetData();
+    EXPECT_TRUE(Contains(collapsed, "test;outer ")) << collapsed.GetData();
+    EXPECT_TRUE(Contains(collapsed, "test;other ")) << collapsed.GetData();
+    EXPECT_FALSE(Contains(collapsed, "test;inner")) << collapsed.GetData();
+}
+
+TEST_F(ZoneProfilerTest, RingKeepsTheNewest)
+{
+    Start(4);
+    const char* names[] = { "z0", "z1", "z2", "z3", "z4", "z5", "z6" };
+    for(int i = 0; i < 7; i++)
+    {
+        PS_PROFILE_ZONE(names[i]);
+    }
+
+    csString trace = profiler->ExportChromeTrace();
+    EXPECT_TRUE(Contains(trace, "\"name\":\"thread_name\"")) << trace.GetData();
+    EXPECT_TRUE(Contains(trace, "\"name\":\"test\"")) << trace.GetData();
+    EXPECT_FALSE(Contains(trace, "\"z2\"")) << trace.GetData();
+    for(int i = 3; i < 7; i++)
+    {
+        csString name;
+        name.Format("{\"name\":\"%s\",\"ph\":\"X\"", names[i]);
+        EXPECT_TRUE(Contains(trace, name)) << trace.GetData();
+    }
+}
+
+TEST_F(ZoneProfilerTest, ResetAndDisable)
+{
+    Start(64);
+    {
+        PS_PROFILE_ZONE("before");
+    }
+    csSleep(1);
+    profiler->Reset();
+
+    profiler->SetEnabled(false);
+    {
+        PS_PROFILE_ZONE("disabled");
+    }
+    profiler->SetEnabled(true);
+    {
+        PS_PROFILE_ZONE(psZoneProfiler::Intern(csString("af") + "ter"));
+    }
+
+    csString trace = profiler->ExportChromeTrace();
+    EXPECT_FALSE(Contains(trace, "before")) << trace.GetData();
+    EXPECT_FALSE(Contains(trace, "disabled")) << trace.GetData();
+    EXPECT_TRUE(Contains(trace, "\"after\"")) << trace.GetData();
+}
@@ -56,6 +56,7 @@
 #include "npcclient.h"
 #include "npc.h"
 #include "networkmgr.h"
+#include "pathrequest.h"
 #include "globals.h"
 
 
@@ -476,6 +477,24 @@ int com_fireperc(const char* arg)
     return 0;
 }
 
+int com_pathstats(const char* arg)
+{
+    PathRequestQueue* pathRequests = npcclient->GetPathRequests();
+    if(!pathRequests)
+    {
+        CPrintf(CON_CMDOUTPUT, "No path network loaded.\n");
+        return 0;
+    }
+
+    CPrintf(CON_CMDOUTPUT, "%s", pathRequests->DumpStats().GetData());
+    if(strcasecmp(arg, "reset") == 0)
+    {
+        pathRequests->ResetStats();
+        CPrintf(CON_CMDOUTPUT, "Path request statistics reset.\n");
+    }
+    return 0;
+}
+
 int com_showtime(const char*)
 {
     CPrintf(CON_CMDOUTPUT,"Game time is %d:%02d %d-%d-%d\n",
@@ -520,6 +539,7 @@ const COMMAND commands[] =
     { "help",         false, com_help,         "Show help information" },
     { "info",         false, com_info,         "Short print for 1 NPC"},
     { "list",         false, com_list,         "List entities ( list [char|ent|loc|npc|path|race|recipe|tribe|warpspace|waypoint] <filter> )" },
+    { "pathstats",    false, com_pathstats,    "Show path request queue and path cache statistics ( pathstats [reset] )"},
     { "print",        false, com_print,        "List all behaviors/hate of 1 NPC"},
     { "quit",         true,  com_quit,         "Makes the npc client exit"},
     { "setbuffer",    false, com_setbuffer,    "Set a npc buffer"},
@@ -60,7 +60,7 @@ psNpcMeshAttach::psNpcMeshAttach(gemNPCObject* objectToAttach) : scfImplementati
 
 gemNPCObject::gemNPCObject(psNPCClient* npcclient, EID id)
     :pcmesh(NULL), eid(id), type(0), visible(true), invincible(false),
-     isAlive(true), scale(1.0), baseScale(1.0), instance(DEFAULT_INSTANCE)
+     isAlive(true), scale(1.0), baseScale(1.0), instance(DEFAULT_INSTANCE), gridSector(NULL)
 {
 }
 
@@ -185,6 +185,9 @@ protected:
     InstanceID  instance;
 
     csRef<iThreadReturn> factory;
+
+    iSector*    gridSector;     ///< Sector of the proximity grid this object is stored in, NULL if none.
+    friend class psNPCClient;
 };
 
 
@@ -450,6 +450,8 @@ void NetworkManager::HandleObjectRemoval(MsgEntry* me)
 {
     psRemoveObject mesg(me);
 
+    positionBaselines.DeleteAll(mesg.objectEID);
+
     gemNPCObject* object = npcclient->FindEntityID(mesg.objectEID);
     if(object == NULL)
     {
@@ -1075,7 +1077,12 @@ void NetworkManager::HandlePositionUpdates(MsgEntry* msg)
         InstanceID instance;
         bool forced;
 
-        EID id = updates.Get(pos, sector, instance, forced, 0, GetMsgStrings(), engine);
+        EID id = updates.Get(pos, sector, instance, forced, positionBaselines, 0, GetMsgStrings(), engine);
+        if(!id.IsValid())
+        {
+            // A move out of order, the next keyframe of the entity resyncs it
+            continue;
+        }
         npcclient->SetEntityPos(id, pos, sector, instance, forced);
     }
 }
@@ -1151,7 +1158,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                 }
 
 
-                Perception perception("spoken_to",spokenTo?"true":"false");
+                static const uint32 spokenToID = Perception::Intern("spoken_to");
+                Perception perception(spokenToID,spokenTo?"true":"false");
                 NPCDebug(npc, 5, "Got spoken_to perception for actor %s(%s) with spoken_to=%s.\n",
                          npc->GetName(), ShowID(npcEID), spokenTo?"true":"false");
 
@@ -1178,7 +1186,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                     break;
                 }
 
-                FactionPerception talk("talk",faction,speaker_ent);
+                static const uint32 talkID = Perception::Intern("talk");
+                FactionPerception talk(talkID,faction,speaker_ent);
                 NPCDebug(npc, 5, "Got Talk perception for from actor %s(%s), faction diff=%d.\n",
                          speaker_ent->GetName(), ShowID(speakerEID), faction);
 
@@ -1204,7 +1213,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                     break;
                 }
 
-                AttackPerception attack("attack",attacker_ent);
+                static const uint32 attackID = Perception::Intern("attack");
+                AttackPerception attack(attackID,attacker_ent);
                 NPCDebug(npc, 5, "Got Attack perception for from actor %s(%s).",
                          attacker_ent->GetName(), ShowID(attackerEID));
 
@@ -1294,7 +1304,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                     break;
                 }
 
-                GroupAttackPerception attack("groupattack",attacker_ents,bestSkillSlots);
+                static const uint32 groupAttackID = Perception::Intern("groupattack");
+                GroupAttackPerception attack(groupAttackID,attacker_ents,bestSkillSlots);
                 NPCDebug(npc, 5, "Got Group Attack perception for recognising %i actors in the group.",
                          attacker_ents.GetSize());
 
@@ -1332,7 +1343,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                     break;
                 }
 
-                DamagePerception damage("damage",attacker_ent,dmg);
+                static const uint32 damageID = Perception::Intern("damage");
+                DamagePerception damage(damageID,attacker_ent,dmg);
                 NPCDebug(npc, 5, "Got Damage perception for from actor %s(%s) for %1.1f HP to %.1f HP of %.1f HP.",
                          attacker_ent->GetName(), ShowID(attackerEID), dmg, hp, maxHP);
 
@@ -1501,16 +1513,20 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                 csVector3 pos;
                 psGameObject::GetPosition(target_ent, pos, sector);
 
+                static const uint32 spellSelfID = Perception::Intern("spell:self");
+                static const uint32 spellTargetID = Perception::Intern("spell:target");
+                static const uint32 spellUnknownID = Perception::Intern("spell:unknown");
+
                 if(npc)
                 {
-                    SpellPerception pcpt_self("spell:self",caster_ent,target_ent,type,severity);
+                    SpellPerception pcpt_self(spellSelfID,caster_ent,target_ent,type,severity);
                     npc->TriggerEvent(&pcpt_self, -1, NULL, NULL, true);
                 }
 
-                SpellPerception pcpt_target("spell:target",caster_ent,target_ent,type,severity);
+                SpellPerception pcpt_target(spellTargetID,caster_ent,target_ent,type,severity);
                 npcclient->TriggerEvent(&pcpt_target, 30, &pos, sector, true); // Broadcast to same sector
 
-                SpellPerception pcpt_unknown("spell:unknown",caster_ent,target_ent,type,severity);
+                SpellPerception pcpt_unknown(spellUnknownID,caster_ent,target_ent,type,severity);
                 npcclient->TriggerEvent(&pcpt_unknown, 30, &pos, sector, true); // Broadcast to same sector
 
                 break;
@@ -1538,28 +1554,33 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                     break;
 
 
-                csString pcpt_name;
-                if(npc->GetOwner() == player)
+                // Player ranges first, then the owner ranges
+                static const uint32 rangeIDs[] =
                 {
-                    pcpt_name.Append("owner ");
-                }
-                else
-                {
-                    pcpt_name.Append("player ");
-                }
-                if(cmd == psNPCCommandsMessage::PCPT_ANYRANGEPLAYER)
-                    pcpt_name.Append("anyrange");
+                    Perception::Intern("player anyrange"),
+                    Perception::Intern("player sensed"),
+                    Perception::Intern("player nearby"),
+                    Perception::Intern("player adjacent"),
+                    Perception::Intern("owner anyrange"),
+                    Perception::Intern("owner sensed"),
+                    Perception::Intern("owner nearby"),
+                    Perception::Intern("owner adjacent")
+                };
+
+                size_t range = 0;
                 if(cmd == psNPCCommandsMessage::PCPT_LONGRANGEPLAYER)
-                    pcpt_name.Append("sensed");
+                    range = 1;
                 if(cmd == psNPCCommandsMessage::PCPT_SHORTRANGEPLAYER)
-                    pcpt_name.Append("nearby");
+                    range = 2;
                 if(cmd == psNPCCommandsMessage::PCPT_VERYSHORTRANGEPLAYER)  // PERSONAL_RANGE
-                    pcpt_name.Append("adjacent");
+                    range = 3;
+                if(npc->GetOwner() == player)
+                    range += 4;
 
-                NPCDebug(npc, 5, "Got Player %s in Range of %s with the %s Perception, with faction %d",
-                         player->GetName(), npc_ent->GetName(), pcpt_name.GetData(), int(faction));
+                FactionPerception pcpt(rangeIDs[range], int (faction), player);
 
-                FactionPerception pcpt(pcpt_name, int (faction), player);
+                NPCDebug(npc, 5, "Got Player %s in Range of %s with the %s Perception, with faction %d",
+                         player->GetName(), npc_ent->GetName(), pcpt.GetName().GetData(), int(faction));
 
                 npc->TriggerEvent(&pcpt);
                 break;
@@ -1657,10 +1678,10 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                 csVector3 pos;
                 psGameObject::GetPosition(owner, pos, sector);
 
-                csString str;
-                str.Format("inventory:%s",(inserted?"added":"removed"));
+                static const uint32 addedID = Perception::Intern("inventory:added");
+                static const uint32 removedID = Perception::Intern("inventory:removed");
 
-                InventoryPerception pcpt(str, item_name, count, pos, sector, 5.0);
+                InventoryPerception pcpt(inserted?addedID:removedID, item_name, count, pos, sector, 5.0);
                 npc->TriggerEvent(&pcpt);
 
                 break;
@@ -1679,7 +1700,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
 
                 NPCDebug(npc, 5, "Got Failed to Attack perception");
 
-                Perception failedToAttack("failed to attack");
+                static const uint32 failedToAttackID = Perception::Intern("failed to attack");
+                Perception failedToAttack(failedToAttackID);
                 npc->TriggerEvent(&failedToAttack);
 
                 break;
@@ -1744,7 +1766,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
                 csVector3 pos;
                 psGameObject::GetPosition(npc->GetActor(), pos, sector);
 
-                InventoryPerception pcpt("transfer", item, count, pos, sector, 5.0);
+                static const uint32 transferID = Perception::Intern("transfer");
+                InventoryPerception pcpt(transferID, item, count, pos, sector, 5.0);
 
                 if(target == "tribe" && npc->GetTribe())
                 {
@@ -1790,7 +1813,8 @@ void NetworkManager::HandlePerceptions(MsgEntry* msg)
 
                 NPCDebug(npc, 5, "Got teleport perception to %s\n",toString(pos,sector).GetDataSafe());
 
-                PositionPerception pcpt("teleported",NULL,instance,sector,pos,yrot,0.0);
+                static const uint32 teleportedID = Perception::Intern("teleported");
+                PositionPerception pcpt(teleportedID,NULL,instance,sector,pos,yrot,0.0);
                 npc->TriggerEvent(&pcpt);
                 break;
             }
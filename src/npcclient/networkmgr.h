@@ -66,6 +66,8 @@ protected:
     csHash<NPC*,PID>      cmd_dr_outbound; /// Entities queued for sending of DR.
     int                   cmd_count;       /// Number of command messages queued
 
+    csHash<psEntityPosBaseline,EID> positionBaselines; /// Last positions received, moves are relative to them.
+
     void RequestAllObjects();
 
     /**
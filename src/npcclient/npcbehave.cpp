@@ -390,6 +390,11 @@ bool NPCType::Load(iDocumentNode* node)
 void NPCType::AddReaction(Reaction* reaction)
 {
     reactions.Push(reaction);
+    if(reaction->GetEventID() >= reactionsByEvent.GetSize())
+    {
+        reactionsByEvent.SetSize(reaction->GetEventID() + 1);
+    }
+    reactionsByEvent[reaction->GetEventID()].Push(reaction);
     if(npc)
     {
         npcclient->RegisterReaction(npc, reaction);
@@ -399,6 +404,11 @@ void NPCType::AddReaction(Reaction* reaction)
 void NPCType::InsertReaction(Reaction* reaction)
 {
     reactions.Insert(0, reaction);  // reactions get inserted at beginning so subclass ones take precedence over superclass.
+    if(reaction->GetEventID() >= reactionsByEvent.GetSize())
+    {
+        reactionsByEvent.SetSize(reaction->GetEventID() + 1);
+    }
+    reactionsByEvent[reaction->GetEventID()].Insert(0, reaction);
     if(npc)
     {
         npcclient->RegisterReaction(npc, reaction);
@@ -417,10 +427,15 @@ void NPCType::FirePerception(NPC* npc, Perception* pcpt)
         }
     }
 
-    // Check all reactions
-    for(size_t x=0; x<reactions.GetSize(); x++)
+    // Check the reactions to this perception
+    if(pcpt->GetID() >= reactionsByEvent.GetSize())
+    {
+        return;
+    }
+    csArray<Reaction*> &eventReactions = reactionsByEvent[pcpt->GetID()];
+    for(size_t x=0; x<eventReactions.GetSize(); x++)
     {
-        reactions[x]->React(npc, pcpt);
+        eventReactions[x]->React(npc, pcpt);
     }
 }
 
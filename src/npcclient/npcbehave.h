@@ -200,6 +200,7 @@ protected:
     NPC*                  npc;       ///< Pointer to the NPC for this brain.
     csString              name;      ///< The name of this NPC type.
     csPDelArray<Reaction> reactions; ///< The reactions available for this NPCType.
+    csArray< csArray<Reaction*> > reactionsByEvent; ///< The reactions by event ID, in the order of reactions.
     BehaviorSet           behaviors; ///< The set of behaviors available for this NPCType.
     float                 ang_vel;   ///< Default ang_vel for this NPCType.
     ///< Will be used for all behaviors unless overriden
@@ -31,6 +31,7 @@
 #include "npcbehave.h"
 #include "npcclient.h"
 #include "npc.h"
+#include "perceptions.h"
 // This requires googletest to be installed
 #include <gtest/gtest.h>
 
@@ -95,3 +96,30 @@ TEST_F(BehaviorSetTest, Advance2Behaviors)
     EXPECT_EQ(behavior, behaviorset.Advance(10, npc));
     EXPECT_EQ(behavior2, behaviorset.Advance(1000, npc));
 }
+
+TEST(PerceptionTest, Intern)
+{
+    uint32 attacked = Perception::Intern("test attacked");
+    EXPECT_EQ(attacked, Perception::Intern("test attacked"));
+    EXPECT_NE(attacked, Perception::Intern("test damaged"));
+    EXPECT_STREQ("test attacked", Perception::GetInternedName(attacked));
+    EXPECT_EQ(NULL, Perception::GetInternedName((uint32)Perception::GetInternedCount()));
+
+    Perception perception("test attacked");
+    EXPECT_EQ(attacked, perception.GetID());
+
+    Perception byID(attacked);
+    EXPECT_STREQ("test attacked", byID.GetName().GetData());
+}
+
+TEST(PerceptionTest, NotInterned)
+{
+    size_t count = Perception::GetInternedCount();
+    EXPECT_EQ(Perception::NO_ID, Perception::Find("test made up"));
+
+    // Names no reaction is to are not interned when fired
+    Perception perception("test made up");
+    EXPECT_EQ(Perception::NO_ID, perception.GetID());
+    EXPECT_STREQ("test made up", perception.GetName().GetData());
+    EXPECT_EQ(count, Perception::GetInternedCount());
+}
@@ -30,6 +30,7 @@
 #include <ivaria/reporter.h>
 #include <iutil/vfs.h>
 #include <csutil/csstring.h>
+#include <csutil/set.h>
 #include <iutil/document.h>
 #include <csutil/xmltiny.h>
 #include <cstool/collider.h>
@@ -64,6 +65,7 @@
 //=============================================================================
 #include "npcclient.h"
 #include "pathfind.h"
+#include "pathrequest.h"
 #include "networkmgr.h"
 #include "npcbehave.h"
 #include "npc.h"
@@ -98,15 +100,13 @@ psNPCClient::psNPCClient() : serverconsole(NULL)
     world         = NULL;
     //    PFMaps       = NULL;
     pathNetwork   = NULL;
+    pathRequests  = NULL;
     eventmanager  = NULL;
     recipemanager = NULL;
     running       = true;
     database      = NULL;
     network       = NULL;
     tick_counter  = 0;
-    current_long_range_perception_index = 0;
-    current_long_range_perception_loc_index = 0;
-    current_tribe_home_perception_index = 0;
     gameMinute = gameHour = gameDay = gameMonth = gameYear = 0;
     gameTimeUpdated = 0;
 }
@@ -128,7 +128,15 @@ psNPCClient::~psNPCClient()
     delete database;
 
 
+    delete pathRequests;
     delete pathNetwork;
+
+    csHash<EntityGrid*, csPtrKey<iSector> >::GlobalIterator entityGridIter(entityGrids.GetIterator());
+    while(entityGridIter.HasNext())
+        delete entityGridIter.Next();
+    csHash<SectorLocations*, csPtrKey<iSector> >::GlobalIterator locationGridIter(locationGrids.GetIterator());
+    while(locationGridIter.HasNext())
+        delete locationGridIter.Next();
     //    delete PFMaps;
     delete world;
 
@@ -633,6 +641,8 @@ void psNPCClient::Add(gemNPCObject* object)
         all_gem_objects_by_pid.Put(object->GetPID(), object);
     }
 
+    UpdateEntityGrid(object);
+
     Notify2(LOG_CELPERSIST,"Added gemNPCObject(%s)\n", ShowID(eid));
 }
 
@@ -658,6 +668,8 @@ void psNPCClient::Remove(gemNPCObject* object)
         all_gem_objects_by_pid.DeleteAll(object->GetPID());
     }
 
+    RemoveFromEntityGrid(object);
+
     gemNPCItem* item = dynamic_cast<gemNPCItem*>(object);
     if(item)
     {
@@ -727,11 +739,63 @@ void psNPCClient::RemoveAll()
     all_gem_objects_by_eid.DeleteAll();
     all_gem_objects_by_pid.DeleteAll();
     all_gem_objects.DeleteAll();
+
+    csHash<EntityGrid*, csPtrKey<iSector> >::GlobalIterator iter(entityGrids.GetIterator());
+    while(iter.HasNext())
+        delete iter.Next();
+    entityGrids.DeleteAll();
+}
+
+psNPCClient::EntityGrid* psNPCClient::GetEntityGrid(iSector* sector, bool create)
+{
+    EntityGrid* grid = entityGrids.Get(sector, NULL);
+    if(!grid && create)
+    {
+        grid = new EntityGrid(LONG_RANGE_PERCEPTION);
+        entityGrids.Put(sector, grid);
+    }
+    return grid;
+}
+
+void psNPCClient::UpdateEntityGrid(gemNPCObject* object)
+{
+    csVector3 pos;
+    iSector* sector = NULL;
+    psGameObject::GetPosition(object, pos, sector);
+
+    if(object->gridSector != sector)
+    {
+        RemoveFromEntityGrid(object);
+        if(!sector)
+            return;
+
+        object->gridSector = sector;
+    }
+    else if(!sector)
+    {
+        return;
+    }
+
+    GetEntityGrid(sector, true)->Move(object, pos);
+}
+
+void psNPCClient::RemoveFromEntityGrid(gemNPCObject* object)
+{
+    if(!object->gridSector)
+        return;
+
+    EntityGrid* grid = GetEntityGrid(object->gridSector, false);
+    if(grid)
+    {
+        grid->Remove(object);
+    }
+    object->gridSector = NULL;
 }
 
 void psNPCClient::Remove(NPC* npc)
 {
     npcs.Delete(npc);
+    UnregisterReactions(npc);
 }
 
 
@@ -930,6 +994,11 @@ bool psNPCClient::LoadPathNetwork()
         return false;
     }
 
+    navStruct->SetPathCacheSize(configmanager->GetInt("PlaneShift.NPCClient.PathFinder.CacheSize", 256));
+
+    pathRequests = new PathRequestQueue(navStruct);
+    pathRequests->SetBudget(configmanager->GetInt("PlaneShift.NPCClient.PathFinder.Budget", 10));
+
     pathNetwork = new psPathNetwork();
     return pathNetwork->Load(engine, db, world);
 }
@@ -1160,7 +1229,45 @@ psPath* psNPCClient::FindPath(const char* name)
 
 void psNPCClient::RegisterReaction(NPC* npc, Reaction* reaction)
 {
-    allReactions.Put(reaction->GetEventType(), npc);
+    uint32 id = reaction->GetEventID();
+    if(id >= reactingNPCs.GetSize())
+    {
+        reactingNPCs.SetSize(id + 1);
+    }
+
+    // Once for each NPC, however many reactions it has to the perception
+    reactingNPCs[id].PushSmart(npc);
+}
+
+void psNPCClient::UnregisterReactions(NPC* npc)
+{
+    for(size_t id = 0; id < reactingNPCs.GetSize(); id++)
+    {
+        reactingNPCs[id].Delete(npc);
+    }
+}
+
+void psNPCClient::SetNotUsedReaction(Perception* pcpt)
+{
+    uint32 id = pcpt->GetID();
+    if(id == Perception::NO_ID)
+    {
+        if(notUsedNames.GetSize() < 100)
+        {
+            notUsedNames.Add(pcpt->GetName());
+        }
+        return;
+    }
+    SetNotUsedReaction(id);
+}
+
+void psNPCClient::SetNotUsedReaction(uint32 id)
+{
+    if(id >= notUsedReactions.GetSize())
+    {
+        notUsedReactions.SetSize(id + 1, false);
+    }
+    notUsedReactions[id] = true;
 }
 
 void psNPCClient::TriggerEvent(Perception* pcpt, float maxRange,
@@ -1170,10 +1277,10 @@ void psNPCClient::TriggerEvent(Perception* pcpt, float maxRange,
     bool foundUser = false;
 
     // Only trigger NPCs that have this percpetion type registered as a reaction.
-    csHash<NPC*,csString>::Iterator iter(allReactions.GetIterator(pcpt->GetName()));
-    while(iter.HasNext())
+    size_t count = pcpt->GetID() < reactingNPCs.GetSize() ? reactingNPCs[pcpt->GetID()].GetSize() : 0;
+    for(size_t i = 0; i < count; i++)
     {
-        NPC* npc = iter.Next();
+        NPC* npc = reactingNPCs[pcpt->GetID()][i];
 
         // skip disabled NPCs
         if(npc->IsDisabled())
@@ -1184,7 +1291,7 @@ void psNPCClient::TriggerEvent(Perception* pcpt, float maxRange,
     }
     if(!foundUser)
     {
-        notUsedReactions.PushSmart(pcpt->GetName());
+        SetNotUsedReaction(pcpt);
     }
 }
 
@@ -1201,6 +1308,7 @@ void psNPCClient::SetEntityPos(EID eid, csVector3 &pos, iSector* sector, Instanc
         }
 
         obj->SetPosition(pos,sector,&instance);
+        UpdateEntityGrid(obj);
     }
     else
     {
@@ -1237,6 +1345,14 @@ void psNPCClient::Tick()
 
     csTicks when = csGetTicks();
 
+    // Search the paths that were over the budget of the last ticks
+    if(pathRequests)
+    {
+        ScopedTimer st(250, "tick for path requests");
+
+        pathRequests->Process();
+    }
+
     // Advance tribes
     for(size_t j=0; j<tribes.GetSize(); j++)
     {
@@ -1811,16 +1927,13 @@ void psNPCClient::ListTribeRecipes(const char* tribeID)
 void psNPCClient::ListReactions(const char* pattern)
 {
     csArray<NPC*> lnpcs;
-    csArray<csString> reactions;
 
-    // Extract uniq lists of NPCs and reactions
+    // Extract uniq list of NPCs
+    for(size_t id = 0; id < reactingNPCs.GetSize(); id++)
     {
-        csHash<NPC*,csString>::GlobalIterator iter(allReactions.GetIterator());
-        while(iter.HasNext())
+        for(size_t i = 0; i < reactingNPCs[id].GetSize(); i++)
         {
-            csTuple2<NPC*,csString> item = iter.NextTuple();
-            lnpcs.PushSmart(item.first);
-            reactions.PushSmart(item.second);
+            lnpcs.PushSmart(reactingNPCs[id][i]);
         }
     }
 
@@ -1832,37 +1945,34 @@ void psNPCClient::ListReactions(const char* pattern)
         CPrintf(CON_CMDOUTPUT, "NPC: %s(%s):\n",npc->GetName(),ShowID(npc->GetEID()));
         csString result;
         csString delim = "";
-        csHash<NPC*,csString>::GlobalIterator iter(allReactions.GetIterator());
-        while(iter.HasNext())
+        for(size_t id = 0; id < reactingNPCs.GetSize(); id++)
         {
-            csTuple2<NPC*,csString> item = iter.NextTuple();
-            if(item.first == npc)
+            if(reactingNPCs[id].Find(npc) != csArrayItemNotFound)
             {
-                csString reaction = item.second;
                 if(result.Length() > 70)
                 {
                     CPrintf(CON_CMDOUTPUT,"%s\n",result.GetDataSafe());
                     delim = "";
                     result = "";
                 }
-                result.AppendFmt("%s%s",delim.GetData(),reaction.GetDataSafe());
+                result.AppendFmt("%s%s",delim.GetData(),Perception::GetInternedName((uint32)id));
                 delim = ", ";
             }
         }
         CPrintf(CON_CMDOUTPUT,"%s\n",result.GetDataSafe());
     }
     CPrintf(CON_CMDOUTPUT, "Registered reactions (Per Reaction):\n");
-    csArray<csString>::Iterator reactionIter = reactions.GetIterator();
-    while(reactionIter.HasNext())
+    for(size_t id = 0; id < reactingNPCs.GetSize(); id++)
     {
-        csString reaction = reactionIter.Next();
-        CPrintf(CON_CMDOUTPUT, "Reaction: \"%s\"\n",reaction.GetDataSafe());
+        if(reactingNPCs[id].IsEmpty())
+            continue;
+
+        CPrintf(CON_CMDOUTPUT, "Reaction: \"%s\"\n",Perception::GetInternedName((uint32)id));
         csString result;
         csString delim = "";
-        csHash<NPC*,csString>::Iterator iter(allReactions.GetIterator(reaction));
-        while(iter.HasNext())
+        for(size_t i = 0; i < reactingNPCs[id].GetSize(); i++)
         {
-            NPC* npc = iter.Next();
+            NPC* npc = reactingNPCs[id][i];
             if(result.Length() > 70)
             {
                 CPrintf(CON_CMDOUTPUT,"%s\n",result.GetDataSafe());
@@ -1876,11 +1986,17 @@ void psNPCClient::ListReactions(const char* pattern)
     }
 
     CPrintf(CON_CMDOUTPUT, "Not used reactions:\n");
-    csArray<csString>::Iterator notUsedIter(notUsedReactions.GetIterator());
+    for(size_t id = 0; id < notUsedReactions.GetSize(); id++)
+    {
+        if(notUsedReactions[id])
+        {
+            CPrintf(CON_CMDOUTPUT, "%s\n",Perception::GetInternedName((uint32)id));
+        }
+    }
+    csSet<csString>::GlobalIterator notUsedIter(notUsedNames.GetIterator());
     while(notUsedIter.HasNext())
     {
-        csString type = notUsedIter.Next();
-        CPrintf(CON_CMDOUTPUT, "%s\n",type.GetDataSafe());
+        CPrintf(CON_CMDOUTPUT, "%s\n",notUsedIter.Next().GetData());
     }
 
 }
@@ -1960,231 +2076,283 @@ void psNPCClient::HandleDeath(NPC* who)
     }
 }
 
-void psNPCClient::PerceptProximityItems()
+void psNPCClient::GetReactingNPCs(const uint32* perceptions, size_t count, csArray<NPC*> &list)
 {
-    //
-    // Note: The follwing method could skeep checking a item for
-    // an iteraction. This because fast delete is used to remove
-    // items from list and than a item on the end might be moved right
-    // into the space just checked.
-    //
-
-    int size = (int)all_gem_items.GetSize();
-    if(!size) return;  // Nothing to do if no items
-
-    int check_count = 50; // We only check 50 items each time. This number has to be tuned
-    if(check_count > size)
+    csSet< csPtrKey<NPC> > found;
+    for(size_t i = 0; i < count; i++)
     {
-        // If not more than check_count items don't check them more than once :)
-        check_count = size;
-    }
+        uint32 id = perceptions[i];
+        if(id >= reactingNPCs.GetSize())
+            continue;
 
-    csList<NPC*> npcList;
-    {
-        csHash<NPC*,csString>::Iterator iter(allReactions.GetIterator("item sensed"));
-        while(iter.HasNext())
-        {
-            NPC* npc = iter.Next();
-            npcList.PushBack(npc);
-        }
-    }
-    {
-        csHash<NPC*,csString>::Iterator iter(allReactions.GetIterator("item adjacent"));
-        while(iter.HasNext())
+        for(size_t n = 0; n < reactingNPCs[id].GetSize(); n++)
         {
-            NPC* npc = iter.Next();
-            npcList.PushBack(npc);
-        }
-    }
-    {
-        csHash<NPC*,csString>::Iterator iter(allReactions.GetIterator("item nearby"));
-        while(iter.HasNext())
-        {
-            NPC* npc = iter.Next();
-            npcList.PushBack(npc);
+            NPC* npc = reactingNPCs[id][n];
+            if(!found.Contains(npc))
+            {
+                found.AddNoTest(npc);
+                list.Push(npc);
+            }
         }
     }
+}
 
-    while(check_count--)
+void psNPCClient::PerceptProximityItems()
+{
+    static const uint32 sensedID = Perception::Intern("item sensed");
+    static const uint32 adjacentID = Perception::Intern("item adjacent");
+    static const uint32 nearbyID = Perception::Intern("item nearby");
+    static const uint32 perceptions[] = { sensedID, adjacentID, nearbyID };
+
+    csArray<NPC*> npcList;
+    GetReactingNPCs(perceptions, 3, npcList);
+
+    csArray<gemNPCObject*> nearby;
+    for(size_t i = 0; i < npcList.GetSize(); i++)
     {
-        current_long_range_perception_index++;
-        if(current_long_range_perception_index >= (int)all_gem_items.GetSize())
-        {
-            current_long_range_perception_index = 0;
-        }
+        NPC* npc = npcList[i];
+
+        // skip disabled NPCs
+        if(npc->IsDisabled())
+            continue;
+
+        if(npc->GetActor() == NULL)
+            continue;
+
+        iSector* npc_sector;
+        csVector3 npc_pos;
+        psGameObject::GetPosition(npc->GetActor(), npc_pos, npc_sector);
+
+        // Only percept for items in same sector, NPC will probably not see a item
+        // in other sectors.
+        EntityGrid* grid = GetEntityGrid(npc_sector, false);
+        if(!grid)
+            continue;
 
-        gemNPCItem* item = all_gem_items[current_long_range_perception_index];
+        // The ranges are boxes around the item, so look as far as the corners
+        nearby.Empty();
+        grid->Query(npc_pos, LONG_RANGE_PERCEPTION * 1.7321f, nearby);
 
-        if(item && item->IsPickable())
+        for(size_t j = 0; j < nearby.GetSize(); j++)
         {
+            gemNPCObject* object = nearby[j];
+            if(!object->IsPickable())
+                continue;
+
+            gemNPCItem* item = static_cast<gemNPCItem*>(object);
+
             iSector* item_sector;
             csVector3 item_pos;
             psGameObject::GetPosition(item,item_pos,item_sector);
 
             // Use bounding boxes to check within perception range. This
             // is faster than using the distance.
-            csBox3 bboxLong;
-            bboxLong.AddBoundingVertex(item_pos-csVector3(LONG_RANGE_PERCEPTION));
-            bboxLong.AddBoundingVertexSmart(item_pos+csVector3(LONG_RANGE_PERCEPTION));
-            csBox3 bboxShort;
-            bboxShort.AddBoundingVertex(item_pos-csVector3(SHORT_RANGE_PERCEPTION));
-            bboxShort.AddBoundingVertexSmart(item_pos+csVector3(SHORT_RANGE_PERCEPTION));
-            csBox3 bboxPersonal;
-            bboxPersonal.AddBoundingVertex(item_pos-csVector3(PERSONAL_RANGE_PERCEPTION));
-            bboxPersonal.AddBoundingVertexSmart(item_pos+csVector3(PERSONAL_RANGE_PERCEPTION));
-
-            csList<NPC*>::Iterator iter(npcList);
-            while(iter.HasNext())
-            {
-                NPC* npc = iter.Next();
-
-                // skip disabled NPCs
-                if(npc->IsDisabled())
-                    continue;
-
-                if(npc->GetActor() == NULL)
-                    continue;
-
-                iSector* npc_sector;
-                csVector3 npc_pos;
-                psGameObject::GetPosition(npc->GetActor(), npc_pos, npc_sector);
-
-                // Only percept for items in same sector, NPC will probably not see a item
-                // in other sectors.
-                if(npc_sector != item_sector)
-                {
-                    continue;
-                }
+            csVector3 delta = npc_pos - item_pos;
+            float reach = csMax(fabsf(delta.x), csMax(fabsf(delta.y), fabsf(delta.z)));
 
-                if(npc_pos < bboxLong)
+            if(reach <= LONG_RANGE_PERCEPTION)
+            {
+                if(reach <= SHORT_RANGE_PERCEPTION)
                 {
-                    if(npc_pos < bboxShort)
+                    if(reach <= PERSONAL_RANGE_PERCEPTION)
                     {
-                        if(npc_pos < bboxPersonal)
-                        {
-                            ItemPerception pcpt_adjacent("item adjacent", item);
-                            npc->TriggerEvent(&pcpt_adjacent);
-                            continue;
-                        }
-                        ItemPerception pcpt_nearby("item nearby", item);
-                        npc->TriggerEvent(&pcpt_nearby);
+                        ItemPerception pcpt_adjacent(adjacentID, item);
+                        npc->TriggerEvent(&pcpt_adjacent);
                         continue;
                     }
-                    ItemPerception pcpt_sensed("item sensed", item);
-                    npc->TriggerEvent(&pcpt_sensed);
+                    ItemPerception pcpt_nearby(nearbyID, item);
+                    npc->TriggerEvent(&pcpt_nearby);
                     continue;
                 }
+                ItemPerception pcpt_sensed(sensedID, item);
+                npc->TriggerEvent(&pcpt_sensed);
+                continue;
             }
         }
     }
 }
 
-void psNPCClient::PerceptProximityLocations()
+void psNPCClient::UpdateLocationGrids()
 {
+    csHash<SectorLocations*, csPtrKey<iSector> >::GlobalIterator iter(locationGrids.GetIterator());
+    while(iter.HasNext())
+    {
+        SectorLocations* locations = iter.Next();
+        locations->grid.Clear();
+        locations->large.Empty();
+    }
 
     int size = locationManager->GetNumberOfLocations();
+    for(int i = 0; i < size; i++)
+    {
+        Location* location = locationManager->GetLocation(i);
+        iSector* sector = location->GetSector(engine);
+        if(!sector)
+            continue;
 
-    if(!size) return;  // Nothing to do if no items
+        SectorLocations* locations = locationGrids.Get(sector, NULL);
+        if(!locations)
+        {
+            locations = new SectorLocations;
+            locationGrids.Put(sector, locations);
+        }
 
-    int check_count = 50; // We only check 50 items each time. This number has to be tuned
-    if(check_count > size)
+        if(location->radius > locations->grid.GetCellSize())
+            locations->large.Push(location);
+        else
+            locations->grid.Move(location, location->pos);
+    }
+}
+
+void psNPCClient::PerceptProximityLocations()
+{
+    static const uint32 perceptions[] = { Perception::Intern("location sensed") };
+
+    if(!locationManager->GetNumberOfLocations()) return;  // Nothing to do if no locations
+
+    csArray<NPC*> npcList;
+    GetReactingNPCs(perceptions, 1, npcList);
+    if(npcList.IsEmpty())
     {
-        // If not more than check_count items don't check them more than once :)
-        check_count = size;
+        SetNotUsedReaction(perceptions[0]);
+        return;
     }
 
-    while(check_count--)
+    UpdateLocationGrids();
+
+    csArray<Location*> nearby;
+    for(size_t i = 0; i < npcList.GetSize(); i++)
     {
-        current_long_range_perception_loc_index++;
-        if(current_long_range_perception_loc_index >= size)
+        NPC* npc = npcList[i];
+
+        // skip disabled NPCs
+        if(npc->IsDisabled())
+            continue;
+
+        if(npc->GetActor() == NULL)
+            continue;
+
+        iSector* npc_sector;
+        csVector3 npc_pos;
+        psGameObject::GetPosition(npc->GetActor(), npc_pos, npc_sector);
+
+        // Only locations within the sector of the NPC are sensed.
+        SectorLocations* locations = locationGrids.Get(npc_sector, NULL);
+        if(!locations)
+            continue;
+
+        nearby.Empty();
+        locations->grid.Query(npc_pos, LONG_RANGE_PERCEPTION + locations->grid.GetCellSize(), nearby);
+        for(size_t j = 0; j < locations->large.GetSize(); j++)
         {
-            current_long_range_perception_loc_index = 0;
+            nearby.Push(locations->large[j]);
         }
 
-        Location* location = locationManager->GetLocation(current_long_range_perception_loc_index);
-
-        LocationPerception pcpt_sensed("location sensed", location->type->name, location, engine);
+        for(size_t j = 0; j < nearby.GetSize(); j++)
+        {
+            Location* location = nearby[j];
+            float range = location->radius + LONG_RANGE_PERCEPTION;
+            if((location->pos - npc_pos).SquaredNorm() > range * range)
+                continue;
 
-        // Now trigger every NPC within the sector of the location.
-        TriggerEvent(&pcpt_sensed, location->radius + LONG_RANGE_PERCEPTION,
-                     &location->pos, location->GetSector(engine), true); // Broadcast only in sector
+            LocationPerception pcpt_sensed(perceptions[0], location->type->name, location, engine);
+            npc->TriggerEvent(&pcpt_sensed);
+        }
     }
 }
 
 void psNPCClient::PerceptProximityTribeHome()
 {
-    int size = (int)all_gem_actors.GetSize();
+    static const uint32 enteringID = Perception::Intern("tribe_home:entering");
+    static const uint32 actorEnteredID = Perception::Intern("tribe_home:actor_entered");
+    static const uint32 livingID = Perception::Intern("tribe_home:living");
+    static const uint32 actorLeftID = Perception::Intern("tribe_home:actor_left");
 
-    if(!size) return;  // Nothing to do if no items
-
-    int check_count = 50; // We only check 50 items each time. This number has to be tuned
-    if(check_count > size)
+    // NPCs move on their own, so get their actors where they are now
+    for(size_t i = 0; i < npcs.GetSize(); i++)
     {
-        // If not more than check_count items don't check them more than once :)
-        check_count = size;
+        if(npcs[i]->GetActor())
+            UpdateEntityGrid(npcs[i]->GetActor());
     }
 
-    while(check_count--)
+    csSet< csPtrKey<gemNPCActor> > within;
+    csArray<gemNPCObject*> nearby;
+
+    for(size_t i=0; i<tribes.GetSize(); i++)
     {
-        current_tribe_home_perception_index++;
-        if(current_tribe_home_perception_index >= size)
-        {
-            current_tribe_home_perception_index = 0;
-        }
+        Tribe* tribe = tribes[i];
 
-        gemNPCActor* actor = all_gem_actors[current_tribe_home_perception_index];
-        bool within = false;
+        // Tribes with a home in a sector not loaded have no one within
+        if(!tribe->GetHomeSector())
+            continue;
 
-        // Now we have an actor, check that actor for each tribe.
-        for(size_t i=0; i<tribes.GetSize(); i++)
-        {
-            Tribe* tribe = tribes[i];
+        csVector3 homePos;
+        float homeRadius;
+        iSector* homeSector;
+        tribe->GetHome(homePos, homeRadius, homeSector);
 
-            csVector3 position;
-            iSector* sector;
-            psGameObject::GetPosition(actor, position, sector);
+        // The home may reach into the sectors next to its own
+        nearby.Empty();
+        csHash<EntityGrid*, csPtrKey<iSector> >::GlobalIterator iter(entityGrids.GetIterator());
+        while(iter.HasNext())
+        {
+            csPtrKey<iSector> sector;
+            EntityGrid* grid = iter.Next(sector);
 
-            if(tribe->CheckWithinBoundsTribeHome(NULL, position, sector))
+            csVector3 pos = homePos;
+            if(world->WarpSpace(homeSector, sector, pos))
             {
-                within = true;
-                if(actor->SetWithinTribe(tribe))
-                {
-                    NPC* npc = actor->GetNPC();
-                    if(npc)
-                    {
-                        // Percept the NPC that it has entered a tribe home
-                        Perception pcpt_entering("tribe_home:entering");
-                        npc->TriggerEvent(&pcpt_entering);
-                    }
-
-                    // Percept all members of the tribe that an actor has entered the tribe home
-                    Perception pcpt_entered("tribe_home:actor_entered");
-                    tribe->TriggerEvent(&pcpt_entered);
-                }
+                grid->Query(pos, homeRadius, nearby);
             }
         }
-        if(!within)
+
+        for(size_t j = 0; j < nearby.GetSize(); j++)
         {
-            Tribe* oldTribe = NULL;
+            gemNPCActor* actor = nearby[j]->GetActorPtr();
+            if(!actor)
+                continue;
 
-            if(actor->SetWithinTribe(NULL,&oldTribe))
+            within.Add(actor);
+            if(actor->SetWithinTribe(tribe))
             {
                 NPC* npc = actor->GetNPC();
                 if(npc)
                 {
                     // Percept the NPC that it has entered a tribe home
-                    Perception pcpt_living("tribe_home:living");
-                    npc->TriggerEvent(&pcpt_living);
+                    Perception pcpt_entering(enteringID);
+                    npc->TriggerEvent(&pcpt_entering);
                 }
 
                 // Percept all members of the tribe that an actor has entered the tribe home
-                Perception pcpt_left("tribe_home:actor_left");
-                oldTribe->TriggerEvent(&pcpt_left);
+                Perception pcpt_entered(actorEnteredID);
+                tribe->TriggerEvent(&pcpt_entered);
             }
         }
-
     }
 
+    for(size_t i = 0; i < all_gem_actors.GetSize(); i++)
+    {
+        gemNPCActor* actor = all_gem_actors[i];
+        if(within.Contains(actor))
+            continue;
+
+        Tribe* oldTribe = NULL;
+
+        if(actor->SetWithinTribe(NULL,&oldTribe))
+        {
+            NPC* npc = actor->GetNPC();
+            if(npc)
+            {
+                // Percept the NPC that it has entered a tribe home
+                Perception pcpt_living(livingID);
+                npc->TriggerEvent(&pcpt_living);
+            }
+
+            // Percept all members of the tribe that an actor has entered the tribe home
+            Perception pcpt_left(actorLeftID);
+            oldTribe->TriggerEvent(&pcpt_left);
+        }
+    }
 }
 
 void psNPCClient::UpdateTime(int minute, int hour, int day, int month, int year)
@@ -2204,34 +2372,38 @@ void psNPCClient::UpdateTime(int minute, int hour, int day, int month, int year)
             gameHour,gameMinute,gameYear,gameMonth,gameDay);
 }
 
-iCelHPath* psNPCClient::ShortestPath(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector)
+void psNPCClient::SendPathDebugMeshes(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector)
 {
-    if(npc->IsDebugging(5))
+    // Seems like the getdebugmeshes destroy the path, so get a separate path for debug...
+    iCelHPath* path = GetNavStruct()->ShortestPath(from,fromSector,goal,goalSector);
+    if(path)
     {
-        // Seems like the getdebugmeshes destroy the path, so get a separate path for debug...
-        iCelHPath* path = GetNavStruct()->ShortestPath(from,fromSector,goal,goalSector);
-        if(path)
+        csArray<csSimpleRenderMesh*>* list = path->GetDebugMeshes();
+        csArray<csSimpleRenderMesh*>::Iterator countIter = list->GetIterator();
+        uint16_t count = 0;
+        while(countIter.HasNext())
         {
-            csArray<csSimpleRenderMesh*>* list = path->GetDebugMeshes();
-            csArray<csSimpleRenderMesh*>::Iterator countIter = list->GetIterator();
-            uint16_t count = 0;
-            while(countIter.HasNext())
-            {
-                count++;
-                countIter.Next();
-            }
+            count++;
+            countIter.Next();
+        }
 
-            csArray<csSimpleRenderMesh*>::Iterator iter = list->GetIterator();
-            uint16_t index = 0;
-            while(iter.HasNext())
-            {
-                csSimpleRenderMesh* &simpleRenderMesh = iter.Next();
-                psSimpleRenderMeshMessage msg(0, connection->GetAccessPointers(), "NPC Path", index, count, fromSector, *simpleRenderMesh);
-                msghandler->SendMessage(msg.msg);
-                index++;
-            }
+        csArray<csSimpleRenderMesh*>::Iterator iter = list->GetIterator();
+        uint16_t index = 0;
+        while(iter.HasNext())
+        {
+            csSimpleRenderMesh* &simpleRenderMesh = iter.Next();
+            psSimpleRenderMeshMessage msg(0, connection->GetAccessPointers(), "NPC Path", index, count, fromSector, *simpleRenderMesh);
+            msghandler->SendMessage(msg.msg);
+            index++;
         }
+    }
+}
 
+iCelHPath* psNPCClient::ShortestPath(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector)
+{
+    if(npc->IsDebugging(5))
+    {
+        SendPathDebugMeshes(npc, from, fromSector, goal, goalSector);
     }
 
     iCelHPath* path = GetNavStruct()->ShortestPath(from,fromSector,goal,goalSector);
@@ -2243,7 +2415,18 @@ iCelHPath* psNPCClient::ShortestPath(NPC* npc, const csVector3 &from, iSector* f
     return path;
 }
 
+csPtr<PathRequest> psNPCClient::RequestPath(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector)
+{
+    if(npc->IsDebugging(5))
+    {
+        SendPathDebugMeshes(npc, from, fromSector, goal, goalSector);
+    }
+
+    NPCDebug(npc, 8, "Requesting path between %s and %s",
+             toString(from, fromSector).GetData(), toString(goal, goalSector).GetData());
 
+    return pathRequests->Request(from, fromSector, goal, goalSector);
+}
 
 void psNPCClient::CatchCommand(const char* cmd)
 {
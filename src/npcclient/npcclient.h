@@ -23,6 +23,7 @@
 //=============================================================================
 #include <csutil/csstring.h>
 #include <csutil/hash.h>
+#include <csutil/set.h>
 #include <csutil/ref.h>
 #include <csutil/list.h>
 #include <iutil/vfs.h>
@@ -43,6 +44,7 @@ struct iCollideSystem;
 #include "util/pspath.h"
 #include "util/pspathnetwork.h"
 #include "util/mathscript.h"
+#include "util/spatialgrid.h"
 
 #include "tools/celhpf.h"
 
@@ -73,6 +75,8 @@ class  Waypoint;
 class  Tribe;
 class  psPath;
 class  psPathNetwork;
+class  PathRequest;
+class  PathRequestQueue;
 struct iCelHNavStruct;
 
 /**
@@ -316,6 +320,11 @@ public:
      */
     void RegisterReaction(NPC* npc, Reaction* reaction);
 
+    /**
+     * Unregister all the reactions of an NPC, when the NPC is removed.
+     */
+    void UnregisterReactions(NPC* npc);
+
     /**
      * Sends a perception to all npcs.
      *
@@ -482,6 +491,20 @@ public:
     void Remove(gemNPCObject* object);
     void RemoveAll();
 
+    /**
+     * Update the position of an entity in the proximity grids.
+     *
+     * Has to be called every time the position or sector of the entity
+     * change for the proximity perceptions to find it. NPCs move on their
+     * own, so their actors are only updated before they are looked for.
+     */
+    void UpdateEntityGrid(gemNPCObject* object);
+
+    /**
+     * Remove an entity from the proximity grids.
+     */
+    void RemoveFromEntityGrid(gemNPCObject* object);
+
     /** Remove NPC from NPC Client.
      */
     void Remove(NPC* npc);
@@ -542,6 +565,20 @@ public:
 
     iCelHPath* ShortestPath(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector);
 
+    /**
+     * Search a path right away while the path budget of the tick lasts,
+     * otherwise queue it for a later tick.
+     *
+     * Unlike ShortestPath() this does not hold up the tick, so use it
+     * where the NPC can wait for its path.
+     */
+    csPtr<PathRequest> RequestPath(NPC* npc, const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector);
+
+    PathRequestQueue* GetPathRequests()
+    {
+        return pathRequests;
+    }
+
     psWorld*  GetWorld()
     {
         return world;
@@ -762,6 +799,45 @@ protected:
      */
     void PerceptProximityTribeHome();
 
+    typedef psSpatialGrid<gemNPCObject> EntityGrid;
+
+    /// The locations of a sector, for the proximity perceptions.
+    struct SectorLocations
+    {
+        SectorLocations() : grid(LONG_RANGE_PERCEPTION) {}
+
+        psSpatialGrid<Location> grid;  ///< Locations with a radius up to the cell size.
+        csArray<Location*> large;       ///< Locations too large for the grid, checked by every NPC.
+    };
+
+    /**
+     * Get the grid of the entities in a sector.
+     *
+     * @param sector The sector of the grid.
+     * @param create Create the grid if it doesn't exist.
+     */
+    EntityGrid* GetEntityGrid(iSector* sector, bool create);
+
+    /**
+     * Put the locations in the location grids again. Locations are added,
+     * moved and deleted without notice, so this is done each pass.
+     */
+    void UpdateLocationGrids();
+
+    /**
+     * Get the NPCs with a reaction to any of the perceptions, each once.
+     */
+    void GetReactingNPCs(const uint32* perceptions, size_t count, csArray<NPC*> &list);
+
+    /**
+     * Remember that no NPC has a reaction to the perception, for ListReactions.
+     *
+     * Names no reaction is to are made up when the perception is fired, so
+     * only the first few of them are kept.
+     */
+    void SetNotUsedReaction(Perception* pcpt);
+    void SetNotUsedReaction(uint32 id);
+
 public:
     static psNPCClient*             npcclient;
 protected:
@@ -782,6 +858,7 @@ protected:
     MathScriptEngine*               mathScriptEngine;
     psPathNetwork*                  pathNetwork;
     csRef<iCelHNavStruct>           navStruct;
+    PathRequestQueue*               pathRequests;            ///< Paths searched for the NPCs outside their operations.
     csPDelArray<NPC>                npcs;
     csArray<DeferredNPC>            npcsDeferred;
     csPDelArray<Tribe>              tribes;
@@ -793,8 +870,9 @@ protected:
 
     csHash<psNPCRaceListMessage::NPCRaceInfo_t,csString>     raceInfos; ///< Information about all the races.
 
-    csHash<NPC*,csString>           allReactions;     ///< Hash of all registered reactions.
-    csArray<csString>               notUsedReactions; ///< List of not matched reactions.
+    csArray< csArray<NPC*> >        reactingNPCs;     ///< The NPCs with a reaction, by perception ID.
+    csArray<bool>                   notUsedReactions; ///< Perceptions not matched, by perception ID.
+    csSet<csString>                 notUsedNames;     ///< Perceptions not matched without an ID.
 
     csRef<iCollideSystem>           cdsys;
 
@@ -805,10 +883,10 @@ protected:
     /// Counter used to start events at every nth client tick
     unsigned int                    tick_counter;
 
-    /// Counters used to distribute load regarding perception generation
-    int                             current_long_range_perception_index;
-    int                             current_long_range_perception_loc_index;
-    int                             current_tribe_home_perception_index;
+    /// Entities by sector, for the proximity perceptions.
+    csHash<EntityGrid*, csPtrKey<iSector> >      entityGrids;
+    /// Locations by sector, for the proximity perceptions.
+    csHash<SectorLocations*, csPtrKey<iSector> > locationGrids;
 
     // Game Time
     int                             gameMinute;
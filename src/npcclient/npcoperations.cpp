@@ -434,7 +434,8 @@ bool ScriptOperation::CheckEndPointOk(NPC* npc, const csVector3 &myPos, iSector*
                  toString(myPos, mySector).GetData(),
                  toString(endPos, endSector).GetData(),deviation);
 
-        Perception perception("failed endpoint");
+        static const uint32 failedEndpointID = Perception::Intern("failed endpoint");
+        Perception perception(failedEndpointID);
         npc->TriggerEvent(&perception);
 
         return false;
@@ -636,6 +637,11 @@ MovementOperation::MovementOperation(const MovementOperation* other)
 {
 }
 
+MovementOperation::~MovementOperation()
+{
+    CancelPathRequest();
+}
+
 bool MovementOperation::Load(iDocumentNode* node)
 {
     if(!ScriptOperation::Load(node))
@@ -680,46 +686,39 @@ bool PathReachedEndPoint(NPC* npc, iCelHPath* path, const csVector3 &endPos, iSe
 
 
 
-ScriptOperation::OperationResult MovementOperation::Run(NPC* npc, bool interrupted)
+void MovementOperation::RequestPath(NPC* npc, const csVector3 &myPos, iSector* mySector)
 {
-    iSector* mySector;
-    csVector3 myPos;
+    CancelPathRequest();
+    pathRequest = npcclient->RequestPath(npc, myPos, mySector, endPos, endSector);
+}
 
-    // Reset the consec collisions counter each time a movment operation is started
-    if(!interrupted)
+void MovementOperation::CancelPathRequest()
+{
+    if(pathRequest)
     {
-        consecCollisions = 0;
+        pathRequest->Cancel();
+        pathRequest = NULL;
     }
+}
 
+ScriptOperation::OperationResult MovementOperation::StartPath(NPC* npc, const csVector3 &myPos, iSector* mySector)
+{
+    csRef<PathRequest> request = pathRequest;
+    pathRequest = NULL;
 
-    psGameObject::GetPosition(npc->GetActor(), myPos, mySector);
-
-    if(!GetEndPosition(npc, myPos, mySector, endPos, endSector))
-    {
-        NPCDebug(npc, 5, "Failed to find target position!");
-        StopMovement(npc);
-        return OPERATION_FAILED;  // This operation is complete
-    }
-
-    float distance = npcclient->GetWorld()->Distance2(myPos, mySector, endPos, endSector);
-    if(distance < 0.5)
-    {
-        NPCDebug(npc, 5, "We are done..");
-        StopMovement(npc);
-        return OPERATION_COMPLETED;
-    }
-    path = npcclient->ShortestPath(npc, myPos,mySector,endPos,endSector);
+    path = request->GetPath();
     if(!path || !path->HasNext())
     {
         // We really failed to find a path between us and the target
         NPCDebug(npc, 5, "Failed to find a path between %s and %s",
-                 toString(myPos, mySector).GetData(),
-                 toString(endPos, endSector).GetData());
+                 toString(request->from, request->fromSector).GetData(),
+                 toString(request->goal, request->goalSector).GetData());
 
         StopMovement(npc);
         return OPERATION_FAILED;  // This operation is complete
     }
-    else if(!PathReachedEndPoint(npc, path, endPos, endSector))
+    // The end position may have moved on, check against the one searched for
+    else if(!PathReachedEndPoint(npc, path, request->goal, request->goalSector))
     {
         StopMovement(npc);
         return OPERATION_FAILED;
@@ -752,6 +751,47 @@ ScriptOperation::OperationResult MovementOperation::Run(NPC* npc, bool interrupt
     }
 }
 
+ScriptOperation::OperationResult MovementOperation::Run(NPC* npc, bool interrupted)
+{
+    iSector* mySector;
+    csVector3 myPos;
+
+    // Reset the consec collisions counter each time a movment operation is started
+    if(!interrupted)
+    {
+        consecCollisions = 0;
+    }
+
+
+    psGameObject::GetPosition(npc->GetActor(), myPos, mySector);
+
+    if(!GetEndPosition(npc, myPos, mySector, endPos, endSector))
+    {
+        NPCDebug(npc, 5, "Failed to find target position!");
+        StopMovement(npc);
+        return OPERATION_FAILED;  // This operation is complete
+    }
+
+    float distance = npcclient->GetWorld()->Distance2(myPos, mySector, endPos, endSector);
+    if(distance < 0.5)
+    {
+        NPCDebug(npc, 5, "We are done..");
+        StopMovement(npc);
+        return OPERATION_COMPLETED;
+    }
+
+    // Over the path budget of the tick the path is searched on a later
+    // tick, Advance starts moving when it is found
+    path = NULL;
+    RequestPath(npc, myPos, mySector);
+    if(pathRequest->IsDone())
+    {
+        return StartPath(npc, myPos, mySector);
+    }
+
+    return OPERATION_NOT_COMPLETED; // This behavior isn't done yet
+}
+
 ScriptOperation::OperationResult MovementOperation::Advance(float timedelta, NPC* npc)
 {
 
@@ -763,6 +803,19 @@ ScriptOperation::OperationResult MovementOperation::Advance(float timedelta, NPC
 
     npc->GetLinMove()->GetLastPosition(myPos, myRot, mySector);
 
+    if(pathRequest)
+    {
+        if(pathRequest->IsDone())
+        {
+            return StartPath(npc, myPos, mySector);
+        }
+        else if(!path)
+        {
+            // Nothing to follow until the first path is found
+            return OPERATION_NOT_COMPLETED;
+        }
+    }
+
     if(!UpdateEndPosition(npc, myPos, mySector, endPos, endSector))
     {
         StopMovement(npc);
@@ -772,7 +825,7 @@ ScriptOperation::OperationResult MovementOperation::Advance(float timedelta, NPC
     // Check if path endpoint has changed and needs to be updated
     float distance;
     csRef<iMapNode> dest;
-    if(EndPointChanged(endPos, endSector))
+    if(!pathRequest && EndPointChanged(endPos, endSector))
     {
         NPCDebug(npc, 8, "target diverged, recalculate path between %s and %s",
                  toString(myPos, mySector).GetData(),
@@ -787,88 +840,72 @@ ScriptOperation::OperationResult MovementOperation::Advance(float timedelta, NPC
             StopMovement(npc);
             return OPERATION_COMPLETED;
         }
-        path = npcclient->ShortestPath(npc, myPos, mySector, endPos, endSector);
-        if(!path || !path->HasNext())
+
+        // Keep following the old path until the new one is found
+        RequestPath(npc, myPos, mySector);
+        if(pathRequest->IsDone())
         {
-            // We really failed to find a path between us and the target
-            NPCDebug(npc, 5, "Failed to find a path between %s and %s",
-                     toString(myPos, mySector).GetData(),
-                     toString(endPos, endSector).GetData());
-            StopMovement(npc);
-            return OPERATION_FAILED;
+            return StartPath(npc, myPos, mySector);
         }
-        else if(!PathReachedEndPoint(npc, path, endPos, endSector))
+    }
+
+    dest = path->Current();
+    distance = npcclient->GetWorld()->Distance2(myPos,mySector,dest->GetPosition(),dest->GetSector());
+    if(distance >= INFINITY_DISTANCE)
+    {
+        NPCDebug(npc, 5, "No connection found..");
+        StopMovement(npc);
+        return OPERATION_FAILED;
+    }
+    else if(distance <= 0.5f || distance > (currentDistance+0.001))
+    {
+        if(distance > (currentDistance+0.001))
         {
-            StopMovement(npc);
-            return OPERATION_FAILED;
+            NPCDebug(npc, 6, "We passed localDest(dist=%.4f > curr=%.4f)...", distance, currentDistance);
         }
-        else if(path->GetDistance() < 0.5)     // Distance already adjusted for offset
+        else
         {
-            NPCDebug(npc, 5, "We are done...");
-
-            StopMovement(npc);
-            return OPERATION_COMPLETED; // This operation is complete
+            NPCDebug(npc, 6, "We are at localDest(dist=%.4f)...", distance);
         }
 
-        // Start moving toward new dest
-        dest = path->Next();
-        StartMoveTo(npc, dest->GetPosition(), dest->GetSector(), GetVelocity(npc),
-                    action, angle);
-        currentDistance = npcclient->GetWorld()->Distance2(myPos, mySector,
-                           dest->GetPosition(), dest->GetSector());
-    }
-    else
-    {
-        dest = path->Current();
-        distance = npcclient->GetWorld()->Distance2(myPos,mySector,dest->GetPosition(),dest->GetSector());
-        if(distance >= INFINITY_DISTANCE)
+        if(!path->HasNext() && pathRequest)
         {
-            NPCDebug(npc, 5, "No connection found..");
+            // Wait at the end of the old path for the new one
+            NPCDebug(npc, 6, "End of old path, waiting for the new one.");
             StopMovement(npc);
-            return OPERATION_FAILED;
+            path = NULL;
+            return OPERATION_NOT_COMPLETED;
         }
-        else if(distance <= 0.5f || distance > (currentDistance+0.001))
+        else if(!path->HasNext())
         {
-            if(distance > (currentDistance+0.001))
-            {
-                NPCDebug(npc, 6, "We passed localDest(dist=%.4f > curr=%.4f)...", distance, currentDistance);
-            }
-            else
-            {
-                NPCDebug(npc, 6, "We are at localDest(dist=%.4f)...", distance);
-            }
-
-            if(!path->HasNext())
+            NPCDebug(npc, 5, "We are done.....");
+            StopMovement(npc);
+            if(CheckEndPointOk(npc, myPos, mySector, endPos, endSector))
             {
-                NPCDebug(npc, 5, "We are done.....");
-                StopMovement(npc);
-                if(CheckEndPointOk(npc, myPos, mySector, endPos, endSector))
-                {
-                    return OPERATION_COMPLETED;
-                }
-                else
-                {
-                    return OPERATION_FAILED;
-                }
+                return OPERATION_COMPLETED;
             }
             else
             {
-                dest = path->Next();
-                if(dest == NULL) 
-                {
-                    NPCDebug(npc, 5, "DEST PATH == NULL.");
-                    return OPERATION_NOT_COMPLETED;
-                }
-                NPCDebug(npc, 5, "DEST PATH is good.");
-                StartMoveTo(npc, dest->GetPosition(), dest->GetSector(), GetVelocity(npc), action, angle);
-                currentDistance = npcclient->GetWorld()->Distance2(myPos, mySector, dest->GetPosition(), dest->GetSector());
+                return OPERATION_FAILED;
             }
         }
         else
         {
-            TurnTo(npc, dest->GetPosition(), dest->GetSector(), forward, angle);
+            dest = path->Next();
+            if(dest == NULL) 
+            {
+                NPCDebug(npc, 5, "DEST PATH == NULL.");
+                return OPERATION_NOT_COMPLETED;
+            }
+            NPCDebug(npc, 5, "DEST PATH is good.");
+            StartMoveTo(npc, dest->GetPosition(), dest->GetSector(), GetVelocity(npc), action, angle);
+            currentDistance = npcclient->GetWorld()->Distance2(myPos, mySector, dest->GetPosition(), dest->GetSector());
         }
     }
+    else
+    {
+        TurnTo(npc, dest->GetPosition(), dest->GetSector(), forward, angle);
+    }
 
     // Limit time extrapolation so we arrive near the correct place.
     float close = GetVelocity(npc)*timedelta;
@@ -908,6 +945,8 @@ void MovementOperation::InterruptOperation(NPC* npc)
 {
     ScriptOperation::InterruptOperation(npc);
 
+    CancelPathRequest();
+
     StopMovement(npc);
 }
 
@@ -3406,7 +3445,8 @@ ScriptOperation::OperationResult MeleeOperation::Advance(float timedelta, NPC* n
             // loop.
             npc->GetCurrentBehavior()->ApplyNeedDelta(npc, -5);
 
-            Perception range("target out of range");
+            static const uint32 outOfRangeID = Perception::Intern("target out of range");
+            Perception range(outOfRangeID);
             npc->TriggerEvent(&range);
         }
         else // no hated targets around
@@ -5228,7 +5268,8 @@ ScriptOperation::OperationResult TribeHomeOperation::Run(NPC* npc, bool interrup
 
     tribe->SetHome(pos,radius,sector);
 
-    Perception move("tribe:home moved");
+    static const uint32 homeMovedID = Perception::Intern("tribe:home moved");
+    Perception move(homeMovedID);
     tribe->TriggerEvent(&move);
 
     return OPERATION_COMPLETED; // Nothing more to do for this op.
@@ -47,6 +47,7 @@ struct iSector;
 #include "npc.h"
 #include "reaction.h"
 #include "perceptions.h"
+#include "pathrequest.h"
 
 /**
  * \addtogroup script_operations
@@ -294,6 +295,7 @@ protected:
 
     // Instance variables
     csRef<iCelHPath> path;
+    csRef<PathRequest> pathRequest; ///< The path searched for, the old path is followed until it is done.
 
     // Cache values for end position
     csVector3 endPos;
@@ -311,7 +313,7 @@ public:
 
     MovementOperation(const char*  name);
 
-    virtual ~MovementOperation() { }
+    virtual ~MovementOperation();
 
     virtual bool Load(iDocumentNode* node);
 
@@ -323,6 +325,15 @@ public:
     virtual bool UpdateEndPosition(NPC* npc, const csVector3 &myPos, const iSector* mySector,
                                    csVector3 &endPos, iSector* &endSector) = 0;
 
+    /// Queue the search of a path to the end position.
+    void RequestPath(NPC* npc, const csVector3 &myPos, iSector* mySector);
+
+    /// Drop the path searched for, if any.
+    void CancelPathRequest();
+
+    /// Take the path of the request that is done and start moving along it.
+    OperationResult StartPath(NPC* npc, const csVector3 &myPos, iSector* mySector);
+
     virtual OperationResult Run(NPC* npc,bool interrupted);
 
     virtual OperationResult Advance(float timedelta,NPC* npc);
@@ -0,0 +1,170 @@
+/*
+ * pathrequest.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/zoneprofiler.h"
+
+//=============================================================================
+// Local Includes
+//=============================================================================
+#include "pathrequest.h"
+
+PathRequest::PathRequest(const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector)
+    : from(from), fromSector(fromSector), goal(goal), goalSector(goalSector), done(false), cancelled(false)
+{
+    queued = csGetTicks();
+}
+
+//-----------------------------------------------------------------------------
+
+PathRequestQueue::PathRequestQueue(iCelHNavStruct* navStruct)
+    : navStruct(navStruct), budget(0), tickUsed(0), pendingCount(0)
+{
+    ResetStats();
+}
+
+PathRequestQueue::~PathRequestQueue()
+{
+}
+
+bool PathRequestQueue::HasBudget()
+{
+    return tickUsed < (csMicroTicks)budget * 1000;
+}
+
+csPtr<PathRequest> PathRequestQueue::Request(const csVector3 &from, iSector* fromSector, const csVector3 &goal,
+                                             iSector* goalSector)
+{
+    csRef<PathRequest> request;
+    request.AttachNew(new PathRequest(from, fromSector, goal, goalSector));
+    requestCount++;
+
+    // Older requests are still waiting, so the budget is used up anyway
+    if(pending.IsEmpty() && HasBudget())
+    {
+        Search(request, true);
+        return csPtr<PathRequest>(request);
+    }
+
+    pending.PushBack(request);
+    pendingCount++;
+    if(pendingCount > peakDepth)
+        peakDepth = pendingCount;
+
+    return csPtr<PathRequest>(request);
+}
+
+csPtr<PathRequest> PathRequestQueue::Next()
+{
+    while(!pending.IsEmpty())
+    {
+        csRef<PathRequest> request = pending.Front();
+        pending.PopFront();
+        pendingCount--;
+
+        if(request->IsCancelled())
+        {
+            cancelledCount++;
+            continue;
+        }
+        return csPtr<PathRequest>(request);
+    }
+    return 0;
+}
+
+void PathRequestQueue::Search(PathRequest* request, bool immediate)
+{
+    csMicroTicks start = csGetMicroTicks();
+    {
+        PS_PROFILE_ZONE("PathRequestQueue::Search");
+        request->path = navStruct->FindPath(request->from, request->fromSector, request->goal, request->goalSector);
+    }
+    csMicroTicks time = csGetMicroTicks() - start;
+    csTicks wait = csGetTicks() - request->queued;
+
+    tickUsed += time;
+    searchCount++;
+    if(immediate)
+        immediateCount++;
+    if(!request->path)
+        failedCount++;
+    totalSearch += time;
+    if(time > maxSearch)
+        maxSearch = time;
+    totalWait += wait;
+    if(wait > maxWait)
+        maxWait = wait;
+
+    request->done = true;
+}
+
+void PathRequestQueue::Process()
+{
+    tickUsed = 0;
+    while(HasBudget())
+    {
+        csRef<PathRequest> request = Next();
+        if(!request)
+            break;
+        Search(request, false);
+    }
+}
+
+csString PathRequestQueue::DumpStats()
+{
+    csString dump;
+    dump.Format("Path requests: budget %u ms per tick, %zu queued (peak %zu)\n"
+                "%zu requested, %zu searched (%zu right away), %zu cancelled, %zu without path\n"
+                "average search %.2f ms, max search %.2f ms, average wait %.1f ms, max wait %u ms\n",
+                budget, pendingCount, peakDepth,
+                requestCount, searchCount, immediateCount, cancelledCount, failedCount,
+                searchCount ? float(totalSearch) / searchCount / 1000.0f : 0.0f, float(maxSearch) / 1000.0f,
+                searchCount ? float(totalWait) / searchCount : 0.0f, maxWait);
+
+    celHPathCacheStats cache = navStruct->GetPathCacheStats();
+    dump.AppendFmt("Path cache: %zu of %zu paths, %zu lookups, %.1f%% hits, %zu evicted, %zu invalidated\n",
+                   cache.entries, cache.size, cache.lookups,
+                   cache.lookups ? 100.0f * cache.hits / cache.lookups : 0.0f,
+                   cache.evicted, cache.invalidated);
+    return dump;
+}
+
+void PathRequestQueue::ResetStats()
+{
+    requestCount = 0;
+    searchCount = 0;
+    immediateCount = 0;
+    cancelledCount = 0;
+    failedCount = 0;
+    peakDepth = pendingCount;
+    totalSearch = 0;
+    maxSearch = 0;
+    totalWait = 0;
+    maxWait = 0;
+
+    navStruct->ResetPathCacheStats();
+}
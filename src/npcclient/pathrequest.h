@@ -0,0 +1,161 @@
+/*
+ * pathrequest.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#ifndef __PATHREQUEST_H__
+#define __PATHREQUEST_H__
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csgeom/vector3.h>
+#include <csutil/csstring.h>
+#include <csutil/list.h>
+#include <csutil/ref.h>
+#include <csutil/refarr.h>
+#include <csutil/refcount.h>
+#include <iengine/sector.h>
+
+//=============================================================================
+// Library Includes
+//=============================================================================
+#include "tools/celhpf.h"
+
+/**
+ * \addtogroup npcclient
+ * @{ */
+
+/**
+ * A path asked for from the PathRequestQueue. The path is searched right
+ * away or on a later tick, the NPC picks it up once IsDone() says so.
+ */
+class PathRequest : public csRefCount
+{
+public:
+    PathRequest(const csVector3 &from, iSector* fromSector, const csVector3 &goal, iSector* goalSector);
+
+    /// Has the path been searched? Only then GetPath() may be called.
+    bool IsDone()
+    {
+        return done;
+    }
+
+    /// The path found, NULL if there is none.
+    iCelHPath* GetPath()
+    {
+        return path;
+    }
+
+    /// The path is not wanted anymore, don't search it if not done yet.
+    void Cancel()
+    {
+        cancelled = true;
+    }
+
+    bool IsCancelled()
+    {
+        return cancelled;
+    }
+
+    csVector3         from;
+    csRef<iSector>    fromSector;
+    csVector3         goal;
+    csRef<iSector>    goalSector;
+    csTicks           queued;
+
+protected:
+    friend class PathRequestQueue;
+
+    csRef<iCelHPath>  path;
+    bool              done;
+    bool              cancelled;
+};
+
+/**
+ * Paths for the NPCs, searched within a time budget per tick instead of in
+ * the middle of the operation that needs them. While the budget of a tick
+ * lasts, Request() searches the path right away, so a single NPC starts
+ * moving in the tick it asked. When many NPCs re-path at once, after a
+ * spawn wave or a tribe moving, the paths over the budget are queued and
+ * searched by Process() in the following ticks instead of stalling one tick.
+ *
+ * Everything runs on the npcclient thread. The paths and the navigation
+ * structure hold references to engine objects, like the sectors, and those
+ * reference counts are not thread safe.
+ */
+class PathRequestQueue
+{
+public:
+    PathRequestQueue(iCelHNavStruct* navStruct);
+    ~PathRequestQueue();
+
+    /**
+     * Set the time that may be spent searching paths each tick.
+     *
+     * @param budget Milliseconds of searches per tick.
+     */
+    void SetBudget(csTicks budget)
+    {
+        this->budget = budget;
+    }
+
+    /**
+     * Search a path, right away if the budget of this tick is not used up,
+     * otherwise on a later tick.
+     */
+    csPtr<PathRequest> Request(const csVector3 &from, iSector* fromSector, const csVector3 &goal,
+                               iSector* goalSector);
+
+    /// Start a new tick and search queued paths until its budget is used up.
+    void Process();
+
+    /// Queue depth, searches and their time, and the hit rate of the path cache, as text.
+    csString DumpStats();
+    void ResetStats();
+
+protected:
+    /// Is there time left to search in this tick?
+    bool HasBudget();
+
+    /// Take the oldest request not cancelled, NULL if there is none.
+    csPtr<PathRequest> Next();
+
+    /// Search the path of a request and mark it done.
+    void Search(PathRequest* request, bool immediate);
+
+    csRef<iCelHNavStruct> navStruct;
+    csTicks budget;
+    csMicroTicks tickUsed;           ///< Time spent searching in this tick.
+
+    csList< csRef<PathRequest> > pending;
+    size_t pendingCount;
+
+    // Statistics
+    size_t requestCount;
+    size_t searchCount;
+    size_t immediateCount;           ///< Searched in Request().
+    size_t cancelledCount;
+    size_t failedCount;
+    size_t peakDepth;
+    csMicroTicks totalSearch;
+    csMicroTicks maxSearch;
+    csTicks totalWait;
+    csTicks maxWait;
+};
+
+/** @} */
+
+#endif
@@ -24,6 +24,8 @@
 //=============================================================================
 #include <csutil/csstring.h>
 #include <csgeom/transfrm.h>
+#include <csutil/hash.h>
+#include <csutil/stringarray.h>
 #include <iutil/document.h>
 
 //=============================================================================
@@ -50,9 +52,46 @@
 
 /*----------------------------------------------------------------------------*/
 
+const uint32 Perception::NO_ID = (uint32)~0;
+
+static csHash<uint32, csString> perceptionIDs;
+static csStringArray perceptionNames;
+
+uint32 Perception::Intern(const char* name)
+{
+    uint32 id = perceptionIDs.Get(name, NO_ID);
+    if(id == NO_ID)
+    {
+        id = (uint32)perceptionNames.Push(name);
+        perceptionIDs.Put(name, id);
+    }
+    return id;
+}
+
+uint32 Perception::Find(const char* name)
+{
+    return perceptionIDs.Get(name, NO_ID);
+}
+
+const char* Perception::GetInternedName(uint32 id)
+{
+    if(id >= perceptionNames.GetSize())
+        return NULL;
+    return perceptionNames[id];
+}
+
+size_t Perception::GetInternedCount()
+{
+    return perceptionNames.GetSize();
+}
+
+// Names of the perceptions fired by the classes below, interned once
+static const uint32 timeID = Perception::Intern("time");
+static const uint32 deathID = Perception::Intern("death");
+
 bool Perception::ShouldReact(Reaction* reaction, NPC* npc)
 {
-    if((GetName() == reaction->GetEventType()) && (reaction->GetType(npc).IsEmpty() || type == reaction->GetType(npc)))
+    if((id == reaction->GetEventID()) && (reaction->GetType(npc).IsEmpty() || type == reaction->GetType(npc)))
     {
         return true;
     }
@@ -107,7 +146,7 @@ csString Perception::ToString(NPC* npc)
 
 bool FactionPerception::ShouldReact(Reaction* reaction, NPC* npc)
 {
-    if(name == reaction->GetEventType())
+    if(id == reaction->GetEventID())
     {
         if(player)
         {
@@ -166,7 +205,7 @@ void FactionPerception::ExecutePerception(NPC* npc,float weight)
 
 Perception* ItemPerception::MakeCopy()
 {
-    ItemPerception* p = new ItemPerception(name,item);
+    ItemPerception* p = new ItemPerception(id,item);
     return p;
 }
 
@@ -186,7 +225,7 @@ bool LocationPerception::GetLocation(csVector3 &pos, iSector* &sector)
 
 Perception* LocationPerception::MakeCopy()
 {
-    LocationPerception* p = new LocationPerception(name, type, location, engine);
+    LocationPerception* p = new LocationPerception(id, type, location, engine);
     return p;
 }
 
@@ -207,7 +246,7 @@ bool PositionPerception::GetLocation(csVector3 &pos, iSector* &sector)
 
 Perception* PositionPerception::MakeCopy()
 {
-    PositionPerception* p = new PositionPerception(name,type,instance,sector,pos,yrot,radius);
+    PositionPerception* p = new PositionPerception(id,type,instance,sector,pos,yrot,radius);
     return p;
 }
 
@@ -220,7 +259,7 @@ float PositionPerception::GetRadius() const
 
 Perception* AttackPerception::MakeCopy()
 {
-    AttackPerception* p = new AttackPerception(name,attacker);
+    AttackPerception* p = new AttackPerception(id,attacker);
     return p;
 }
 
@@ -232,7 +271,7 @@ void AttackPerception::ExecutePerception(NPC* npc,float weight)
 
 Perception* GroupAttackPerception::MakeCopy()
 {
-    GroupAttackPerception* p = new GroupAttackPerception(name,attacker_ents,bestSkillSlots);
+    GroupAttackPerception* p = new GroupAttackPerception(id,attacker_ents,bestSkillSlots);
     return p;
 }
 
@@ -248,7 +287,7 @@ void GroupAttackPerception::ExecutePerception(NPC* npc,float weight)
 
 Perception* DamagePerception::MakeCopy()
 {
-    DamagePerception* p = new DamagePerception(name,attacker,damage);
+    DamagePerception* p = new DamagePerception(id,attacker,damage);
     return p;
 }
 
@@ -259,10 +298,10 @@ void DamagePerception::ExecutePerception(NPC* npc,float weight)
 
 //---------------------------------------------------------------------------------
 
-SpellPerception::SpellPerception(const char* name,
+SpellPerception::SpellPerception(uint32 id,
                                  gemNPCObject* caster, gemNPCObject* target,
                                  const char* type, float severity)
-    : Perception(name)
+    : Perception(id)
 {
     this->caster = (gemNPCActor*) caster;
     this->target = (gemNPCActor*) target;
@@ -301,7 +340,7 @@ bool SpellPerception::ShouldReact(Reaction* reaction, NPC* npc)
 
 Perception* SpellPerception::MakeCopy()
 {
-    SpellPerception* p = new SpellPerception(name,caster,target,type,spell_severity);
+    SpellPerception* p = new SpellPerception(id,caster,target,type,spell_severity);
     return p;
 }
 
@@ -314,7 +353,7 @@ void SpellPerception::ExecutePerception(NPC* npc,float weight)
 
 bool TimePerception::ShouldReact(Reaction* reaction, NPC* npc)
 {
-    if(name == reaction->GetEventType())
+    if(id == reaction->GetEventID())
     {
         if(npc->IsDebugging(15))
         {
@@ -386,6 +425,11 @@ bool TimePerception::ShouldReact(Reaction* reaction, NPC* npc)
     return false;
 }
 
+TimePerception::TimePerception(int hour, int minute, int year, int month, int day)
+    : Perception(timeID), gameHour(hour),gameMinute(minute),gameYear(year),gameMonth(month),gameDay(day)
+{
+}
+
 Perception* TimePerception::MakeCopy()
 {
     TimePerception* p = new TimePerception(gameHour,gameMinute,gameYear,gameMonth,gameDay);
@@ -450,6 +494,11 @@ void TimePerception::NormalizeReaction(Reaction* reaction)
 
 //---------------------------------------------------------------------------------
 
+DeathPerception::DeathPerception(EID ent_id)
+    : Perception(deathID), who(ent_id)
+{
+}
+
 Perception* DeathPerception::MakeCopy()
 {
     DeathPerception* p = new DeathPerception(who);
@@ -486,7 +535,7 @@ OwnerCmdPerception::OwnerCmdPerception(const char* name,
 
 bool OwnerCmdPerception::ShouldReact(Reaction* reaction, NPC* npc)
 {
-    if(name == reaction->GetEventType())
+    if(id == reaction->GetEventID())
     {
         return true;
     }
@@ -602,10 +651,8 @@ OwnerActionPerception::OwnerActionPerception(const char* name  ,
     this->action = action;
     this->owner = owner;
     this->pet = pet;
-}
 
-bool OwnerActionPerception::ShouldReact(Reaction* reaction, NPC* npc)
-{
+    // Reacted to as the owner command of the action
     csString event("ownercmd");
     event.Append(':');
 
@@ -628,7 +675,12 @@ bool OwnerActionPerception::ShouldReact(Reaction* reaction, NPC* npc)
             break;
     }
 
-    if(event == reaction->GetEventType())
+    id = Find(event);
+}
+
+bool OwnerActionPerception::ShouldReact(Reaction* reaction, NPC* npc)
+{
+    if(id == reaction->GetEventID())
     {
         return true;
     }
@@ -665,7 +717,7 @@ NPCCmdPerception::NPCCmdPerception(const char* command, NPC* self) : Perception(
 
 bool NPCCmdPerception::ShouldReact(Reaction* reaction, NPC* npc)
 {
-    if(name == reaction->GetEventType() &&
+    if(id == reaction->GetEventID() &&
             (name.StartsWith("npccmd:global:", true) ||
              (name.StartsWith("npccmd:self:", true) && npc == self)))
     {
@@ -59,16 +59,23 @@ class Perception
 {
 protected:
     csString name;       ///< The name of this perception.
+    uint32   id;         ///< The name interned, Perception::NO_ID if no reaction is to it.
 
     csString type;       ///< Type used by perceptions. Usally they correspond to the same value in a reaction.
 
 public:
+    /// The ID of perceptions with a name no reaction is to.
+    static const uint32 NO_ID;
+
     /**
      * Constructor.
      *
+     * For names made up when the perception is fired. The name is looked up,
+     * not interned, see Perception::Find.
+     *
      * @param name            The name of the perception.
      */
-    Perception(const char* name):name(name) {}
+    Perception(const char* name):name(name),id(Find(name)) {}
 
     /**
      * Constructor.
@@ -76,7 +83,24 @@ public:
      * @param name            The name of the perception.
      * @param type            The type for this perception.
      */
-    Perception(const char* name, const char* type):name(name),type(type) {}
+    Perception(const char* name, const char* type):name(name),id(Find(name)),type(type) {}
+
+    /**
+     * Constructor.
+     *
+     * For perceptions with a constant name, interned once by the code firing them.
+     *
+     * @param id              The ID of the name from Perception::Intern.
+     */
+    Perception(uint32 id):name(GetInternedName(id)),id(id) {}
+
+    /**
+     * Constructor.
+     *
+     * @param id              The ID of the name from Perception::Intern.
+     * @param type            The type for this perception.
+     */
+    Perception(uint32 id, const char* type):name(GetInternedName(id)),id(id),type(type) {}
 
     /**
      * Destructor.
@@ -130,6 +154,57 @@ public:
      */
     virtual const csString &GetName() const;
 
+    /**
+     * Get the ID of the perception, the one of the reactions it is dispatched to.
+     *
+     * The reactions are looked up by this ID, so perceptions are dispatched
+     * without comparing names.
+     *
+     * @return the ID of the perception.
+     */
+    uint32 GetID() const
+    {
+        return id;
+    }
+
+    /**
+     * Intern a perception or reaction event name.
+     *
+     * The same name always gives the same ID. The IDs are handed out from 0
+     * up, so they may be used as index in arrays of reactions. Names are
+     * never dropped, so only the event names of reactions and the constant
+     * names of perceptions are interned.
+     *
+     * @param name            The perception name.
+     *
+     * @return the ID of the name.
+     */
+    static uint32 Intern(const char* name);
+
+    /**
+     * Get the ID of a name without interning it.
+     *
+     * @param name            The perception name.
+     *
+     * @return the ID of the name, or Perception::NO_ID if it isn't interned.
+     *         No reaction is to such a name.
+     */
+    static uint32 Find(const char* name);
+
+    /**
+     * Get the name of an ID given by Perception::Intern.
+     *
+     * @param id              The ID of the name.
+     *
+     * @return the name, or NULL if the ID isn't given out.
+     */
+    static const char* GetInternedName(uint32 id);
+
+    /**
+     * Get the number of names interned, one more than the highest ID.
+     */
+    static size_t GetInternedCount();
+
     /**
      * Get the type of the perception.
      *
@@ -186,8 +261,7 @@ protected:
     int gameHour,gameMinute,gameYear,gameMonth,gameDay;
 
 public:
-    TimePerception(int hour, int minute, int year, int month, int day)
-        : Perception("time"), gameHour(hour),gameMinute(minute),gameYear(year),gameMonth(month),gameDay(day)  {    }
+    TimePerception(int hour, int minute, int year, int month, int day);
     virtual ~TimePerception() {}
 
     virtual bool ShouldReact(Reaction* reaction,NPC* npc);
@@ -217,6 +291,8 @@ protected:
 public:
     FactionPerception(const char* n,int d,gemNPCObject* p)
         : Perception(n), factionDelta(d), player((gemNPCActor*)p)  {    }
+    FactionPerception(uint32 id,int d,gemNPCObject* p)
+        : Perception(id), factionDelta(d), player((gemNPCActor*)p)  {    }
     virtual ~FactionPerception() {}
 
     virtual bool ShouldReact(Reaction* reaction,NPC* npc);
@@ -240,8 +316,8 @@ protected:
     csWeakRef<gemNPCObject> item;
 
 public:
-    ItemPerception(const char* n,gemNPCObject* i)
-        : Perception(n), item(i)  {    }
+    ItemPerception(uint32 id,gemNPCObject* i)
+        : Perception(id), item(i)  {    }
     virtual ~ItemPerception() {}
 
     virtual Perception* MakeCopy();
@@ -263,8 +339,8 @@ protected:
     Location* location;
 
 public:
-    LocationPerception(const char* n, const char* type, Location* location, iEngine* engine)
-        : Perception(n,type), location(location), engine(engine)  {}
+    LocationPerception(uint32 id, const char* type, Location* location, iEngine* engine)
+        : Perception(id,type), location(location), engine(engine)  {}
     virtual ~LocationPerception() {}
 
     virtual Perception* MakeCopy();
@@ -289,8 +365,8 @@ protected:
     float radius;
 
 public:
-    PositionPerception(const char* n, const char* type,InstanceID &instance, iSector* sector, csVector3 &pos, float yrot, float radius)
-        : Perception(n,type), instance(instance), sector(sector), pos(pos), yrot(yrot), radius(radius)  {}
+    PositionPerception(uint32 id, const char* type,InstanceID &instance, iSector* sector, csVector3 &pos, float yrot, float radius)
+        : Perception(id,type), instance(instance), sector(sector), pos(pos), yrot(yrot), radius(radius)  {}
     virtual ~PositionPerception() {}
 
     virtual Perception* MakeCopy();
@@ -314,8 +390,8 @@ protected:
     csWeakRef<gemNPCActor> attacker;
 
 public:
-    AttackPerception(const char* n,gemNPCObject* attack)
-        : Perception(n), attacker((gemNPCActor*) attack) { }
+    AttackPerception(uint32 id,gemNPCObject* attack)
+        : Perception(id), attacker((gemNPCActor*) attack) { }
 
     virtual Perception* MakeCopy();
     virtual void ExecutePerception(NPC* npc,float weight);
@@ -343,8 +419,8 @@ protected:
     csArray<int> bestSkillSlots;
 
 public:
-    GroupAttackPerception(const char* n,csArray<gemNPCObject*> &ents, csArray<int> &slots)
-        : Perception(n), attacker_ents(ents), bestSkillSlots(slots) { }
+    GroupAttackPerception(uint32 id,csArray<gemNPCObject*> &ents, csArray<int> &slots)
+        : Perception(id), attacker_ents(ents), bestSkillSlots(slots) { }
 
     virtual Perception* MakeCopy();
     virtual void ExecutePerception(NPC* npc,float weight);
@@ -365,8 +441,8 @@ protected:
     float damage;
 
 public:
-    DamagePerception(const char* n,gemNPCObject* attack,float dmg)
-        : Perception(n), attacker((gemNPCActor*)attack), damage(dmg) { }
+    DamagePerception(uint32 id,gemNPCObject* attack,float dmg)
+        : Perception(id), attacker((gemNPCActor*)attack), damage(dmg) { }
 
     virtual Perception* MakeCopy();
     virtual void ExecutePerception(NPC* npc,float weight);
@@ -396,7 +472,7 @@ protected:
     float       spell_severity;
 
 public:
-    SpellPerception(const char* name,gemNPCObject* caster,gemNPCObject* target, const char* spell_type, float severity);
+    SpellPerception(uint32 id,gemNPCObject* caster,gemNPCObject* target, const char* spell_type, float severity);
 
     virtual bool ShouldReact(Reaction* reaction,NPC* npc);
     virtual Perception* MakeCopy();
@@ -423,8 +499,7 @@ protected:
     EID who;
 
 public:
-    DeathPerception(EID ent_id)
-        : Perception("death"), who(ent_id) { }
+    DeathPerception(EID ent_id);
 
     virtual Perception* MakeCopy();
     virtual void ExecutePerception(NPC* npc,float weight);
@@ -450,6 +525,12 @@ public:
         type = t;
         sector = s;
     }
+    InventoryPerception(uint32 id,const char* t,const int c, const csVector3 &p, iSector* s, float r)
+        : Perception(id), pos(p), radius(r), count(c)
+    {
+        type = t;
+        sector = s;
+    }
 
     virtual Perception* MakeCopy();
     virtual bool GetLocation(csVector3 &pos, iSector* &sector)
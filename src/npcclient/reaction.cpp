@@ -47,6 +47,7 @@
 /*----------------------------------------------------------------------------*/
 
 Reaction::Reaction():
+    eventID((uint32)~0),
     range(0.0f),
     factionDiff(0),
     activeOnly(false),
@@ -74,6 +75,7 @@ bool Reaction::Load(iDocumentNode* node,BehaviorSet &behaviors)
         Error3("Event type with variables not allowed for %s. From node: %s",eventType.GetData(),node->GetValue());
         return false;
     }
+    eventID                = Perception::Intern(eventType);
 
     // Default to guaranteed
     desireType = DESIRE_GUARANTEED;
@@ -196,6 +198,7 @@ void Reaction::DeepCopy(Reaction &other,BehaviorSet &behaviors)
         affected.Push(behavior);
     }
     eventType              = other.eventType;
+    eventID                = other.eventID;
     range                  = other.range;
     factionDiff            = other.factionDiff;
     oper                   = other.oper;
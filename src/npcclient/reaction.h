@@ -55,6 +55,7 @@ protected:
 
     // members making up the "if statement"
     csString  eventType;
+    uint32    eventID;      ///< The event type interned, see Perception::Intern.
     float     range;
     int       factionDiff;
     csString  oper;
@@ -132,6 +133,10 @@ public:
     bool OnlyInterrupt(Behavior* behavior);
 
     const csString &GetEventType() const;
+    uint32          GetEventID() const
+    {
+        return eventID;
+    }
     float           GetRange()
     {
         return range;
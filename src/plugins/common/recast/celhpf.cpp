@@ -101,7 +101,7 @@ void celHPath::Initialize(iCelPath* highLevelPath)
   iMapNode* goal = hlPath->Next();
   currentSector = firstNode->GetSector();
   csRef<iCelNavMesh> navMesh = navMeshes.Get(currentSector, 0);
-  llPaths[0] = navMesh->ShortestPath(firstNode->GetPosition(), goal->GetPosition());
+  llPaths[0] = navMesh->FindPath(firstNode->GetPosition(), goal->GetPosition());
 
   // Set current node
   currentNode = firstNode;
@@ -161,7 +161,7 @@ iMapNode* celHPath::NextInternal (bool rev)
       else
       {
         csRef<iCelNavMesh> navMesh = navMeshes.Get(currentSector, 0);
-        llPaths[currentllPosition] = navMesh->ShortestPath(currentNode->GetPosition(), dst->GetPosition());
+        llPaths[currentllPosition] = navMesh->FindPath(currentNode->GetPosition(), dst->GetPosition());
         if(rev)
         {
           while(llPaths[currentllPosition]->HasNext())
@@ -353,6 +353,214 @@ csArray<csSimpleRenderMesh*>* celHPath::GetDebugMeshes ()
 
 
 
+/*
+ * celHPathCache
+ */
+
+celHPathCache::celHPathCache ()
+{
+  newest = 0;
+  oldest = 0;
+  size = 0;
+  count = 0;
+  ResetStats();
+}
+
+celHPathCache::~celHPathCache ()
+{
+  Clear();
+}
+
+void celHPathCache::SetSize (size_t size)
+{
+  this->size = size;
+  while (count > size)
+  {
+    Remove(oldest);
+    evicted++;
+  }
+}
+
+void celHPathCache::Unlink (Entry* entry)
+{
+  if (entry->newer)
+  {
+    entry->newer->older = entry->older;
+  }
+  else
+  {
+    newest = entry->older;
+  }
+  if (entry->older)
+  {
+    entry->older->newer = entry->newer;
+  }
+  else
+  {
+    oldest = entry->newer;
+  }
+}
+
+void celHPathCache::PushNewest (Entry* entry)
+{
+  entry->newer = 0;
+  entry->older = newest;
+  if (newest)
+  {
+    newest->newer = entry;
+  }
+  newest = entry;
+  if (!oldest)
+  {
+    oldest = entry;
+  }
+}
+
+void celHPathCache::Remove (Entry* entry)
+{
+  Unlink(entry);
+  entries.DeleteAll(entry->key);
+  count--;
+  delete entry;
+}
+
+bool celHPathCache::Find (const Key& key, csArray<iMapNode*>& nodes)
+{
+  lookups++;
+
+  Entry* entry = entries.Get(key, 0);
+  if (!entry)
+  {
+    return false;
+  }
+  hits++;
+
+  Unlink(entry);
+  PushNewest(entry);
+  nodes = entry->nodes;
+  return true;
+}
+
+void celHPathCache::Add (const Key& key, iCelPath* path, csHash<csRef<iCelNavMesh>, csPtrKey<iSector> >& navMeshes)
+{
+  Entry* entry = new Entry;
+  entry->key = key;
+
+  // Keep the portals and the tiles every node of the path is on
+  size_t nodeCount = path->GetNodeCount();
+  path->Restart();
+  iMapNode* node = path->GetFirst();
+  for (size_t i = 0; node; i++)
+  {
+    if (i > 0 && i < nodeCount - 1)
+    {
+      entry->nodes.Push(node);
+    }
+
+    csPtrKey<iSector> sector = node->GetSector();
+    csRef<iCelNavMesh> navMesh = navMeshes.Get(sector, 0);
+    if (navMesh)
+    {
+      int x, y;
+      navMesh->GetTileLocation(node->GetPosition(), x, y);
+      size_t j = 0;
+      while (j < entry->tiles.GetSize() && entry->tiles[j].sector != node->GetSector())
+      {
+        j++;
+      }
+      if (j == entry->tiles.GetSize())
+      {
+        TileRange range = { node->GetSector(), x, y, x, y };
+        entry->tiles.Push(range);
+      }
+      else
+      {
+        TileRange& range = entry->tiles[j];
+        range.minX = csMin(range.minX, x);
+        range.minY = csMin(range.minY, y);
+        range.maxX = csMax(range.maxX, x);
+        range.maxY = csMax(range.maxY, y);
+      }
+    }
+
+    node = path->HasNext() ? path->Next() : 0;
+  }
+  path->Restart();
+
+  if (!size)
+  {
+    delete entry;
+    return;
+  }
+
+  // Replace a path cached for the same polygons
+  Entry* old = entries.Get(key, 0);
+  if (old)
+  {
+    Remove(old);
+  }
+  while (count >= size)
+  {
+    Remove(oldest);
+    evicted++;
+  }
+
+  entries.Put(key, entry);
+  PushNewest(entry);
+  count++;
+}
+
+void celHPathCache::Invalidate (iSector* sector, int minX, int minY, int maxX, int maxY)
+{
+  Entry* entry = oldest;
+  while (entry)
+  {
+    Entry* next = entry->newer;
+    for (size_t i = 0; i < entry->tiles.GetSize(); i++)
+    {
+      const TileRange& range = entry->tiles[i];
+      if (range.sector == sector && range.minX <= maxX && range.maxX >= minX &&
+          range.minY <= maxY && range.maxY >= minY)
+      {
+        Remove(entry);
+        invalidated++;
+        break;
+      }
+    }
+    entry = next;
+  }
+}
+
+void celHPathCache::Clear ()
+{
+  while (oldest)
+  {
+    Remove(oldest);
+  }
+}
+
+celHPathCacheStats celHPathCache::GetStats ()
+{
+  celHPathCacheStats stats;
+  stats.size = size;
+  stats.entries = count;
+  stats.lookups = lookups;
+  stats.hits = hits;
+  stats.evicted = evicted;
+  stats.invalidated = invalidated;
+  return stats;
+}
+
+void celHPathCache::ResetStats ()
+{
+  lookups = 0;
+  hits = 0;
+  evicted = 0;
+  invalidated = 0;
+}
+
+
+
 /*
  * celHNavStruct
  */
@@ -362,6 +570,7 @@ celHNavStruct::celHNavStruct (const iCelNavMeshParams* params, iObjectRegistry*
   this->objectRegistry = objectRegistry;
   parameters.AttachNew(params->Clone());
   debugMeshes = 0;
+  pathCache.SetSize(256);
 }
 
 celHNavStruct::~celHNavStruct ()
@@ -382,6 +591,7 @@ void celHNavStruct::AddNavMesh(iCelNavMesh* navMesh)
  */
 bool celHNavStruct::BuildHighLevelGraph()
 {
+  pathCache.Clear();
   hlGraph.Invalidate();
   hlGraph = scfCreateInstance<iCelGraph>("cel.celgraph");
   if (!hlGraph)
@@ -583,11 +793,25 @@ bool celHNavStruct::BuildHighLevelGraph()
 
 void celHNavStruct::SetHighLevelGraph(iCelGraph* graph)
 {
+  pathCache.Clear();
   hlGraph = graph;
 }
 
 iCelHPath* celHNavStruct::ShortestPath (const csVector3& from, iSector* fromSector, const csVector3& goal,
     iSector* goalSector)
+{
+  path = FindPath(from, fromSector, goal, goalSector);
+  return path;
+}
+
+iCelHPath* celHNavStruct::ShortestPath (iMapNode* from, iMapNode* goal)
+{
+  path = FindPath(from, goal);
+  return path;
+}
+
+csPtr<iCelHPath> celHNavStruct::FindPath (const csVector3& from, iSector* fromSector, const csVector3& goal,
+    iSector* goalSector)
 {
   csRef<iMapNode> fromNode;
   fromNode.AttachNew(new csMapNode("n"));
@@ -599,7 +823,7 @@ iCelHPath* celHNavStruct::ShortestPath (const csVector3& from, iSector* fromSect
   goalNode->SetPosition(goal);
   goalNode->SetSector(goalSector);
 
-  return ShortestPath(fromNode, goalNode);
+  return FindPath(fromNode, goalNode);
 }
 
 /*
@@ -609,133 +833,214 @@ iCelHPath* celHNavStruct::ShortestPath (const csVector3& from, iSector* fromSect
  * 2- For each two adjacent nodes in the high level path, find the corresponding low level
  * path between those points, using the navigation mesh for their sector.
  * After that, the nodes and edges that were added to the graph can be removed.
+ *
+ * The temporary nodes leave the graph as it was, so several paths found this way can
+ * be in use at once. Both steps are skipped when a path between the same polygons is
+ * cached.
  */
-iCelHPath* celHNavStruct::ShortestPath (iMapNode* from, iMapNode* goal)
+csPtr<iCelHPath> celHNavStruct::FindPath (iMapNode* from, iMapNode* goal)
 {
-  // Add from and goal nodes to the high level graph
-  size_t fromNodeIdx, goalNodeIdx;
-  csRef<iCelNode> fromNode = hlGraph->CreateEmptyNode(fromNodeIdx);
-  csRef<iCelNode> goalNode = hlGraph->CreateEmptyNode(goalNodeIdx);
-  fromNode->SetMapNode(from);
-  goalNode->SetMapNode(goal);
-
-  // Create edges between from and goal nodes and all portals from their respective sectors
   csPtrKey<iSector> fromSector = from->GetSector();
   csPtrKey<iSector> goalSector = goal->GetSector();  
   csRef<iCelNavMesh> fromNavMesh = navMeshes.Get(fromSector, 0);
   csRef<iCelNavMesh> goalNavMesh = navMeshes.Get(goalSector, 0);  
   if (!fromNavMesh || !goalNavMesh)
   {
-    hlGraph->RemoveNode(fromNodeIdx);
-    hlGraph->RemoveNode(goalNodeIdx);
     return 0;
   }
-  // Save edges added to the graph so we can remove them after finding the path.
-  csArray<iCelNode*> tmpEdgesOriginsF;
-  csArray<size_t> tmpEdgesIndicesF;
-  csArray<iCelNode*> tmpEdgesOriginsB;
-  csArray<size_t> tmpEdgesIndicesB;
-  csVector3 box = parameters->GetPolygonSearchBox();
-  size_t size = hlGraph->GetNodeCount();
-  for (size_t i = 0; i < size; i++)
+
+  // Positions on the polygons of a cached path take the same portals
+  celHPathCache::Key cacheKey;
+  cacheKey.fromSector = fromSector;
+  cacheKey.goalSector = goalSector;
+  cacheKey.fromRef = 0;
+  cacheKey.goalRef = 0;
+  if (pathCache.GetSize())
+  {
+    cacheKey.fromRef = fromNavMesh->GetPolygonRef(from->GetPosition());
+    cacheKey.goalRef = goalNavMesh->GetPolygonRef(goal->GetPosition());
+
+    csArray<iMapNode*> portals;
+    if (cacheKey.fromRef && cacheKey.goalRef && pathCache.Find(cacheKey, portals))
+    {
+      csRef<iCelPath> hlPath = scfCreateInstance<iCelPath>("cel.celpath");
+      if (hlPath)
+      {
+        hlPath->AddNode(from);
+        for (size_t i = 0; i < portals.GetSize(); i++)
+        {
+          hlPath->AddNode(portals[i]);
+        }
+        hlPath->AddNode(goal);
+
+        celHPath* newPath = new celHPath(navMeshes);
+        newPath->Initialize(hlPath);
+        return csPtr<iCelHPath>(newPath);
+      }
+    }
+  }
+
+  // Portal nodes of the sectors of the from and goal nodes
+  csRefArray<iCelNode> fromPortals;
+  csRefArray<iCelNode> goalPortals;
   {
-    if (i != fromNodeIdx && i != goalNodeIdx)
+    size_t size = hlGraph->GetNodeCount();
+    for (size_t i = 0; i < size; i++)
     {
-      csRef<iCelNode> node = hlGraph->GetNode(i);
-      csRef<iMapNode> mapNode = node->GetMapNode();
-      csRef<iSector> sector = mapNode->GetSector();
-      // From node
+      iCelNode* node = hlGraph->GetNode(i);
+      iSector* sector = node->GetMapNode()->GetSector();
       if(!sector)
           continue;
       if (sector->QueryObject()->GetID() == fromSector->QueryObject()->GetID())
       {
-        csRef<iCelNavMeshPath> tmpPath = fromNavMesh->ShortestPath(from->GetPosition(), mapNode->GetPosition());
-        if (tmpPath->GetNodeCount() > 0)
-        {
-          csVector3 last;
-          tmpPath->GetLast(last);
-          // Check if last calculated point is within reach of the last given point
-          if (ABS(last[0] - node->GetPosition()[0]) <= box[0] && 
-              ABS(last[1] - node->GetPosition()[1]) <= box[1] &&
-              ABS(last[2] - node->GetPosition()[2]) <= box[2]) 
-          {
-            tmpEdgesOriginsF.Push(fromNode);
-            tmpEdgesIndicesF.Push(hlGraph->AddEdge(fromNode, node, true, tmpPath->Length()));
-          }
-        }
+        fromPortals.Push(node);
       }
-      // Goal node
       if (sector->QueryObject()->GetID() == goalSector->QueryObject()->GetID())
       {
-        csRef<iCelNavMeshPath> tmpPath = goalNavMesh->ShortestPath(mapNode->GetPosition(), goalNode->GetPosition());
-        if (tmpPath->GetNodeCount() > 0)
-        {
-          csVector3 last;
-          tmpPath->GetLast(last);
-          // Check if last calculated point is within reach of the last given point
-          if (ABS(last[0] - goalNode->GetPosition()[0]) <= box[0] && 
-              ABS(last[1] - goalNode->GetPosition()[1]) <= box[1] &&
-              ABS(last[2] - goalNode->GetPosition()[2]) <= box[2]) 
-          {
-            tmpEdgesOriginsB.Push(node);
-            tmpEdgesIndicesB.Push(hlGraph->AddEdge(node, goalNode, true, tmpPath->Length()));
-          }
-        }
+        goalPortals.Push(node);
+      }
+    }
+  }
+
+  // Find the edges from the from node and to the goal node
+  csArray<iCelNode*> fromEdges;
+  csArray<float> fromEdgeWeights;
+  csArray<iCelNode*> goalEdges;
+  csArray<float> goalEdgeWeights;
+  float directWeight = -1;
+  csVector3 box = parameters->GetPolygonSearchBox();
+  for (size_t i = 0; i < fromPortals.GetSize(); i++)
+  {
+    iCelNode* node = fromPortals[i];
+    csRef<iCelNavMeshPath> tmpPath = fromNavMesh->FindPath(from->GetPosition(), node->GetPosition());
+    if (tmpPath->GetNodeCount() > 0)
+    {
+      csVector3 last;
+      tmpPath->GetLast(last);
+      // Check if last calculated point is within reach of the last given point
+      if (ABS(last[0] - node->GetPosition()[0]) <= box[0] && 
+          ABS(last[1] - node->GetPosition()[1]) <= box[1] &&
+          ABS(last[2] - node->GetPosition()[2]) <= box[2]) 
+      {
+        fromEdges.Push(node);
+        fromEdgeWeights.Push(tmpPath->Length());
+      }
+    }
+  }
+  for (size_t i = 0; i < goalPortals.GetSize(); i++)
+  {
+    iCelNode* node = goalPortals[i];
+    csRef<iCelNavMeshPath> tmpPath = goalNavMesh->FindPath(node->GetPosition(), goal->GetPosition());
+    if (tmpPath->GetNodeCount() > 0)
+    {
+      csVector3 last;
+      tmpPath->GetLast(last);
+      // Check if last calculated point is within reach of the last given point
+      if (ABS(last[0] - goal->GetPosition()[0]) <= box[0] && 
+          ABS(last[1] - goal->GetPosition()[1]) <= box[1] &&
+          ABS(last[2] - goal->GetPosition()[2]) <= box[2]) 
+      {
+        goalEdges.Push(node);
+        goalEdgeWeights.Push(tmpPath->Length());
       }
     }
   }
   if (fromSector->QueryObject()->GetID() == goalSector->QueryObject()->GetID())
   {
-    csRef<iCelNavMeshPath> tmpPath = goalNavMesh->ShortestPath(from->GetPosition(), goal->GetPosition());
+    csRef<iCelNavMeshPath> tmpPath = goalNavMesh->FindPath(from->GetPosition(), goal->GetPosition());
     if (tmpPath->GetNodeCount() > 0)
     {
       csVector3 last;
       tmpPath->GetLast(last);
       // Check if last calculated point is within reach of the last given point
-      if (ABS(last[0] - goalNode->GetPosition()[0]) <= box[0] && 
-          ABS(last[1] - goalNode->GetPosition()[1]) <= box[1] &&
-          ABS(last[2] - goalNode->GetPosition()[2]) <= box[2]) 
+      if (ABS(last[0] - goal->GetPosition()[0]) <= box[0] && 
+          ABS(last[1] - goal->GetPosition()[1]) <= box[1] &&
+          ABS(last[2] - goal->GetPosition()[2]) <= box[2]) 
       {
-        tmpEdgesOriginsF.Push(fromNode);
-        tmpEdgesIndicesF.Push(hlGraph->AddEdge(fromNode, goalNode, true, tmpPath->Length()));
+        directWeight = tmpPath->Length();
       }
     }
   }
 
-  // Find path in high level graph
-  bool found = false;
   csRef<iCelPath> hlPath = scfCreateInstance<iCelPath>("cel.celpath");
-  if (hlPath)
+  if (!hlPath)
   {
-    found = hlGraph->ShortestPath2(fromNode, goalNode, hlPath);
+    return 0;
   }
 
-  // Remove edges that were added temporarily.
-  size = tmpEdgesIndicesF.GetSize();
-  for (size_t i = 0; i < size; i++)
-  {
-    hlGraph->RemoveEdge(tmpEdgesOriginsF[i], tmpEdgesIndicesF[i]);
-  }
-  size = tmpEdgesIndicesB.GetSize();
-  for (size_t i = 0; i < size; i++)
+  bool found = false;
   {
-    hlGraph->RemoveEdge(tmpEdgesOriginsB[i], tmpEdgesIndicesB[i]);
-  }
+    // Add from and goal nodes to the high level graph
+    size_t fromNodeIdx, goalNodeIdx;
+    csRef<iCelNode> fromNode = hlGraph->CreateEmptyNode(fromNodeIdx);
+    csRef<iCelNode> goalNode = hlGraph->CreateEmptyNode(goalNodeIdx);
+    fromNode->SetMapNode(from);
+    goalNode->SetMapNode(goal);
+
+    // Save edges added to the graph so we can remove them after finding the path.
+    csArray<size_t> tmpEdgesIndicesF;
+    csArray<size_t> tmpEdgesIndicesB;
+    for (size_t i = 0; i < fromEdges.GetSize(); i++)
+    {
+      tmpEdgesIndicesF.Push(hlGraph->AddEdge(fromNode, fromEdges[i], true, fromEdgeWeights[i]));
+    }
+    for (size_t i = 0; i < goalEdges.GetSize(); i++)
+    {
+      tmpEdgesIndicesB.Push(hlGraph->AddEdge(goalEdges[i], goalNode, true, goalEdgeWeights[i]));
+    }
+    if (directWeight >= 0)
+    {
+      tmpEdgesIndicesF.Push(hlGraph->AddEdge(fromNode, goalNode, true, directWeight));
+    }
+
+    // Find path in high level graph
+    found = hlGraph->ShortestPath2(fromNode, goalNode, hlPath);
+
+    // Remove edges that were added temporarily.
+    for (size_t i = 0; i < tmpEdgesIndicesF.GetSize(); i++)
+    {
+      hlGraph->RemoveEdge(fromNode, tmpEdgesIndicesF[i]);
+    }
+    for (size_t i = 0; i < tmpEdgesIndicesB.GetSize(); i++)
+    {
+      hlGraph->RemoveEdge(goalEdges[i], tmpEdgesIndicesB[i]);
+    }
 
-  // Remove from and goal nodes from the high level graph.
-  hlGraph->RemoveNode(goalNodeIdx);
-  hlGraph->RemoveNode(fromNodeIdx);  
+    // Remove from and goal nodes from the high level graph.
+    hlGraph->RemoveNode(goalNodeIdx);
+    hlGraph->RemoveNode(fromNodeIdx);  
+  }
 
   if (!found || hlPath->GetNodeCount() <= 1)
   {
     return 0;
   }
+
+  if (cacheKey.fromRef && cacheKey.goalRef)
+  {
+    pathCache.Add(cacheKey, hlPath, navMeshes);
+  }
   
   // Initialize path
-  path.AttachNew(new celHPath(navMeshes));
-  path->Initialize(hlPath);
+  celHPath* newPath = new celHPath(navMeshes);
+  newPath->Initialize(hlPath);
 
-  return path;
+  return csPtr<iCelHPath>(newPath);
+}
+
+void celHNavStruct::SetPathCacheSize (size_t size)
+{
+  pathCache.SetSize(size);
+}
+
+celHPathCacheStats celHNavStruct::GetPathCacheStats ()
+{
+  return pathCache.GetStats();
+}
+
+void celHNavStruct::ResetPathCacheStats ()
+{
+  pathCache.ResetStats();
 }
 
 /*
@@ -770,6 +1075,12 @@ bool celHNavStruct::Update (const csBox3& boundingBox, iSector* sector)
   csRef<iCelNavMesh> navMesh = navMeshes.Get(key, 0);
   navMesh->Update(boundingBox);
 
+  // Drop the cached paths crossing the updated tiles
+  int minX, minY, maxX, maxY;
+  navMesh->GetTileLocation(boundingBox.Min(), minX, minY);
+  navMesh->GetTileLocation(boundingBox.Max(), maxX, maxY);
+  pathCache.Invalidate(sector, minX, minY, maxX, maxY);
+
   // Update high level graph
   int nNodes = hlGraph->GetNodeCount();
   csArray<csRef<iCelNode> > sameSectorNodes(hlGraph->GetNodeCount());
@@ -1130,6 +1441,7 @@ SCF_IMPLEMENT_FACTORY (celHNavStructBuilder)
 celHNavStructBuilder::celHNavStructBuilder (iBase* parent) : scfImplementationType (this, parent)
 {
   sectors = 0;
+  threadCount = 1;
   parameters.AttachNew(new celNavMeshParams());
 }
 
@@ -1173,6 +1485,7 @@ bool celHNavStructBuilder::InstantiateNavMeshBuilders ()
       return false;
     }
     builder->SetNavMeshParams(parameters);
+    builder->SetThreadCount(threadCount);
     builder->SetSector(key);
     builders.Put(key, builder);
     currentSector++;
@@ -1187,6 +1500,7 @@ iCelHNavStruct* celHNavStructBuilder::BuildHNavStruct ()
     return 0;
   }
 
+  csTicks start = csGetTicks();
   navStruct.AttachNew(new celHNavStruct(parameters, objectRegistry));
 
   csHash<csRef<iCelNavMeshBuilder>, csPtrKey<iSector> >::GlobalIterator it = builders.GetIterator();
@@ -1219,6 +1533,7 @@ iCelHNavStruct* celHNavStructBuilder::BuildHNavStruct ()
   }
 
   navStruct->BuildHighLevelGraph();
+  csPrintf("Built %d navigation meshes in %u ms\n", totalIterations, csGetTicks() - start);
 
   return navStruct;
 }
@@ -1465,4 +1780,14 @@ void celHNavStructBuilder::SetNavMeshParams (const iCelNavMeshParams* parameters
   }
 }
 
+void celHNavStructBuilder::SetThreadCount (int count)
+{
+  threadCount = csMax(count, 1);
+  csHash<csRef<iCelNavMeshBuilder>, csPtrKey<iSector> >::GlobalIterator it = builders.GetIterator();
+  while (it.HasNext())
+  {
+    it.Next()->SetThreadCount(threadCount);
+  }
+}
+
 } CS_PLUGIN_NAMESPACE_END(celNavMesh)
@@ -27,6 +27,7 @@
 #include <cstool/mapnode.h>
 #include <csutil/csstring.h>
 #include <csutil/hash.h>
+#include <csutil/refarr.h>
 #include <csutil/scf_implementation.h>
 #include <iengine/sector.h>
 #include <iutil/comp.h>
@@ -86,6 +87,106 @@ public:
 
 
 
+/**
+ * Paths found recently, by the polygons they start and end on. Paths between
+ * positions on the same two polygons take the same portals, so a hit only has
+ * to put the new positions at the ends of the cached portals. The low level
+ * paths are searched when the path is followed, as for any other path.
+ *
+ * Each path remembers the tiles its nodes span in each sector, updating one
+ * of those tiles drops it. When the cache is full the least recently used
+ * path makes room.
+ *
+ * The portal nodes are kept as plain pointers, the high level graph holds
+ * them. Only the path built from a hit references them, so the cache has to
+ * be cleared when the graph is replaced.
+ */
+class celHPathCache
+{
+public:
+  struct Key
+  {
+    iSector* fromSector;
+    iSector* goalSector;
+    uint fromRef;
+    uint goalRef;
+
+    uint GetHash () const
+    {
+      return fromRef ^ (goalRef * 2654435761u) ^ (uint)(uintptr_t)fromSector ^ ((uint)(uintptr_t)goalSector << 7);
+    }
+
+    bool operator< (const Key& other) const
+    {
+      if (fromRef != other.fromRef)
+        return fromRef < other.fromRef;
+      if (goalRef != other.goalRef)
+        return goalRef < other.goalRef;
+      if (fromSector != other.fromSector)
+        return fromSector < other.fromSector;
+      return goalSector < other.goalSector;
+    }
+  };
+
+  celHPathCache ();
+  ~celHPathCache ();
+
+  /// Set the most paths kept, 0 to keep none.
+  void SetSize (size_t size);
+  size_t GetSize () const { return size; }
+
+  /**
+   * Get the portal nodes of the path cached for a key, without its ends.
+   * \return False if no path is cached for it.
+   */
+  bool Find (const Key& key, csArray<iMapNode*>& nodes);
+
+  /// Cache a high level path found for a key.
+  void Add (const Key& key, iCelPath* path, csHash<csRef<iCelNavMesh>, csPtrKey<iSector> >& navMeshes);
+
+  /// Drop the paths with nodes in the tiles of a sector between the given tile coordinates.
+  void Invalidate (iSector* sector, int minX, int minY, int maxX, int maxY);
+
+  void Clear ();
+  celHPathCacheStats GetStats ();
+  void ResetStats ();
+
+private:
+  /// Tiles spanned by the nodes of a path in one sector.
+  struct TileRange
+  {
+    iSector* sector;
+    int minX, minY, maxX, maxY;
+  };
+
+  struct Entry
+  {
+    Key key;
+    csArray<iMapNode*> nodes;
+    csArray<TileRange> tiles;
+    Entry* newer;
+    Entry* older;
+  };
+
+  void Unlink (Entry* entry);
+  void PushNewest (Entry* entry);
+  void Remove (Entry* entry);
+
+  csHash<Entry*, Key> entries;
+  Entry* newest;
+  Entry* oldest;
+  size_t size;
+  size_t count;
+
+  // Statistics
+  size_t lookups;
+  size_t hits;
+  size_t evicted;
+  size_t invalidated;
+};
+
+
+
 /**
  * Hierarchical navigation mesh representing the navigable areas of a Map.
  */
@@ -96,7 +197,8 @@ private:
   csRef<iCelNavMeshParams> parameters;
   csHash<csRef<iCelNavMesh>, csPtrKey<iSector> > navMeshes;
   csRef<iCelGraph> hlGraph; // High level graph
-  csRef<celHPath> path;
+  csRef<iCelHPath> path;
+  celHPathCache pathCache;
   csArray<csSimpleRenderMesh*>* debugMeshes;
 
   // Helpers for the SaveToFile method
@@ -116,6 +218,12 @@ public:
   virtual iCelHPath* ShortestPath (const csVector3& from, iSector* fromSector, const csVector3& goal,
                                    iSector* goalSector);
   virtual iCelHPath* ShortestPath (iMapNode* from, iMapNode* goal);
+  virtual csPtr<iCelHPath> FindPath (const csVector3& from, iSector* fromSector, const csVector3& goal,
+                                     iSector* goalSector);
+  virtual csPtr<iCelHPath> FindPath (iMapNode* from, iMapNode* goal);
+  virtual void SetPathCacheSize (size_t size);
+  virtual celHPathCacheStats GetPathCacheStats ();
+  virtual void ResetPathCacheStats ();
   virtual bool Update (const csBox3& boundingBox, iSector* sector = 0);
   virtual bool Update (const csOBB& boundingBox, iSector* sector = 0);
   virtual bool SaveToFile (iVFS* vfs, const char* directory);
@@ -139,6 +247,7 @@ private:
   csRefArray<iSector> sectors;
   csHash<csRef<iCelNavMeshBuilder>, csPtrKey<iSector> > builders;
   csRef<celHNavStruct> navStruct;
+  int threadCount;
 
   bool InstantiateNavMeshBuilders();
 
@@ -159,6 +268,7 @@ public:
   virtual iCelHNavStruct* LoadHNavStruct (iVFS* vfs, const char* directory);
   virtual const iCelNavMeshParams* GetNavMeshParams () const;
   virtual void SetNavMeshParams (const iCelNavMeshParams* parameters);
+  virtual void SetThreadCount (int count);
 };
 
 }
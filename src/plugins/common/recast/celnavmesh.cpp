@@ -25,6 +25,9 @@
 #include "csutil/csendian.h"
 #include "csutil/databuf.h"
 #include "csutil/memfile.h"
+#include "csutil/threading/condition.h"
+#include "csutil/threading/mutex.h"
+#include "csutil/threading/thread.h"
 
 CS_PLUGIN_NAMESPACE_BEGIN(celNavMesh)
 {
@@ -451,6 +454,11 @@ celNavMesh::~celNavMesh ()
     delete debugMeshes;
   }
 
+  for (size_t i = 0; i < freeQueries.GetSize(); i++)
+  {
+    delete freeQueries[i];
+  }
+
   delete detourNavMesh;
   delete detourNavMeshQuery;
 }
@@ -542,8 +550,77 @@ csArray<csPoly3D> celNavMesh::QueryPolygons(const csBox3& box) const
   return result;
 }
 
-// Based on Recast NavMeshTesterTool::recalc()
+celNavMeshQuery::celNavMeshQuery ()
+{
+  query = 0;
+  polys = 0;
+  straightPath = 0;
+  straightPathFlags = 0;
+  straightPathPolys = 0;
+  capacity = 0;
+}
+
+celNavMeshQuery::~celNavMeshQuery ()
+{
+  delete query;
+  delete [] polys;
+  delete [] straightPath;
+  delete [] straightPathFlags;
+  delete [] straightPathPolys;
+}
+
+void celNavMeshQuery::Reserve (int size)
+{
+  if (size <= capacity)
+  {
+    return;
+  }
+
+  delete [] polys;
+  delete [] straightPath;
+  delete [] straightPathFlags;
+  delete [] straightPathPolys;
+  polys = new dtPolyRef[size];
+  straightPath = new float[size * 3];
+  straightPathFlags = new unsigned char[size];
+  straightPathPolys = new dtPolyRef[size];
+  capacity = size;
+}
+
+celNavMeshQuery* celNavMesh::AcquireQuery ()
+{
+  {
+    CS::Threading::MutexScopedLock lock(queryMutex);
+    if (!freeQueries.IsEmpty())
+    {
+      return freeQueries.Pop();
+    }
+  }
+
+  celNavMeshQuery* query = new celNavMeshQuery;
+  query->query = new dtNavMeshQuery;
+  if (!detourNavMesh || query->query->init(detourNavMesh, MAX_NODES) != DT_SUCCESS)
+  {
+    delete query;
+    return 0;
+  }
+  return query;
+}
+
+void celNavMesh::ReleaseQuery (celNavMeshQuery* query)
+{
+  CS::Threading::MutexScopedLock lock(queryMutex);
+  freeQueries.Push(query);
+}
+
 iCelNavMeshPath* celNavMesh::ShortestPath (const csVector3& from, const csVector3& goal, const int maxPathSize)
+{
+  path = FindPath(from, goal, maxPathSize);
+  return path;
+}
+
+// Based on Recast NavMeshTesterTool::recalc()
+csPtr<iCelNavMeshPath> celNavMesh::FindPath (const csVector3& from, const csVector3& goal, const int maxPathSize)
 {
   float startPos[3];
   float endPos[3];
@@ -553,47 +630,80 @@ iCelNavMeshPath* celNavMesh::ShortestPath (const csVector3& from, const csVector
     endPos[i] = goal[i];
   }
 
+  celNavMeshQuery* query = AcquireQuery();
+  if (!query)
+  {
+    return csPtr<iCelNavMeshPath>(new celNavMeshPath(0, 0, 0, 0));
+  }
+  query->Reserve(maxPathSize);
+  dtNavMeshQuery* detourQuery = query->query;
+
   // Find nearest polygons around the origin and destination of the path
   float polyPickExt[3];
   polyPickExt[0] = parameters->GetPolygonSearchBox()[0];
   polyPickExt[1] = parameters->GetPolygonSearchBox()[1];
   polyPickExt[2] = parameters->GetPolygonSearchBox()[2];
   dtPolyRef startRef; 
-  detourNavMeshQuery->findNearestPoly(startPos, polyPickExt, &filter, &startRef, 0);
+  detourQuery->findNearestPoly(startPos, polyPickExt, &filter, &startRef, 0);
   dtPolyRef endRef;
-  detourNavMeshQuery->findNearestPoly(endPos, polyPickExt, &filter, &endRef, 0);
+  detourQuery->findNearestPoly(endPos, polyPickExt, &filter, &endRef, 0);
 
   // Find the polygons that compose the path
-  dtPolyRef* polys = new dtPolyRef[maxPathSize];
   int npolys = 0;
-  detourNavMeshQuery->findPath(startRef, endRef, startPos, endPos, &filter, polys, &npolys, maxPathSize);
+  detourQuery->findPath(startRef, endRef, startPos, endPos, &filter, query->polys, &npolys, maxPathSize);
 
   // Find the actual path inside those polygons
-  float* straightPath = new float[maxPathSize * 3];
-  unsigned char* straightPathFlags = new unsigned char[maxPathSize];
-  dtPolyRef* straightPathPolys = new dtPolyRef[maxPathSize];
   int nstraightPath = 0;
   if (npolys > 0)
   {
-    detourNavMeshQuery->findStraightPath(startPos, endPos, polys, npolys, straightPath, 
-                                         straightPathFlags, straightPathPolys, &nstraightPath, maxPathSize);
+    detourQuery->findStraightPath(startPos, endPos, query->polys, npolys, query->straightPath, 
+                                  query->straightPathFlags, query->straightPathPolys, &nstraightPath, 
+                                  maxPathSize);
   }
+
+  // The path keeps its points, the scratch goes back to the pool
+  celNavMeshPath* result;
   if (nstraightPath > 0)
   {
-    path.AttachNew(new celNavMeshPath(straightPath, nstraightPath, maxPathSize, sector));
+    float* straightPath = new float[maxPathSize * 3];
+    memcpy(straightPath, query->straightPath, nstraightPath * 3 * sizeof(float));
+    result = new celNavMeshPath(straightPath, nstraightPath, maxPathSize, sector);
   }
   else
   {
-    delete [] straightPath;
-    path.AttachNew(new celNavMeshPath(0, 0, 0, 0));
+    result = new celNavMeshPath(0, 0, 0, 0);
   }
+  ReleaseQuery(query);
 
-  // For now, these are not really used
-  delete [] polys;
-  delete [] straightPathFlags;
-  delete [] straightPathPolys;
+  return csPtr<iCelNavMeshPath>(result);
+}
 
-  return path;
+uint celNavMesh::GetPolygonRef (const csVector3& position)
+{
+  celNavMeshQuery* query = AcquireQuery();
+  if (!query)
+  {
+    return 0;
+  }
+
+  float pos[3];
+  float polyPickExt[3];
+  for (int i = 0; i < 3; i++)
+  {
+    pos[i] = position[i];
+    polyPickExt[i] = parameters->GetPolygonSearchBox()[i];
+  }
+  dtPolyRef ref = 0;
+  query->query->findNearestPoly(pos, polyPickExt, &filter, &ref, 0);
+  ReleaseQuery(query);
+
+  return ref;
+}
+
+void celNavMesh::GetTileLocation (const csVector3& position, int& x, int& y) const
+{
+  float pos[3] = { position[0], position[1], position[2] };
+  detourNavMesh->calcTileLoc(pos, &x, &y);
 }
 
 bool celNavMesh::Update (const csBox3& boundingBox)
@@ -1655,13 +1765,8 @@ celNavMeshBuilder::celNavMeshBuilder (iBase* parent) : scfImplementationType (th
   triangleVertices = 0;
   triangleIndices = 0;
   chunkyTriMesh = 0;
-  triangleAreas = 0;
-  solid = 0;
-  chf = 0;
-  cSet = 0;
-  pMesh = 0;
-  dMesh = 0;
 
+  threadCount = 1;
   numberOfVertices = 0;
   numberOfTriangles = 0;
   numberOfOffMeshCon = 0;
@@ -1673,7 +1778,6 @@ celNavMeshBuilder::celNavMeshBuilder (iBase* parent) : scfImplementationType (th
 celNavMeshBuilder::~celNavMeshBuilder ()
 {
   CleanUpSectorData();
-  CleanUpTileData();
 }
 
 void celNavMeshBuilder::CleanUpSectorData () 
@@ -2078,28 +2182,9 @@ bool celNavMeshBuilder::GetSectorData ()
   return true;
 }
 
-// Based on Recast Sample_TileMesh::buildAllTiles()
-THREADED_CALLABLE_IMPL(celNavMeshBuilder,BuildNavMesh)
+void celNavMeshBuilder::InitTileConfig (rcConfig& tileConfig) const
 {
-  CS_ASSERT(currentSector);
-  if (!currentSector) 
-  {
-    return false;
-  }
-
-  navMesh.AttachNew(new celNavMesh(objectRegistry));
-  CS_ASSERT(navMesh.IsValid());
-  navMesh->Initialize(parameters, currentSector, boundingMin, boundingMax);
-
   const float cellSize = parameters->GetCellSize();
-  const int tileSize = parameters->GetTileSize();
-  int gridWidth = 0, gridHeight = 0;
-  rcCalcGridSize(boundingMin, boundingMax, cellSize, &gridWidth, &gridHeight);
-  const int tw = (gridWidth + tileSize - 1) / tileSize;
-  const int th = (gridHeight + tileSize - 1) / tileSize;
-  const float tcs = tileSize * cellSize;
-
-  rcConfig tileConfig;
   memset(&tileConfig, 0, sizeof(tileConfig));
   tileConfig.cs = cellSize;
   tileConfig.ch = parameters->GetCellHeight();  
@@ -2112,58 +2197,257 @@ THREADED_CALLABLE_IMPL(celNavMeshBuilder,BuildNavMesh)
   tileConfig.minRegionArea = (int)rcSqr(parameters->GetMinRegionArea());
   tileConfig.mergeRegionArea = (int)rcSqr(parameters->GetMergeRegionArea());
   tileConfig.maxVertsPerPoly = parameters->GetMaxVertsPerPoly();
-  tileConfig.tileSize = tileSize;
+  tileConfig.tileSize = parameters->GetTileSize();
   tileConfig.borderSize = tileConfig.walkableRadius + 3; // Reserve enough padding.
   tileConfig.width = tileConfig.tileSize + tileConfig.borderSize * 2;
   tileConfig.height = tileConfig.tileSize + tileConfig.borderSize * 2;
   tileConfig.detailSampleDist = parameters->GetDetailSampleDist() < 0.9f ? 0 : cellSize * 
                                 parameters->GetDetailSampleDist();
   tileConfig.detailSampleMaxError = tileConfig.ch * parameters->GetDetailSampleMaxError();
+}
 
-  float tileBoundingMin[3];
-  float tileBoundingMax[3];
-  for (int y = 0; y < th; ++y)
+void celNavMeshBuilder::SetTileBounds (const int tx, const int ty, rcConfig& tileConfig, float* bmin, 
+                                       float* bmax) const
+{
+  const float tcs = tileConfig.tileSize * tileConfig.cs;
+
+  bmin[0] = boundingMin[0] + tx * tcs;
+  bmin[1] = boundingMin[1];
+  bmin[2] = boundingMin[2] + ty * tcs;
+
+  bmax[0] = boundingMin[0] + (tx + 1) * tcs;
+  bmax[1] = boundingMax[1];
+  bmax[2] = boundingMin[2] + (ty + 1) * tcs;
+
+  rcVcopy(tileConfig.bmin, bmin);
+  rcVcopy(tileConfig.bmax, bmax);
+  tileConfig.bmin[0] -= tileConfig.borderSize * tileConfig.cs;
+  tileConfig.bmin[2] -= tileConfig.borderSize * tileConfig.cs;
+  tileConfig.bmax[0] += tileConfig.borderSize * tileConfig.cs;
+  tileConfig.bmax[2] += tileConfig.borderSize * tileConfig.cs;
+}
+
+/**
+ * Tiles of a navigation mesh shared by the threads building them. The
+ * threads take the next tile in x/y order and store its data in the slot
+ * of the tile, from where it is added to the mesh in the same order.
+ */
+struct celNavMeshTileJobs
+{
+  struct Tile
   {
-    int percent = ((float)y/th)*100;
-    csPrintf("%d%%\n",percent); // Print progress %
-    for (int x = 0; x < tw; ++x)
-    {
-      tileBoundingMin[0] = boundingMin[0] + x * tcs;
-      tileBoundingMin[1] = boundingMin[1];
-      tileBoundingMin[2] = boundingMin[2] + y * tcs;
+    unsigned char* data;
+    int dataSize;
+    bool done;
+  };
 
-      tileBoundingMax[0] = boundingMin[0] + (x + 1) * tcs;
-      tileBoundingMax[1] = boundingMax[1];
-      tileBoundingMax[2] = boundingMin[2] + (y + 1) * tcs;
+  CS::Threading::Mutex mutex;
+  CS::Threading::Condition condition;
+  csArray<Tile> tiles;
+  int width;
+  size_t next;
+};
 
-      rcVcopy(tileConfig.bmin, tileBoundingMin);
-      rcVcopy(tileConfig.bmax, tileBoundingMax);
-      tileConfig.bmin[0] -= tileConfig.borderSize * tileConfig.cs;
-      tileConfig.bmin[2] -= tileConfig.borderSize * tileConfig.cs;
-      tileConfig.bmax[0] += tileConfig.borderSize * tileConfig.cs;
-      tileConfig.bmax[2] += tileConfig.borderSize * tileConfig.cs;
+/// Thread building tiles, with a Recast context and scratch of its own.
+class celNavMeshTileWorker : public CS::Threading::Runnable
+{
+public:
+  celNavMeshTileWorker (const celNavMeshBuilder* builder, celNavMeshTileJobs* jobs)
+    : builder(builder), jobs(jobs)
+  {
+  }
+
+  virtual void Run ()
+  {
+    rcConfig tileConfig;
+    builder->InitTileConfig(tileConfig);
+
+    float tileBoundingMin[3];
+    float tileBoundingMax[3];
+    while (true)
+    {
+      size_t index;
+      {
+        CS::Threading::MutexScopedLock lock(jobs->mutex);
+        if (jobs->next == jobs->tiles.GetSize())
+        {
+          return;
+        }
+        index = jobs->next++;
+      }
+
+      const int x = (int)(index % jobs->width);
+      const int y = (int)(index / jobs->width);
+      builder->SetTileBounds(x, y, tileConfig, tileBoundingMin, tileBoundingMax);
 
       int dataSize = 0;
-      unsigned char* data = BuildTile(x, y, tileBoundingMin, tileBoundingMax, tileConfig, dataSize);
-      if (data)
+      unsigned char* data = builder->BuildTile(scratch, x, y, tileBoundingMin, tileBoundingMax, tileConfig, 
+                                               dataSize);
+
+      CS::Threading::MutexScopedLock lock(jobs->mutex);
+      celNavMeshTileJobs::Tile& tile = jobs->tiles[index];
+      tile.data = data;
+      tile.dataSize = dataSize;
+      tile.done = true;
+      jobs->condition.NotifyAll();
+    }
+  }
+
+private:
+  const celNavMeshBuilder* builder;
+  celNavMeshTileJobs* jobs;
+  celNavMeshTileScratch scratch;
+};
+
+void celNavMeshBuilder::BuildTilesThreaded (const int tw, const int th, int& builtTiles)
+{
+  celNavMeshTileJobs jobs;
+  celNavMeshTileJobs::Tile empty = { 0, 0, false };
+  jobs.tiles.SetSize(tw * th, empty);
+  jobs.width = tw;
+  jobs.next = 0;
+
+  csRefArray<CS::Threading::Thread> threads;
+  for (int i = 0; i < threadCount; i++)
+  {
+    csRef<celNavMeshTileWorker> worker;
+    worker.AttachNew(new celNavMeshTileWorker(this, &jobs));
+    csRef<CS::Threading::Thread> thread;
+    thread.AttachNew(new CS::Threading::Thread(worker));
+    thread->Start();
+    threads.Push(thread);
+  }
+
+  // Add the tiles as they are done, in the order the serial build adds them
+  for (size_t i = 0; i < jobs.tiles.GetSize(); i++)
+  {
+    const int x = (int)(i % tw);
+    const int y = (int)(i / tw);
+    if (x == 0)
+    {
+      int percent = ((float)y/th)*100;
+      csPrintf("%d%%\n",percent); // Print progress %
+    }
+
+    celNavMeshTileJobs::Tile tile;
+    {
+      CS::Threading::MutexScopedLock lock(jobs.mutex);
+      while (!jobs.tiles[i].done)
+      {
+        jobs.condition.Wait(jobs.mutex);
+      }
+      tile = jobs.tiles[i];
+    }
+
+    if (tile.data)
+    {
+      builtTiles++;
+      if (!navMesh->AddTile(tile.data, tile.dataSize))
+      {
+        dtFree(tile.data);
+        csApplicationFramework::ReportWarning("could not add tile at location %d, %d in sector %s",
+            x, y, currentSector->QueryObject()->GetName());
+      }
+    }
+
+    if (x == tw - 1)
+    {
+      csPrintf(CS_ANSI_CURSOR_UP(1)); // go back one line
+      csPrintf(CS_ANSI_CLEAR_LINE); // clear line
+    }
+  }
+
+  for (size_t i = 0; i < threads.GetSize(); i++)
+  {
+    threads[i]->Wait();
+  }
+}
+
+// Based on Recast Sample_TileMesh::buildAllTiles()
+THREADED_CALLABLE_IMPL(celNavMeshBuilder,BuildNavMesh)
+{
+  CS_ASSERT(currentSector);
+  if (!currentSector) 
+  {
+    return false;
+  }
+
+  csTicks start = csGetTicks();
+
+  navMesh.AttachNew(new celNavMesh(objectRegistry));
+  CS_ASSERT(navMesh.IsValid());
+  navMesh->Initialize(parameters, currentSector, boundingMin, boundingMax);
+
+  const float cellSize = parameters->GetCellSize();
+  const int tileSize = parameters->GetTileSize();
+  int gridWidth = 0, gridHeight = 0;
+  rcCalcGridSize(boundingMin, boundingMax, cellSize, &gridWidth, &gridHeight);
+  const int tw = (gridWidth + tileSize - 1) / tileSize;
+  const int th = (gridHeight + tileSize - 1) / tileSize;
+
+  int builtTiles = 0;
+  if (threadCount > 1 && tw * th > 1)
+  {
+    BuildTilesThreaded(tw, th, builtTiles);
+  }
+  else
+  {
+    rcConfig tileConfig;
+    InitTileConfig(tileConfig);
+
+    float tileBoundingMin[3];
+    float tileBoundingMax[3];
+    for (int y = 0; y < th; ++y)
+    {
+      int percent = ((float)y/th)*100;
+      csPrintf("%d%%\n",percent); // Print progress %
+      for (int x = 0; x < tw; ++x)
       {
-        if (!navMesh->AddTile(data, dataSize))
+        SetTileBounds(x, y, tileConfig, tileBoundingMin, tileBoundingMax);
+
+        int dataSize = 0;
+        unsigned char* data = BuildTile(scratch, x, y, tileBoundingMin, tileBoundingMax, tileConfig, dataSize);
+        if (data)
         {
-          dtFree(data);
-          csApplicationFramework::ReportWarning("could not add tile at location %d, %d in sector %s",
-              x, y, currentSector->QueryObject()->GetName());
-          continue;
+          builtTiles++;
+          if (!navMesh->AddTile(data, dataSize))
+          {
+            dtFree(data);
+            csApplicationFramework::ReportWarning("could not add tile at location %d, %d in sector %s",
+                x, y, currentSector->QueryObject()->GetName());
+            continue;
+          }
         }
       }
+      csPrintf(CS_ANSI_CURSOR_UP(1)); // go back one line
+      csPrintf(CS_ANSI_CLEAR_LINE); // clear line
     }
-    csPrintf(CS_ANSI_CURSOR_UP(1)); // go back one line
-    csPrintf(CS_ANSI_CLEAR_LINE); // clear line
   }
+
+  csPrintf("Sector %s: %d of %dx%d tiles built in %u ms with %d thread(s)\n",
+           currentSector->QueryObject()->GetName(), builtTiles, tw, th, csGetTicks() - start,
+           threadCount);
+
   ret->SetResult(csRef<iBase>(navMesh));
   return true;
 }
 
-void celNavMeshBuilder::CleanUpTileData()
+celNavMeshTileScratch::celNavMeshTileScratch ()
+{
+  triangleAreas = 0;
+  solid = 0;
+  chf = 0;
+  cSet = 0;
+  pMesh = 0;
+  dMesh = 0;
+}
+
+celNavMeshTileScratch::~celNavMeshTileScratch ()
+{
+  CleanUp();
+}
+
+void celNavMeshTileScratch::CleanUp ()
 {
   delete [] triangleAreas;
   triangleAreas = 0;
@@ -2181,8 +2465,9 @@ void celNavMeshBuilder::CleanUpTileData()
 
 // Based on Recast Sample_TileMesh::buildTileMesh()
 // NOTE I left the original Recast comments
-unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const float* bmin, const float* bmax, 
-                                            const rcConfig& tileConfig, int& dataSize)
+unsigned char* celNavMeshBuilder::BuildTile(celNavMeshTileScratch& scratch, const int tx, const int ty, 
+                                            const float* bmin, const float* bmax, const rcConfig& tileConfig, 
+                                            int& dataSize) const
 {
 
   if (!triangleVertices || !triangleIndices || !chunkyTriMesh)
@@ -2192,17 +2477,18 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
   }
 
   // Make sure memory from last run is freed correctly (so there are no memory leaks if BuildTile crashes)
-  CleanUpTileData();
+  scratch.CleanUp();
+  rcContext* context = &scratch.context;
 
   // Allocate voxel heighfield where we rasterize our input data to.
-  solid = rcAllocHeightfield();
-  if (!solid)
+  scratch.solid = rcAllocHeightfield();
+  if (!scratch.solid)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
   }
-  if (!rcCreateHeightfield(&dummy, *solid, tileConfig.width, tileConfig.height, tileConfig.bmin, tileConfig.bmax, 
-                           tileConfig.cs, tileConfig.ch))
+  if (!rcCreateHeightfield(context, *scratch.solid, tileConfig.width, tileConfig.height, tileConfig.bmin, 
+                           tileConfig.bmax, tileConfig.cs, tileConfig.ch))
   {
     csApplicationFramework::ReportError("Failed to create Heightfield");
     return 0;
@@ -2211,8 +2497,8 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
   // Allocate array that can hold triangle flags.
   // If you have multiple meshes you need to process, allocate
   // and array which can hold the max number of triangles you need to process.
-  triangleAreas = new unsigned char[chunkyTriMesh->maxTrisPerChunk];
-  if (!triangleAreas)
+  scratch.triangleAreas = new unsigned char[chunkyTriMesh->maxTrisPerChunk];
+  if (!scratch.triangleAreas)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
@@ -2239,44 +2525,45 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
 
     tileTriangleCount += ntris;
 
-    memset(triangleAreas, 0, ntris * sizeof(unsigned char));
-    rcMarkWalkableTriangles(&dummy, tileConfig.walkableSlopeAngle, triangleVertices, numberOfVertices, tris, 
-                            ntris, triangleAreas);
+    memset(scratch.triangleAreas, 0, ntris * sizeof(unsigned char));
+    rcMarkWalkableTriangles(context, tileConfig.walkableSlopeAngle, triangleVertices, numberOfVertices, tris, 
+                            ntris, scratch.triangleAreas);
 
-    rcRasterizeTriangles(&dummy, triangleVertices, numberOfVertices, tris, triangleAreas, ntris, *solid, 
-                         tileConfig.walkableClimb);
+    rcRasterizeTriangles(context, triangleVertices, numberOfVertices, tris, scratch.triangleAreas, ntris, 
+                         *scratch.solid, tileConfig.walkableClimb);
   }
 
-  delete [] triangleAreas;
-  triangleAreas = 0;
+  delete [] scratch.triangleAreas;
+  scratch.triangleAreas = 0;
 
   // Once all geoemtry is rasterized, we do initial pass of filtering to
   // remove unwanted overhangs caused by the conservative rasterization
   // as well as filter spans where the character cannot possibly stand.
-  rcFilterLowHangingWalkableObstacles(&dummy, tileConfig.walkableClimb, *solid);
-  rcFilterLedgeSpans(&dummy, tileConfig.walkableHeight, tileConfig.walkableClimb, *solid);
-  rcFilterWalkableLowHeightSpans(&dummy, tileConfig.walkableHeight, *solid);
+  rcFilterLowHangingWalkableObstacles(context, tileConfig.walkableClimb, *scratch.solid);
+  rcFilterLedgeSpans(context, tileConfig.walkableHeight, tileConfig.walkableClimb, *scratch.solid);
+  rcFilterWalkableLowHeightSpans(context, tileConfig.walkableHeight, *scratch.solid);
 
   // Compact the heightfield so that it is faster to handle from now on.
   // This will result more cache coherent data as well as the neighbours
   // between walkable cells will be calculated.
-  chf = rcAllocCompactHeightfield();
-  if (!chf)
+  scratch.chf = rcAllocCompactHeightfield();
+  if (!scratch.chf)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
   }
-  if (!rcBuildCompactHeightfield(&dummy, tileConfig.walkableHeight, tileConfig.walkableClimb, *solid, *chf))
+  if (!rcBuildCompactHeightfield(context, tileConfig.walkableHeight, tileConfig.walkableClimb, *scratch.solid, 
+                                 *scratch.chf))
   {
     csApplicationFramework::ReportError("failed to build compact heightfield");
     return 0;
   }
 
-  rcFreeHeightField(solid);
-  solid = 0;
+  rcFreeHeightField(scratch.solid);
+  scratch.solid = 0;
 
   // Erode the walkable area by agent radius.
-  if (!rcErodeWalkableArea(&dummy, tileConfig.walkableRadius, *chf))
+  if (!rcErodeWalkableArea(context, tileConfig.walkableRadius, *scratch.chf))
   {
     csApplicationFramework::ReportError("failed to errode walkable area");
     return 0;
@@ -2285,83 +2572,86 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
   // (Optional) Mark areas.
   for (int i  = 0; i < numberOfVolumes; ++i)
   {
-    rcMarkConvexPolyArea(&dummy, volumes[i].verts, volumes[i].nverts, volumes[i].hmin, volumes[i].hmax, 
-                         (unsigned char)volumes[i].area, *chf);
+    rcMarkConvexPolyArea(context, volumes[i].verts, volumes[i].nverts, volumes[i].hmin, volumes[i].hmax, 
+                         (unsigned char)volumes[i].area, *scratch.chf);
   }
 
   // Prepare for region partitioning, by calculating distance field along the walkable surface.
-  if (!rcBuildDistanceField(&dummy, *chf))
+  if (!rcBuildDistanceField(context, *scratch.chf))
   {
     csApplicationFramework::ReportError("failed to build distance field");
     return 0;
   }
 
   // Partition the walkable surface into simple regions without holes.
-  if (!rcBuildRegions(&dummy, *chf, tileConfig.borderSize, tileConfig.minRegionArea, tileConfig.mergeRegionArea))
+  if (!rcBuildRegions(context, *scratch.chf, tileConfig.borderSize, tileConfig.minRegionArea, 
+                      tileConfig.mergeRegionArea))
   {
     csApplicationFramework::ReportError("failed to build regions");
     return 0;
   }
 
   // remove border mapping as we don't want those to be removed
-  /*for(int i = 0; i < chf->spanCount; i++)
+  /*for(int i = 0; i < scratch.chf->spanCount; i++)
   {
-    chf->areas[i] &= ~RC_BORDER_REG;
+    scratch.chf->areas[i] &= ~RC_BORDER_REG;
   }*/
 
   // Create contours.
-  cSet = rcAllocContourSet();
-  if (!cSet)
+  scratch.cSet = rcAllocContourSet();
+  if (!scratch.cSet)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
   }
-  if (!rcBuildContours(&dummy, *chf, tileConfig.maxSimplificationError, tileConfig.maxEdgeLen, *cSet))
+  if (!rcBuildContours(context, *scratch.chf, tileConfig.maxSimplificationError, tileConfig.maxEdgeLen, 
+                       *scratch.cSet))
   {
     csApplicationFramework::ReportError("failed to build contours");
     return 0;
   }
-  if (cSet->nconts == 0)
+  if (scratch.cSet->nconts == 0)
   {
     return 0;
   }
 
   // Build polygon navmesh from the contours.
-  pMesh = rcAllocPolyMesh();
-  if (!pMesh)
+  scratch.pMesh = rcAllocPolyMesh();
+  if (!scratch.pMesh)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
   }
-  if (!rcBuildPolyMesh(&dummy, *cSet, tileConfig.maxVertsPerPoly, *pMesh))
+  if (!rcBuildPolyMesh(context, *scratch.cSet, tileConfig.maxVertsPerPoly, *scratch.pMesh))
   {
     csApplicationFramework::ReportError("failed to build poly mesh");
     return 0;
   }
 
   // Build detail mesh.
-  dMesh = rcAllocPolyMeshDetail();
-  if (!dMesh)
+  scratch.dMesh = rcAllocPolyMeshDetail();
+  if (!scratch.dMesh)
   {
     csApplicationFramework::ReportError("Out of memory building navigation mesh.");
     return 0;
   }
-  if (!rcBuildPolyMeshDetail(&dummy, *pMesh, *chf, tileConfig.detailSampleDist, tileConfig.detailSampleMaxError, *dMesh))
+  if (!rcBuildPolyMeshDetail(context, *scratch.pMesh, *scratch.chf, tileConfig.detailSampleDist, 
+                             tileConfig.detailSampleMaxError, *scratch.dMesh))
   {
     csApplicationFramework::ReportError("fail to build poly mesh detail");
     return 0;
   }
 
-  rcFreeCompactHeightfield(chf);
-  chf = 0;
-  rcFreeContourSet(cSet);
-  cSet = 0;
+  rcFreeCompactHeightfield(scratch.chf);
+  scratch.chf = 0;
+  rcFreeContourSet(scratch.cSet);
+  scratch.cSet = 0;
 
   unsigned char* navData = 0;
   int navDataSize = 0;
   if (tileConfig.maxVertsPerPoly <= DT_VERTS_PER_POLYGON)
   {
-    if (pMesh->nverts >= 0xffff)
+    if (scratch.pMesh->nverts >= 0xffff)
     {
       // The vertex indices are ushorts, and cannot point to more than 0xffff vertices.
       csApplicationFramework::ReportError("number of vertices overflowed");
@@ -2369,41 +2659,41 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
     }
 
     // Update poly flags from areas.
-    for (int i = 0; i < pMesh->npolys; ++i)
+    for (int i = 0; i < scratch.pMesh->npolys; ++i)
     {
-      if (pMesh->areas[i] == RC_WALKABLE_AREA)
-        pMesh->areas[i] = SAMPLE_POLYAREA_GROUND;
+      if (scratch.pMesh->areas[i] == RC_WALKABLE_AREA)
+        scratch.pMesh->areas[i] = SAMPLE_POLYAREA_GROUND;
 
-      if (pMesh->areas[i] == SAMPLE_POLYAREA_GROUND ||
-        pMesh->areas[i] == SAMPLE_POLYAREA_GRASS ||
-        pMesh->areas[i] == SAMPLE_POLYAREA_ROAD)
+      if (scratch.pMesh->areas[i] == SAMPLE_POLYAREA_GROUND ||
+        scratch.pMesh->areas[i] == SAMPLE_POLYAREA_GRASS ||
+        scratch.pMesh->areas[i] == SAMPLE_POLYAREA_ROAD)
       {
-        pMesh->flags[i] = SAMPLE_POLYFLAGS_WALK;
+        scratch.pMesh->flags[i] = SAMPLE_POLYFLAGS_WALK;
       }
-      else if (pMesh->areas[i] == SAMPLE_POLYAREA_WATER)
+      else if (scratch.pMesh->areas[i] == SAMPLE_POLYAREA_WATER)
       {
-        pMesh->flags[i] = SAMPLE_POLYFLAGS_SWIM;
+        scratch.pMesh->flags[i] = SAMPLE_POLYFLAGS_SWIM;
       }
-      else if (pMesh->areas[i] == SAMPLE_POLYAREA_DOOR)
+      else if (scratch.pMesh->areas[i] == SAMPLE_POLYAREA_DOOR)
       {
-        pMesh->flags[i] = SAMPLE_POLYFLAGS_WALK | SAMPLE_POLYFLAGS_DOOR;
+        scratch.pMesh->flags[i] = SAMPLE_POLYFLAGS_WALK | SAMPLE_POLYFLAGS_DOOR;
       }
     }
 
     dtNavMeshCreateParams params;
     memset(&params, 0, sizeof(params));
-    params.verts = pMesh->verts;
-    params.vertCount = pMesh->nverts;
-    params.polys = pMesh->polys;
-    params.polyAreas = pMesh->areas;
-    params.polyFlags = pMesh->flags;
-    params.polyCount = pMesh->npolys;
-    params.nvp = pMesh->nvp;
-    params.detailMeshes = dMesh->meshes;
-    params.detailVerts = dMesh->verts;
-    params.detailVertsCount = dMesh->nverts;
-    params.detailTris = dMesh->tris;
-    params.detailTriCount = dMesh->ntris;
+    params.verts = scratch.pMesh->verts;
+    params.vertCount = scratch.pMesh->nverts;
+    params.polys = scratch.pMesh->polys;
+    params.polyAreas = scratch.pMesh->areas;
+    params.polyFlags = scratch.pMesh->flags;
+    params.polyCount = scratch.pMesh->npolys;
+    params.nvp = scratch.pMesh->nvp;
+    params.detailMeshes = scratch.dMesh->meshes;
+    params.detailVerts = scratch.dMesh->verts;
+    params.detailVertsCount = scratch.dMesh->nverts;
+    params.detailTris = scratch.dMesh->tris;
+    params.detailTriCount = scratch.dMesh->ntris;
     params.offMeshConVerts = offMeshConVerts;
     params.offMeshConRad = offMeshConRads;
     params.offMeshConDir = offMeshConDirs;
@@ -2429,10 +2719,10 @@ unsigned char* celNavMeshBuilder::BuildTile(const int tx, const int ty, const fl
     }
   }
 
-  rcFreePolyMesh(pMesh);
-  pMesh = 0;
-  rcFreePolyMeshDetail(dMesh);
-  dMesh = 0;
+  rcFreePolyMesh(scratch.pMesh);
+  scratch.pMesh = 0;
+  rcFreePolyMeshDetail(scratch.dMesh);
+  scratch.dMesh = 0;
 
   dataSize = navDataSize;
   return navData;
@@ -2534,7 +2824,7 @@ bool celNavMeshBuilder::UpdateNavMesh (celNavMesh* navMesh, const csBox3& boundi
       tileConfig.bmax[2] += tileConfig.borderSize * tileConfig.cs;
 
       int dataSize = 0;
-      unsigned char* data = BuildTile(x, y, tileBoundingMin, tileBoundingMax, tileConfig, dataSize);
+      unsigned char* data = BuildTile(scratch, x, y, tileBoundingMin, tileBoundingMax, tileConfig, dataSize);
       if (data)
       {        
         if (!navMesh->RemoveTile(x, y) || !navMesh->AddTile(data, dataSize))
@@ -2567,5 +2857,15 @@ iSector* celNavMeshBuilder::GetSector () const
   return currentSector;
 }
 
+void celNavMeshBuilder::SetThreadCount (int count)
+{
+  threadCount = csMax(count, 1);
+}
+
+int celNavMeshBuilder::GetThreadCount () const
+{
+  return threadCount;
+}
+
 }
 CS_PLUGIN_NAMESPACE_END(celNavMesh)
@@ -32,6 +32,7 @@
 #include <csutil/ref.h>
 #include <csutil/scf_implementation.h>
 #include <csutil/threadmanager.h>
+#include <csutil/threading/mutex.h>
 #include <iengine/mesh.h>
 #include <iengine/movable.h>
 #include <iengine/portal.h>
@@ -234,6 +235,25 @@ public:
 
 
 
+/**
+ * Detour query and scratch buffers for one path search. A navigation mesh
+ * keeps the free ones for the next searches, so the searches do not
+ * allocate them every time.
+ */
+struct celNavMeshQuery
+{
+  dtNavMeshQuery* query;
+  dtPolyRef* polys;
+  float* straightPath;
+  unsigned char* straightPathFlags;
+  dtPolyRef* straightPathPolys;
+  int capacity;
+
+  celNavMeshQuery ();
+  ~celNavMeshQuery ();
+  void Reserve (int size);
+};
+
 /**
  * Polygon mesh representing the navigable areas of a Sector.
  */
@@ -266,6 +286,8 @@ private:
   float boundingMin[3];
   float boundingMax[3];
   unsigned char navMeshDrawFlags;
+  CS::Threading::Mutex queryMutex;
+  csArray<celNavMeshQuery*> freeQueries;
   static const int MAX_NODES;
   static const int NAVMESHSET_MAGIC;
   static const int NAVMESHSET_VERSION;
@@ -273,6 +295,8 @@ private:
   bool LoadCelNavMeshParams (iDocumentNode* mainNode);
   bool LoadDtNavMeshParams (iDocumentNode* paramsNode, dtNavMeshParams& params);
   bool LoadNavMeshLegacy (iFile* file);
+  celNavMeshQuery* AcquireQuery ();
+  void ReleaseQuery (celNavMeshQuery* query);
 public:
   celNavMesh (iObjectRegistry* objectRegistry);
   virtual ~celNavMesh ();
@@ -285,6 +309,9 @@ public:
 
   // API
   virtual iCelNavMeshPath* ShortestPath (const csVector3& from, const csVector3& goal, int maxPathSize = 32);
+  virtual csPtr<iCelNavMeshPath> FindPath (const csVector3& from, const csVector3& goal, int maxPathSize = 32);
+  virtual uint GetPolygonRef (const csVector3& position);
+  virtual void GetTileLocation (const csVector3& position, int& x, int& y) const;
   virtual bool Update (const csBox3& boundingBox);
   virtual bool Update (const csOBB& boundingBox);
   virtual iSector* GetSector () const;
@@ -302,6 +329,27 @@ public:
 
 
 
+/**
+ * Recast context and intermediate structures of the tile being built.
+ * Every thread building tiles has its own.
+ */
+struct celNavMeshTileScratch
+{
+  rcContext context;
+  unsigned char* triangleAreas;
+  rcHeightfield* solid;
+  rcCompactHeightfield* chf;
+  rcContourSet* cSet;
+  rcPolyMesh* pMesh;
+  rcPolyMeshDetail* dMesh;
+
+  celNavMeshTileScratch ();
+  ~celNavMeshTileScratch ();
+  void CleanUp ();
+};
+
+class celNavMeshTileWorker;
+
 /**
  * Navigation mesh creator.
  */
@@ -318,13 +366,8 @@ private:
   rcChunkyTriMesh* chunkyTriMesh;
   
   // Tile specific
-  unsigned char* triangleAreas;
-  rcContext dummy;
-  rcHeightfield* solid;
-  rcCompactHeightfield* chf;
-  rcContourSet* cSet;
-  rcPolyMesh* pMesh;
-  rcPolyMeshDetail* dMesh;
+  celNavMeshTileScratch scratch;
+  int threadCount;
   
   // Off-Mesh connections.
   static const int MAX_OFFMESH_CONNECTIONS = 256;
@@ -352,10 +395,12 @@ private:
   float boundingMax[3];
 
   void CleanUpSectorData ();
-  void CleanUpTileData ();
   bool GetSectorData ();  
-  unsigned char* BuildTile(const int tx, const int ty, const float* bmin, const float* bmax, 
-                           const rcConfig& tileConfig, int& dataSize);
+  void InitTileConfig (rcConfig& tileConfig) const;
+  void SetTileBounds (const int tx, const int ty, rcConfig& tileConfig, float* bmin, float* bmax) const;
+  unsigned char* BuildTile(celNavMeshTileScratch& scratch, const int tx, const int ty, const float* bmin, 
+                           const float* bmax, const rcConfig& tileConfig, int& dataSize) const;
+  void BuildTilesThreaded (const int tw, const int th, int& builtTiles);
   iObjectRegistry* GetObjectRegistry() const { return objectRegistry; }
 
   // helper function to check whether an object has to be clipped
@@ -381,7 +426,10 @@ public:
   virtual const iCelNavMeshParams* GetNavMeshParams () const;
   virtual void SetNavMeshParams (const iCelNavMeshParams* parameters);
   virtual iSector* GetSector () const;
+  virtual void SetThreadCount (int count);
+  virtual int GetThreadCount () const;
 
+  friend class celNavMeshTileWorker;
 };
 
 }
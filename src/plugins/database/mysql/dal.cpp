@@ -23,6 +23,7 @@
 
 #include "util/log.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 #include "dal.h"
 
@@ -39,10 +40,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
     psMysqlConnection::psMysqlConnection(iBase *iParent) : scfImplementationType(this, iParent)
     {
         conn = NULL;
+        connPort = 0;
+        workers = NULL;
     }
 
     psMysqlConnection::~psMysqlConnection()
     {
+        delete workers;
         mysql_close(conn);
         conn = NULL;
     }
@@ -52,6 +56,11 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         objectReg = objectreg;
 
         pslog::Initialize (objectreg);
+        psZoneProfiler::Attach(objectreg);
+
+        // Only the connection loaded as plugin queues queries, the
+        // connections of its workers don't get a pool of their own
+        workers = new psDBWorkerPool(this, this);
 
         return true;
     }
@@ -60,6 +69,14 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
                                   const char *user, const char *pwd, LogCSV* logcsv)
     {
         this->logcsv = logcsv;
+
+        // Kept to open the connections of the workers
+        connHost = host;
+        connPort = port;
+        connDatabase = database;
+        connUser = user;
+        connPwd = pwd;
+
         // Create a mydb
         mysql_library_init(0, NULL, NULL);
         mysql_thread_init();
@@ -87,6 +104,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
 
     bool psMysqlConnection::Close()
     {
+        if(workers)
+            workers->Stop();
         mysql_close(conn);
         conn = NULL;
 
@@ -137,6 +156,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         return 1;
     #else
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::CommandPump");
         csString querystr;
         va_list args;
 
@@ -172,6 +192,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
     unsigned long psMysqlConnection::Command(const char *sql,...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Command");
         csString querystr;
         va_list args;
 
@@ -201,6 +222,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
     iResultSet *psMysqlConnection::Select(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Select");
         csString querystr;
         va_list args;
 
@@ -231,6 +253,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
     int psMysqlConnection::SelectSingleNumber(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::SelectSingleNumber");
         csString querystr;
         va_list args;
 
@@ -409,9 +432,98 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         return recv;
     }
 
+    bool psMysqlConnection::StartWorkers(size_t count)
+    {
+        return workers->Start(count);
+    }
+
+    void psMysqlConnection::StopWorkers()
+    {
+        if(workers)
+            workers->Stop();
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::SelectAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_SELECT, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::CommandAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_COMMAND, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericInsertWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildInsert(this, table, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_INSERT, callback, command);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericUpdateWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char *idfield, const char *id,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildUpdate(this, table, idfield, id, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_COMMAND, callback, command);
+    }
+
+    size_t psMysqlConnection::DispatchCallbacks()
+    {
+        return workers ? workers->DispatchCallbacks() : 0;
+    }
+
+    bool psMysqlConnection::GetTableChecksum(const char *table, uint64 &checksum)
+    {
+        iResultSet *rs = Select("CHECKSUM TABLE %s", table);
+        if (!rs)
+            return false;
+
+        // The checksum of a table that doesn't exist is NULL
+        const char *value = rs->Count() ? (*rs)[0]["Checksum"] : NULL;
+        if (value)
+            checksum = (*rs)[0].stringtouint64(value);
+        rs->Release();
+        return value != NULL;
+    }
+
+    csPtr<iDataConnection> psMysqlConnection::Connect()
+    {
+        csRef<psMysqlConnection> worker;
+        worker.AttachNew(new psMysqlConnection((iBase*) NULL));
+        if(!worker->Initialize(connHost, connPort, connDatabase, connUser, connPwd, logcsv))
+        {
+            Error2("Database worker failed to connect: %s", worker->GetLastError());
+            return csPtr<iDataConnection>(NULL);
+        }
+        return csPtr<iDataConnection>(worker);
+    }
+
+    void psMysqlConnection::EndThread()
+    {
+        // Initialize() registered the worker's thread with the client library
+        mysql_thread_end();
+    }
+
     const char* psMysqlConnection::DumpProfile()
     {
         profileDump = profs.Dump();
+        if(workers)
+            profileDump.Append(workers->DumpStats());
         return profileDump;
     }
 
@@ -444,7 +556,10 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
             current = (unsigned long) -1;
         }
         else
+        {
             rows = 0;
+            fields = 0;
+        }
     }
 
     psResultSet::~psResultSet()
@@ -452,6 +567,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         mysql_free_result(rs);
     }
 
+    const char *psResultSet::GetFieldName(int whichfield)
+    {
+        if (whichfield < 0 || whichfield >= (int)fields)
+            return NULL;
+        return mysql_fetch_field_direct(rs, whichfield)->name;
+    }
+
     iResultRow& psResultSet::operator[](unsigned long whichrow)
     {
         if (whichrow != current)
@@ -676,6 +798,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
             Prepare();
 
         psStopWatch timer;
+        PS_PROFILE_ZONE("dbRecord::Execute");
         timer.Start();
 
         CS_ASSERT(count == mysql_stmt_param_count(stmt));
@@ -796,6 +919,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
                     currQuery = arr[end];
                     end = (end+1) % THREADED_BUFFER_SIZE;
                 }
+                PS_PROFILE_ZONE("DelayedQueryManager::Query");
                 timer.Start();
                 if (!mysql_query(m_conn, currQuery))
                     profs.AddSQLTime(currQuery, timer.Stop());
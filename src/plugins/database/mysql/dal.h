@@ -22,6 +22,7 @@
 #include <csutil/csstring.h>
 #include "util/stringarray.h"
 #include "util/dbprofile.h"
+#include "util/dbworkers.h"
 
 using namespace CS::Threading;
 
@@ -57,7 +58,8 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
     };
     #endif
 
-    class psMysqlConnection : public scfImplementation2<psMysqlConnection, iComponent, iDataConnection>
+    class psMysqlConnection : public scfImplementation2<psMysqlConnection, iComponent, iDataConnection>,
+                              public psDBConnector
     {
     protected:
         MYSQL mydb; // Mysql connection
@@ -68,6 +70,17 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         csString profileDump;
         LogCSV* logcsv;
 
+        /**
+         * Workers running the queued queries, with the settings to connect
+         * them. NULL on the connections of the workers, which never queue.
+         */
+        psDBWorkerPool* workers;
+        csString connHost;
+        unsigned int connPort;
+        csString connDatabase;
+        csString connUser;
+        csString connPwd;
+
     public:
         psMysqlConnection(iBase *iParent);
         virtual ~psMysqlConnection();
@@ -109,6 +122,22 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         iRecord* NewUpdatePreparedStatement(const char* table, const char* idfield, unsigned int count, const char* file, unsigned int line);
         iRecord* NewInsertPreparedStatement(const char* table, unsigned int count, const char* file, unsigned int line);
 
+        bool StartWorkers(size_t count);
+        void StopWorkers();
+        csPtr<iAsyncQuery> SelectAsync(iAsyncQueryCallback* callback, const char *sql, ...);
+        csPtr<iAsyncQuery> CommandAsync(iAsyncQueryCallback* callback, const char *sql, ...);
+        csPtr<iAsyncQuery> GenericInsertWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                    const char **fieldnames, psStringArray& fieldvalues);
+        csPtr<iAsyncQuery> GenericUpdateWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                    const char *idfield, const char *id,
+                                                    const char **fieldnames, psStringArray& fieldvalues);
+        size_t DispatchCallbacks();
+        bool GetTableChecksum(const char *table, uint64 &checksum);
+
+        /// Open the connection of a worker or another thread, see psDBConnector.
+        virtual csPtr<iDataConnection> Connect();
+        virtual void EndThread();
+
     #ifdef USE_DELAY_QUERY    
         csRef<DelayedQueryManager> dqm;
         csRef<Thread> dqmThread;
@@ -175,6 +204,9 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbmysql)
         iResultRow& operator[](unsigned long whichrow);
 
         unsigned long Count(void) { return rows; };
+
+        int GetFieldCount() { return fields; };
+        const char *GetFieldName(int whichfield);
     };
 
     class dbRecord : public iRecord
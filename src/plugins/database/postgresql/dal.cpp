@@ -23,6 +23,7 @@
 
 #include "util/log.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 #include "dal.h"
 
@@ -45,12 +46,15 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
     psMysqlConnection::psMysqlConnection(iBase *iParent) : scfImplementationType(this, iParent)
     {
         conn = NULL;
+        connPort = 0;
+        workers = NULL;
         stmtNum = 0;
     }
 
     psMysqlConnection::~psMysqlConnection()
     {
         Close();
+        delete workers;
     }
 
     bool psMysqlConnection::Initialize (iObjectRegistry *objectreg)
@@ -58,6 +62,11 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
         objectReg = objectreg;
 
         pslog::Initialize (objectreg);
+        psZoneProfiler::Attach(objectreg);
+
+        // Only the connection loaded as plugin queues queries, the
+        // connections of its workers don't get a pool of their own
+        workers = new psDBWorkerPool(this, this);
 
         return true;
     }
@@ -66,6 +75,14 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
                                   const char *user, const char *pwd, LogCSV* logcsv)
     {
         this->logcsv = logcsv;
+
+        // Kept to open the connections of the workers
+        connHost = host;
+        connPort = port;
+        connDatabase = database;
+        connUser = user;
+        connPwd = pwd;
+
         // Create a mydb
         csString dbConnectString;
         dbConnectString.Format("host=%s dbname=%s user=%s password=%s", host, database, user, pwd);
@@ -92,6 +109,9 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
 
     bool psMysqlConnection::Close()
     {
+        if(workers)
+            workers->Stop();
+
         //waits for postgresql to complete and close.
         if(conn)
         {
@@ -142,6 +162,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
         return 1;
     #else
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::CommandPump");
         csString querystr;
         va_list args;
 
@@ -184,6 +205,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
     unsigned long psMysqlConnection::Command(const char *sql,...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Command");
         csString querystr;
         va_list args;
 
@@ -220,6 +242,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
     iResultSet *psMysqlConnection::Select(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Select");
         csString querystr;
         va_list args;
 
@@ -256,6 +279,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
     int psMysqlConnection::SelectSingleNumber(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::SelectSingleNumber");
         csString querystr;
         va_list args;
 
@@ -437,9 +461,96 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
         return recv;
     }
 
+    bool psMysqlConnection::StartWorkers(size_t count)
+    {
+        return workers->Start(count);
+    }
+
+    void psMysqlConnection::StopWorkers()
+    {
+        if(workers)
+            workers->Stop();
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::SelectAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_SELECT, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::CommandAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_COMMAND, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericInsertWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildInsert(this, table, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_INSERT, callback, command);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericUpdateWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char *idfield, const char *id,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildUpdate(this, table, idfield, id, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_COMMAND, callback, command);
+    }
+
+    size_t psMysqlConnection::DispatchCallbacks()
+    {
+        return workers ? workers->DispatchCallbacks() : 0;
+    }
+
+    bool psMysqlConnection::GetTableChecksum(const char *table, uint64 &checksum)
+    {
+        iResultSet *rs = Select("SELECT md5(string_agg(t::text, ',' ORDER BY t::text)) FROM %s t", table);
+        if (!rs)
+            return false;
+
+        // The first 64 bits of the md5 of all the rows, an empty table has none
+        const char *value = rs->Count() ? (*rs)[0][0] : "";
+        checksum = 0;
+        for (int i = 0; i < 16 && value[i]; i++)
+        {
+            char c = value[i];
+            checksum = (checksum << 4) | (c >= 'a' ? c - 'a' + 10 : c - '0');
+        }
+        rs->Release();
+        return true;
+    }
+
+    csPtr<iDataConnection> psMysqlConnection::Connect()
+    {
+        csRef<psMysqlConnection> worker;
+        worker.AttachNew(new psMysqlConnection((iBase*) NULL));
+        if(!worker->Initialize(connHost, connPort, connDatabase, connUser, connPwd, logcsv))
+        {
+            Error2("Database worker failed to connect: %s", worker->GetLastError());
+            return csPtr<iDataConnection>(NULL);
+        }
+        return csPtr<iDataConnection>(worker);
+    }
+
     const char* psMysqlConnection::DumpProfile()
     {
         profileDump = profs.Dump();
+        if(workers)
+            profileDump.Append(workers->DumpStats());
         return profileDump;
     }
 
@@ -476,6 +587,13 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
         PQclear(rs);
     }
 
+    const char *psResultSet::GetFieldName(int whichfield)
+    {
+        if (whichfield < 0 || whichfield >= (int)fields)
+            return NULL;
+        return PQfname(rs, whichfield);
+    }
+
     iResultRow& psResultSet::operator[](unsigned long whichrow)
     {
         if (whichrow != current)
@@ -672,6 +790,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
             Prepare();
 
         psStopWatch timer;
+        PS_PROFILE_ZONE("dbRecord::Execute");
         timer.Start();
 
         CS_ASSERT(count != index);
@@ -840,6 +959,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbpostgresql)
                     currQuery = arr[end];
                     end = (end+1) % THREADED_BUFFER_SIZE;
                 }
+                PS_PROFILE_ZONE("DelayedQueryManager::Query");
                 timer.Start();
                 if (!mysql_query(m_conn, currQuery))
                     profs.AddSQLTime(currQuery, timer.Stop());
@@ -23,6 +23,7 @@
 
 #include "util/log.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 #include "dal.h"
 
@@ -43,11 +44,14 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
     psMysqlConnection::psMysqlConnection(iBase *iParent) : scfImplementationType(this, iParent)
     {
         conn = NULL;
+        connPort = 0;
+        workers = NULL;
     }
 
     psMysqlConnection::~psMysqlConnection()
     {
         Close();
+        delete workers;
     }
 
     bool psMysqlConnection::Initialize (iObjectRegistry *objectreg)
@@ -55,18 +59,34 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
         objectReg = objectreg;
 
         pslog::Initialize (objectreg);
+        psZoneProfiler::Attach(objectreg);
+
+        // Only the connection loaded as plugin queues queries, the
+        // connections of its workers don't get a pool of their own
+        workers = new psDBWorkerPool(this, this);
 
         return true;
     }
 
-    bool psMysqlConnection::Initialize(const char* /*host*/, unsigned int /*port*/, const char* database,
-                                  const char* /*user*/, const char* /*pwd*/, LogCSV* logcsv)
+    bool psMysqlConnection::Initialize(const char* host, unsigned int port, const char* database,
+                                  const char* user, const char* pwd, LogCSV* logcsv)
     {
         this->logcsv = logcsv;
+
+        // Kept to open the connections of the workers
+        connHost = host;
+        connPort = port;
+        connDatabase = database;
+        connUser = user;
+        connPwd = pwd;
+
         // Create a mydb
         if(sqlite3_open(database, &conn) != SQLITE_OK)
             return false;
 
+        // The workers have their own connections, wait for their locks
+        sqlite3_busy_timeout(conn, 5000);
+
     #ifdef USE_DELAY_QUERY
         dqm.AttachNew(new DelayedQueryManager(host, port, database, user, pwd));
         dqmThread.AttachNew(new Thread(dqm));
@@ -79,6 +99,9 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
 
     bool psMysqlConnection::Close()
     {
+        if(workers)
+            workers->Stop();
+
         //waits for sqlite to complete and close.
         if(conn)
         {
@@ -122,6 +145,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
         return 1;
     #else
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::CommandPump");
         csString querystr;
         va_list args;
 
@@ -157,6 +181,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
     unsigned long psMysqlConnection::Command(const char *sql,...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Command");
         csString querystr;
         va_list args;
 
@@ -186,6 +211,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
     iResultSet *psMysqlConnection::Select(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::Select");
         csString querystr;
         va_list args;
 
@@ -220,6 +246,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
     int psMysqlConnection::SelectSingleNumber(const char *sql, ...)
     {
         psStopWatch timer;
+        PS_PROFILE_ZONE("psMysqlConnection::SelectSingleNumber");
         csString querystr;
         va_list args;
 
@@ -399,9 +426,84 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
         return recv;
     }
 
+    bool psMysqlConnection::StartWorkers(size_t count)
+    {
+        return workers->Start(count);
+    }
+
+    void psMysqlConnection::StopWorkers()
+    {
+        if(workers)
+            workers->Stop();
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::SelectAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_SELECT, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::CommandAsync(iAsyncQueryCallback* callback, const char *sql, ...)
+    {
+        csString querystr;
+        va_list args;
+
+        va_start(args, sql);
+        querystr.FormatV(sql, args);
+        va_end(args);
+
+        return workers->Queue(ASYNC_COMMAND, callback, querystr);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericInsertWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildInsert(this, table, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_INSERT, callback, command);
+    }
+
+    csPtr<iAsyncQuery> psMysqlConnection::GenericUpdateWithIDAsync(iAsyncQueryCallback* callback, const char *table,
+                                                                   const char *idfield, const char *id,
+                                                                   const char **fieldnames, psStringArray& fieldvalues)
+    {
+        csString command = psDBWorkerPool::BuildUpdate(this, table, idfield, id, fieldnames, fieldvalues);
+        return workers->Queue(ASYNC_COMMAND, callback, command);
+    }
+
+    size_t psMysqlConnection::DispatchCallbacks()
+    {
+        return workers ? workers->DispatchCallbacks() : 0;
+    }
+
+    bool psMysqlConnection::GetTableChecksum(const char *, uint64 &)
+    {
+        // No table checksums in sqlite, and reading the local file is as fast anyway
+        return false;
+    }
+
+    csPtr<iDataConnection> psMysqlConnection::Connect()
+    {
+        csRef<psMysqlConnection> worker;
+        worker.AttachNew(new psMysqlConnection((iBase*) NULL));
+        if(!worker->Initialize(connHost, connPort, connDatabase, connUser, connPwd, logcsv))
+        {
+            Error2("Database worker failed to open %s", connDatabase.GetData());
+            return csPtr<iDataConnection>(NULL);
+        }
+        return csPtr<iDataConnection>(worker);
+    }
+
     const char* psMysqlConnection::DumpProfile()
     {
         profileDump = profs.Dump();
+        if(workers)
+            profileDump.Append(workers->DumpStats());
         return profileDump;
     }
 
@@ -434,7 +536,10 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
             current = (unsigned long) -1;
         }
         else
+        {
             rows = 0;
+            fields = 0;
+        }
     }
 
     psResultSet::~psResultSet()
@@ -442,6 +547,14 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
         sqlite3_free_table(rs);
     }
 
+    const char *psResultSet::GetFieldName(int whichfield)
+    {
+        // The first row of the table holds the names
+        if (whichfield < 0 || whichfield >= (int)fields)
+            return NULL;
+        return rs[whichfield];
+    }
+
     iResultRow& psResultSet::operator[](unsigned long whichrow)
     {
         if (whichrow != current)
@@ -633,6 +746,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
             Prepare();
 
         psStopWatch timer;
+        PS_PROFILE_ZONE("dbRecord::Execute");
         timer.Start();
 
         CS_ASSERT(count == (unsigned int)sqlite3_bind_parameter_count(stmt));
@@ -772,6 +886,7 @@ CS_PLUGIN_NAMESPACE_BEGIN(dbsqlite3)
                     currQuery = arr[end];
                     end = (end+1) % THREADED_BUFFER_SIZE;
                 }
+                PS_PROFILE_ZONE("DelayedQueryManager::Query");
                 timer.Start();
                 if (!mysql_query(m_conn, currQuery))
                     profs.AddSQLTime(currQuery, timer.Stop());
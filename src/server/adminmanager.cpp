@@ -6065,6 +6065,9 @@ void AdminManager::TeleportOfflineCharacter(Client* client, AdminCmdDataTeleport
     sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where name=\"%s\"",
                   gmPoint.x, gmPoint.y, gmPoint.z, yRot, gmSectorInfo->uid, client->GetActor()->GetInstance(), escapedName.GetDataSafe());
 
+    // Only the name is known, so wait for all queued saves of the characters
+    psserver->GetDatabase()->GetWriteBehind()->Barrier();
+
     if(db->CommandPump(sql) != 1)
     {
         Error3("Couldn't save character's position to database.\nCommand was "
@@ -9945,6 +9948,7 @@ void AdminManager::ChangeName(MsgEntry* me, psAdminCmdMessage &msg, AdminCmdData
     }
 
     // Need instant DB update if we should be able to change the same persons name twice
+    psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
     db->CommandPump("UPDATE characters SET name='%s', lastname='%s' WHERE id='%u'",data->newName.GetData(),data->newLastName.GetDataSafe(), pid.Unbox());
 
     // Resend group list
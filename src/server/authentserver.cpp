@@ -56,6 +56,7 @@
 #include "icachedobject.h"
 #include "advicemanager.h"
 #include "commandmanager.h"
+#include "netmanager.h"
 
 class CachedAuthMessage : public iCachedObject
 {
@@ -212,7 +213,11 @@ void AuthenticationServer::HandlePreAuthent(MsgEntry* me, Client* notused)
     if(!CheckAuthenticationPreCondition(me->clientnum,msg.NetVersionOk(),"pre"))
         return;
 
-    psPreAuthApprovedMessage reply(me->clientnum);
+    // Compress big messages for clients that can inflate them
+    if(msg.compression)
+        psserver->GetNetManager()->EnableCompression(me->clientnum);
+
+    psPreAuthApprovedMessage reply(me->clientnum, msg.compression);
     reply.SendMessage();
 }
 
@@ -287,7 +292,8 @@ void AuthenticationServer::HandleAuthent(MsgEntry* me, Client* notused)
         {
             csString sanitized;
             db->Escape(sanitized, msg.sPassword256);
-            db->CommandPump("UPDATE accounts set password256=\"%s\" where id=%d", sanitized.GetData(), acctinfo->accountid);
+            csRef<iAsyncQuery> query = db->CommandAsync(NULL, "UPDATE accounts set password256=\"%s\" where id=%d",
+                                                        sanitized.GetData(), acctinfo->accountid);
         }
     }
 
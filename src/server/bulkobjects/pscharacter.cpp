@@ -837,6 +837,7 @@ void psCharacter::SetLastLoginTime()
     }
 
     //Store in database
+    psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
     if(!db->CommandPump("UPDATE characters SET last_login='%s' WHERE id='%d'", lastLoginTime.GetData(), pid.Unbox()))
     {
         Error2("Last login storage: DB Error: %s\n", db->GetLastError());
@@ -1135,6 +1136,8 @@ void psCharacter::UpdateRespawn(csVector3 pos, float yrot, psSectorInfo* sector,
 
     sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where id=%u",
                   l.loc.x, l.loc.y, l.loc.z, l.loc_yrot, l.loc_sector->uid, l.worldInstance, pid.Unbox());
+    // A queued save of the whole row would overwrite this with the old values
+    psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
     if(db->CommandPump(sql) != 1)
     {
         Error3("Couldn't save character's position to database.\nCommand was "
@@ -1337,6 +1340,7 @@ void psCharacter::SetProgressionPoints(unsigned int X,bool save)
         // Update the DB
         csString sql;
         sql.Format("UPDATE characters SET progression_points = '%u', experience_points = '%u' WHERE id ='%u'", X, exp, pid.Unbox());
+        psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
         if(!db->CommandPump(sql))
         {
             Error3("Couldn't execute SQL %s!, %s's PP points are NOT saved", sql.GetData(), ShowID(pid));
@@ -1752,6 +1756,7 @@ void psCharacter::SaveMoney(bool bank)
                       money.GetCircles(), money.GetTrias(), money.GetHexas(), money.GetOctas(), pid.Unbox());
     }
 
+    psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
     if(db->CommandPump(sql) != 1)
     {
         Error3("Couldn't save character's money to database.\nCommand was "
@@ -2269,6 +2274,7 @@ void psCharacter::SaveLocationInWorld()
 
     sql.AppendFmt("update characters set loc_x=%10.2f, loc_y=%10.2f, loc_z=%10.2f, loc_yrot=%10.2f, loc_sector_id=%u, loc_instance=%u where id=%u",
                   l.loc.x, l.loc.y, l.loc.z, l.loc_yrot, l.loc_sector->uid, l.worldInstance, pid.Unbox());
+    psserver->GetDatabase()->GetWriteBehind()->Flush("characters", pid.Unbox());
     if(db->CommandPump(sql) != 1)
     {
         Error3("Couldn't save character's position to database.\nCommand was "
@@ -190,6 +190,8 @@ psCharacter* psCharacterLoader::LoadCharacterData(PID pid, bool forceReload)
     }
     //}
 
+    // Saves of the character and its items may still be queued
+    psserver->GetDatabase()->GetWriteBehind()->Barrier();
 
     // Now load from the database if not found in cache
     csTicks start = csGetTicks();
@@ -254,6 +256,9 @@ psCharacter* psCharacterLoader::LoadCharacterData(PID pid, bool forceReload)
 
 psCharacter* psCharacterLoader::QuickLoadCharacterData(PID pid, bool noInventory)
 {
+    // Saves of the character and its items may still be queued
+    psserver->GetDatabase()->GetWriteBehind()->Barrier();
+
     Result result(db->Select("SELECT id, name, lastname, racegender_id FROM characters WHERE id=%u LIMIT 1", pid.Unbox()));
 
     if(!result.IsValid() || result.Count() < 1)
@@ -520,6 +525,9 @@ bool psCharacterLoader::SaveCharacterSkill(PID pid, unsigned int skill_id,
 
 bool psCharacterLoader::DeleteCharacterData(PID pid, csString &error)
 {
+    // Write the last saves of the character and its items before reading and deleting them
+    psserver->GetDatabase()->GetWriteBehind()->Barrier();
+
     csString query;
     query.Format("SELECT name, lastname, guild_member_of, guild_level FROM characters where id='%u'\n", pid.Unbox());
     Result result(db->Select(query));
@@ -626,17 +634,9 @@ bool psCharacterLoader::SaveCharacterData(psCharacter* chardata, gemActor* actor
                        chardata->GetCharType() == PSCHARACTER_TYPE_PET;
 
     size_t i;
-    static iRecord* updatePlayer;
-    static iRecord* updateNpc;
-    if(playerORpet && updatePlayer == NULL)
-    {
-        updatePlayer = db->NewUpdatePreparedStatement("characters", "id", 35, __FILE__, __LINE__); // 35 fields + 1 id field
-    }
 
-    if(!playerORpet && updateNpc == NULL)
-    {
-        updateNpc = db->NewUpdatePreparedStatement("characters", "id", 28, __FILE__, __LINE__); // 28 fields + 1 id field
-    }
+    // The character row is coalesced and written later, the other tables right away
+    psWriteBehindRecord update(psserver->GetDatabase()->GetWriteBehind(), db, "characters", "id");
 
     // Give 100% hp if the char is dead
     if(!actor->IsAlive())
@@ -644,9 +644,7 @@ bool psCharacterLoader::SaveCharacterData(psCharacter* chardata, gemActor* actor
         chardata->SetHitPoints(chardata->GetMaxHP().Base());
     }
 
-    iRecord* targetUpdate = (playerORpet) ? updatePlayer : updateNpc;
-
-    targetUpdate->Reset();
+    iRecord* targetUpdate = &update;
 
     targetUpdate->AddField("name", chardata->GetCharName());
     targetUpdate->AddField("lastname", chardata->GetCharLastName());
@@ -646,9 +646,11 @@ void psItem::Commit(bool children)
     if(!loaded)
         return;
 
-    static iRecord* updateQuery;
     static iRecord* insertQuery;
 
+    // Updates of existing items are coalesced and written later, inserts need the new id now
+    psWriteBehindRecord updateQuery(psserver->GetDatabase()->GetWriteBehind(), db, "item_instances", "id");
+
     iRecord* targetQuery;
 
     if(GetUID()==0)
@@ -659,9 +661,7 @@ void psItem::Commit(bool children)
     }
     else
     {
-        if(updateQuery == NULL)
-            updateQuery = db->NewUpdatePreparedStatement("item_instances", "id", 30, __FILE__, __LINE__); // 26 fields + 1 id field
-        targetQuery = updateQuery;
+        targetQuery = &updateQuery;
     }
 
     targetQuery->Reset();
@@ -2863,6 +2863,7 @@ bool psItem::Destroy()
 
 bool psItem::DeleteFromDatabase()
 {
+    psserver->GetDatabase()->GetWriteBehind()->Cancel("item_instances", uid);
     if(db->CommandPump("DELETE FROM item_instances where id='%u'",this->uid)!=1)
         return false;
 
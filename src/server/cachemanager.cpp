@@ -22,7 +22,10 @@
 // Crystal Space Includes
 //=============================================================================
 #include <zlib.h>
+#include <iutil/cfgmgr.h>
+#include <iutil/vfs.h>
 #include <csutil/stringarray.h>
+#include <csutil/sysfunc.h>
 
 //=============================================================================
 // Project Space Includes
@@ -62,6 +65,43 @@
 #include "globals.h"
 #include "scripting.h"
 
+// The selects of the preload, queued by PreloadAll() before the tables are loaded
+static const char* SECTORS_QUERY                     = "SELECT * from sectors";
+static const char* SKILLS_QUERY                      = "SELECT * from skills";
+static const char* LIMITATIONS_QUERY                 = "SELECT * from character_limitations";
+static const char* RACE_INFO_QUERY                   = "SELECT * from race_info";
+static const char* TRAITS_QUERY                      = "SELECT * from traits order by id";
+static const char* WEAPON_TYPES_QUERY                = "SELECT * from weapon_types";
+static const char* ITEM_CATEGORIES_QUERY             = "SELECT * from item_categories";
+static const char* ITEM_ANIMATIONS_QUERY             = "SELECT * from item_animations order by id, min_use_level";
+static const char* ITEM_STATS_QUERY                  = "SELECT * from item_stats where stat_type in ('B','U','R') ";
+static const char* WAYS_QUERY                        = "SELECT * from ways";
+static const char* FACTIONS_QUERY                    = "SELECT * from factions";
+static const char* SCRIPTS_QUERY                     = "SELECT * from progression_events";
+static const char* SPELLS_QUERY                      = "SELECT * from spells";
+static const char* QUESTS_QUERY                      = "select * from quests order by id";
+static const char* ATTACK_TYPES_QUERY                = "SELECT * from attack_types";
+static const char* ATTACKS_QUERY                     = "select * from attacks order by id";
+static const char* TRADE_COMBINATIONS_QUERY          = "select * from trade_combinations order by pattern_id, result_id, item_id";
+static const char* TRADE_TRANSFORMATIONS_QUERY       = "select * from trade_transformations order by pattern_id, item_id";
+static const char* PATTERN_IDS_QUERY                 = "select id from trade_patterns order by id";
+static const char* UNIQUE_TRANSFORMATION_ITEMS_QUERY = "select distinct pattern_id, item_id from trade_transformations order by pattern_id, item_id";
+static const char* UNIQUE_COMBINATION_ITEMS_QUERY    = "select distinct pattern_id, item_id from trade_combinations order by pattern_id, item_id";
+static const char* TRADE_PROCESSES_QUERY             = "select * from trade_processes order by process_id, subprocess_number";
+static const char* TRADE_PATTERNS_QUERY              = "select * from trade_patterns order by designitem_id";
+static const char* CRAFT_PATTERNS_QUERY              = "SELECT * from trade_patterns where designitem_id<>0 order by designitem_id";
+static const char* CRAFT_TRANSFORMATIONS_QUERY       = "select * from trade_transformations order by id";
+static const char* CRAFT_COMBINATIONS_QUERY          = "select * from trade_combinations order by id";
+static const char* TIPS_QUERY                        = "select tip from tips where id<1000";
+static const char* BAD_NAMES_QUERY                   = "SELECT * from bad_names";
+static const char* ARMOR_VS_WEAPON_QUERY             = "select * from armor_vs_weapon";
+static const char* MOVEMENT_MODES_QUERY              = "SELECT * FROM movement_modes";
+static const char* MOVEMENT_TYPES_QUERY              = "SELECT * FROM movement_types";
+static const char* STANCES_QUERY                     = "select * from stances order by id";
+static const char* OPTIONS_QUERY                     = "SELECT * from server_options";
+static const char* LOOT_MODIFIERS_QUERY              = "SELECT * FROM loot_modifiers ORDER BY modifier_type, probability";
+static const char* LOOT_MODIFIER_RESTRAINS_QUERY     = "SELECT * FROM loot_modifiers_restrains ORDER BY loot_modifier_id";
+
 CacheManager::CacheManager()
 {
     slotMap[PSCHARACTER_SLOT_RIGHTHAND]   = PSITEMSTATS_SLOT_RIGHTHAND;
@@ -146,6 +186,11 @@ CacheManager::CacheManager()
 
     commandManager = NULL;
 
+    preloadEntityManager = NULL;
+    preloadStart = 0;
+    preloadFailed = false;
+    preloadWriter = NULL;
+
     lootRandomizer = new LootRandomizer(this);
 
     // Init common string data.
@@ -163,76 +208,349 @@ CacheManager::~CacheManager()
 
 bool CacheManager::PreloadAll(EntityManager* entitymanager)
 {
-    if(!PreloadSectors())
-        return false;
-    if(!PreloadSkills())
-        return false;
-    if(!PreloadLimitations())
-        return false;
-    if(!PreloadRaceInfo())
-        return false;
-    if(!PreloadTraits())
-        return false; // Need RaceInfo
-    if(!PreloadWeaponTypes())
-        return false;
-    if (!PreloadItemCategories())
-        return false;
-    if(!PreloadItemAnimList())
-        return false;
-    if(!PreloadItemStatsDatabase())
-        return false;
-    if(!PreloadWays())
-        return false;
-    if(!PreloadFactions())
-        return false;
-    if(!PreloadScripts(entitymanager))
-        return false;
-    if(!PreloadMathScripts())
-        return false;
-    if(!PreloadSpells())
-        return false;
-    if(!PreloadQuests())
-        return false;
-    if(!PreloadAttackTypes())
-        return false;
-    if (!PreloadAttacks())
-        return false;
-    if (!PreloadTradeCombinations())
-        return false;
-    if(!PreloadTradeTransformations())
-        return false;
-    if(!PreloadUniqueTradeTransformations())
-        return false;
-    if(!PreloadTradeProcesses())
-        return false;
-    if(!PreloadTradePatterns())
-        return false;
-    if(!PreloadCraftMessages())
-        return false;
-    if(!PreloadTips())
-        return false;
-    if(!PreloadBadNames())
-        return false;
-    if(!PreloadArmorVsWeapon())
-        return false;
-    if(!PreloadMovement())
-        return false;
-    if(!PreloadStances())
-        return false;
-    if(!PreloadOptions())
-        return false;
-    if(!PreloadLootModifiers())
-        return false;
+    // Main thread stages are loaded in the order they are listed in, any
+    // thread stages as soon as the stages they are after are done.
+    static const PreloadStage stages[] =
+    {
+        { "Sectors",                    &CacheManager::PreloadSectors,                    false, { NULL }, { SECTORS_QUERY } },
+        { "Skills",                     &CacheManager::PreloadSkills,                     false, { NULL }, { SKILLS_QUERY } },
+        { "Limitations",                &CacheManager::PreloadLimitations,                true,  { NULL }, { LIMITATIONS_QUERY } },
+        { "RaceInfo",                   &CacheManager::PreloadRaceInfo,                   false, { NULL }, { RACE_INFO_QUERY } },
+        { "Traits",                     &CacheManager::PreloadTraits,                     false, { NULL }, { TRAITS_QUERY } },
+        { "WeaponTypes",                &CacheManager::PreloadWeaponTypes,                true,  { NULL }, { WEAPON_TYPES_QUERY } },
+        { "ItemCategories",             &CacheManager::PreloadItemCategories,             true,  { NULL }, { ITEM_CATEGORIES_QUERY } },
+        { "ItemAnimList",               &CacheManager::PreloadItemAnimList,               false, { NULL }, { ITEM_ANIMATIONS_QUERY } },
+        { "ItemStatsDatabase",          &CacheManager::PreloadItemStatsDatabase,          false, { "WeaponTypes", "ItemCategories", NULL }, { ITEM_STATS_QUERY } },
+        { "Ways",                       &CacheManager::PreloadWays,                       true,  { NULL }, { WAYS_QUERY } },
+        { "Factions",                   &CacheManager::PreloadFactions,                   true,  { NULL }, { FACTIONS_QUERY } },
+        { "Scripts",                    &CacheManager::PreloadScripts,                    false, { "Factions", NULL }, { SCRIPTS_QUERY } },
+        { "MathScripts",                &CacheManager::PreloadMathScripts,                false, { NULL }, { NULL } },
+        { "Spells",                     &CacheManager::PreloadSpells,                     false, { "Ways", NULL }, { SPELLS_QUERY } },
+        { "Quests",                     &CacheManager::PreloadQuests,                     false, { "Factions", NULL }, { QUESTS_QUERY } },
+        { "AttackTypes",                &CacheManager::PreloadAttackTypes,                false, { "WeaponTypes", NULL }, { ATTACK_TYPES_QUERY } },
+        { "Attacks",                    &CacheManager::PreloadAttacks,                    false, { NULL }, { ATTACKS_QUERY } },
+        { "TradeCombinations",          &CacheManager::PreloadTradeCombinations,          true,  { NULL }, { TRADE_COMBINATIONS_QUERY } },
+        { "TradeTransformations",       &CacheManager::PreloadTradeTransformations,       false, { NULL }, { TRADE_TRANSFORMATIONS_QUERY } },
+        { "UniqueTradeTransformations", &CacheManager::PreloadUniqueTradeTransformations, true,  { NULL }, { PATTERN_IDS_QUERY, UNIQUE_TRANSFORMATION_ITEMS_QUERY, UNIQUE_COMBINATION_ITEMS_QUERY } },
+        { "TradeProcesses",             &CacheManager::PreloadTradeProcesses,             false, { NULL }, { TRADE_PROCESSES_QUERY } },
+        { "TradePatterns",              &CacheManager::PreloadTradePatterns,              true,  { NULL }, { TRADE_PATTERNS_QUERY } },
+        { "CraftMessages",              &CacheManager::PreloadCraftMessages,              false, { "TradePatterns", NULL }, { CRAFT_PATTERNS_QUERY, CRAFT_TRANSFORMATIONS_QUERY, CRAFT_COMBINATIONS_QUERY } },
+        { "Tips",                       &CacheManager::PreloadTips,                       true,  { NULL }, { TIPS_QUERY } },
+        { "BadNames",                   &CacheManager::PreloadBadNames,                   true,  { NULL }, { BAD_NAMES_QUERY } },
+        { "ArmorVsWeapon",              &CacheManager::PreloadArmorVsWeapon,              true,  { NULL }, { ARMOR_VS_WEAPON_QUERY } },
+        { "Movement",                   &CacheManager::PreloadMovement,                   true,  { NULL }, { MOVEMENT_MODES_QUERY, MOVEMENT_TYPES_QUERY } },
+        { "Stances",                    &CacheManager::PreloadStances,                    false, { NULL }, { STANCES_QUERY } },
+        { "Options",                    &CacheManager::PreloadOptions,                    true,  { NULL }, { OPTIONS_QUERY } },
+        { "LootModifiers",              &CacheManager::PreloadLootModifiers,              true,  { NULL }, { LOOT_MODIFIERS_QUERY, LOOT_MODIFIER_RESTRAINS_QUERY } },
+        { "CommandGroups",              &CacheManager::PreloadCommandGroups,              false, { NULL }, { NULL } }
+    };
 
-    PreloadCommandGroups();
+    preloadEntityManager = entitymanager;
+    preloadFailed = false;
+    preloadStart = csGetMicroTicks();
 
-    return true;
+    for(size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); i++)
+    {
+        preloadStages.Push(stages[i]);
+    }
+
+    // Unchanged tables are taken from the snapshot of the last preload
+    csString snapshot = psserver->GetConfig()->GetStr("PlaneShift.Database.PreloadSnapshot", "");
+    if(!snapshot.IsEmpty())
+        LoadPreloadSnapshot(snapshot);
+
+    // The workers are stopped again before the server starts its own
+    int workers = psserver->GetConfig()->GetInt("PlaneShift.Database.PreloadWorkers", 4);
+    bool parallel = workers > 0 && db->StartWorkers(workers);
+    if(workers > 0 && !parallel)
+    {
+        CPrintf(CON_WARNING, "Couldn't start the database workers for the preload, loading on one connection.\n");
+    }
+
+    for(size_t i = 0; parallel && i < preloadStages.GetSize(); i++)
+    {
+        for(size_t q = 0; q < 3 && stages[i].queries[q]; q++)
+        {
+            if(IsPreloadSnapshotCurrent(stages[i].queries[q]))
+                continue;
+            csRef<iAsyncQuery> query = db->SelectAsync(NULL, "%s", stages[i].queries[q]);
+            preloadQueries.PutUnique(stages[i].queries[q], query);
+        }
+    }
+
+    csRef<CS::Threading::Thread> thread;
+    if(parallel)
+    {
+        csRef<PreloadHelper> helper;
+        helper.AttachNew(new PreloadHelper(this));
+        thread.AttachNew(new CS::Threading::Thread(helper));
+        thread->Start();
+    }
+
+    bool loaded = RunPreloadStages(false);
+
+    if(thread)
+        thread->Wait();
+
+    // Queries of stages not loaded after a failure
+    preloadQueries.DeleteAll();
+    if(parallel)
+        db->StopWorkers();
+
+    if(loaded && preloadWriter)
+        SavePreloadSnapshot(snapshot);
+    delete preloadWriter;
+    preloadWriter = NULL;
+    preloadChecksums.DeleteAll();
+    preloadSnapshotQueries.Empty();
+    preloadSnapshot.Load(NULL); // Frees the buffer
+
+    CPrintf(CON_CMDOUTPUT, "%s", DumpPreloadStages(csGetMicroTicks() - preloadStart).GetData());
+    preloadStages.DeleteAll();
+    preloadEntityManager = NULL;
+
+    return loaded;
+}
+
+bool CacheManager::RunPreloadStages(bool helper)
+{
+    CS::Threading::MutexScopedLock lock(preloadMutex);
+    while(!preloadFailed)
+    {
+        bool left = false;
+        PreloadStage* stage = NextPreloadStage(helper, left);
+        if(!stage)
+        {
+            if(!left)
+                break;
+            preloadCondition.Wait(preloadMutex);
+            continue;
+        }
+
+        stage->state = PRELOAD_LOADING;
+        stage->helper = helper;
+        stage->thread = CS::Threading::Thread::GetThreadID();
+        csMicroTicks start = csGetMicroTicks();
+        stage->start = start - preloadStart;
+
+        preloadMutex.Unlock();
+        bool loaded = (this->*stage->load)();
+        preloadMutex.Lock();
+
+        stage->time = csGetMicroTicks() - start;
+        stage->state = loaded ? PRELOAD_DONE : PRELOAD_FAILED;
+        if(!loaded)
+        {
+            Error2("Could not preload %s.", stage->name);
+            preloadFailed = true;
+        }
+        preloadCondition.NotifyAll();
+    }
+    return !preloadFailed;
+}
+
+CacheManager::PreloadStage* CacheManager::NextPreloadStage(bool helper, bool &left)
+{
+    bool mainWaiting = false;
+    for(size_t i = 0; i < preloadStages.GetSize(); i++)
+    {
+        PreloadStage &stage = preloadStages[i];
+        if(stage.state == PRELOAD_DONE || (helper && !stage.anyThread))
+            continue;
+
+        // The main thread waits for the any thread stages loaded by the helper too
+        left = true;
+        if(stage.state != PRELOAD_WAITING)
+            continue;
+
+        // Main thread stages wait for the earlier ones
+        if(!stage.anyThread)
+        {
+            if(mainWaiting)
+                continue;
+            mainWaiting = true;
+        }
+
+        bool ready = true;
+        for(size_t a = 0; ready && a < 3 && stage.after[a]; a++)
+        {
+            for(size_t j = 0; j < preloadStages.GetSize(); j++)
+            {
+                if(!strcmp(preloadStages[j].name, stage.after[a]) && preloadStages[j].state != PRELOAD_DONE)
+                    ready = false;
+            }
+        }
+        if(ready)
+            return &stage;
+    }
+    return NULL;
 }
 
-void CacheManager::PreloadCommandGroups()
+/// The table of a preload query, the name after the first from.
+static csString GetPreloadTable(const char* sql)
+{
+    csString lower(sql);
+    lower.Downcase();
+    size_t from = lower.FindStr(" from ");
+    if(from == (size_t)-1)
+        return "";
+
+    size_t start = from + 6;
+    size_t end = start;
+    while(end < lower.Length() && (isalnum((unsigned char)lower[end]) || lower[end] == '_'))
+    {
+        end++;
+    }
+    return lower.Slice(start, end - start);
+}
+
+iResultSet* CacheManager::PreloadSelect(const char* sql)
+{
+    // Reloaded later
+    if(preloadStages.IsEmpty())
+        return db->Select("%s", sql);
+
+    iResultSet* result = NULL;
+    bool fromSnapshot = false;
+    csMicroTicks wait = 0;
+
+    if(IsPreloadSnapshotCurrent(sql))
+    {
+        result = preloadSnapshot.Select(sql);
+        fromSnapshot = true;
+    }
+    else
+    {
+        csRef<iAsyncQuery> query;
+        {
+            CS::Threading::MutexScopedLock lock(preloadMutex);
+            query = preloadQueries.Get(sql, csRef<iAsyncQuery>());
+            preloadQueries.DeleteAll(sql);
+        }
+
+        // During the preload the workers are safe from any thread
+        if(!query)
+            query = db->SelectAsync(NULL, "%s", sql);
+
+        csMicroTicks start = csGetMicroTicks();
+        query->Wait();
+        result = query->TakeResultSet();
+        wait = csGetMicroTicks() - start;
+    }
+
+    CS::Threading::MutexScopedLock lock(preloadMutex);
+    if(fromSnapshot)
+    {
+        preloadSnapshotQueries.Push(sql);
+    }
+    else if(preloadWriter && result && preloadChecksums.Contains(GetPreloadTable(sql)))
+    {
+        preloadWriter->AddResult(sql, result);
+    }
+
+    CS::Threading::ThreadID thread = CS::Threading::Thread::GetThreadID();
+    for(size_t i = 0; i < preloadStages.GetSize(); i++)
+    {
+        PreloadStage &stage = preloadStages[i];
+        if(stage.state == PRELOAD_LOADING && stage.thread == thread)
+        {
+            stage.wait += wait;
+            stage.rows += result ? result->Count() : 0;
+            stage.snapshotRows += fromSnapshot && result ? result->Count() : 0;
+            break;
+        }
+    }
+    return result;
+}
+
+bool CacheManager::IsPreloadSnapshotCurrent(const char* sql)
+{
+    csString table = GetPreloadTable(sql);
+    const uint64* checksum = preloadChecksums.GetElementPointer(table);
+    uint64 saved;
+    return checksum && preloadSnapshot.GetTableChecksum(table, saved) && saved == *checksum &&
+           preloadSnapshot.HasResult(sql);
+}
+
+void CacheManager::LoadPreloadSnapshot(const char* path)
+{
+    csRef<iDataBuffer> data = psserver->vfs->ReadFile(path, false);
+    if(data && !preloadSnapshot.Load(data))
+    {
+        CPrintf(CON_WARNING, "The preload snapshot %s is damaged or of another version, preloading all tables.\n", path);
+    }
+
+    // Tables the database has no checksums for are always selected
+    preloadWriter = new psDBSnapshotWriter;
+    for(size_t i = 0; i < preloadStages.GetSize(); i++)
+    {
+        for(size_t q = 0; q < 3 && preloadStages[i].queries[q]; q++)
+        {
+            csString table = GetPreloadTable(preloadStages[i].queries[q]);
+            uint64 checksum;
+            if(table.IsEmpty() || preloadChecksums.Contains(table) || !db->GetTableChecksum(table, checksum))
+                continue;
+
+            preloadChecksums.Put(table, checksum);
+            preloadWriter->AddTable(table, checksum);
+        }
+    }
+}
+
+void CacheManager::SavePreloadSnapshot(const char* path)
+{
+    // Every result was taken from the snapshot
+    if(!preloadWriter->GetResultCount())
+        return;
+
+    for(size_t i = 0; i < preloadSnapshotQueries.GetSize(); i++)
+    {
+        Result result(preloadSnapshot.Select(preloadSnapshotQueries[i]));
+        if(result.IsValid())
+            preloadWriter->AddResult(preloadSnapshotQueries[i], result.rs);
+    }
+
+    csRef<iDataBuffer> data = preloadWriter->Save();
+    if(!psserver->vfs->WriteFile(path, data->GetData(), data->GetSize()))
+    {
+        CPrintf(CON_WARNING, "Couldn't save the preload snapshot %s.\n", path);
+    }
+}
+
+csString CacheManager::DumpPreloadStages(csMicroTicks total)
+{
+    static const char* stateNames[] = { "-", "", "", "failed" };
+
+    csString dump;
+    dump.Format("%-28s %-7s %10s %10s %10s %8s %8s\n", "Preload stage", "Thread", "Start ms", "Wait ms", "Load ms", "Rows",
+                "Snapshot");
+
+    csMicroTicks sum = 0;
+    csMicroTicks waitSum = 0;
+    for(size_t i = 0; i < preloadStages.GetSize(); i++)
+    {
+        const PreloadStage &stage = preloadStages[i];
+        const char* thread = stage.state == PRELOAD_DONE ? (stage.helper ? "helper" : "main") : stateNames[stage.state];
+        dump.AppendFmt("%-28s %-7s %10.1f %10.1f %10.1f %8zu %8zu\n", stage.name, thread,
+                       stage.start / 1000.0f, stage.wait / 1000.0f, stage.time / 1000.0f, stage.rows, stage.snapshotRows);
+        sum += stage.time;
+        waitSum += stage.wait;
+    }
+    dump.AppendFmt("Preloaded in %.1f ms, the stages took %.1f ms of which %.1f ms waiting for queries\n",
+                   total / 1000.0f, sum / 1000.0f, waitSum / 1000.0f);
+    return dump;
+}
+
+void CacheManager::PreloadHelper::Run()
+{
+    cache->RunPreloadStages(true);
+}
+
+bool CacheManager::PreloadCommandGroups()
 {
     commandManager = new psCommandManager;
     commandManager->LoadFromDatabase();
+    return true;
 }
 
 void CacheManager::UnloadAll()
@@ -441,6 +759,7 @@ void CacheManager::RemoveInstance(psItem* &item)
     Notify2(LOG_CACHE, "Removing Instance of item: %u", item->GetUID());
     if(item->GetUID() != 0)
     {
+        psserver->GetDatabase()->GetWriteBehind()->Cancel("item_instances", item->GetUID());
         db->Command("DELETE from item_instances where id='%u'", item->GetUID());
     }
     delete item;
@@ -464,13 +783,21 @@ void CacheManager::RemoveItemStats(psItemStats* &itemStats)
 bool CacheManager::PreloadLootModifiers()
 {
     // Order by's are a little slower but it guarentees order
-    Result result(db->Select("SELECT * FROM loot_modifiers ORDER BY modifier_type, probability"));
+    Result result(PreloadSelect(LOOT_MODIFIERS_QUERY));
     if(!result.IsValid())
     {
         Error2("Could not load loot modifiers due to database error: %s\n", db->GetLastError());
         return false;
     }
 
+    Result restrains(PreloadSelect(LOOT_MODIFIER_RESTRAINS_QUERY));
+    if(!restrains.IsValid())
+    {
+        Error2("Could not load loot modifiers restrains due to database error: %s\n", db->GetLastError());
+        return false;
+    }
+    ResultIndex restrainsByModifier(restrains, "loot_modifier_id");
+
     float previous_probability = 0;
     for(unsigned int i = 0; i < result.Count(); i++)
     {
@@ -490,18 +817,11 @@ bool CacheManager::PreloadLootModifiers()
         entry->icon = result[i][ "icon" ];
         entry->not_usable_with = result[i][ "not_usable_with" ];
 
-        Result restrainResult(db->Select("SELECT * FROM loot_modifiers_restrains where loot_modifier_id=%i", entry->id));
-        if(!restrainResult.IsValid())
+        const csArray<size_t> &rows = restrainsByModifier.Get(entry->id);
+        for(size_t j = 0; j < rows.GetSize(); j++)
         {
-            Error2("Could not load loot modifiers restrains due to database error: %s\n", db->GetLastError());
-            delete entry;
-            return false;
-        }
-
-        for(size_t j = 0; j < restrainResult.Count(); j++)
-        {
-            entry->itemRestrain.PutUnique(restrainResult[j].GetUInt32("item_id"),
-                                          *restrainResult[j]["allowed"] == 'Y');
+            entry->itemRestrain.PutUnique(restrains[rows[j]].GetUInt32("item_id"),
+                                          *restrains[rows[j]]["allowed"] == 'Y');
         }
 
         lootRandomizer->AddLootModifier(entry);
@@ -515,7 +835,7 @@ bool CacheManager::PreloadLootModifiers()
 bool CacheManager::PreloadOptions()
 {
     unsigned int currentrow;
-    Result result(db->Select("SELECT * from server_options"));
+    Result result(PreloadSelect(OPTIONS_QUERY));
 
     if(!result.IsValid())
     {
@@ -625,7 +945,7 @@ bool optionEntry::getValueAsVector(csVector3 &vector)
 bool CacheManager::PreloadSkills()
 {
     unsigned int currentrow;
-    Result result(db->Select("SELECT * from skills"));
+    Result result(PreloadSelect(SKILLS_QUERY));
 
     if(!result.IsValid())
     {
@@ -691,7 +1011,7 @@ bool CacheManager::PreloadLimitations()
 {
     psCharacterLimitation* limit;
     unsigned int currentrow;
-    Result result(db->Select("SELECT * from character_limitations"));
+    Result result(PreloadSelect(LIMITATIONS_QUERY));
 
     if(!result.IsValid())
     {
@@ -729,7 +1049,7 @@ bool CacheManager::PreloadSectors()
 {
     unsigned int currentrow;
     psSectorInfo* newsector;
-    Result result(db->Select("SELECT * from sectors"));
+    Result result(PreloadSelect(SECTORS_QUERY));
 
     if(!result.IsValid())
     {
@@ -889,7 +1209,7 @@ bool CacheManager::PreloadSectors()
 
 bool CacheManager::PreloadMovement()
 {
-    Result modes(db->Select("SELECT * FROM movement_modes"));
+    Result modes(PreloadSelect(MOVEMENT_MODES_QUERY));
     if(!modes.IsValid())
     {
         Error1("Could not cache database table. Check >movement_modes<");
@@ -928,7 +1248,7 @@ bool CacheManager::PreloadMovement()
     }
     Notify2(LOG_STARTUP, "%lu Movement Modes Loaded", modes.Count());
 
-    Result types(db->Select("SELECT * FROM movement_types"));
+    Result types(PreloadSelect(MOVEMENT_TYPES_QUERY));
     if(!types.IsValid())
     {
         return false;
@@ -997,7 +1317,7 @@ uint8_t CacheManager::GetMovementID(const char* name)
 bool CacheManager::PreloadArmorVsWeapon()
 {
     unsigned int currentrow;
-    Result result(db->Select("select * from armor_vs_weapon"));
+    Result result(PreloadSelect(ARMOR_VS_WEAPON_QUERY));
 
     if(!result.IsValid())
     {
@@ -1039,7 +1359,7 @@ bool CacheManager::PreloadArmorVsWeapon()
 
 bool CacheManager::PreloadStances()
 {
-    Result result(db->Select("select * from stances order by id"));
+    Result result(PreloadSelect(STANCES_QUERY));
 
     if(!result.IsValid())
     {
@@ -1071,7 +1391,7 @@ bool CacheManager::PreloadStances()
 
 bool CacheManager::PreloadAttacks()
 {
-    Result result(db->Select("select * from attacks order by id"));
+    Result result(PreloadSelect(ATTACKS_QUERY));
 
     if (!result.IsValid())
     {
@@ -1154,7 +1474,7 @@ bool CacheManager::PreloadQuests()
     unsigned int currentrow;
     psQuest* quest;
 
-    Result result(db->Select("select * from quests order by id"));
+    Result result(PreloadSelect(QUESTS_QUERY));
 
     if(!result.IsValid())
     {
@@ -1280,7 +1600,7 @@ bool CacheManager::PreloadTradeCombinations()
     CombinationConstruction* ctr;
     csPDelArray<CombinationConstruction>* newArray = NULL;
 
-    Result result(db->Select("select * from trade_combinations order by pattern_id, result_id, item_id"));
+    Result result(PreloadSelect(TRADE_COMBINATIONS_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >trade_combinations<");
@@ -1339,7 +1659,7 @@ bool CacheManager::PreloadTradeTransformations()
     csHash<csPDelArray<psTradeTransformations> *,uint32>* transHash = NULL;
     csPDelArray<psTradeTransformations>* newArray = NULL;
 
-    Result result(db->Select("select * from trade_transformations order by pattern_id, item_id"));
+    Result result(PreloadSelect(TRADE_TRANSFORMATIONS_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >trade_transformations<");
@@ -1404,61 +1724,54 @@ csPDelArray<psTradeTransformations>* CacheManager::FindTransformationsList(uint3
 // Trade Transformations
 bool CacheManager::PreloadUniqueTradeTransformations()
 {
-    uint32 currentID;
-    csString query;
-    csArray<uint32>* newArray;
-
     // Get a list of the trade patterns ids
-    Result result(db->Select("select id from trade_patterns order by id"));
+    Result result(PreloadSelect(PATTERN_IDS_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >trade_patterns<");
+        return true;
     }
-    else
+
+    // Get the unique transformation and combination items of all the patterns at once
+    Result transformations(PreloadSelect(UNIQUE_TRANSFORMATION_ITEMS_QUERY));
+    if(!transformations.IsValid())
     {
-        for(size_t currentrow=0; currentrow<result.Count(); currentrow++)
-        {
-            newArray = new csArray<uint32>;
-            currentID = result[currentrow].GetUInt32("id");
+        Error1("No distinct item ids found in trade_transformations");
+        return true;
+    }
+    Result combinations(PreloadSelect(UNIQUE_COMBINATION_ITEMS_QUERY));
+    if(!combinations.IsValid())
+    {
+        Error1("No distinct item ids found in trade_combinations");
+        return true;
+    }
+    ResultIndex transformationItems(transformations, "pattern_id");
+    ResultIndex combinationItems(combinations, "pattern_id");
 
-            // Now get a list of unique transformation items for each pattern
-            query.Format("select distinct item_id from trade_transformations where pattern_id =%d order by item_id", currentID);
-            Result result(db->Select(query));
-            if(!result.IsValid())
-            {
-                Error1("No distinct item ids found in trade_transformations");
-            }
-            else
-            {
-                // Push each result item ID into array
-                for(size_t transrow=0; transrow<result.Count(); transrow++)
-                {
-                    newArray->Push(result[transrow].GetUInt32("item_id"));
-                }
+    for(size_t currentrow=0; currentrow<result.Count(); currentrow++)
+    {
+        csArray<uint32>* newArray = new csArray<uint32>;
+        uint32 currentID = result[currentrow].GetUInt32("id");
 
-                // Now get a list of unique combination items for each pattern
-                query.Format("select distinct item_id from trade_combinations where pattern_id =%d order by item_id", currentID);
-                Result result2(db->Select(query));
-                if(!result2.IsValid())
-                {
-                    Error1("No distinct item ids found in trade_combinations");
-                }
-                else
-                {
-                    // Push each result item ID into array
-                    for(size_t combsrow=0; combsrow<result2.Count(); combsrow++)
-                    {
-                        newArray->Push(result2[combsrow].GetUInt32("item_id"));
-                    }
+        // Push each transformation item ID into array
+        const csArray<size_t> &transrows = transformationItems.Get(currentID);
+        for(size_t transrow=0; transrow<transrows.GetSize(); transrow++)
+        {
+            newArray->Push(transformations[transrows[transrow]].GetUInt32("item_id"));
+        }
 
-                    // Add hash
-                    tradeTransUnique_IDHash.Put(currentID,newArray);
-                }
-            }
+        // Then each combination item ID
+        const csArray<size_t> &combsrows = combinationItems.Get(currentID);
+        for(size_t combsrow=0; combsrow<combsrows.GetSize(); combsrow++)
+        {
+            newArray->Push(combinations[combsrows[combsrow]].GetUInt32("item_id"));
         }
 
-        Notify2(LOG_STARTUP, "%lu Unique Trade Transformations Loaded", result.Count());
+        // Add hash
+        tradeTransUnique_IDHash.Put(currentID,newArray);
     }
+
+    Notify2(LOG_STARTUP, "%lu Unique Trade Transformations Loaded", result.Count());
     return true;
 }
 
@@ -1476,7 +1789,7 @@ bool CacheManager::PreloadTradeProcesses()
     csArray<psTradeProcesses*>* newArray = NULL;
 
     // Get a list of the trade processes
-    Result result(db->Select("select * from trade_processes order by process_id, subprocess_number"));
+    Result result(PreloadSelect(TRADE_PROCESSES_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >trade_process<");
@@ -1523,7 +1836,7 @@ bool CacheManager::PreloadTradePatterns()
     psTradePatterns* newPattern;
 
     // Get a list of the trade patterns ignoring the dummy ones
-    Result result(db->Select("select * from trade_patterns order by designitem_id"));
+    Result result(PreloadSelect(TRADE_PATTERNS_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >trade_patterns<");
@@ -1560,298 +1873,224 @@ psTradePatterns* CacheManager::GetTradePatternByName(csString name)
 }
 
 
-/** Insert Sorted Unique
- *  Insert the itemID into an array, sorted according the the item's Name, no more than one time.
- */
-bool CacheManager::UniqueInsertIntoItemArray(csArray<uint32>* finalItems, uint32 itemID)
+/// Rows of entries by key, the entries of key k are entries[first[k]] up to first[k+1], in the order of the keys.
+static void BuildSparseRows(const csArray<size_t> &keys, size_t keyCount, csArray<size_t> &first, csArray<size_t> &entries)
 {
-    if(itemID==0) return false;
-
-    psItemStats* NewStats = GetBasicItemStatsByID(itemID);
-    if(!NewStats)
+    first.SetSize(keyCount + 1, 0);
+    for(size_t i=0; i<keys.GetSize(); i++)
     {
-        return false;
+        first[keys[i] + 1]++;
+    }
+    for(size_t k=0; k<keyCount; k++)
+    {
+        first[k + 1] += first[k];
     }
 
-    for(size_t i=0; i<finalItems->GetSize(); i++)
+    csArray<size_t> next(first);
+    entries.SetSize(keys.GetSize());
+    for(size_t i=0; i<keys.GetSize(); i++)
     {
-        psItemStats* CurrStats;
-        if(finalItems->Get(i) == itemID)    //already in list
-        {
-            return false;
-        }
-        CurrStats = GetBasicItemStatsByID(finalItems->Get(i));
-        if(!CurrStats)
-        {
-            return false;
-        }
-        if(strcmp(NewStats->GetName(),CurrStats->GetName())<1)
-        {
-            finalItems->Insert(i, itemID);      //insert before current item
-            return true;
-        }
+        entries[next[keys[i]]++] = i;
     }
-    finalItems->Push(itemID);
-    return true;
 }
 
-/** Check if an int value is already in an array
- * This is used primarily with the "stack" arrays that track progress through a network of data nodes,
- * to determine if a node has already been visited.
- */
-int CacheManager::Contains(csArray<uint32>* list, uint32 id)
+/// The node of the item, added if it has none yet.
+static size_t GetCraftNode(csHash<size_t, uint32> &nodes, csArray<uint32> &items, uint32 itemID)
+{
+    const size_t* node = nodes.GetElementPointer(itemID);
+    if(node)
+        return *node;
+
+    nodes.Put(itemID, items.GetSize());
+    return items.Push(itemID);
+}
+
+void CacheManager::BuildCraftGraph(CraftGraph &graph, Result &transformations, Result &combinations)
 {
-    int matches	= 0;
-    for(size_t i=0; i<list->GetSize(); i++)
+    // The edges in the order of their first transformation
+    csHash<size_t, uint64> edges;
+    size_t transformationCount = transformations.IsValid() ? transformations.Count() : 0;
+    graph.transformations.SetCapacity(transformationCount);
+    for(size_t i=0; i<transformationCount; i++)
     {
-        if(list->Get(i)==id)
+        size_t item = GetCraftNode(graph.nodes, graph.items, transformations[i].GetUInt32("item_id"));
+        size_t result = GetCraftNode(graph.nodes, graph.items, transformations[i].GetUInt32("result_id"));
+
+        uint64 key = ((uint64)item << 32) | result;
+        const size_t* edge = edges.GetElementPointer(key);
+        if(!edge)
         {
-            matches++;
+            edges.Put(key, graph.edgeItem.GetSize());
+            edge = edges.GetElementPointer(key);
+            graph.edgeItem.Push(item);
+            graph.edgeResult.Push(result);
         }
-    }
-    return matches;
-}
+        graph.transformationEdge.Push(*edge);
+        graph.patterns.Push(transformations[i].GetUInt32("pattern_id"));
 
-/** Build the list of 'final' items.
- * starting at any random node, recursively walk the data network until a 'final' looking node is encountered,
- * then add it to the finalItems list.
- */
-bool CacheManager::FindFinalItem(csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txItemHash,
-                                 csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* rxItemHash,
-                                 csArray<uint32>* finalItems, uint32 itemID, csArray<uint32>* itemStack)
-{
-    csHash<csPDelArray<psTradeTransformations> *,uint32>* iHash	= NULL;
+        psTradeTransformations* tx = new psTradeTransformations;
+        if(!tx->Load(transformations[i]))
+        {
+            delete tx;
+            tx = NULL;
+        }
+        graph.transformations.Push(tx);
+    }
 
-    itemStack->Push(itemID);
-    iHash = txItemHash->Get(itemID, NULL);
-    if(!iHash)
+    size_t combinationCount = combinations.IsValid() ? combinations.Count() : 0;
+    csArray<size_t> comboResults;
+    csArray<size_t> comboItems;
+    for(size_t i=0; i<combinationCount; i++)
     {
-        //no records found matching this itemID
-        UniqueInsertIntoItemArray(finalItems, itemID);
+        comboResults.Push(GetCraftNode(graph.nodes, graph.items, combinations[i].GetUInt32("result_id")));
+        comboItems.Push(GetCraftNode(graph.nodes, graph.items, combinations[i].GetUInt32("item_id")));
     }
-    else
-    {
-        csHash<csPDelArray<psTradeTransformations> *,uint32>::GlobalIterator Iter(iHash->GetIterator());
-        Iter.Reset();
-        while(Iter.HasNext())
-        {
-            uint32 key;
-            Iter.Next(key); // Move to next key
 
-            if(itemID == key)
-            {
-                UniqueInsertIntoItemArray(finalItems, itemID);
-            }
-            else if(Contains(itemStack, key)>0)
-            {
-                //if there's a loop, it's impossible to determine programmatically which *should* be the final state;
+    size_t nodeCount = graph.items.GetSize();
+    BuildSparseRows(graph.transformationEdge, graph.edgeItem.GetSize(), graph.edgeFirst, graph.edgeTransformations);
+    BuildSparseRows(graph.edgeItem, nodeCount, graph.outFirst, graph.outEdges);
+    BuildSparseRows(graph.edgeResult, nodeCount, graph.inFirst, graph.inEdges);
+    BuildSparseRows(comboResults, nodeCount, graph.comboFirst, graph.comboItems);
+    for(size_t i=0; i<graph.comboItems.GetSize(); i++)
+    {
+        graph.comboItems[i] = comboItems[graph.comboItems[i]];
+    }
 
-                //DISCARDED OPTION: adopt the heuristic that the one that is the target of fewer transformations is the final one.
-                //DISCARDED OPTION: adopt the hueristic that if they have the same number they are both 'final' states. This should
-                //heuristic : product of more transforms = final item
-                if(rxItemHash->Get(key, NULL)->GetSize() > rxItemHash->Get(itemID, NULL)->GetSize())
-                {
-                    UniqueInsertIntoItemArray(finalItems, key);
-                }
-                else
-                {
-                    UniqueInsertIntoItemArray(finalItems, itemID);
-                }
-            }
-            else  	//move toward the final result...
-            {
-                if(!Contains(finalItems, key))
-                {
-                    FindFinalItem(txItemHash, rxItemHash, finalItems, key, itemStack);
-                }
-            }
-        }
+    graph.stats.SetSize(nodeCount);
+    for(size_t n=0; n<nodeCount; n++)
+    {
+        graph.stats[n] = GetBasicItemStatsByID(graph.items[n]);
     }
-    itemStack->Pop();
 
-    return true;
+    graph.book = 0;
+    graph.walk = 0;
+    graph.bookPattern = 0;
+    graph.bookGroup = 0;
+    graph.edgeBook.SetSize(graph.edgeItem.GetSize(), 0);
+    graph.finalMark.SetSize(nodeCount, 0);
+    graph.patternFinalMark.SetSize(nodeCount, 0);
+    graph.bookItemMark.SetSize(nodeCount, 0);
+    graph.visitMark.SetSize(nodeCount, 0);
+    graph.onPath.SetSize(nodeCount, false);
 }
 
-
-bool CacheManager::ReconcileFinalItems(csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txItemHash,
-                                       csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txResultHash,
-                                       csArray<uint32>* finalItems,
-                                       csArray<uint32>* craftBookItems,
-                                       uint32 resultID,
-                                       uint32 patternID,
-                                       csArray<uint32>* itemStack)
+size_t CacheManager::CountBookEdgesInto(CraftGraph &graph, size_t node)
 {
-    csHash<csPDelArray<psTradeTransformations> *,uint32>*   rHash   = NULL;
-
-    itemStack->Push(resultID);
-    rHash = txResultHash->Get(resultID, NULL);
-    if(!rHash)
+    size_t count = 0;
+    for(size_t i=graph.inFirst[node]; i<graph.inFirst[node + 1]; i++)
     {
-        //no records found matching this resultID...try combinations
-        csString        query;
-
-        //query.Format("select * from trade_combinations where result_id=%d and pattern_id=%d", resultID, patternID);
-        query.Format("select * from trade_combinations where result_id=%d", resultID);
-        Result combinations(db->Select(query));
-        if(!combinations.IsValid())
+        if(graph.edgeBook[graph.inEdges[i]] == graph.book)
         {
-            Error3("invalid return from \"select * from trade_combinations where result_id=%d and pattern_id=%d\"", resultID, patternID);
-        }
-        else if(combinations.Count()>0)
-        {
-            for(size_t j=0; j<combinations.Count(); j++)
-            {
-                if(Contains(finalItems, combinations[j].GetUInt32("item_id")))
-                {
-                    UniqueInsertIntoItemArray(craftBookItems, combinations[j].GetUInt32("item_id"));
-                }
-                ReconcileFinalItems(txItemHash, txResultHash, finalItems, craftBookItems, combinations[j].GetUInt32("item_id"), patternID, itemStack);
-            }
+            count++;
         }
     }
-    else
+    return count;
+}
+
+void CacheManager::GetBookTransformations(CraftGraph &graph, size_t edge)
+{
+    graph.describe.Empty();
+    for(size_t i=graph.edgeFirst[edge]; i<graph.edgeFirst[edge + 1]; i++)
     {
-        csHash<csPDelArray<psTradeTransformations> *,uint32>::GlobalIterator Iter(rHash->GetIterator());
-        Iter.Reset();
-        while(Iter.HasNext())
+        size_t t = graph.edgeTransformations[i];
+        if(graph.transformations[t] && (graph.patterns[t] == graph.bookPattern || graph.patterns[t] == graph.bookGroup))
         {
-            uint32  key;
-            Iter.Next(key); // Get next key
-
-            if(!Contains(itemStack, key))
-            {
-                if(Contains(finalItems, key))
-                {
-                    UniqueInsertIntoItemArray(craftBookItems,  key);
-                }
-                ReconcileFinalItems(txItemHash, txResultHash, finalItems, craftBookItems, key, patternID, itemStack);
-            }
+            graph.describe.Push(graph.transformations[t]);
         }
     }
-
-    return true;
 }
 
-
-
-/** load transformations into hashes for faster access.
- * NOTE that these hashes are for use specifically in creating the Craft book messages and are cleaned up after.
+/** Mark the 'final' items.
+ * starting at any node, walk the data network until a 'final' looking node is encountered,
+ * then mark it. Items without stats are never final.
  */
-bool CacheManager::loadTradeTransformationsByPatternAndGroup(Result* TransformationList,
-        csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txResultHash,
-        csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txItemHash)
+void CacheManager::FindFinalItems(CraftGraph &graph, size_t node, csArray<uint32> &finalMark)
 {
-    csHash<csPDelArray<psTradeTransformations> *,uint32>* rHash	= NULL;
-    csPDelArray<psTradeTransformations>* rArray	= NULL;
-    csHash<csPDelArray<psTradeTransformations> *,uint32>* iHash	= NULL;
-    csPDelArray<psTradeTransformations>* iArray	= NULL;
-    psTradeTransformations* tx	= NULL;
+    graph.visitMark[node] = graph.walk;
+    graph.onPath[node] = true;
 
-    for(size_t currentrow=0; currentrow<TransformationList->Count(); currentrow++)
+    bool transformed = false;
+    for(size_t i=graph.outFirst[node]; i<graph.outFirst[node + 1]; i++)
     {
-        uint32 itemID	= (*TransformationList)[currentrow].GetUInt32("item_id");
-        uint32 resultID	= (*TransformationList)[currentrow].GetUInt32("result_id");
-
-        //load hash by result - use to traverse from results to item
-        if(!(rHash = txResultHash->Get(resultID, NULL)))
+        size_t edge = graph.outEdges[i];
+        if(graph.edgeBook[edge] != graph.book)
         {
-            //if there's no hash for this resultID, add one
-            rHash = new csHash<csPDelArray<psTradeTransformations> *,uint32>;
-            txResultHash->Put(resultID,rHash);
+            continue;
         }
+        transformed = true;
 
-        //only if transformation from item -> result occurs by different processes will there be more than 1 item in the array
-        if(!(rArray = rHash->Get(itemID, NULL)))
+        size_t result = graph.edgeResult[edge];
+        size_t finalNode = csArrayItemNotFound;
+        if(result == node)
         {
-            //if there's no array for this itemID, add one
-            rArray = new csPDelArray<psTradeTransformations>;
-            rHash->Put(itemID,rArray);
+            finalNode = node;
         }
-
-        //load hash by item - use to traverse from item to results
-        if(!(iHash = txItemHash->Get(itemID, NULL)))
+        else if(graph.onPath[result])
         {
-            //if there's no hash for this itemID, add one
-            iHash = new csHash<csPDelArray<psTradeTransformations> *,uint32>;
-            txItemHash->Put(itemID, iHash);
+            //if there's a loop, it's impossible to determine programmatically which *should* be the final state;
+            //heuristic : product of more transforms = final item
+            finalNode = CountBookEdgesInto(graph, result) > CountBookEdgesInto(graph, node) ? result : node;
         }
-
-        //only if transformation from item -> result occurs by different processes will there be more than 1 item in the array
-        if(!(iArray = iHash->Get(resultID, NULL)))
+        else if(finalMark[result] != graph.book && graph.visitMark[result] != graph.walk)
         {
-            //if there's no array for this resultID, add one
-            iArray = new csPDelArray<psTradeTransformations>;
-            iHash->Put(resultID,iArray);
+            //move toward the final result...
+            FindFinalItems(graph, result, finalMark);
         }
 
-        tx = new psTradeTransformations;
-        if(tx->Load((*TransformationList)[currentrow]))
+        if(finalNode != csArrayItemNotFound && graph.stats[finalNode])
         {
-            rArray->Push(tx);
-        }
-        else
-        {
-            delete tx;
+            finalMark[finalNode] = graph.book;
         }
     }
-    return true;
+
+    //no transformations of this item
+    if(!transformed && graph.stats[node])
+    {
+        finalMark[node] = graph.book;
+    }
+    graph.onPath[node] = false;
 }
 
-/** dispose of transformation hashes for craft books.
- *
- */
-bool CacheManager::freeTradeTransformationsByPatternAndGroup(csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txItemHash, csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txResultHash)
+void CacheManager::ReconcileFinalItems(CraftGraph &graph, size_t node)
 {
+    graph.visitMark[node] = graph.walk;
 
-    csHash<csPDelArray<psTradeTransformations> *,uint32>*   iHash   = NULL;
-    csPDelArray<psTradeTransformations>*                    iArray  = NULL;
-
-    csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>::GlobalIterator txIter(txItemHash->GetIterator());
-    txIter.Reset();
-    while(txIter.HasNext())
+    bool transformed = false;
+    for(size_t i=graph.inFirst[node]; i<graph.inFirst[node + 1]; i++)
     {
-        iHash = txIter.Next();
-        if(iHash)
+        size_t edge = graph.inEdges[i];
+        if(graph.edgeBook[edge] != graph.book)
+        {
+            continue;
+        }
+        transformed = true;
+
+        size_t item = graph.edgeItem[edge];
+        if(graph.visitMark[item] != graph.walk)
         {
-            csHash<csPDelArray<psTradeTransformations> *,uint32>::GlobalIterator Iter(iHash->GetIterator());
-            Iter.Reset();
-            while(Iter.HasNext())
+            if(graph.finalMark[item] == graph.book && graph.bookItemMark[item] != graph.book)
             {
-                iArray =  Iter.Next();
-                if(iArray)
-                {
-                    delete iArray;
-                }
+                graph.bookItemMark[item] = graph.book;
+                graph.bookItems.Push(item);
             }
-            delete iHash;
+            ReconcileFinalItems(graph, item);
         }
     }
 
-    csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>::GlobalIterator rxIter(txResultHash->GetIterator());
-    rxIter.Reset();
-    while(rxIter.HasNext())
+    //no transformations into this item...try combinations
+    for(size_t i=graph.comboFirst[node]; !transformed && i<graph.comboFirst[node + 1]; i++)
     {
-        iHash = rxIter.Next();
-        if(iHash)
+        size_t item = graph.comboItems[i];
+        if(graph.finalMark[item] == graph.book && graph.bookItemMark[item] != graph.book)
         {
-            csHash<csPDelArray<psTradeTransformations> *,uint32>::GlobalIterator Iter(iHash->GetIterator());
-            Iter.Reset();
-            while(Iter.HasNext())
-            {
-                iArray =  Iter.Next();
-                if(iArray)
-                {
-                    delete iArray;
-                }
-            }
-            delete iHash;
+            graph.bookItemMark[item] = graph.book;
+            graph.bookItems.Push(item);
+        }
+        if(graph.visitMark[item] != graph.walk)
+        {
+            ReconcileFinalItems(graph, item);
         }
     }
-
-    delete txItemHash;
-    delete txResultHash;
-
-    return false;
 }
 
 bool CacheManager::DescribeTransformation(psTradeTransformations* t, csArray<CraftTransInfo*>* newArray)
@@ -1889,16 +2128,16 @@ bool CacheManager::DescribeTransformation(psTradeTransformations* t, csArray<Cra
     return true;
 }
 
-bool CacheManager::DescribeMultiTransformation(csPDelArray<psTradeTransformations>* rArray, csArray<CraftTransInfo*>* newArray)
+bool CacheManager::DescribeMultiTransformation(csArray<psTradeTransformations*>* rArray, csArray<CraftTransInfo*>* newArray)
 {
     //sort transformations by their processes skill requirements
-    csPDelArray<psTradeTransformations>* sortedArray = NULL;
+    csArray<psTradeTransformations*>* sortedArray = NULL;
     for(size_t i=0; i<rArray->GetSize(); i++)
     {
         psTradeTransformations*    t = rArray->Get(i);
         if(sortedArray==NULL)
         {
-            sortedArray = new  csPDelArray<psTradeTransformations>;
+            sortedArray = new  csArray<psTradeTransformations*>;
             sortedArray->Push(rArray->Get(i));
         }
         else
@@ -2103,12 +2342,12 @@ bool CacheManager::DescribeMultiTransformation(csPDelArray<psTradeTransformation
 
 
 
-bool CacheManager::DescribeCombination(Result* combinations, csArray<CraftTransInfo*>* newArray)
+bool CacheManager::DescribeCombination(Result* combinations, const csArray<size_t> &rows, csArray<CraftTransInfo*>* newArray)
 {
     CraftTransInfo* craftInfo;
     craftInfo = new CraftTransInfo;
 
-    craftInfo->craftStepDescription = CreateComboCraftDescription(combinations);
+    craftInfo->craftStepDescription = CreateComboCraftDescription(combinations, rows);
 
     //note that the skill mins are not used for combinations, so set them all to 0
     craftInfo->priSkillId = craftInfo->minPriSkill = craftInfo->secSkillId = craftInfo->minSecSkill = 0;
@@ -2120,81 +2359,78 @@ bool CacheManager::DescribeCombination(Result* combinations, csArray<CraftTransI
 }
 
 /** List the steps to produce an item.
- * given a result item ID, recursively list all the transformations and combinations required to produce it
+ * given a result item, list all the transformations and combinations required to produce it
  */
-bool CacheManager::ListProductionSteps(csArray<CraftTransInfo*>* newArray,
-                                       csHash<csHash<csPDelArray<psTradeTransformations> *, uint32> *,uint32>* txResultHash,
-                                       csArray<uint32>* finalItems, uint32 resultID, uint32 patternID, uint groupID, csArray<uint32>* itemStack)
+void CacheManager::ListProductionSteps(CraftGraph &graph, ResultIndex &combinations, csArray<CraftTransInfo*>* newArray, size_t node)
 {
-    csHash<csPDelArray<psTradeTransformations> *,uint32>*   rHash   = NULL;
-    csPDelArray<psTradeTransformations>*                    rArray  = NULL;
+    graph.visitMark[node] = graph.walk;
+    graph.onPath[node] = true;
 
-    itemStack->Push(resultID);
-    rHash = txResultHash->Get(resultID, NULL);
-    if(!rHash)
+    bool transformed = false;
+    for(size_t i=graph.inFirst[node]; i<graph.inFirst[node + 1]; i++)
     {
-        //no records found matching this resultID...try combinations
-        csString        query;
-
-        query.Format("select * from trade_combinations where result_id=%d", resultID);
-        Result combinations(db->Select(query));
-        if(!combinations.IsValid())
+        size_t edge = graph.inEdges[i];
+        if(graph.edgeBook[edge] != graph.book)
         {
-            Error3("invalid return from \"select * from trade_combinations where result_id=%d and pattern_id=%d\"", resultID, patternID);
+            continue;
         }
-        else if(combinations.Count()>0)
+        transformed = true;
+
+        size_t item = graph.edgeItem[edge];
+        if(item == node || graph.visitMark[item] == graph.walk)
         {
-            for(size_t j=0; j<combinations.Count(); j++)
+            GetBookTransformations(graph, edge);
+            if(graph.describe.GetSize()==1)
             {
-                if(!Contains(finalItems, combinations[j].GetUInt32("item_id")))
-                {
-                    ListProductionSteps(newArray, txResultHash, finalItems, combinations[j].GetUInt32("item_id"), patternID, groupID, itemStack);
-                }
+                DescribeTransformation(graph.describe[0], newArray);
+            }
+            else
+            {
+                DescribeMultiTransformation(&graph.describe, newArray);
             }
-            DescribeCombination(&combinations, newArray);
         }
-    }
-    else
-    {
-        csHash<csPDelArray<psTradeTransformations> *,uint32>::GlobalIterator Iter(rHash->GetIterator());
-        Iter.Reset();
-        while(Iter.HasNext())
+        else
         {
-            uint32  Key;
-            rArray =  Iter.Next(Key);
-
-            if(resultID == Key || Contains(itemStack, Key))
+            if(graph.finalMark[item] != graph.book)
             {
-                if(rArray->GetSize()==1)
-                {
-                    DescribeTransformation(rArray->Get(0), newArray);
-                }
-                else
-                {
-                    DescribeMultiTransformation(rArray, newArray);
-                }
+                ListProductionSteps(graph, combinations, newArray, item);
             }
-            else if(!Contains(itemStack, Key))
+
+            // The walk above reuses the scratch
+            GetBookTransformations(graph, edge);
+            for(size_t j=0; j<graph.describe.GetSize(); j++)
             {
-                if(!Contains(finalItems, Key))
-                {
-                    ListProductionSteps(newArray, txResultHash, finalItems, Key, patternID, groupID, itemStack);
-                }
-                for(size_t j=0; j<rArray->GetSize(); j++)
-                {
-                    DescribeTransformation(rArray->Get(j), newArray);
-                }
+                DescribeTransformation(graph.describe[j], newArray);
+            }
+        }
+    }
 
+    //no transformations into this item...try combinations
+    if(!transformed && graph.comboFirst[node] < graph.comboFirst[node + 1])
+    {
+        for(size_t i=graph.comboFirst[node]; i<graph.comboFirst[node + 1]; i++)
+        {
+            // Components on the path would be listed over and over
+            size_t item = graph.comboItems[i];
+            if(graph.finalMark[item] != graph.book && !graph.onPath[item])
+            {
+                ListProductionSteps(graph, combinations, newArray, item);
             }
         }
+        DescribeCombination(&combinations.GetResult(), combinations.Get(graph.items[node]), newArray);
     }
 
-    return true;
+    graph.onPath[node] = false;
 }
 
-
-
-
+/// Items listed in a craft book are sorted by name.
+static int CompareCraftBookItems(psItemStats* const &a, psItemStats* const &b)
+{
+    int order = strcmp(a->GetName(), b->GetName());
+    if(order)
+        return order;
+    return a->GetUID() < b->GetUID() ? -1 : (a->GetUID() > b->GetUID() ? 1 : 0);
+}
 
 // Trade Info Message
 bool CacheManager::PreloadCraftMessages()
@@ -2203,17 +2439,36 @@ bool CacheManager::PreloadCraftMessages()
 
 
     // Get a list of all the trade patterns in the database ordered by design item ID
-    Result result(db->Select("SELECT * from trade_patterns where designitem_id<>0 order by designitem_id"));
+    Result result(PreloadSelect(CRAFT_PATTERNS_QUERY));
+    if(!result.IsValid())
+    {
+        Error1("Could not cache database table. Check >trade_patterns<");
+        return true;
+    }
+
+    // All the transformations and combinations at once instead of a query per pattern and item
+    Result transformations(PreloadSelect(CRAFT_TRANSFORMATIONS_QUERY));
+    if(!transformations.IsValid())
+    {
+        Error1("Could not cache database table. Check >trade_transformations<");
+    }
+    Result combinationList(PreloadSelect(CRAFT_COMBINATIONS_QUERY));
+    if(!combinationList.IsValid())
+    {
+        Error1("Could not cache database table. Check >trade_combinations<");
+    }
+    ResultIndex transformationsByPattern(transformations, "pattern_id");
+    ResultIndex combinations(combinationList, "result_id");
+
+    // One graph of the transformations of all the patterns, walked for each book
+    CraftGraph graph;
+    BuildCraftGraph(graph, transformations, combinationList);
+    csArray<size_t> patternFinals;
+    csArray<psItemStats*> craftBookItems;
+
     for(size_t currentPattern=0; currentPattern<result.Count(); currentPattern++)
     {
         CraftTransInfo* craftInfo;
-        csString query;
-        csArray<uint32>* finalItems = new csArray<uint32>;
-        csArray<uint32>* finalPatternItems = new csArray<uint32>;
-        csArray<uint32>* craftBookItems = new csArray<uint32>;
-
-        csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>*	txResultHash	= new csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>;
-        csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>*	txItemHash	= new csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>;
 
         // Get the design item that goes with the pattern
         uint32 patternID = result[currentPattern].GetUInt32("id");
@@ -2223,77 +2478,94 @@ bool CacheManager::PreloadCraftMessages()
         newArray = new csArray<CraftTransInfo*>;
         tradeCraftTransInfo_IDHash.Put(designItemID,newArray);
 
-        //Get the list of transformations for this pattern and group
-        query.Format("select * from trade_transformations where pattern_id=%i or pattern_id=%i", patternID, currentGroupID);
-        Result TransformationList(db->Select(query));
-        if(!result.IsValid())
+        //the transformations of this pattern and group are the edges of the book
+        const csArray<size_t> &patternRows = transformationsByPattern.Get(patternID);
+        const csArray<size_t> &groupRows = transformationsByPattern.Get(currentGroupID);
+        graph.book++;
+        graph.bookPattern = patternID;
+        graph.bookGroup = currentGroupID;
+        graph.bookItems.Empty();
+        for(size_t i=0; i<patternRows.GetSize(); i++)
         {
-            Error1("Could not cache database table. Check >trade_transformations<");
+            graph.edgeBook[graph.transformationEdge[patternRows[i]]] = graph.book;
         }
-        else
+        for(size_t i=0; i<groupRows.GetSize(); i++)
         {
-            loadTradeTransformationsByPatternAndGroup(&TransformationList, txResultHash, txItemHash);
+            graph.edgeBook[graph.transformationEdge[groupRows[i]]] = graph.book;
         }
 
         //identify the final products of transformations
-        for(size_t i=0; i<TransformationList.Count(); i++)
+        graph.walk++;
+        for(size_t i=0; i<patternRows.GetSize() + groupRows.GetSize(); i++)
         {
-            csArray<uint32>* itemStack = new csArray<uint32>;
-
-            FindFinalItem(txItemHash, txResultHash, finalItems, TransformationList[i].GetInt("item_id"), itemStack);
-            itemStack->DeleteAll();
+            size_t row = i < patternRows.GetSize() ? patternRows[i] : groupRows[i - patternRows.GetSize()];
+            size_t node = graph.edgeItem[graph.transformationEdge[row]];
+            if(graph.visitMark[node] != graph.walk)
+            {
+                FindFinalItems(graph, node, graph.finalMark);
+            }
         }
 
         //identify final items directly related to items with the pattern_id
-        for(size_t i=0; i<TransformationList.Count(); i++)
+        graph.walk++;
+        for(size_t i=0; i<patternRows.GetSize(); i++)
         {
-            if(TransformationList[i].GetUInt32("pattern_id")==patternID)
+            size_t node = graph.edgeItem[graph.transformationEdge[patternRows[i]]];
+            if(graph.visitMark[node] != graph.walk)
             {
-                csArray<uint32>* itemStack = new csArray<uint32>;
-
-                FindFinalItem(txItemHash, txResultHash, finalPatternItems, TransformationList[i].GetInt("item_id"), itemStack);
-                itemStack->DeleteAll();
+                FindFinalItems(graph, node, graph.patternFinalMark);
             }
         }
 
         //merge the final items that appear in 'finalItems' and are used by items appearing in 'finalPatternItems' with those
         //appearing in 'finalPatternItems' to produce 'craftBookItems'
-        for(size_t i=0; i<finalPatternItems->GetSize(); i++)
+        patternFinals.Empty();
+        for(size_t n=0; n<graph.items.GetSize(); n++)
         {
-            csArray<uint32>* itemStack = new csArray<uint32>;
-
-            ReconcileFinalItems(txItemHash, txResultHash, finalItems, craftBookItems, finalPatternItems->Get(i), patternID, itemStack);
-            itemStack->DeleteAll();
+            if(graph.patternFinalMark[n] == graph.book)
+            {
+                patternFinals.Push(n);
+            }
+        }
+        graph.walk++;
+        for(size_t i=0; i<patternFinals.GetSize(); i++)
+        {
+            if(graph.visitMark[patternFinals[i]] != graph.walk)
+            {
+                ReconcileFinalItems(graph, patternFinals[i]);
+            }
+        }
+        for(size_t i=0; i<patternFinals.GetSize(); i++)
+        {
+            if(graph.bookItemMark[patternFinals[i]] != graph.book)
+            {
+                graph.bookItemMark[patternFinals[i]] = graph.book;
+                graph.bookItems.Push(patternFinals[i]);
+            }
         }
-        for(size_t i=0; i<finalPatternItems->GetSize(); i++)
+
+        // Final items all have stats
+        craftBookItems.Empty();
+        for(size_t i=0; i<graph.bookItems.GetSize(); i++)
         {
-            UniqueInsertIntoItemArray(craftBookItems, finalPatternItems->Get(i));
+            craftBookItems.Push(graph.stats[graph.bookItems[i]]);
         }
+        craftBookItems.Sort(CompareCraftBookItems);
 
         //for each of the items in craftBookItems
-        for(size_t i=0; i<craftBookItems->GetSize(); i++)
+        for(size_t i=0; i<craftBookItems.GetSize(); i++)
         {
             //list the item to be created
             craftInfo = new CraftTransInfo;
             craftInfo->priSkillId = craftInfo->minPriSkill = craftInfo->secSkillId = craftInfo->minSecSkill = 0;
             craftInfo->craftStepDescription.Append("-- ");
-            if(GetBasicItemStatsByID(craftBookItems->Get(i)))
-            {
-                craftInfo->craftStepDescription.Append(GetBasicItemStatsByID(craftBookItems->Get(i))->GetName());
-            }
-            else
-            {
-                craftInfo->craftStepDescription.Append(" item ");
-                craftInfo->craftStepDescription.Append(craftBookItems->Get(i));
-            }
+            craftInfo->craftStepDescription.Append(craftBookItems[i]->GetName());
             craftInfo->craftStepDescription.Append(" ----- \n");
             newArray->Push(craftInfo);
 
             //list the steps to create it
-            csArray<uint32>* itemStack = new csArray<uint32>;
-
-            ListProductionSteps(newArray, txResultHash, finalItems, craftBookItems->Get(i), patternID, currentGroupID, itemStack);
-            itemStack->DeleteAll();
+            graph.walk++;
+            ListProductionSteps(graph, combinations, newArray, *graph.nodes.GetElementPointer(craftBookItems[i]->GetUID()));
 
             //insert a blank row between items
             craftInfo = new CraftTransInfo;
@@ -2301,11 +2573,6 @@ bool CacheManager::PreloadCraftMessages()
             craftInfo->craftStepDescription = "\n";
             newArray->Push(craftInfo);
         }
-
-        freeTradeTransformationsByPatternAndGroup(txItemHash, txResultHash);
-        finalItems->DeleteAll();
-        finalPatternItems->DeleteAll();
-
     }
     Notify2(LOG_STARTUP, "%lu Craft Books Loaded", result.Count());
     return true;
@@ -2390,7 +2657,7 @@ csString CacheManager::CreateTransCraftDescription(psTradeTransformations* tran,
     return desc;
 }
 
-csString CacheManager::CreateComboCraftDescription(Result* currentComb)
+csString CacheManager::CreateComboCraftDescription(Result* currentComb, const csArray<size_t> &rows)
 {
     csString temp;
     csString desc("");
@@ -2401,11 +2668,11 @@ csString CacheManager::CreateComboCraftDescription(Result* currentComb)
     desc.Append("Combine ");
 
     // Get each of the items
-    for(size_t j=0; j<(*currentComb).Count(); j++)
+    for(size_t j=0; j<rows.GetSize(); j++)
     {
-        uint32 combId  = (*currentComb)[j].GetInt("item_id");
-        int combMinQty = (*currentComb)[j].GetInt("min_qty");
-        int combMaxQty = (*currentComb)[j].GetInt("max_qty");
+        uint32 combId  = (*currentComb)[rows[j]].GetInt("item_id");
+        int combMinQty = (*currentComb)[rows[j]].GetInt("min_qty");
+        int combMaxQty = (*currentComb)[rows[j]].GetInt("max_qty");
         psItemStats* itemStats = GetBasicItemStatsByID(combId);
         if(!itemStats)
         {
@@ -2452,17 +2719,17 @@ csString CacheManager::CreateComboCraftDescription(Result* currentComb)
     }
 
     // Get result item names
-    psItemStats* resultItemStats = GetBasicItemStatsByID((*currentComb)[0].GetInt("result_id"));
+    psItemStats* resultItemStats = GetBasicItemStatsByID((*currentComb)[rows[0]].GetInt("result_id"));
     if(!resultItemStats)
     {
-        Error2("No item stats for id %u", (*currentComb)[0].GetInt("result_id"));
+        Error2("No item stats for id %u", (*currentComb)[rows[0]].GetInt("result_id"));
         desc.Append(" <item ");
-        desc.Append((*currentComb)[0].GetInt("result_id"));
+        desc.Append((*currentComb)[rows[0]].GetInt("result_id"));
         desc.Append("> ");
     }
 
     // Add result part of description
-    if((*currentComb)[0].GetInt("result_id") == 1)
+    if((*currentComb)[rows[0]].GetInt("result_id") == 1)
     {
         temp.Format("into %s.\n", resultItemStats->GetName());
         desc.Append(temp);
@@ -2473,11 +2740,11 @@ csString CacheManager::CreateComboCraftDescription(Result* currentComb)
 
         if( N[strlen(N)-1]=='s' )
         {
-            temp.Format("into %d %s.\n", (*currentComb)[0].GetInt("result_qty"), N);
+            temp.Format("into %d %s.\n", (*currentComb)[rows[0]].GetInt("result_qty"), N);
         }
         else
         {
-            temp.Format("into %d %ss.\n", (*currentComb)[0].GetInt("result_qty"), N);
+            temp.Format("into %d %ss.\n", (*currentComb)[rows[0]].GetInt("result_qty"), N);
         }
         desc.Append(temp);
     }
@@ -2500,7 +2767,7 @@ bool CacheManager::PreloadTips()
     unsigned int currentrow;
 
     // Id<1000 means we are excluding Tutorial tips
-    Result result(db->Select("select tip from tips where id<1000"));
+    Result result(PreloadSelect(TIPS_QUERY));
     if(!result.IsValid())
     {
         Error1("Could not cache database table. Check >tips<");
@@ -2735,7 +3002,7 @@ bool CacheManager::PreloadTraits()
 {
     unsigned int currentrow;
     psTrait* newtrait;
-    Result result(db->Select("SELECT * from traits order by id"));
+    Result result(PreloadSelect(TRAITS_QUERY));
 
     if(!result.IsValid())
     {
@@ -2857,7 +3124,7 @@ PSCHARACTER_GENDER CacheManager::ConvertGenderString(const char* genderstring)
 bool CacheManager::PreloadRaceInfo()
 {
     unsigned int currentrow;
-    Result result(db->Select("SELECT * from race_info"));
+    Result result(PreloadSelect(RACE_INFO_QUERY));
 
     if(!result.IsValid())
     {
@@ -3378,7 +3645,7 @@ PSSKILL CacheManager::ConvertSkill(int skill_id)
 
 bool CacheManager::PreloadItemCategories()
 {
-    Result categories(db->Select("SELECT * from item_categories"));
+    Result categories(PreloadSelect(ITEM_CATEGORIES_QUERY));
 
     if(categories.IsValid())
     {
@@ -3406,7 +3673,7 @@ bool CacheManager::PreloadItemCategories()
 }
 bool CacheManager::PreloadWeaponTypes()
 {
-    Result types(db->Select("SELECT * from weapon_types"));
+    Result types(PreloadSelect(WEAPON_TYPES_QUERY));
 
     if(types.IsValid())
     {
@@ -3426,7 +3693,7 @@ bool CacheManager::PreloadWeaponTypes()
 }
 bool CacheManager::PreloadAttackTypes()
 {
-    Result types(db->Select("SELECT * from attack_types"));
+    Result types(PreloadSelect(ATTACK_TYPES_QUERY));
 
     if( types.IsValid())
     {
@@ -3464,7 +3731,7 @@ bool CacheManager::PreloadAttackTypes()
 
 bool CacheManager::PreloadWays()
 {
-    Result ways(db->Select("SELECT * from ways"));
+    Result ways(PreloadSelect(WAYS_QUERY));
     if(ways.IsValid())
     {
         int i,count=ways.Count();
@@ -3522,7 +3789,7 @@ void CacheManager::PreloadFactionCharacterEvents(const char* script, Faction* fa
 
 bool CacheManager::PreloadFactions()
 {
-    Result result_factions(db->Select("SELECT * from factions"));
+    Result result_factions(PreloadSelect(FACTIONS_QUERY));
 
     unsigned int x = 0;
 
@@ -3550,9 +3817,14 @@ bool CacheManager::PreloadFactions()
     return true;
 }
 
+bool CacheManager::PreloadScripts()
+{
+    return PreloadScripts(preloadEntityManager);
+}
+
 bool CacheManager::PreloadScripts(EntityManager* entitymanager)
 {
-    Result result(db->Select("SELECT * from progression_events"));
+    Result result(PreloadSelect(SCRIPTS_QUERY));
 
     if(result.IsValid())
     {
@@ -3617,7 +3889,7 @@ bool CacheManager::PreloadMathScripts()
 
 bool CacheManager::PreloadSpells()
 {
-    Result spells(db->Select("SELECT * from spells"));
+    Result spells(PreloadSelect(SPELLS_QUERY));
     if(spells.IsValid())
     {
         int i,count=spells.Count();
@@ -3657,7 +3929,7 @@ bool CacheManager::PreloadItemAnimList()
     psItemAnimation* newitem;
     csPDelArray<psItemAnimation>* newarray;
 
-    Result result(db->Select("SELECT * from item_animations order by id, min_use_level"));
+    Result result(PreloadSelect(ITEM_ANIMATIONS_QUERY));
 
     if(!result.IsValid())
     {
@@ -3760,7 +4032,7 @@ bool CacheManager::PreloadItemStatsDatabase()
 {
     uint32 currentrow;
     psItemStats* newitem;
-    Result result(db->Select("SELECT * from item_stats where stat_type in ('B','U','R') "));
+    Result result(PreloadSelect(ITEM_STATS_QUERY));
 
     if(!result.IsValid())
     {
@@ -3849,7 +4121,7 @@ psItemStats* CacheManager::CopyItemStats(uint32 id, csString newName)
 
 bool CacheManager::PreloadBadNames()
 {
-    Result result(db->Select("SELECT * from bad_names"));
+    Result result(PreloadSelect(BAD_NAMES_QUERY));
 
     if(!result.IsValid())
     {
@@ -25,6 +25,9 @@
 //=============================================================================
 #include <csutil/stringarray.h>
 #include <csutil/hash.h>
+#include <csutil/threading/condition.h>
+#include <csutil/threading/mutex.h>
+#include <csutil/threading/thread.h>
 #include <csgeom/vector3.h>
 
 //=============================================================================
@@ -32,6 +35,7 @@
 //=============================================================================
 #include "util/slots.h"
 #include "util/gameevent.h"
+#include "util/dbsnapshot.h"
 
 #include "bulkobjects/pscharacter.h"
 #include "bulkobjects/psitemstats.h"
@@ -62,6 +66,7 @@ class psSpell;
 class psItemStats;
 class psItem;
 class RandomizedOverlay;
+class ResultIndex;
 
 struct CraftTransInfo;
 struct CombinationConstruction;
@@ -403,7 +408,13 @@ public:
     unsigned int NewAccountInfo(psAccountInfo* ainfo);
     //@}
 
-    /// Convenience function to preload all of the above in an appropriate order
+    /**
+     * Preload all of the above. The selects of all the tables are queued to
+     * the database workers first. The tables the others depend on are then
+     * loaded in order on the calling thread, while a helper thread loads the
+     * tables loaded on their own, see PreloadStage. Prints how long each
+     * table took when done.
+     */
     bool PreloadAll(EntityManager* entitymanager);
     void UnloadAll();
 
@@ -509,7 +520,8 @@ public:
     psTradePatterns* GetTradePatternByName(csString name);
     csString CreateTransCraftDescription(psTradeTransformations* tran, psTradeProcesses* proc);
     csString CreateComboCraftDescription(CombinationConstruction* combArray);
-    csString CreateComboCraftDescription(Result* combArray);
+    /// The description of the combination at the given rows of the trade combinations.
+    csString CreateComboCraftDescription(Result* combArray, const csArray<size_t> &rows);
     csArray<CraftTransInfo*>* GetTradeTransInfoByItemID(uint32 id);
     csArray<CraftComboInfo*>* GetTradeComboInfoByItemID(uint32 id);
     //@}
@@ -694,6 +706,8 @@ protected:
     void PreloadFactionCharacterEvents(const char* script, Faction* faction);
     bool PreloadFactions();
     bool PreloadScripts(EntityManager* entitymanager);
+    /// PreloadScripts() with the entity manager given to PreloadAll().
+    bool PreloadScripts();
     bool PreloadMathScripts();
     bool PreloadSpells();
     bool PreloadItemStatsDatabase();
@@ -706,7 +720,7 @@ protected:
     bool PreloadArmorVsWeapon();
     bool PreloadMovement();
     bool PreloadStances();
-    void PreloadCommandGroups();
+    bool PreloadCommandGroups();
 
 
     /**
@@ -719,76 +733,172 @@ protected:
     /// Cache in the crafting messages.
     bool PreloadCraftMessages();
 
+    /// The states of a PreloadStage.
+    enum PreloadState
+    {
+        PRELOAD_WAITING,
+        PRELOAD_LOADING,
+        PRELOAD_DONE,
+        PRELOAD_FAILED
+    };
+
     /**
-     * Insert the itemID into an array, sorted according the the item's Name, no more than one time.
-     *
-     *  @param finalItems    The array of items
-     *  @param itemID        The ID number of the item to be inserted/sorted
+     * A step of PreloadAll(), loading some tables into the cache. Stages
+     * using other caches, math scripts or the common strings are loaded on
+     * the main thread in the order of the table in PreloadAll(). Stages that
+     * only fill their own caches may be loaded on any thread, as soon as the
+     * stages they are after are done.
      */
-    bool UniqueInsertIntoItemArray(csArray<uint32>* finalItems, uint32 itemID);
+    struct PreloadStage
+    {
+        const char* name;
+        bool (CacheManager::*load)();
+        bool anyThread;
+        const char* after[3];       ///< Any thread stages to be done first, up to the first NULL.
+        const char* queries[3];     ///< Selects queued before the stages are loaded, up to the first NULL.
+
+        PreloadState state;
+        bool helper;                ///< Loaded on the helper thread.
+        CS::Threading::ThreadID thread;
+        csMicroTicks start;         ///< Since the preload started.
+        csMicroTicks wait;          ///< Waiting for the queries.
+        csMicroTicks time;          ///< Loading, the wait included.
+        size_t rows;
+        size_t snapshotRows;        ///< Of the rows, the ones taken from the snapshot.
+    };
+
+    class PreloadHelper : public CS::Threading::Runnable
+    {
+    public:
+        PreloadHelper(CacheManager* cache) : cache(cache) {}
+        virtual void Run();
+
+    private:
+        CacheManager* cache;
+    };
+    friend class PreloadHelper;
 
     /**
-     * Check if an int value is already in an array
-     * This is used primarily with the "stack" arrays that track progress through a network of data nodes,
-     * to determine if a node has already been visited.
-     *
-     * @param list    The array of ints
-     * @param id      The int value to be checked for
+     * Load the stages the thread may load until none is left or one failed.
      *
-     * @return        The number of matches found
+     * @param helper The helper thread, that only loads the any thread stages.
+     * @return False if a stage failed.
      */
-    int Contains(csArray<uint32>* list, uint32 id);
+    bool RunPreloadStages(bool helper);
 
     /**
-     * Build the list of 'final' items.
-     * starting at any random node, recursively walk the data network until a 'final' looking node is encountered,
-     * then add it to the finalItems list.
+     * The next stage the thread may load, preloadMutex must be locked.
      *
-     * @param txItemHash    Hash on item ID to find result ID
-     * @param rxItemHash    Hash on result ID to find item ID
-     * @param finalItems    Array listing item numbers considered 'final'
-     * @param itemID        item under current considerations
-     * @param itemStack     List of items already visited; used for detecting cycles inthe data
-     *
-     * @return
+     * @param left Set if there are stages left the thread has to wait for.
+     * @return NULL if no stage is ready.
      */
-    bool FindFinalItem(csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txItemHash, csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* rxItemHash, csArray<uint32>* finalItems, uint32 itemID, csArray<uint32>* itemStack);
+    PreloadStage* NextPreloadStage(bool helper, bool &left);
 
     /**
-     * From the list of final items, extract those that belong to the specified craft book
-     *
-     * @param txItemHash        Hash on item ID to find result ID
-     * @param rxItemHash        Hash on result ID to find item ID
-     * @param finalItems        Array listing item numbers considered 'final'
-     * @param craftBookItems    Array listing item numbers considered 'final'
-     * @param resultID          Item under current considerations
-     * @param patternID         pattern that specifies the craft Book
-     * @param itemStack         List of items already visited; used for detecting cycles inthe data
+     * Select for a preload. Takes the result from the snapshot if its table
+     * is unchanged, else the result of the query queued by PreloadAll() if
+     * there is one. Counts the wait and rows for the stage loaded by the
+     * calling thread.
      *
-     * @return                  true
+     * @return The result set, to be released by the caller.
      */
-    bool ReconcileFinalItems(csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txItemHash, csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* rxItemHash, csArray<uint32>* finalItems, csArray<uint32>* craftBookItems, uint32 resultID, uint32 patternID, csArray<uint32>* itemStack);
+    iResultSet* PreloadSelect(const char* sql);
+
+    /// Can the result of the preload query be taken from the snapshot?
+    bool IsPreloadSnapshotCurrent(const char* sql);
+
+    /// Read the preload snapshot and the checksums of the preloaded tables.
+    void LoadPreloadSnapshot(const char* path);
 
     /**
-     *  load transformations into hashes for faster access.
-     * NOTE that these hashes are for use specifically in creating the Craft book messages and are cleaned up after.
-     *
-     * @param txResultHash   Hash on result ID to find item ID
-     * @param txItemHash     Hash on item ID to find result ID
+     * Save the results of the preload to the snapshot again, if any was
+     * selected from the database.
+     */
+    void SavePreloadSnapshot(const char* path);
+
+    /// The stages loaded by PreloadAll() and their times, as text.
+    csString DumpPreloadStages(csMicroTicks total);
+
+    /**
+     * The trade transformations as a graph, for the craft books. Items are
+     * the nodes and each item -> result pair with transformations an edge.
+     * Everything is kept in flat arrays indexed by node or edge, the edges of
+     * a node being a range of an array (compressed sparse rows), so the walks
+     * need neither lookups nor allocations. Built once for all the patterns,
+     * the walks for a book only follow the edges with transformations of its
+     * pattern or group.
+     */
+    struct CraftGraph
+    {
+        csHash<size_t, uint32> nodes;                   ///< The node of an item ID.
+        csArray<uint32> items;                          ///< The item ID of a node.
+        csArray<psItemStats*> stats;                    ///< The stats of the item of a node, NULL if unknown.
+
+        csPDelArray<psTradeTransformations> transformations; ///< By row, NULL if the row failed to load.
+        csArray<uint32> patterns;                       ///< The pattern of a transformation.
+        csArray<size_t> transformationEdge;             ///< The edge of a transformation.
+
+        csArray<size_t> edgeItem;                       ///< The node transformed by an edge.
+        csArray<size_t> edgeResult;                     ///< The node an edge transforms into.
+        csArray<size_t> edgeFirst;                      ///< The transformations of edge e are edgeTransformations[edgeFirst[e]] up to edgeFirst[e+1].
+        csArray<size_t> edgeTransformations;
+        csArray<size_t> outFirst;                       ///< The edges from node n are outEdges[outFirst[n]] up to outFirst[n+1].
+        csArray<size_t> outEdges;
+        csArray<size_t> inFirst;                        ///< The edges into node n are inEdges[inFirst[n]] up to inFirst[n+1].
+        csArray<size_t> inEdges;
+        csArray<size_t> comboFirst;                     ///< The components combined into node n are comboItems[comboFirst[n]] up to comboFirst[n+1].
+        csArray<size_t> comboItems;
+
+        // Scratch of the walks. A mark is set if it equals the current book or walk.
+        uint32 book;
+        uint32 walk;
+        uint32 bookPattern;
+        uint32 bookGroup;
+        csArray<uint32> edgeBook;                       ///< The edge has transformations in the book.
+        csArray<uint32> finalMark;                      ///< Final item of the transformations of the book.
+        csArray<uint32> patternFinalMark;               ///< Final item of the transformations of the pattern itself.
+        csArray<uint32> bookItemMark;                   ///< Listed in the book.
+        csArray<uint32> visitMark;                      ///< Visited by the walk.
+        csArray<bool> onPath;                           ///< On the path of the walk to the current node.
+        csArray<size_t> bookItems;                      ///< The nodes listed in the book.
+        csArray<psTradeTransformations*> describe;      ///< The transformations of an edge in the book.
+    };
+
+    /**
+     * Build the graph of all the trade transformations and combinations.
      *
-     * @return               true
+     * @param graph          The graph to build, empty
+     * @param transformations All the trade transformations
+     * @param combinations   All the trade combinations
      */
-    bool loadTradeTransformationsByPatternAndGroup(Result* result, csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txResultHash, csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txItemHash);
+    void BuildCraftGraph(CraftGraph &graph, Result &transformations, Result &combinations);
 
     /**
-     * dispose of transformation hashes for craft books.
+     * Mark the 'final' items.
+     * Walks from the node toward the results of its transformations until a
+     * 'final' looking node is encountered, an item that is not transformed
+     * any further or part of a cycle.
      *
-     * @param txResultHash   Hash on result ID to find item ID
-     * @param txItemHash     Hash on item ID to find result ID
+     * @param graph      The graph, with the edges of the book set
+     * @param node       Item under current consideration
+     * @param finalMark  The marks to set for the final items
+     */
+    void FindFinalItems(CraftGraph &graph, size_t node, csArray<uint32> &finalMark);
+
+    /**
+     * From the final items, list those the item is made of in the book.
+     * Walks from the node back to the items transformed or combined into it.
      *
-     * @return               true
+     * @param graph      The graph, with the final items of the book marked
+     * @param node       Item under current consideration
      */
-    bool freeTradeTransformationsByPatternAndGroup(csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txItemHash, csHash<csHash<csPDelArray<psTradeTransformations> *,uint32> *,uint32>* txResultHash);
+    void ReconcileFinalItems(CraftGraph &graph, size_t node);
+
+    /// The transformations of the edge in the book, in graph.describe.
+    void GetBookTransformations(CraftGraph &graph, size_t edge);
+
+    /// The number of edges of the book into the node.
+    size_t CountBookEdgesInto(CraftGraph &graph, size_t node);
 
     /**
      * build the description of the trade transformation
@@ -808,31 +918,30 @@ protected:
      *
      * @return           true
      */
-    bool DescribeMultiTransformation(csPDelArray<psTradeTransformations>* rArray, csArray<CraftTransInfo*>* newArray);
+    bool DescribeMultiTransformation(csArray<psTradeTransformations*>* rArray, csArray<CraftTransInfo*>* newArray);
 
     /**
      * build the description of a trade combination
      *
-     * @param combinations   list of components of a specific trade combination
+     * @param combinations   All the trade combinations
+     * @param rows           The rows of the components of a specific trade combination
      * @param newArray       Array that holds the CraftTransInfo objects needed to construct the text
      *
      * @return           true
      */
-    bool DescribeCombination(Result* combinations, csArray<CraftTransInfo*>* newArray);
+    bool DescribeCombination(Result* combinations, const csArray<size_t> &rows, csArray<CraftTransInfo*>* newArray);
 
     /**
      * main procedure constructing the recipe steps
+     * Walks from the node back to the items transformed or combined into it,
+     * listing the steps after the steps of the items they use.
      *
+     * @param graph          The graph, with the final items of the book marked
+     * @param combinations   All the trade combinations by result ID
      * @param newArray       Array that holds the CraftTransInfo objects needed to construct the text
-     * @param txResultHash   Hash of trade transformations by result item
-     * @param finalItems     list of items identified as 'final'; these are used to construct the seperate recipes in a single book.
-     * @param itemID         which item to construct the recipe for
-     * @param patternID      which pattern id to construct the recipe for
-     * @param groupID        which group (ie craft book) to construct the recipe for
-     * @param itemStack      array that keeps track of items visited in the traversal of data; used to detect loops in the data.
-     *
+     * @param node           which item to construct the recipe for
      */
-    bool ListProductionSteps(csArray<CraftTransInfo*>* newArray, csHash<csHash<csPDelArray<psTradeTransformations>*, uint32> *,uint32>* txResultHash, csArray<uint32>* finalItems, uint32 itemID, uint32 patternID, uint32 groupID, csArray<uint32>* itemStack);
+    void ListProductionSteps(CraftGraph &graph, ResultIndex &combinations, csArray<CraftTransInfo*>* newArray, size_t node);
 
     /**
      * Caches in the crafting transforms.
@@ -938,6 +1047,19 @@ protected:
     psCommandManager* commandManager;
     optionEntry rootOptionEntry;
 
+    // PreloadAll()
+    csArray<PreloadStage> preloadStages;
+    csHash<csRef<iAsyncQuery>, csString> preloadQueries;    ///< Queued by PreloadAll() and not taken yet.
+    EntityManager* preloadEntityManager;
+    csMicroTicks preloadStart;
+    bool preloadFailed;
+    CS::Threading::Mutex preloadMutex;
+    CS::Threading::Condition preloadCondition;
+    psDBSnapshot preloadSnapshot;                           ///< The results of the last preload.
+    psDBSnapshotWriter* preloadWriter;                      ///< The results of this preload, if a snapshot is used.
+    csHash<uint64, csString> preloadChecksums;              ///< Of the preloaded tables, as they are now.
+    csStringArray preloadSnapshotQueries;                   ///< Taken from the snapshot.
+
     LootRandomizer* lootRandomizer; ///< A pointer to the lootrandomizer mantained by the cachemanager.
     MathScript* maxCarryWeight;     ///< A pointer maintained by MathScriptEngine
     MathScript* maxCarryAmount;     ///< A pointer maintained by MathScriptEngine
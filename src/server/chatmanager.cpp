@@ -532,6 +532,12 @@ void ChatManager::SendGuild(const csString &sender, EID senderEID, psGuildInfo*
     ClientIterator iter(*psserver->GetConnections());
     psGuildMember* member;
 
+    // The same message goes to everyone, so it is split into packets only once
+    psChatMessage newMsg(0, senderEID, sender, 0, msg.sText, msg.iChatType, msg.translate);
+    if(!newMsg.valid)
+        return;
+    psNetFanOut fanout(newMsg.msg);
+
     while(iter.HasNext())
     {
         Client* client = iter.Next();
@@ -540,8 +546,7 @@ void ChatManager::SendGuild(const csString &sender, EID senderEID, psGuildInfo*
         member = client->GetCharacterData()->GetGuildMembership();
         if((!member) || (!member->HasRights(RIGHTS_VIEW_CHAT))) continue;
         // Send the chat message
-        psChatMessage newMsg(client->GetClientNum(), senderEID, sender, 0, msg.sText, msg.iChatType, msg.translate);
-        newMsg.SendMessage();
+        psserver->GetNetManager()->SendFanOut(fanout, client->GetClientNum());
         // The message is saved to the chat history of all the clients in the same guild (PS#2789)
         client->GetActor()->LogChatMessage(sender.GetData(), msg);
     }
@@ -581,6 +586,12 @@ void ChatManager::SendAlliance(const csString &sender, EID senderEID, psGuildAll
     ClientIterator iter(*psserver->GetConnections());
     psGuildMember* member;
 
+    // The same message goes to everyone, so it is split into packets only once
+    psChatMessage newMsg(0, senderEID, sender, 0, msg.sText, msg.iChatType, msg.translate);
+    if(!newMsg.valid)
+        return;
+    psNetFanOut fanout(newMsg.msg);
+
     while(iter.HasNext())
     {
         Client* client = iter.Next();
@@ -589,8 +600,7 @@ void ChatManager::SendAlliance(const csString &sender, EID senderEID, psGuildAll
         member = client->GetCharacterData()->GetGuildMembership();
         if((!member) || (!member->HasRights(RIGHTS_VIEW_CHAT_ALLIANCE))) continue;
         // Send the chat message
-        psChatMessage newMsg(client->GetClientNum(), senderEID, sender, 0, msg.sText, msg.iChatType, msg.translate);
-        newMsg.SendMessage();
+        psserver->GetNetManager()->SendFanOut(fanout, client->GetClientNum());
         // The message is saved to the chat history of all the clients in the same alliance (PS#2789)
         client->GetActor()->LogChatMessage(sender.GetData(), msg);
     }
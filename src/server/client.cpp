@@ -41,6 +41,7 @@
 //=============================================================================
 #include "usermanager.h"
 #include "client.h"
+#include "clients.h"
 #include "psserver.h"
 #include "playergroup.h"
 #include "globals.h"
@@ -60,6 +61,7 @@ Client::Client()
       cheatMask(NO_CHEAT)
 {
     actor           = 0;
+    connectionSet   = NULL;
     exchangeID      = 0;
     advisorPoints   = 0;
     lastInviteTime  = 0;
@@ -269,6 +271,22 @@ bool Client::IsMyPet(gemActor* other) const
 void Client::SetName(const char* n)
 {
     name = n;
+    if(connectionSet)
+        connectionSet->UpdateIndex(this);
+}
+
+void Client::SetAccountID(AccountID id)
+{
+    accountID = id;
+    if(connectionSet)
+        connectionSet->UpdateIndex(this);
+}
+
+void Client::SetPID(PID id)
+{
+    playerID = id;
+    if(connectionSet)
+        connectionSet->UpdateIndex(this);
 }
 
 const char* Client::GetName()
@@ -291,6 +309,10 @@ void Client::SetActor(gemActor* myactor)
     {
         allowedToDisconnect = true;
     }
+
+    // The name comes from the character now
+    if(connectionSet)
+        connectionSet->UpdateIndex(this);
 }
 
 psCharacter* Client::GetCharacterData()
@@ -556,9 +578,9 @@ void Client::SaveAccountData()
     if(spamPoints >= 2)
         spamPoints = 1;
 
-    // Save to the db
-    db->CommandPump("UPDATE accounts SET spam_points = '%d', advisor_points = '%d' WHERE id = '%d'",
-                    spamPoints, advisorPoints, accountID.Unbox());
+    // Save to the db, nothing waits for it
+    csRef<iAsyncQuery> query = db->CommandAsync(NULL, "UPDATE accounts SET spam_points = '%d', advisor_points = '%d' WHERE id = '%d'",
+                                                spamPoints, advisorPoints, accountID.Unbox());
 }
 
 void Client::PathSetIsDisplaying(iSector* sector)
@@ -38,6 +38,7 @@
 //=============================================================================
 
 class Client;
+class ClientConnectionSet;
 class psCharacter;
 class gemObject;
 class gemActor;
@@ -94,6 +95,8 @@ struct OrderedMessageChannel;
 */
 class Client : protected NetBase::Connection, public CS::Utility::WeakReferenced
 {
+    friend class ClientConnectionSet;
+
 public:
     /**
     * Please call constructor with the connection object produced by
@@ -213,20 +216,14 @@ public:
     {
         return accountID;
     }
-    void SetAccountID(AccountID id)
-    {
-        accountID = id;
-    }
+    void SetAccountID(AccountID id);
 
     /// The player number for this client.
     PID GetPID()
     {
         return playerID;
     }
-    void SetPID(PID id)
-    {
-        playerID = id;
-    }
+    void SetPID(PID id);
 
     int GetExchangeID()
     {
@@ -541,6 +538,9 @@ protected:
     csArray<gemNPC*> listeningNpc;
     csString name;
 
+    /// The set this client was added to, it indexes the client by name, PID and account.
+    ClientConnectionSet* connectionSet;
+
     csArray<uint32_t> duel_clients;
 
     // Flood control
@@ -56,7 +56,7 @@ bool SockAddress::operator< (const SockAddress &other) const
 }
 
 
-ClientConnectionSet::ClientConnectionSet():addrHash(307),hash(307)
+ClientConnectionSet::ClientConnectionSet():addrHash(307),hash(307),nameIndex(307),pidIndex(307),accountIndex(307),indexKeys(307)
 {
 }
 
@@ -101,6 +101,8 @@ Client* ClientConnectionSet::Add(LPSOCKADDR_IN addr)
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
     addrHash.PutUnique(SockAddress(client->GetAddress()), client);
     hash.Put(client->GetClientNum(), client);
+    client->connectionSet = this;
+    Index(client);
     return client;
 }
 
@@ -112,6 +114,8 @@ void ClientConnectionSet::MarkDelete(Client* client)
     if(!addrHash.DeleteAll(client->GetAddress()))
         Bug2("Couldn't delete client %d, it was never added!", clientid);
 
+    Unindex(client);
+    client->connectionSet = NULL;
     hash.DeleteAll(clientid);
     toDelete.Push(client);
 }
@@ -184,50 +188,36 @@ Client* ClientConnectionSet::Find(const char* name)
         return NULL;
     }
 
+    csString key(name);
+    key.Downcase();
+
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it(addrHash.GetIterator());
-    Client* p = NULL;
+    csHash<Client*, csString>::Iterator it(nameIndex.GetIterator(key));
     while(it.HasNext())
     {
-        p = it.Next();
-        if(!p->GetName())
-            continue;
-
-        if(!strcasecmp(p->GetName(), name))
-            break;
-        p = NULL;
+        Client* p = it.Next();
+        if(p->IsReady())
+            return p;
     }
 
-    if(p && p->IsReady())
-        return p;
-    else
-        return NULL;
+    return NULL;
 }
 
 Client* ClientConnectionSet::FindPlayer(PID playerID)
 {
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it(addrHash.GetIterator());
-
-    while(it.HasNext())
-    {
-        Client* p = it.Next();
-        if(p->GetPID() == playerID)
-            return p;
-    }
-
-    return NULL;
+    return pidIndex.Get(playerID, NULL);
 }
 
 Client* ClientConnectionSet::FindAccount(AccountID accountID, uint32_t excludeClient)
 {
     CS::Threading::RecursiveMutexScopedLock lock(mutex);
-    AddressHash::GlobalIterator it(addrHash.GetIterator());
+    csHash<Client*, AccountID>::Iterator it(accountIndex.GetIterator(accountID));
 
     while(it.HasNext())
     {
         Client* p = it.Next();
-        if(p->GetAccountID() == accountID && p->GetClientNum() != excludeClient)
+        if(p->GetClientNum() != excludeClient)
             return p;
     }
 
@@ -254,6 +244,52 @@ csRef<NetPacketQueueRefCount> ClientConnectionSet::FindQueueAny(uint32_t clientn
         return NULL;
 }
 
+void ClientConnectionSet::UpdateIndex(Client* client)
+{
+    CS::Threading::RecursiveMutexScopedLock lock(mutex);
+
+    // Not added yet or already on its way out
+    if(hash.Get(client->GetClientNum(), NULL) != client)
+        return;
+
+    Unindex(client);
+    Index(client);
+}
+
+void ClientConnectionSet::Index(Client* client)
+{
+    IndexKeys keys;
+    keys.name = client->GetName();
+    keys.name.Downcase();
+    keys.pid = client->GetPID();
+    keys.account = client->GetAccountID();
+
+    if(!keys.name.IsEmpty())
+        nameIndex.Put(keys.name, client);
+    if(keys.pid.IsValid())
+        pidIndex.Put(keys.pid, client);
+    if(keys.account.IsValid())
+        accountIndex.Put(keys.account, client);
+
+    indexKeys.PutUnique(client->GetClientNum(), keys);
+}
+
+void ClientConnectionSet::Unindex(Client* client)
+{
+    IndexKeys* keys = indexKeys.GetElementPointer(client->GetClientNum());
+    if(!keys)
+        return;
+
+    if(!keys->name.IsEmpty())
+        nameIndex.Delete(keys->name, client);
+    if(keys->pid.IsValid())
+        pidIndex.Delete(keys->pid, client);
+    if(keys->account.IsValid())
+        accountIndex.Delete(keys->account, client);
+
+    indexKeys.DeleteAll(client->GetClientNum());
+}
+
 ClientIterator::ClientIterator(ClientConnectionSet &clients)
     : ClientConnectionSet::AddressHash::GlobalIterator(clients.addrHash.GetIterator()), mutex(clients.mutex)
 {
@@ -52,8 +52,21 @@ template<> class csHashComputer<SockAddress> :
 
 /**
  * This class is a list of several CLient objects, it's designed for finding
- * clients very fast based on their clientnum or their IP address.
- * This class is also threadsafe now
+ * clients very fast based on their clientnum, IP address, name, player id
+ * or account id.
+ *
+ * This class is threadsafe. The lock is recursive, so a thread holding a
+ * ClientIterator may look up other clients or rename a client, which only
+ * changes the indexes and not the set being iterated.
+ *
+ * The lookups take the same lock as the changes, the net thread and the
+ * game thread may wait on each other here. Reading the indexes without a
+ * lock, from an immutable copy swapped in by each change, was left out: a
+ * reader takes its reference to the copy while a change may drop the last
+ * one, and Crystal Space has no way to load a pointer and take a reference
+ * to it at once. Guarding that needs a lock again, and the Client pointers
+ * returned stay only as valid as they are now. The lock is held for a hash
+ * lookup only, so it is rarely contended.
  */
 class ClientConnectionSet
 {
@@ -62,11 +75,29 @@ public:
 protected:
     friend class ClientIterator;
 
+    /// The keys a client is indexed under, to find its entries again when they change.
+    struct IndexKeys
+    {
+        csString name;      ///< Lower case name, empty if not indexed.
+        PID pid;
+        AccountID account;
+    };
+
     AddressHash addrHash;
     csHash<Client*> hash;
+    csHash<Client*, csString> nameIndex;
+    csHash<Client*, PID> pidIndex;
+    csHash<Client*, AccountID> accountIndex;
+    csHash<IndexKeys> indexKeys;
     csPDelArray<Client> toDelete;
     CS::Threading::RecursiveMutex mutex;
 
+    /// Add a client to the name, PID and account indexes. Needs the lock.
+    void Index(Client* client);
+
+    /// Remove a client from the name, PID and account indexes. Needs the lock.
+    void Unindex(Client* client);
+
 public:
     ClientConnectionSet();
     ~ClientConnectionSet();
@@ -101,6 +132,12 @@ public:
     Client* Find(LPSOCKADDR_IN addr);
 
     csRef<NetPacketQueueRefCount> FindQueueAny(uint32_t id);
+
+    /**
+     * Index a client again under its current name, PID and account. Called
+     * by the client when one of them changes.
+     */
+    void UpdateIndex(Client* client);
 };
 
 class ClientIterator : public ClientConnectionSet::AddressHash::GlobalIterator
@@ -43,6 +43,7 @@
 #include "util/serverconsole.h"
 #include "util/eventmanager.h"
 #include "net/messages.h"
+#include "net/netbufferpool.h"
 #include "globals.h"
 #include "psserver.h"
 #include "cachemanager.h"
@@ -63,6 +64,7 @@
 #include "weathermanager.h"
 #include "rpgrules/factions.h"
 #include "util/dbprofile.h"
+#include "util/zoneprofiler.h"
 #include "economymanager.h"
 #include "questmanager.h"
 #include "chatmanager.h"
@@ -276,6 +278,44 @@ int com_netprofile(const char*)
     return 0;
 }
 
+int com_netbuffers(const char* arg)
+{
+    if(!strcasecmp(arg, "reset"))
+    {
+        psNetBufferPool::ResetStats();
+        CPrintf(CON_CMDOUTPUT, "Network buffer statistics cleared\n");
+        return 0;
+    }
+    else if(strlen(arg))
+    {
+        CPrintf(CON_CMDOUTPUT, "Syntax: netbuffers [reset]\n");
+        return 0;
+    }
+
+    CPrintf(CON_CMDOUTPUT, "%s", psNetBufferPool::Dump().GetData());
+    return 0;
+}
+
+int com_eventstats(const char* arg)
+{
+    EventManager* eventmanager = psserver->GetEventManager();
+
+    if(!strcasecmp(arg, "reset"))
+    {
+        eventmanager->ResetEventStats();
+        CPrintf(CON_CMDOUTPUT, "Event statistics cleared\n");
+        return 0;
+    }
+    else if(strlen(arg))
+    {
+        CPrintf(CON_CMDOUTPUT, "Syntax: eventstats [reset]\n");
+        return 0;
+    }
+
+    CPrintf(CON_CMDOUTPUT, "%s", eventmanager->DumpEventStats().GetData());
+    return 0;
+}
+
 int com_dbprofile(const char*)
 {
     csString dumpstr = db->DumpProfile();
@@ -286,6 +326,73 @@ int com_dbprofile(const char*)
     return 0;
 }
 
+int com_zoneprofile(const char* arg)
+{
+    psZoneProfiler* profiler = psZoneProfiler::GetInstance();
+    if(!profiler)
+    {
+        CPrintf(CON_CMDOUTPUT, "The zone profiler is disabled in psserver.cfg\n");
+        return 0;
+    }
+
+    WordArray words(arg);
+    if(words[0] == "chrome" || words[0] == "collapsed")
+    {
+        bool chrome = words[0] == "chrome";
+        csString filename = words[1];
+        if(filename.IsEmpty())
+            filename = chrome ? "/this/zones.json" : "/this/zones.folded";
+
+        csString dump = chrome ? profiler->ExportChromeTrace() : profiler->ExportCollapsed();
+        csRef<iFile> file = psserver->vfs->Open(filename, VFS_FILE_WRITE);
+        if(!file)
+        {
+            CPrintf(CON_CMDOUTPUT, "Could not open %s\n", filename.GetData());
+            return 0;
+        }
+        file->Write(dump, dump.Length());
+        CPrintf(CON_CMDOUTPUT, "Zones dumped to %s\n", filename.GetData());
+    }
+    else if(words[0] == "reset")
+    {
+        profiler->Reset();
+        CPrintf(CON_CMDOUTPUT, "Zone samples cleared\n");
+    }
+    else if(words[0] == "on" || words[0] == "off")
+    {
+        profiler->SetEnabled(words[0] == "on");
+        CPrintf(CON_CMDOUTPUT, "Zone profiler %s\n", words[0].GetData());
+    }
+    else if(words.GetCount())
+    {
+        CPrintf(CON_CMDOUTPUT, "Syntax: zoneprofile [chrome|collapsed [file]|reset|on|off]\n");
+    }
+    else
+    {
+        CPrintf(CON_CMDOUTPUT, "%s", profiler->DumpStats().GetData());
+    }
+    return 0;
+}
+
+int com_writebehind(const char* arg)
+{
+    psWriteBehindQueue* queue = psserver->GetDatabase()->GetWriteBehind();
+    if(!strcasecmp(arg, "reset"))
+    {
+        queue->ResetStats();
+        CPrintf(CON_CMDOUTPUT, "Write behind statistics cleared\n");
+        return 0;
+    }
+    else if(strlen(arg))
+    {
+        CPrintf(CON_CMDOUTPUT, "Syntax: writebehind [reset]\n");
+        return 0;
+    }
+
+    CPrintf(CON_CMDOUTPUT, "%s", queue->DumpStats().GetData());
+    return 0;
+}
+
 int com_queue(const char* player)
 {
     int playernum = atoi(player);
@@ -533,6 +640,34 @@ int com_dumpwarpspace(const char*)
     return 0;
 }
 
+int com_proxstats(const char*)
+{
+    psserver->entitymanager->GetGEM()->DumpProxStats();
+    return 0;
+}
+
+int com_proxmode(const char* arg)
+{
+    GEMSupervisor* gem = psserver->entitymanager->GetGEM();
+
+    if(!strcasecmp(arg, "incremental"))
+    {
+        gem->SetIncrementalProx(true);
+    }
+    else if(!strcasecmp(arg, "distance"))
+    {
+        gem->SetIncrementalProx(false);
+    }
+    else if(strlen(arg))
+    {
+        CPrintf(CON_CMDOUTPUT, "Syntax: proxmode [incremental|distance]\n");
+        return 0;
+    }
+
+    CPrintf(CON_CMDOUTPUT, "Proxlist mode is %s\n", gem->IsIncrementalProx() ? "incremental" : "distance");
+    return 0;
+}
+
 
 int com_loadmap(const char* mapname)
 {
@@ -2552,7 +2687,11 @@ const COMMAND commands[] =
     { "lock",      false, com_lock,      "Tells server to stop accepting connections"},
     { "maplist",   true, com_maplist,   "List all mounted maps"},
     { "dumpwarpspace",   true, com_dumpwarpspace,   "Dump the warp space table"},
+    { "eventstats", true, com_eventstats, "[reset] Shows count, trigger time and lag of events by type" },
+    { "netbuffers", true, com_netbuffers, "[reset] Shows allocations of pooled message and packet buffers" },
     { "netprofile", true, com_netprofile, "shows network profile info" },
+    { "proxmode",  true, com_proxmode,  "[incremental|distance] Shows or sets how proxlists are updated" },
+    { "proxstats", true, com_proxstats, "Shows proxlist updates per second since last call" },
     { "quit",      true, com_quit,      "[minutes] Makes the server exit immediately or after the specified amount of minutes"},
     { "ready",     false, com_ready,     "Tells server to start accepting connections"},
     { "sectors",   true, com_sectors,   "Display all sectors" },
@@ -2566,6 +2705,8 @@ const COMMAND commands[] =
     { "spawn",     false, com_spawn,     "Loads npcs, items, action locations, hunt locations in the server"},
     { "status",    true, com_status,    "Show server status"},
     { "transactions", false, com_transactions, "Performs an action on the transaction history (run without parameters for options)" },
+    { "zoneprofile", true, com_zoneprofile, "[chrome|collapsed [file]|reset|on|off] Exports the zone profiler samples, by default to /this/zones.json or /this/zones.folded" },
+    { "writebehind", true, com_writebehind, "[reset] Shows depth, coalesced saves and flush time of the write behind queue" },
     { "dumpallocations", true, com_allocations, "Dump all allocations to allocations.txt if CS extensive memdebug is enabled" },
 
     // npc commands
@@ -718,6 +718,9 @@ bool EntityManager::DeletePlayer(Client* client)
         gem->RemovePlayerFromLootables(actor->GetPID());
         client->SetActor(NULL); // Prevent anyone from getting to a deleted actor through the client
         RemoveActor(actor);
+
+        // The character may log in again right away, so its saves must be written
+        psserver->GetDatabase()->GetWriteBehind()->Barrier();
     }
     return true;
 }
@@ -36,6 +36,7 @@
 #include <csgeom/transfrm.h>
 #include <csutil/snprintf.h>
 #include <csutil/hash.h>
+#include <csutil/set.h>
 #include <imesh/object.h>
 #include <imesh/spritecal3d.h>
 #include <imesh/nullmesh.h>
@@ -62,6 +63,7 @@
 #include "util/psutil.h"
 #include "util/serverconsole.h"
 #include "util/mathscript.h"
+#include "util/zoneprofiler.h"
 
 #include "net/npcmessages.h"
 #include "net/message.h"
@@ -91,6 +93,7 @@
 #include "weathermanager.h"
 #include "npcmanager.h"
 #include "netmanager.h"
+#include "multicastscheduler.h"
 #include "globals.h"
 #include "progressionmanager.h"
 #include "workmanager.h"
@@ -113,6 +116,9 @@
 /// Lifetime of a chat history line, in ticks
 #define CHAT_HISTORY_LIFETIME 300000 // 5 minutes
 
+/// Ticks between two keyframes of a moving player sent to the superclients
+#define SUPERCLIENT_KEYFRAME_INTERVAL 10000
+
 //-----------------------------------------------------------------------------
 
 psGemServerMeshAttach::psGemServerMeshAttach(gemObject* objectToAttach) : scfImplementationType(this)
@@ -140,6 +146,12 @@ GEMSupervisor::GEMSupervisor(iObjectRegistry* objreg,
     // Default celID scope has max of 100000 IDs so to support more than
     // 90000 enties another scope should be added to cel
     nextEID = 10000;
+    superclientGeneration = 0;
+
+    incrementalProx = psserver->GetConfig()->GetBool("PlaneShift.Server.Proximity.Incremental", false);
+    proxFullUpdates = 0;
+    proxRangeUpdates = 0;
+    proxStatsStart = csGetTicks();
 
     Subscribe(&GEMSupervisor::HandleDamageMessage,MSGTYPE_DAMAGE_EVENT,NO_VALIDATION);
     Subscribe(&GEMSupervisor::HandleStatDRUpdateMessage,MSGTYPE_STATDRUPDATE, REQUIRE_READY_CLIENT);
@@ -164,6 +176,18 @@ GEMSupervisor::~GEMSupervisor()
         count = entities_by_eid.GetSize();
         continue;
     }
+
+    csHash<SectorGrids*, csPtrKey<iSector> >::GlobalIterator it(entityGrids.GetIterator());
+    while(it.HasNext())
+    {
+        SectorGrids* grids = it.Next();
+        SectorGrids::GlobalIterator gridIt(grids->GetIterator());
+        while(gridIt.HasNext())
+        {
+            delete gridIt.Next();
+        }
+        delete grids;
+    }
 }
 
 void GEMSupervisor::HandleStatsMessage(MsgEntry* me,Client* client)
@@ -252,6 +276,7 @@ void GEMSupervisor::RemoveEntity(gemObject* which)
         return;
 
     entities_by_eid.Delete(which->GetEID(), which);
+    movedActors.DeleteAll(which->GetEID());
     Debug3(LOG_CELPERSIST,0,"Entity <%s, %s> removed from supervisor.\n", which->GetName(), ShowID(which->GetEID()));
 
 }
@@ -451,62 +476,68 @@ void GEMSupervisor::GetPlayerObjects(PID playerID, csArray<gemObject*> &list)
 
 void GEMSupervisor::GetAllEntityPos(csArray<psAllEntityPosMessage> &update)
 {
-    csHash<gemObject*, EID>::GlobalIterator iter(entities_by_eid.GetIterator());
-
     csTicks now = csGetTicks();
+    csStringSet* msgstrings = cacheManager->GetMsgStrings();
+    csArray<EID> settled;
+
+    psAllEntityPosMessage msg;
+    msg.SetLength(ALLENTITYPOS_MAX_AMOUNT,0); // Set a message length limit
 
-    // Loop as long as we need to send more messages.
+    // Only players are in movedActors
+    // FIXME: This should be modify to send all actors exepct
+    //        NPCs controlled by the receving superclient.
+    csHash<gemActor*, EID>::GlobalIterator iter(movedActors.GetIterator());
     while(iter.HasNext())
     {
-        psAllEntityPosMessage msg;
-        msg.SetLength(ALLENTITYPOS_MAX_AMOUNT,0); // Set a message length limit
+        EID eid;
+        gemActor* actor = iter.Next(eid);
+        if(!actor || !actor->GetClient())
+        {
+            settled.Push(eid);
+            continue;
+        }
+
+        csVector3 pos;
+        float yrot;
+        iSector* sector;
+        csTicks last;
+        actor->GetPosition(pos,yrot,sector);
+        InstanceID instance = actor->GetInstance();
+        const psEntityPosBaseline &sent = actor->GetLastSuperclientPos(last);
 
-        // Fill the message
-        int count_actual = 0;
-        while(iter.HasNext())
+        float dist2 = (pos - sent.GetPosition()).SquaredNorm();
+        csTicks time = now - last;
+
+        // We need to filter some to prevent overloading the network
+        if(!sent.valid || (dist2 > 1.0) || (dist2 > .04 && time > 2000) ||
+           (instance != sent.instance) || (sector != sent.sector))
         {
-            gemObject* obj = iter.Next();
-            if(obj->GetPID().IsValid())
+            if(msg.IsFull())
             {
-                gemActor* actor = dynamic_cast<gemActor*>(obj);
-                // FIXME: Now only distribute players, this should
-                //        be modify to send all actors exepct
-                //        NPCs controlled by the receving superclient.
-                if(actor && actor->GetClient())
-                {
-                    csVector3 pos,pos2;
-                    float yrot;
-                    InstanceID instance,oldInstance;
-                    iSector* sector;
-                    csTicks last;
-                    obj->GetPosition(pos,yrot,sector);
-                    instance = obj->GetInstance();
-                    obj->GetLastSuperclientPos(pos2,oldInstance,last);
-
-                    float dist2 = (pos.x - pos2.x) * (pos.x - pos2.x) +
-                                  (pos.y - pos2.y) * (pos.y - pos2.y) +
-                                  (pos.z - pos2.z) * (pos.z - pos2.z);
-
-                    csTicks time = now - last;
-
-                    // We need to filter some to prevent overloading the network
-                    if((dist2 > 1.0) || (dist2 > .04 && time > 2000) || (instance != oldInstance))
-                    {
-                        count_actual++;
-                        msg.Add(obj->GetEID(), pos, sector, obj->GetInstance(),
-                                cacheManager->GetMsgStrings());
-                        obj->SetLastSuperclientPos(pos,instance,now);
-                    }
-                }
+                msg.Finish();
+                update.Push(msg);
+                msg = psAllEntityPosMessage();
+                msg.SetLength(ALLENTITYPOS_MAX_AMOUNT,0);
             }
-            if(count_actual == ALLENTITYPOS_MAX_AMOUNT) //we reached message limit so we break out of here
-                break;
+            actor->AddSuperclientPos(msg, superclientGeneration, now, msgstrings);
+            dist2 = 0;
+        }
+
+        // Dead reckoning moves the actor without telling, so keep it until it stops
+        if(dist2 <= .04 && !actor->IsMoving())
+        {
+            settled.Push(eid);
         }
-        msg.msg->ClipToCurrentSize();  // Actual Data size
-        msg.msg->Reset();
-        // Now correct the first value, which is the count of following entities
-        // SetLength has allready allocated the int16_t for this.
-        msg.msg->Add((int16_t)count_actual);
+    }
+
+    for(size_t i = 0; i < settled.GetSize(); i++)
+    {
+        movedActors.DeleteAll(settled[i]);
+    }
+
+    if(msg.count)
+    {
+        msg.Finish();
         update.Push(msg);
     }
 }
@@ -551,29 +582,199 @@ csArray<gemObject*> GEMSupervisor::FindNearbyEntities(iSector* sector, const csV
 {
     csArray<gemObject*> list;
 
-    csRef<iMeshWrapperIterator> obj_it =  engine->GetNearbyMeshes(sector, pos, radius);
-    while(obj_it->HasNext())
+    if(!sector)
+        return list;
+
+    QueryEntityGrid(sector, pos, instance, radius, list);
+
+    // Entities on the other side of a warp portal are near as well.
+    psWorld* world = entityManager->GetWorld();
+    csArray<iSector*> connected;
+    world->GetConnectedSectors(sector, connected);
+    bool warped = false;
+    for(size_t i = 0; i < connected.GetSize(); i++)
     {
-        iMeshWrapper* m = obj_it->Next();
-        if(!doInvisible)
+        // A portal back into the same sector would query its grid again
+        if(connected[i] == sector)
+            continue;
+
+        csVector3 warpedPos = pos;
+        if(world->WarpSpace(sector, connected[i], warpedPos))
         {
-            bool invisible = m->GetFlags().Check(CS_ENTITY_INVISIBLE);
-            if(invisible)
-                continue;
+            QueryEntityGrid(connected[i], warpedPos, instance, radius, list);
+            warped = true;
         }
+    }
 
-        gemObject* object = FindAttachedObject(m->QueryObject());
+    // An entity is in one grid only, but be sure each is listed once
+    if(warped)
+    {
+        csSet< csPtrKey<gemObject> > found;
+        size_t i = 0;
+        while(i < list.GetSize())
+        {
+            if(found.Contains(list[i]))
+            {
+                list.DeleteIndex(i);
+            }
+            else
+            {
+                found.AddNoTest(list[i]);
+                i++;
+            }
+        }
+    }
 
-        if(object && (object->GetInstance() == instance ||
-           object->GetInstance() == INSTANCE_ALL || instance == INSTANCE_ALL))
+    if(!doInvisible)
+    {
+        size_t i = 0;
+        while(i < list.GetSize())
         {
-            list.Push(object);
+            iMeshWrapper* mesh = list[i]->GetMeshWrapper();
+            if(!mesh || mesh->GetFlags().Check(CS_ENTITY_INVISIBLE))
+            {
+                list.DeleteIndexFast(i);
+            }
+            else
+            {
+                i++;
+            }
         }
     }
 
     return list;
 }
 
+GEMSupervisor::EntityGrid* GEMSupervisor::GetEntityGrid(iSector* sector, InstanceID instance, bool create)
+{
+    SectorGrids* grids = entityGrids.Get(sector, NULL);
+    if(!grids)
+    {
+        if(!create)
+            return NULL;
+
+        grids = new SectorGrids;
+        entityGrids.Put(sector, grids);
+    }
+
+    EntityGrid* grid = grids->Get(instance, NULL);
+    if(!grid && create)
+    {
+        grid = new EntityGrid(DEF_GRID_CELL_SIZE);
+        grids->Put(instance, grid);
+    }
+
+    return grid;
+}
+
+void GEMSupervisor::QueryEntityGrid(iSector* sector, const csVector3 &pos, InstanceID instance, float radius, csArray<gemObject*> &list)
+{
+    SectorGrids* grids = entityGrids.Get(sector, NULL);
+    if(!grids)
+        return;
+
+    if(instance == INSTANCE_ALL)
+    {
+        SectorGrids::GlobalIterator it(grids->GetIterator());
+        while(it.HasNext())
+        {
+            it.Next()->Query(pos, radius, list);
+        }
+        return;
+    }
+
+    EntityGrid* grid = grids->Get(instance, NULL);
+    if(grid)
+    {
+        grid->Query(pos, radius, list);
+    }
+
+    // Entities in the 'all' instance are seen from every instance.
+    grid = grids->Get(INSTANCE_ALL, NULL);
+    if(grid)
+    {
+        grid->Query(pos, radius, list);
+    }
+}
+
+bool GEMSupervisor::UpdateEntityGrid(gemObject* obj)
+{
+    // Without a mesh there is no position to put it at
+    if(!obj->GetMeshWrapper())
+    {
+        RemoveFromEntityGrid(obj);
+        return false;
+    }
+
+    iSector* sector = obj->GetSector();
+    InstanceID instance = obj->GetInstance();
+
+    if(obj->GetClient())
+    {
+        movedActors.PutUnique(obj->GetEID(), obj->GetActorPtr());
+    }
+
+    if(obj->gridSector != sector || obj->gridInstance != instance)
+    {
+        RemoveFromEntityGrid(obj);
+        if(!sector)
+            return false;
+
+        obj->gridSector = sector;
+        obj->gridInstance = instance;
+    }
+    else if(!sector)
+    {
+        return false;
+    }
+
+    if(GetEntityGrid(sector, instance, true)->Move(obj, obj->GetPosition()))
+    {
+        obj->gridCellChanged = true;
+        return true;
+    }
+    return false;
+}
+
+void GEMSupervisor::DumpProxStats()
+{
+    csTicks now = csGetTicks();
+    float seconds = (now - proxStatsStart) / 1000.0f;
+    if(seconds <= 0.0f)
+        seconds = 1.0f;
+
+    CPrintf(CON_CMDOUTPUT, "Proxlist mode        : %s\n", incrementalProx ? "incremental" : "distance");
+    CPrintf(CON_CMDOUTPUT, "Period               : %.1f s\n", seconds);
+    CPrintf(CON_CMDOUTPUT, "Full updates         : %u (%.1f/s)\n", proxFullUpdates, proxFullUpdates / seconds);
+    CPrintf(CON_CMDOUTPUT, "Range only updates   : %u (%.1f/s)\n", proxRangeUpdates, proxRangeUpdates / seconds);
+
+    proxFullUpdates = 0;
+    proxRangeUpdates = 0;
+    proxStatsStart = now;
+}
+
+void GEMSupervisor::RemoveFromEntityGrid(gemObject* obj)
+{
+    if(!obj->gridSector)
+        return;
+
+    EntityGrid* grid = GetEntityGrid(obj->gridSector, obj->gridInstance, false);
+    if(grid)
+    {
+        grid->Remove(obj);
+
+        // Instances come and go, so don't keep empty grids around.
+        if(!grid->GetObjectCount())
+        {
+            SectorGrids* grids = entityGrids.Get(obj->gridSector, NULL);
+            grids->Delete(obj->gridInstance, grid);
+            delete grid;
+        }
+    }
+
+    obj->gridSector = NULL;
+}
+
 csArray<gemObject*> GEMSupervisor::FindSectorEntities(iSector* sector, bool doInvisible)
 {
     csArray<gemObject*> list;
@@ -636,6 +837,9 @@ gemObject::gemObject(GEMSupervisor* gemsupervisor,
     proxlist = NULL;
     is_alive = false;
     alwaysWatching = false;
+    gridSector = NULL;
+    gridInstance = myInstance;
+    gridCellChanged = false;
 
     eid = cel->CreateEntity(this);
 
@@ -658,6 +862,7 @@ gemObject::~gemObject()
     valid = false;
 
     Disconnect();
+    cel->RemoveFromEntityGrid(this);
     cel->RemoveEntity(this);
     delete proxlist;
     proxlist = NULL;
@@ -794,6 +999,7 @@ iMeshWrapper* gemObject::GetMeshWrapper()
 void gemObject::Move(const csVector3 &pos,float rotangle, iSector* room)
 {
     pcmesh->MoveMesh(room, rotangle, pos);
+    cel->UpdateEntityGrid(this);
 }
 
 bool gemObject::IsNear(gemObject* obj, float radius, bool ignoreY)
@@ -831,13 +1037,32 @@ bool gemObject::InitProximityList(float radius,int clientnum)
 
 void gemObject::UpdateProxList(bool force)
 {
+    PS_PROFILE_ZONE("gemObject::UpdateProxList");
+
 #ifdef PSPROXDEBUG
     psString log;
 #endif
 
+    // Linmove can move the mesh without going through Move(), so resync here.
+    cel->UpdateEntityGrid(this);
+
     if(!force && !proxlist->CheckUpdateRequired())   // This allows updates only if moved some way away
         return;
 
+    bool cellChanged = gridCellChanged;
+    gridCellChanged = false;
+
+    // In incremental mode the set of watchers is only searched again when a new
+    // cell or instance has been entered, but ranges still has to be refreshed
+    // for the range perceptions.
+    if(!force && !cellChanged && cel->IsIncrementalProx())
+    {
+        proxlist->UpdateWatcherRanges();
+        cel->CountProxUpdate(false);
+        return;
+    }
+    cel->CountProxUpdate(true);
+
 #ifdef PSPROXDEBUG
     log.AppendFmt("Generating proxlist for %s\n", GetName());
     //proxlist->DebugDumpContents();
@@ -962,13 +1187,15 @@ void gemObject::UpdateProxList(bool force)
 
     // Now remove those that should be no more connected to out object
 
-    gemObject* obj;
+    csArray<gemObject*> untouched;
 
     size_t debug_count = 0;
     if(GetClientID() != 0)
     {
-        while(proxlist->GetUntouched_ObjectThatIWatch(obj))
+        proxlist->GetUntouched_ObjectsThatIWatch(untouched);
+        for(size_t i = 0; i < untouched.GetSize(); i++)
         {
+            gemObject* obj = untouched[i];
             debug_count++;
 #ifdef PSPROXDEBUG
             log.AppendFmt("-removing %s from client %s\n",obj->GetName(),GetName());
@@ -993,8 +1220,11 @@ void gemObject::UpdateProxList(bool force)
         psserver->GetLogCSV()->Write(CSV_STATUS, status);
     }
 
-    while(proxlist->GetUntouched_ObjectThatWatchesMe(obj))
+    untouched.Empty();
+    proxlist->GetUntouched_ObjectsThatWatchMe(untouched);
+    for(size_t i = 0; i < untouched.GetSize(); i++)
     {
+        gemObject* obj = untouched[i];
         if(obj->GetClientID() != 0)
         {
 #ifdef PSPROXDEBUG
@@ -2177,8 +2407,8 @@ gemActor::gemActor(GEMSupervisor* gemsupervisor, CacheManager* cachemanager, Ent
                    float rotangle,
                    int clientnum) :
     gemObject(gemsupervisor,entitymanager,cachemanager,chardata->GetCharFullName(),factname,myInstance,room,pos,rotangle,clientnum),
-    psChar(chardata), mount(NULL), attack_cnt(0), DRcounter(0), forceDRcounter(0), lastDR(0), lastV(0), lastSentSuperclientPos(0, 0, 0),
-    lastSentSuperclientInstance(-1), activeReports(0), isFalling(false), invincible(false), visible(true), viewAllObjects(false),
+    psChar(chardata), mount(NULL), attack_cnt(0), DRcounter(0), forceDRcounter(0), lastDR(0), lastV(0),
+    lastSentSuperclientTick(0), lastSuperclientKeyframe(0), superclientGeneration(0), activeReports(0), isFalling(false), invincible(false), visible(true), viewAllObjects(false),
     movementMode(0), isAllowedToMove(true), atRest(true), player_mode(PSCHARACTER_MODE_PEACE), spellCasting(NULL), workEvent(NULL),
     activeMagic_seq(0), pcmove(NULL), nevertired(false), infinitemana(false), instantcast(false), safefall(false), givekillexp(false),
     attackable(false)
@@ -3773,6 +4003,7 @@ void gemActor::SetDefaults(bool player)
 void gemActor::SetInstance(InstanceID worldInstance)
 {
     this->worldInstance = worldInstance;
+    cel->UpdateEntityGrid(this);
 }
 
 void gemActor::Teleport(const char* sectorName, const csVector3 &pos, float yrot, InstanceID instance, int32_t loadDelay, csString background, csVector2 point1, csVector2 point2, csString widget)
@@ -4008,6 +4239,7 @@ bool gemActor::SetDRData(psDRMessage &drmsg)
     }
     pcmove->SetDRData(drmsg.on_ground,drmsg.pos,drmsg.yrot,drmsg.sector,drmsg.vel,drmsg.worldVel,drmsg.ang_vel);
     DRcounter = drmsg.counter;
+    cel->UpdateEntityGrid(this);
 
 
     // Apply stamina only on PCs
@@ -4093,7 +4325,8 @@ void gemActor::MulticastDRUpdate()
     psDRMessage drmsg(0, eid, on_ground, movementMode, DRcounter,
                       pos,yrot,sector, "", vel,worldVel,ang_vel,
                       psserver->GetNetManager()->GetAccessPointers());
-    drmsg.Multicast(GetMulticastClients(),0,PROX_LIST_ANY_RANGE);
+    // Only called when the position jumps, so nobody may get it late
+    psserver->GetNetManager()->GetMulticastScheduler()->Multicast(drmsg.msg, eid, GetMulticastClients(), 0, true);
 }
 
 void gemActor::ForcePositionUpdate(int32_t loadDelay, csString background, csVector2 point1, csVector2 point2, csString widget)
@@ -4104,6 +4337,9 @@ void gemActor::ForcePositionUpdate(int32_t loadDelay, csString background, csVec
     psForcePositionMessage msg(clientnum, ++forceDRcounter, GetPosition(), GetAngle(), GetSector(), GetVelocity(),
                                cacheManager->GetMsgStrings(), loadDelay, background, point1, point2, widget);
     msg.SendMessage();
+
+    // Held updates are from before the forced position
+    psserver->GetNetManager()->GetMulticastScheduler()->Drop(eid);
 }
 
 bool gemActor::UpdateDR()
@@ -4116,17 +4352,26 @@ bool gemActor::UpdateDR()
     return true;
 }
 
-void gemActor::GetLastSuperclientPos(csVector3 &pos, InstanceID &instance, csTicks &last) const
+bool gemActor::IsMoving()
 {
-    pos = lastSentSuperclientPos;
-    instance = lastSentSuperclientInstance;
-    last = lastSentSuperclientTick;
+    return !pcmove->GetVelocity().IsZero() || !pcmove->GetAngularVelocity().IsZero();
 }
 
-void gemActor::SetLastSuperclientPos(const csVector3 &pos, InstanceID instance, const csTicks &now)
+void gemActor::AddSuperclientPos(psAllEntityPosMessage &msg, uint32 generation, csTicks now, csStringSet* msgstrings,
+                                 bool forced)
 {
-    lastSentSuperclientPos = pos;
-    lastSentSuperclientInstance = instance;
+    csVector3 pos;
+    float yrot;
+    iSector* sector;
+    GetPosition(pos,yrot,sector);
+
+    // Keyframes now and then resync superclients that lost track of the moves
+    bool keyframe = generation != superclientGeneration || now - lastSuperclientKeyframe > SUPERCLIENT_KEYFRAME_INTERVAL;
+    if(msg.Add(GetEID(), pos, sector, GetInstance(), superclientBaseline, keyframe, msgstrings, forced))
+    {
+        superclientGeneration = generation;
+        lastSuperclientKeyframe = now;
+    }
     lastSentSuperclientTick = now;
 }
 
@@ -5383,13 +5628,9 @@ void gemNPC::ForcePositionUpdate()
     psAllEntityPosMessage msg;
     //we send just one position update
     msg.SetLength(1,0);
-    iSector* sector = GetSector();
-    csVector3 position = GetPosition();
-    csTicks now = csGetTicks();
     //we add the data and flag this position update as forced
-    msg.Add(GetEID(), position, sector, GetInstance(),
-            cacheManager->GetMsgStrings(),true);
-    SetLastSuperclientPos(GetPosition(),GetInstance(),now);
+    AddSuperclientPos(msg, cel->GetSuperclientGeneration(), csGetTicks(), cacheManager->GetMsgStrings(), true);
+    msg.Finish();
     //send this to all npcclients
     msg.Multicast(psserver->GetNPCManager()->GetSuperClients(),-1,PROX_LIST_ANY_RANGE);
 }
@@ -42,6 +42,7 @@
 
 #include "util/gameevent.h"
 #include "util/consoleout.h"
+#include "util/spatialgrid.h"
 
 #include "net/npcmessages.h"  // required for psNPCCommandsMessage::PerceptionType
 
@@ -196,7 +197,26 @@ public:
     void UpdateAllDR();
     void UpdateAllStats();
 
+    /**
+     * Fill position updates for the superclients with the players that
+     * moved since their positions were last sent.
+     */
     void GetAllEntityPos(csArray<psAllEntityPosMessage> &msgs);
+
+    /**
+     * Make the next position updates of all players keyframes, as a new
+     * superclient doesn't have the positions the moves are relative to.
+     */
+    void ResetSuperclientPositions()
+    {
+        superclientGeneration++;
+    }
+
+    uint32 GetSuperclientGeneration() const
+    {
+        return superclientGeneration;
+    }
+
     int  CountManagedNPCs(AccountID superclientID);
     void FillNPCList(MsgEntry* msg, AccountID superclientID);
     void SendAllNPCStats(AccountID superclientID);
@@ -263,6 +283,10 @@ public:
     /**
      * Create a list of all nearby gem objects.
      *
+     * Besides the sector itself only the sectors one warp portal away are
+     * looked in, unlike a walk through the portals of the meshes. Each
+     * entity is listed once.
+     *
      * @param sector The sector to check in.
      * @param pos The starting position
      * @param instance The instance ID for the starting point
@@ -283,7 +307,81 @@ public:
      */
     csArray<gemObject*> FindSectorEntities(iSector* sector, bool doInvisible = false);
 
+    /**
+     * Update the position of an entity in the entity grids.
+     *
+     * Has to be called every time the position, sector or instance of
+     * the entity change for FindNearbyEntities to find it. Moved players
+     * are also remembered for the next GetAllEntityPos().
+     *
+     * @param obj The entity that has moved.
+     * @return True if the entity entered a new grid cell.
+     */
+    bool UpdateEntityGrid(gemObject* obj);
+
+    /**
+     * Remove an entity from the entity grids.
+     *
+     * @param obj The entity to remove.
+     */
+    void RemoveFromEntityGrid(gemObject* obj);
+
+    /** @name Proximity list update mode and statistics
+     */
+    ///@{
+    /**
+     * In incremental mode the watchers of an entity are only searched again
+     * when the entity enter a new grid cell or instance. Other moves only
+     * refresh the ranges of the watchers it already has.
+     */
+    bool IsIncrementalProx() const
+    {
+        return incrementalProx;
+    }
+
+    void SetIncrementalProx(bool incremental)
+    {
+        incrementalProx = incremental;
+    }
+
+    /**
+     * Count one proxlist update.
+     *
+     * @param full True if the watchers were searched again, false if only ranges were refreshed.
+     */
+    void CountProxUpdate(bool full)
+    {
+        if(full)
+            proxFullUpdates++;
+        else
+            proxRangeUpdates++;
+    }
+
+    /**
+     * Print the proxlist update rates since the last call and reset them.
+     */
+    void DumpProxStats();
+    ///@}
+
 protected:
+    typedef psSpatialGrid<gemObject> EntityGrid;
+    typedef csHash<EntityGrid*, InstanceID> SectorGrids;
+
+    /**
+     * Get the grid of the entities in an instance of a sector.
+     *
+     * @param sector The sector of the grid.
+     * @param instance The instance of the grid.
+     * @param create Create the grid if it doesn't exist.
+     */
+    EntityGrid* GetEntityGrid(iSector* sector, InstanceID instance, bool create);
+
+    /**
+     * Add all entities in the grids of a sector within radius to the list.
+     */
+    void QueryEntityGrid(iSector* sector, const csVector3 &pos, InstanceID instance, float radius, csArray<gemObject*> &list);
+
+
     /**
      * Get the next ID for an object.
      *
@@ -294,9 +392,18 @@ protected:
     csHash<gemObject*, EID> entities_by_eid; ///< A list of all the entities stored by EID (entity/gem ID).
     csHash<gemItem*, uint32> items_by_uid;   ///< A list of all the items stored by UID (psItem ID).
     csHash<gemActor*,  PID> actors_by_pid;   ///< A list of all the actors stored by PID (player/character ID).
+    csHash<gemActor*,  EID> movedActors;     ///< Players that may have to be sent to the superclients.
+    uint32              superclientGeneration; ///< Counts superclients connecting, see ResetSuperclientPositions().
 
     uint32              nextEID;             ///< The next ID available for an object.
 
+    csHash<SectorGrids*, csPtrKey<iSector> > entityGrids; ///< Grids of all positioned entities by sector and instance.
+
+    bool                incrementalProx;     ///< Update proxlists on cell crossings only.
+    uint32              proxFullUpdates;     ///< Proxlist updates that searched for watchers since proxStatsStart.
+    uint32              proxRangeUpdates;    ///< Proxlist updates that only refreshed ranges since proxStatsStart.
+    csTicks             proxStatsStart;      ///< Start of the current proxlist statistics period.
+
 
     csRef<iEngine> engine;                   ///< Stored here to save expensive csQueryRegistry calls
 };
@@ -388,6 +495,7 @@ public:
     void SetInstance(InstanceID newInstance)
     {
         worldInstance = newInstance;
+        cel->UpdateEntityGrid(this);
     }
     InstanceID  GetInstance()
     {
@@ -606,8 +714,6 @@ public:
     {
         return 0;
     }
-    virtual void GetLastSuperclientPos(csVector3 &pos, InstanceID &instance, csTicks &last) const { }
-    virtual void SetLastSuperclientPos(const csVector3 &pos, InstanceID instance, const csTicks &now) { }
     virtual void AddLootablePlayer(PID playerID) { }
     virtual void RemoveLootablePlayer(PID playerID) { }
     virtual bool IsLootablePlayer(PID playerID)
@@ -677,6 +783,11 @@ protected:
     float prox_distance_desired;                ///< What is the maximum range of proxlist we want
     float prox_distance_current;                ///< What is the current actual range for proxlists (they adjust when the # of objects gets too high)
 
+    iSector* gridSector;                        ///< Sector of the entity grid this object is stored in, NULL if none.
+    InstanceID gridInstance;                    ///< Instance of the entity grid this object is stored in.
+    bool gridCellChanged;                       ///< Entered a new grid cell since the last full proxlist update.
+    friend class GEMSupervisor;
+
     bool InitProximityList(float radius,int clientnum);
 
     void InitMesh(const char* name, const csVector3 &pos, const float rotangle, iSector* room);
@@ -1187,9 +1298,10 @@ protected:
     /** Production Start Pos is used to record the place where people started digging. */
     csVector3 productionStartPos;
 
-    csVector3 lastSentSuperclientPos;
-    unsigned int lastSentSuperclientInstance;
+    psEntityPosBaseline superclientBaseline;   ///< The position last sent to the superclients.
     csTicks      lastSentSuperclientTick;
+    csTicks      lastSuperclientKeyframe;
+    uint32       superclientGeneration;        ///< GEMSupervisor::superclientGeneration of the last keyframe.
 
     csArray<iDeathCallback*> deathReceivers;  ///< List of objects which are to be notified when this actor dies.
 
@@ -1647,8 +1759,31 @@ public:
     void Resurrect();
 
     virtual bool UpdateDR();
-    virtual void GetLastSuperclientPos(csVector3 &pos, InstanceID &instance, csTicks &last) const;
-    virtual void SetLastSuperclientPos(const csVector3 &pos, InstanceID instance, const csTicks &now);
+
+    /// Does the dead reckoning still move the actor?
+    bool IsMoving();
+
+    /**
+     * Get the position last sent to the superclients.
+     *
+     * @param last Set to the time it was sent.
+     */
+    const psEntityPosBaseline &GetLastSuperclientPos(csTicks &last) const
+    {
+        last = lastSentSuperclientTick;
+        return superclientBaseline;
+    }
+
+    /**
+     * Add the actor to a position update for the superclients. It is sent
+     * as a move from the last position sent, or as a keyframe when the
+     * superclients may not have that position.
+     *
+     * @param generation The GEMSupervisor superclient generation.
+     * @param forced Flag the update as forced.
+     */
+    void AddSuperclientPos(psAllEntityPosMessage &msg, uint32 generation, csTicks now, csStringSet* msgstrings,
+                           bool forced = false);
 
     virtual void BroadcastTargetStatDR(ClientConnectionSet* clients);
     virtual void SendTargetStatDR(Client* client);
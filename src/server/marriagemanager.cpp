@@ -488,6 +488,7 @@ void psMarriageManager::DeleteMarriageInfo(psCharacter* charData)
             unsigned int id = row.GetUInt32("id");
 
             query.Format("UPDATE characters SET lastname=old_lastname, old_lastname='' WHERE id=%d", id);
+            psserver->GetDatabase()->GetWriteBehind()->Flush("characters", id);
 
             if(!db->Command(query.GetData()))
             {
@@ -0,0 +1,309 @@
+/*
+ * multicastscheduler.cpp
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+
+#include <psconfig.h>
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/sysfunc.h>
+#include <iutil/cfgmgr.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "util/eventmanager.h"
+#include "util/log.h"
+
+//=============================================================================
+// Local Includes
+//=============================================================================
+#include "multicastscheduler.h"
+#include "netmanager.h"
+#include "client.h"
+#include "clients.h"
+#include "gem.h"
+#include "globals.h"
+
+//---------------------------------------------------------------------------
+
+class MulticastSchedulerTick : public psGameEvent
+{
+public:
+    MulticastSchedulerTick(int offset, MulticastScheduler* s)
+        : psGameEvent(0, offset, "psMulticastSchedulerTick")
+    {
+        scheduler = s;
+    }
+
+    virtual void Trigger()
+    {
+        scheduler->Tick();
+    }
+
+protected:
+    MulticastScheduler* scheduler;
+};
+
+/// A held update that is due, with the order it should be sent in.
+struct DueUpdate
+{
+    EID entity;
+    float score;
+
+    /// Highest score sorts first.
+    bool operator<(const DueUpdate &other) const
+    {
+        return score > other.score;
+    }
+};
+
+//---------------------------------------------------------------------------
+
+MulticastScheduler::MulticastScheduler(NetManager* netmanager)
+    : netmanager(netmanager)
+{
+    enabled = false;
+    tickInterval = 100;
+    nearRange = 20.0f;
+    farRange = 60.0f;
+    midInterval = 250;
+    farInterval = 1000;
+    budget = 0;
+
+    immediateCount = 0;
+    scheduledCount = 0;
+    sentCount = 0;
+}
+
+MulticastScheduler::~MulticastScheduler()
+{
+    csHash<ClientSchedule*, uint32_t>::GlobalIterator iter(schedules.GetIterator());
+    while(iter.HasNext())
+    {
+        delete iter.Next();
+    }
+}
+
+void MulticastScheduler::Initialize(iConfigManager* config)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    enabled = config->GetBool("PlaneShift.Server.Multicast.Scheduler", false);
+    tickInterval = config->GetInt("PlaneShift.Server.Multicast.TickInterval", 100);
+    nearRange = config->GetFloat("PlaneShift.Server.Multicast.NearRange", 20.0f);
+    farRange = config->GetFloat("PlaneShift.Server.Multicast.FarRange", 60.0f);
+    midInterval = config->GetInt("PlaneShift.Server.Multicast.MidInterval", 250);
+    farInterval = config->GetInt("PlaneShift.Server.Multicast.FarInterval", 1000);
+    budget = config->GetInt("PlaneShift.Server.Multicast.Budget", 8192);
+
+    if(enabled)
+    {
+        psserver->GetEventManager()->Push(new MulticastSchedulerTick(tickInterval, this));
+    }
+}
+
+csTicks MulticastScheduler::GetInterval(float dist) const
+{
+    if(dist < nearRange)
+        return 0;
+    if(dist < farRange)
+        return midInterval;
+    return farInterval;
+}
+
+void MulticastScheduler::Send(MsgEntry* me, uint32_t client, ClientSchedule* schedule,
+                              ScheduledUpdate &update, csTicks now)
+{
+    me->clientnum = client;
+    netmanager->SendMessage(me);      // This copies the mem block, so we can reuse.
+
+    schedule->used += me->bytes->GetTotalSize();
+    update.lastSent = now;
+    update.msg = NULL;
+}
+
+void MulticastScheduler::Multicast(MsgEntry* me, EID entity, const csArray<PublishDestination> &multi,
+                                   uint32_t except, bool important)
+{
+    if(!enabled)
+    {
+        netmanager->Multicast(me, multi, except, PROX_LIST_ANY_RANGE);
+        return;
+    }
+
+    CS::Threading::MutexScopedLock lock(mutex);
+    csTicks now = csGetTicks();
+
+    for(size_t i=0; i<multi.GetSize(); i++)
+    {
+        if(multi[i].client==except)   // skip the exception client to avoid circularity
+            continue;
+
+        Client* c = netmanager->GetConnections()->Find(multi[i].client);
+        if(!c || !c->IsReady())
+            continue;
+
+        ClientSchedule* schedule = schedules.Get(multi[i].client, NULL);
+        if(!schedule)
+        {
+            schedule = new ClientSchedule;
+            schedule->used = 0;
+            schedules.Put(multi[i].client, schedule);
+        }
+
+        ScheduledUpdate empty;
+        empty.dist = 0;
+        empty.lastSent = 0;
+        ScheduledUpdate &update = schedule->updates.GetOrCreate(entity, empty);
+
+        // min_dist is the range at the last proxlist check, so an entity
+        // coming closer is treated by the nearest of the two.
+        float dist = csMin(multi[i].dist, multi[i].min_dist);
+
+        gemObject* target = c->GetTargetObject();
+        gemActor* watcher = c->GetActor();
+        if(important || GetInterval(dist) == 0 || (target && target->GetEID() == entity) ||
+           (watcher && watcher->GetMode() == PSCHARACTER_MODE_COMBAT))
+        {
+            Send(me, multi[i].client, schedule, update, now);
+            immediateCount++;
+        }
+        else
+        {
+            // Replaces any older update still held
+            update.msg = me;
+            update.dist = dist;
+            scheduledCount++;
+        }
+    }
+}
+
+void MulticastScheduler::Cancel(uint32_t client, EID entity)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    ClientSchedule* schedule = schedules.Get(client, NULL);
+    if(schedule)
+    {
+        schedule->updates.DeleteAll(entity);
+    }
+}
+
+void MulticastScheduler::Drop(EID entity)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+
+    csHash<ClientSchedule*, uint32_t>::GlobalIterator iter(schedules.GetIterator());
+    while(iter.HasNext())
+    {
+        ScheduledUpdate* update = iter.Next()->updates.GetElementPointer(entity);
+        if(update)
+        {
+            update->msg = NULL;
+        }
+    }
+}
+
+void MulticastScheduler::Tick()
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    csTicks now = csGetTicks();
+
+    csArray<uint32_t> goneClients;
+    csArray<DueUpdate> due;
+    csArray<EID> stale;
+
+    csHash<ClientSchedule*, uint32_t>::GlobalIterator iter(schedules.GetIterator());
+    while(iter.HasNext())
+    {
+        uint32_t clientnum;
+        ClientSchedule* schedule = iter.Next(clientnum);
+
+        Client* c = netmanager->GetConnections()->Find(clientnum);
+        if(!c || !c->IsReady())
+        {
+            goneClients.Push(clientnum);
+            continue;
+        }
+
+        // Collect the held updates that waited long enough
+        due.Empty();
+        stale.Empty();
+        csHash<ScheduledUpdate, EID>::GlobalIterator updates(schedule->updates.GetIterator());
+        while(updates.HasNext())
+        {
+            EID entity;
+            ScheduledUpdate &update = updates.Next(entity);
+            csTicks waited = now - update.lastSent;
+
+            if(!update.msg)
+            {
+                // Nothing sent for a while, the next update is due right away anyway
+                if(waited > farInterval)
+                    stale.Push(entity);
+                continue;
+            }
+
+            if(waited >= GetInterval(update.dist))
+            {
+                DueUpdate d;
+                d.entity = entity;
+                d.score = float(waited) / csMax(update.dist, 1.0f);
+                due.Push(d);
+            }
+        }
+
+        for(size_t i = 0; i < stale.GetSize(); i++)
+        {
+            schedule->updates.DeleteAll(stale[i]);
+        }
+
+        // Closest and longest waiting first, until the budget is used up.
+        // One always goes, so far entities keep moving in a crowd.
+        due.Sort();
+        for(size_t i = 0; i < due.GetSize(); i++)
+        {
+            ScheduledUpdate* update = schedule->updates.GetElementPointer(due[i].entity);
+            if(budget && i > 0 && schedule->used + update->msg->bytes->GetTotalSize() > budget)
+                break;
+
+            csRef<MsgEntry> msg = update->msg;
+            Send(msg, clientnum, schedule, *update, now);
+            sentCount++;
+        }
+
+        schedule->used = 0;
+    }
+
+    for(size_t i = 0; i < goneClients.GetSize(); i++)
+    {
+        delete schedules.Get(goneClients[i], NULL);
+        schedules.DeleteAll(goneClients[i]);
+    }
+
+    psserver->GetEventManager()->Push(new MulticastSchedulerTick(tickInterval, this));
+}
+
+void MulticastScheduler::GetStats(size_t &immediate, size_t &scheduled, size_t &sent)
+{
+    CS::Threading::MutexScopedLock lock(mutex);
+    immediate = immediateCount;
+    scheduled = scheduledCount;
+    sent = sentCount;
+}
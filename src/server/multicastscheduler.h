@@ -0,0 +1,147 @@
+/*
+ * multicastscheduler.h
+ *
+ * Copyright (C) 2013 Atomic Blue (info@planeshift.it, http://www.atomicblue.org)
+ *
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation (version 2 of the License)
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ *
+ */
+#ifndef __MULTICASTSCHEDULER_H__
+#define __MULTICASTSCHEDULER_H__
+
+//=============================================================================
+// Crystal Space Includes
+//=============================================================================
+#include <csutil/hash.h>
+#include <csutil/threading/mutex.h>
+
+//=============================================================================
+// Project Includes
+//=============================================================================
+#include "net/netbase.h"
+#include "util/psconst.h"
+
+class NetManager;
+struct iConfigManager;
+
+/**
+ * \addtogroup server
+ * @{ */
+
+/**
+ * Sends position updates of entities to the clients watching them, at a
+ * rate depending on how far away the entity is.
+ *
+ * Updates of entities close to the client, in combat, or targeted by the
+ * client, and all updates to a client in combat are sent right away. Updates of entities further away are held
+ * and sent by Tick() once the interval of their distance tier passed,
+ * replacing any older update of the same entity still held. Each client
+ * has a budget of bytes per tick. Updates sent right away always go and
+ * use the budget first, the held updates are sent in order of how long
+ * they waited relative to their distance, until the budget is used up.
+ * At least one held update is sent per tick so nothing freezes for good.
+ *
+ * Only use this for updates that are superseded by the next update of the
+ * same entity, like DR messages. Anything else must use Multicast(). When
+ * a position of an entity is sent some other way, Drop() the held updates
+ * so they can not arrive after it.
+ *
+ * Disabled unless PlaneShift.Server.Multicast.Scheduler is set.
+ */
+class MulticastScheduler
+{
+public:
+    MulticastScheduler(NetManager* netmanager);
+    ~MulticastScheduler();
+
+    /**
+     * Read the tiers and budget from the configuration and start ticking.
+     * Until this is called all updates are sent right away.
+     */
+    void Initialize(iConfigManager* config);
+
+    /**
+     * Send or schedule an update of an entity to the clients watching it.
+     *
+     * @param me        The update, it is kept until it is sent.
+     * @param entity    The entity the update is about.
+     * @param multi     The clients watching the entity.
+     * @param except    A client not to send the update to.
+     * @param important Send to everyone right away, e.g. when in combat.
+     */
+    void Multicast(MsgEntry* me, EID entity, const csArray<PublishDestination> &multi,
+                   uint32_t except, bool important);
+
+    /**
+     * Forget any held update of an entity for a client, because the client
+     * no longer watches the entity.
+     */
+    void Cancel(uint32_t client, EID entity);
+
+    /**
+     * Forget the held updates of an entity for all clients, because a
+     * newer position of the entity was sent without the scheduler.
+     */
+    void Drop(EID entity);
+
+    /**
+     * Send the held updates that are due, within the budget of each client.
+     * Called every tick interval from the game thread.
+     */
+    void Tick();
+
+    /// Number of updates sent right away, held, and sent by Tick() so far.
+    void GetStats(size_t &immediate, size_t &scheduled, size_t &sent);
+
+protected:
+    /// The last update of an entity sent to or held for a client.
+    struct ScheduledUpdate
+    {
+        csRef<MsgEntry> msg;   ///< Held update, NULL if nothing is waiting.
+        float dist;            ///< Distance of the entity when the update was held.
+        csTicks lastSent;      ///< When the last update was sent.
+    };
+
+    /// Everything held for one client.
+    struct ClientSchedule
+    {
+        csHash<ScheduledUpdate, EID> updates;
+        size_t used;           ///< Bytes sent this tick.
+    };
+
+    /// Time to wait between updates of an entity at this distance.
+    csTicks GetInterval(float dist) const;
+
+    /// Send an update to one client now.
+    void Send(MsgEntry* me, uint32_t client, ClientSchedule* schedule, ScheduledUpdate &update, csTicks now);
+
+    NetManager* netmanager;
+    CS::Threading::Mutex mutex;
+    csHash<ClientSchedule*, uint32_t> schedules;
+
+    bool enabled;
+    csTicks tickInterval;
+    float nearRange;           ///< Closer than this updates are sent right away.
+    float farRange;            ///< Further than this the far interval is used.
+    csTicks midInterval;
+    csTicks farInterval;
+    size_t budget;             ///< Bytes per client per tick, 0 for no limit.
+
+    size_t immediateCount;
+    size_t scheduledCount;
+    size_t sentCount;
+};
+
+/** @} */
+
+#endif
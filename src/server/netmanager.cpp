@@ -39,6 +39,7 @@
 // Local Includes
 //=============================================================================
 #include "netmanager.h"
+#include "multicastscheduler.h"
 #include "client.h"
 #include "clients.h"
 #include "playergroup.h"
@@ -56,6 +57,11 @@
 
 
 
+/**
+ * Sends a message later. Triggered by the game thread like every other send
+ * to the client, so the messages of a client are queued in the order they are
+ * sent.
+ */
 class DelayedMessageSendEvent : public psGameEvent
 {
 protected:
@@ -87,10 +93,12 @@ NetManager::NetManager()
     : NetBase(1000),stop_network(false)
 {
     port=0;
+    scheduler = new MulticastScheduler(this);
 }
 
 NetManager::~NetManager()
 {
+    delete scheduler;
 }
 
 bool NetManager::Initialize(CacheManager* cachemanager, int client_firstmsg, int npcclient_firstmsg, int timeout)
@@ -464,6 +472,10 @@ void NetManager::Run()
     long    lasttotalcountin=0;
     long    lasttotalcountout=0;
 
+    size_t  lastimmediate=0;
+    size_t  lastscheduled=0;
+    size_t  lastscheduledsent=0;
+
     float   kbpsout = 0;
     float   kbpsin = 0;
 
@@ -505,6 +517,9 @@ void NetManager::Run()
         // Display Network statistics
         if(currentticks - laststatdisplay > STATDISPLAYCHECK)
         {
+            long totaltransferin, totaltransferout, totalcountin, totalcountout;
+            GetTransferTotals(totaltransferin, totaltransferout, totalcountin, totalcountout);
+
             kbpsin = (float)(totaltransferin - lasttotaltransferin) / (float)STATDISPLAYCHECK;
             if(kbpsin > kbpsInMax)
             {
@@ -540,6 +555,14 @@ void NetManager::Run()
                         kbpsin, kbpsInMax);
                 CPrintf(CON_DEBUG, "Packets inbound %ld , outbound %ld...\n",
                         totalcountin-lasttotalcountin,totalcountout-lasttotalcountout);
+
+                size_t immediate, scheduled, scheduledsent;
+                scheduler->GetStats(immediate, scheduled, scheduledsent);
+                CPrintf(CON_DEBUG, "Position updates %zu sent right away, %zu held, %zu of them sent later...\n",
+                        immediate-lastimmediate, scheduled-lastscheduled, scheduledsent-lastscheduledsent);
+                lastimmediate = immediate;
+                lastscheduled = scheduled;
+                lastscheduledsent = scheduledsent;
             }
 
             lasttotalcountout = totalcountout;
@@ -549,6 +572,23 @@ void NetManager::Run()
     printf("Network thread stopped!\n");
 }
 
+bool NetManager::SendFanOut(psNetFanOut &fanout, uint32_t clientnum)
+{
+    csRef<NetPacketQueueRefCount> outqueue = clients.FindQueueAny(clientnum);
+    if(!outqueue)
+        return false;
+
+    // Same order as in SendMessage(), packets first and then the senders.
+    bool sendresult = NetBase::SendFanOut(fanout, clientnum, outqueue);
+
+    if(!senders.Add(outqueue))
+    {
+        Error1("Senderlist Full!");
+    }
+
+    return sendresult;
+}
+
 void NetManager::Broadcast(MsgEntry* me, int scope, int guildID)
 {
     switch(scope)
@@ -564,31 +604,33 @@ void NetManager::Broadcast(MsgEntry* me, int scope, int guildID)
             newmsg.AttachNew(new MsgEntry(me));
             newmsg->msgid = GetRandomID();
 
-            // Message is copied again into packet sections, so we can reuse same one.
-            ClientIterator i(clients);
-
-            while(i.HasNext())
+            // Message is split into packets once, all clients share them.
             {
-                Client* p = i.Next();
-                if(scope==NetBase::BC_EVERYONEBUTSELF
-                        && p->GetClientNum() == originalclient)
-                    continue;
+                psNetFanOut fanout(newmsg);
+                ClientIterator i(clients);
 
-                // send to superclient only the messages he needs
-                if(p->IsSuperClient())
+                while(i.HasNext())
                 {
-                    // time of the day is needed
-                    if(me->GetType()!=MSGTYPE_WEATHER)
+                    Client* p = i.Next();
+                    if(scope==NetBase::BC_EVERYONEBUTSELF
+                            && p->GetClientNum() == originalclient)
                         continue;
-                }
 
-                // Only clients that finished connecting get broadcastet
-                // stuff
-                if(!p->IsReady())
-                    continue;
+                    // send to superclient only the messages he needs
+                    if(p->IsSuperClient())
+                    {
+                        // time of the day is needed
+                        if(me->GetType()!=MSGTYPE_WEATHER)
+                            continue;
+                    }
+
+                    // Only clients that finished connecting get broadcastet
+                    // stuff
+                    if(!p->IsReady())
+                        continue;
 
-                newmsg->clientnum = p->GetClientNum();
-                SendMessage(newmsg);
+                    SendFanOut(fanout, p->GetClientNum());
+                }
             }
 
             CHECK_FINAL_DECREF(newmsg, "BroadcastMsg");
@@ -608,16 +650,18 @@ void NetManager::Broadcast(MsgEntry* me, int scope, int guildID)
             newmsg.AttachNew(new MsgEntry(me));
             newmsg->msgid = GetRandomID();
 
-            // Message is copied again into packet sections, so we can reuse same one.
-            ClientIterator i(clients);
-
-            while(i.HasNext())
+            // Message is split into packets once, all clients share them.
             {
-                Client* p = i.Next();
-                if(p->GetGuildID() == guildID)
+                psNetFanOut fanout(newmsg);
+                ClientIterator i(clients);
+
+                while(i.HasNext())
                 {
-                    newmsg->clientnum = p->GetClientNum();
-                    SendMessage(newmsg);
+                    Client* p = i.Next();
+                    if(p->GetGuildID() == guildID)
+                    {
+                        SendFanOut(fanout, p->GetClientNum());
+                    }
                 }
             }
 
@@ -664,6 +708,9 @@ Client* NetManager::GetAnyClient(int cnum)
 
 void NetManager::Multicast(MsgEntry* me, const csArray<PublishDestination> &multi, uint32_t except, float range)
 {
+    // Split into packets once, all clients share them.
+    psNetFanOut fanout(me);
+
     for(size_t i=0; i<multi.GetSize(); i++)
     {
         if(multi[i].client==except)   // skip the exception client to avoid circularity
@@ -674,8 +721,7 @@ void NetManager::Multicast(MsgEntry* me, const csArray<PublishDestination> &mult
         {
             if(range == 0 || multi[i].dist < range)
             {
-                me->clientnum = multi[i].client;
-                SendMessage(me);      // This copies the mem block, so we can reuse.
+                SendFanOut(fanout, multi[i].client);
             }
         }
     }
@@ -36,6 +36,7 @@
 #include "clients.h"
 
 class CacheManager;
+class MulticastScheduler;
 
 /**
  * \addtogroup server
@@ -115,6 +116,15 @@ public:
      */
     virtual void Multicast(MsgEntry* me, const csArray<PublishDestination> &multi, uint32_t except, float range);
 
+    /**
+     * Gets the scheduler that sends position updates at a rate depending
+     * on distance, use it instead of Multicast() for DR messages.
+     */
+    MulticastScheduler* GetMulticastScheduler()
+    {
+        return scheduler;
+    }
+
     /**
      * Checks for and deletes link dead clients.
      *
@@ -160,6 +170,17 @@ public:
      */
     virtual bool SendMessage(MsgEntry* me);
 
+    /**
+     * Sends a message of a fan-out to one client. Use this instead of
+     * SendMessage() when the same message goes to many clients, so it is
+     * split into packets only once.
+     *
+     * @param fanout   Holds the message and the packets shared by the clients.
+     * @param clientnum The client to send it to.
+     * @return Returns success or faliure.
+     */
+    bool SendFanOut(psNetFanOut &fanout, uint32_t clientnum);
+
     /**
      * Queues the message for sending later, so the calling classes don't have
      * to all manage this themselves.
@@ -224,6 +245,9 @@ private:
     /// list of connected clients
     ClientConnectionSet clients;
 
+    /// Rate and bandwidth control for position updates
+    MulticastScheduler* scheduler;
+
     /// UDP port the server binds to
     int port;
 
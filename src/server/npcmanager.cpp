@@ -610,6 +610,8 @@ void NPCManager::HandleNPCReady(MsgEntry* me,Client* client)
     gemSupervisor->ActivateNPCs(client->GetAccountID());
     // NPC Client is now ready so add onto superclients list
     client->SetReady(true);
+    // The new superclient has no positions to apply moves to
+    gemSupervisor->ResetSuperclientPositions();
     superclients.Push(PublishDestination(client->GetClientNum(), client, 0, 0));
 
     // TODO: Consider move this to a earlier stage in the load process
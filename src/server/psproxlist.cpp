@@ -56,6 +56,9 @@
 #include "npcmanager.h"
 #include "entitymanager.h"
 #include "actionmanager.h"
+#include "netmanager.h"
+#include "multicastscheduler.h"
+#include "psserver.h"
 
 // define if you want loads of debug printfs
 //#define PSPROXDEBUG
@@ -75,6 +78,7 @@ ProximityList::ProximityList(iObjectRegistry* object_reg, gemObject* parent, Ent
     self = parent;
 
     clientnum = 0;
+    touchGeneration = 1;
     float rot;
     iSector* sector;
     firstFrame = true;
@@ -91,17 +95,18 @@ ProximityList::~ProximityList()
     while(objectsThatIWatch.GetSize())
     {
 #ifdef PSPROXDEBUG
-        CPrintf(CON_DEBUG, "Unsubscribing from %s (%p).\n", objectsThatIWatch[0]->GetName(), this);
+        CPrintf(CON_DEBUG, "Unsubscribing from %s (%p).\n", objectsThatIWatch.Top()->GetName(), this);
 #endif
 
-        objectsThatIWatch[0]->GetProxList()->RemoveWatcher(self);
-        objectsThatIWatch.DeleteIndex(0);
-        objectsThatIWatch_touched.DeleteIndex(0);
+        objectsThatIWatch.Top()->GetProxList()->RemoveWatcher(self);
+        objectsThatIWatch.Pop();
+        objectsThatIWatch_touched.Pop();
     }
+    objectsThatIWatch_index.Empty();
 
     while(objectsThatWatchMe.GetSize())
     {
-        gemObject* obj = (gemObject*)objectsThatWatchMe.Get(0).object;
+        gemObject* obj = (gemObject*)objectsThatWatchMe.Top().object;
 #ifdef PSPROXDEBUG
         CPrintf(CON_DEBUG, "Unsubscribing from %s (%p).\n",obj->GetName(), this);
 #endif
@@ -159,7 +164,7 @@ void ProximityList::AddWatcher(gemObject* interestedObject, float range)
 {
     PublishDestination* pd;
 
-    uint index;
+    size_t index;
     pd = FindObjectThatWatchesMe(interestedObject, index);
     if(pd != NULL)
     {
@@ -167,11 +172,11 @@ void ProximityList::AddWatcher(gemObject* interestedObject, float range)
         return;
     }
 
-
-    destRangeTimer.Push(0);
-    size_t i = objectsThatWatchMe.Push(PublishDestination(interestedObject->GetClientID(), interestedObject, 0, 100));
-    UpdatePublishDestRange(&objectsThatWatchMe[i], self, interestedObject, i, range);
-    objectsThatWatchMe_touched.Push(true);
+    index = objectsThatWatchMe.Push(PublishDestination(interestedObject->GetClientID(), interestedObject, 0, 100));
+    objectsThatWatchMe_timer.Push(0);
+    objectsThatWatchMe_touched.Push(touchGeneration);
+    objectsThatWatchMe_index.Put(interestedObject->GetEID(), index);
+    UpdatePublishDestRange(&objectsThatWatchMe[index], self, interestedObject, index, range);
 }
 
 bool ProximityList::EndMutualWatching(gemObject* fromobject)
@@ -192,38 +197,56 @@ bool ProximityList::StartWatching(gemObject* object, float range)
         return false;
     }
 
-    objectsThatIWatch.Push(object);
-    objectsThatIWatch_touched.Push(true);
+    size_t index = objectsThatIWatch.Push(object);
+    objectsThatIWatch_touched.Push(touchGeneration);
+    objectsThatIWatch_index.Put(object->GetEID(), index);
     object->GetProxList()->AddWatcher(self, range);
     return true;
 }
 
 void ProximityList::EndWatching(gemObject* object)
 {
-    for(size_t x = 0; x < objectsThatIWatch.GetSize(); x++)
+    const size_t* index = objectsThatIWatch_index.GetElementPointer(object->GetEID());
+    if(!index)
+        return;
+
+    size_t x = *index;
+    objectsThatIWatch_index.DeleteAll(object->GetEID());
+
+    objectsThatIWatch[x]->GetProxList()->RemoveWatcher(self);
+    objectsThatIWatch.DeleteIndexFast(x);
+    objectsThatIWatch_touched.DeleteIndexFast(x);
+
+    // The last entry was moved into the hole
+    if(x < objectsThatIWatch.GetSize())
     {
-        if(objectsThatIWatch[x] == object)
-        {
-            objectsThatIWatch[x]->GetProxList()->RemoveWatcher(self);
-            objectsThatIWatch.DeleteIndex(x);
-            objectsThatIWatch_touched.DeleteIndex(x);
-            return;
-        }
+        objectsThatIWatch_index.PutUnique(objectsThatIWatch[x]->GetEID(), x);
     }
 }
 
 void ProximityList::RemoveWatcher(gemObject* object)
 {
     // Remove the target's entity/client from our list
-    for(size_t x = 0; x < objectsThatWatchMe.GetSize(); x++)
+    const size_t* index = objectsThatWatchMe_index.GetElementPointer(object->GetEID());
+    if(!index)
+        return;
+
+    size_t x = *index;
+    objectsThatWatchMe_index.DeleteAll(object->GetEID());
+
+    // A position update held for the watcher would arrive after we are removed from it
+    if(objectsThatWatchMe[x].client)
+        psserver->GetNetManager()->GetMulticastScheduler()->Cancel(objectsThatWatchMe[x].client, self->GetEID());
+
+    objectsThatWatchMe.DeleteIndexFast(x);
+    objectsThatWatchMe_timer.DeleteIndexFast(x);
+    objectsThatWatchMe_touched.DeleteIndexFast(x);
+
+    // The last entry was moved into the hole
+    if(x < objectsThatWatchMe.GetSize())
     {
-        if(objectsThatWatchMe[x].object == object)
-        {
-            objectsThatWatchMe.DeleteIndex(x);
-            objectsThatWatchMe_touched.DeleteIndex(x);
-            destRangeTimer.DeleteIndex(x);
-            return;
-        }
+        gemObject* moved = (gemObject*)objectsThatWatchMe[x].object;
+        objectsThatWatchMe_index.PutUnique(moved->GetEID(), x);
     }
 }
 
@@ -241,40 +264,28 @@ bool ProximityList::FindClient(uint32_t cnum)
 
 bool ProximityList::FindObject(gemObject* object)
 {
-    for(size_t x = 0; x < objectsThatWatchMe.GetSize(); x++)
-    {
-        if(objectsThatWatchMe[x].object == object)
-        {
-            return true;
-        }
-    }
-    return false;
+    return objectsThatWatchMe_index.Contains(object->GetEID());
 }
 
-PublishDestination* ProximityList::FindObjectThatWatchesMe(gemObject* object, uint &x)
+PublishDestination* ProximityList::FindObjectThatWatchesMe(gemObject* object, size_t &x)
 {
-    for(x = 0; x < objectsThatWatchMe.GetSize(); x++)
-    {
-        if(objectsThatWatchMe[x].object == object)
-        {
-            objectsThatWatchMe_touched[x] = true;
-            return &objectsThatWatchMe[x];
-        }
-    }
-    return NULL;
+    const size_t* index = objectsThatWatchMe_index.GetElementPointer(object->GetEID());
+    if(!index)
+        return NULL;
+
+    x = *index;
+    objectsThatWatchMe_touched[x] = touchGeneration;
+    return &objectsThatWatchMe[x];
 }
 
 bool ProximityList::FindObjectThatIWatch(gemObject* object)
 {
-    for(size_t x = 0; x < objectsThatIWatch.GetSize(); x++)
-    {
-        if(objectsThatIWatch[x] == object)
-        {
-            objectsThatIWatch_touched[x] = true;
-            return true;
-        }
-    }
-    return false;
+    const size_t* index = objectsThatIWatch_index.GetElementPointer(object->GetEID());
+    if(!index)
+        return false;
+
+    objectsThatIWatch_touched[*index] = touchGeneration;
+    return true;
 }
 
 gemObject* ProximityList::FindObjectName(const char* name)
@@ -290,7 +301,7 @@ gemObject* ProximityList::FindObjectName(const char* name)
 }
 
 void ProximityList::UpdatePublishDestRange(PublishDestination* pd, gemObject* myself, gemObject* object,
-        uint objIdx, float newrange)
+        size_t objIdx, float newrange)
 {
     csArray<psNPCCommandsMessage::PerceptionType> pcpts;
 
@@ -321,11 +332,11 @@ void ProximityList::UpdatePublishDestRange(PublishDestination* pd, gemObject* my
     // Anyone that is watching each other should get a perception once in a while.
     // Check per-entity any distance.
     csTicks now = csGetTicks();
-    csTicks timeout = destRangeTimer[objIdx];
+    csTicks timeout = objectsThatWatchMe_timer[objIdx];
     if(timeout < now)
     {
         pcpts.Push(psNPCCommandsMessage::PCPT_ANYRANGEPLAYER);
-        destRangeTimer[objIdx] = now + newrange*50;
+        objectsThatWatchMe_timer[objIdx] = now + newrange*50;
     }
 
     for(size_t i=0; i<pcpts.GetSize(); ++i)
@@ -367,14 +378,11 @@ void ProximityList::UpdatePublishDestRange(PublishDestination* pd, gemObject* my
 
 void ProximityList::TouchObjectThatWatchesMe(gemObject* object,float newrange)
 {
-    for(size_t x = 0; x < objectsThatWatchMe.GetSize(); x++)
+    size_t x;
+    PublishDestination* pd = FindObjectThatWatchesMe(object, x);
+    if(pd)
     {
-        if(objectsThatWatchMe[x].object == object)
-        {
-            objectsThatWatchMe_touched[x] = true;
-            UpdatePublishDestRange(&objectsThatWatchMe[x], self, object, x, newrange);
-            return;
-        }
+        UpdatePublishDestRange(pd, self, object, x, newrange);
     }
 }
 
@@ -398,42 +406,62 @@ bool ProximityList::CheckUpdateRequired()
 }
 
 
+void ProximityList::UpdateWatcherRanges()
+{
+    // Objects I watch keep my range in their list of watchers
+    for(size_t x = 0; x < objectsThatIWatch.GetSize(); x++)
+    {
+        gemObject* object = objectsThatIWatch[x];
+        object->GetProxList()->TouchObjectThatWatchesMe(self, RangeTo(object));
+    }
+
+    for(size_t x = 0; x < objectsThatWatchMe.GetSize(); x++)
+    {
+        gemObject* object = (gemObject*)objectsThatWatchMe[x].object;
+        UpdatePublishDestRange(&objectsThatWatchMe[x], self, object, x, RangeTo(object));
+    }
+}
+
 void ProximityList::ClearTouched()
 {
-    size_t objNum;
+    touchGeneration++;
 
-    for(objNum = 0; objNum < objectsThatWatchMe_touched.GetSize(); objNum++)
-        objectsThatWatchMe_touched[objNum] = false;
-    for(objNum = 0; objNum < objectsThatIWatch_touched.GetSize(); objNum++)
-        objectsThatIWatch_touched[objNum]  = false;
+    // On wrap around old marks could match the new generation, so reset them.
+    if(touchGeneration == 0)
+    {
+        size_t objNum;
+
+        for(objNum = 0; objNum < objectsThatWatchMe_touched.GetSize(); objNum++)
+            objectsThatWatchMe_touched[objNum] = 0;
+        for(objNum = 0; objNum < objectsThatIWatch_touched.GetSize(); objNum++)
+            objectsThatIWatch_touched[objNum]  = 0;
+
+        touchGeneration = 1;
+    }
 }
 
-bool ProximityList::GetUntouched_ObjectThatWatchesMe(gemObject* &object)
+void ProximityList::GetUntouched_ObjectsThatWatchMe(csArray<gemObject*> &list)
 {
     for(size_t x = 0; x < objectsThatWatchMe_touched.GetSize(); x++)
     {
-        if(!objectsThatWatchMe_touched[x])
+        if(objectsThatWatchMe_touched[x] != touchGeneration)
         {
-            object = (gemObject*)objectsThatWatchMe[x].object;
-            objectsThatWatchMe_touched[x] = true;
-            return true;
+            list.Push((gemObject*)objectsThatWatchMe[x].object);
+            objectsThatWatchMe_touched[x] = touchGeneration;
         }
     }
-    return false;
 }
 
-bool ProximityList::GetUntouched_ObjectThatIWatch(gemObject* &object)
+void ProximityList::GetUntouched_ObjectsThatIWatch(csArray<gemObject*> &list)
 {
     for(size_t x = 0; x < objectsThatIWatch_touched.GetSize(); x++)
     {
-        if(!objectsThatIWatch_touched[x])
+        if(objectsThatIWatch_touched[x] != touchGeneration)
         {
-            object = objectsThatIWatch[x];
-            objectsThatIWatch_touched[x] = true;
-            return true;
+            list.Push(objectsThatIWatch[x]);
+            objectsThatIWatch_touched[x] = touchGeneration;
         }
     }
-    return false;
 }
 
 
@@ -47,8 +47,16 @@ class EntityManager;
  *    - values in objectsThatIWatch  are unique
  *    - object X is in objectsThatWatchMe of object Y <===> object Y must be in objectsThatIWatch of X
  *    - objects with GetClientID()==0 have empty objectsThatIWatch
- *    - correspondence between objectsThatWatchMe and objectsThatWatchMe_touched
- *                             objectsThatIWatch  and objectsThatIWatch_touched
+ *    - objectsThatWatchMe, objectsThatWatchMe_timer and objectsThatWatchMe_touched have the same size
+ *      and the same order, objectsThatWatchMe_index maps the EID of each watcher to its index.
+ *    - objectsThatIWatch and objectsThatIWatch_touched have the same size and the same order,
+ *      objectsThatIWatch_index maps the EID of each watched object to its index.
+ *
+ * Entries are removed by moving the last entry into the hole, so the order of the
+ * arrays is not stable and indexes are only valid until the next removal.
+ *
+ * An entry is touched when its touch mark equals touchGeneration. ClearTouched()
+ * untouches all entries at once by starting a new generation.
  */
 
 class ProximityList
@@ -57,11 +65,15 @@ protected:
     gemObject* self;
 
     csArray<PublishDestination> objectsThatWatchMe;   ///< What players are subscribed to my updates?
+    csArray<csTicks> objectsThatWatchMe_timer;        ///< Per-object timeout on dest range checks.
+    csArray<uint32> objectsThatWatchMe_touched;       ///< Touch mark of each object that watches me.
+    csHash<size_t, EID> objectsThatWatchMe_index;     ///< Index in the arrays above by EID.
+
     csArray<gemObject*>  objectsThatIWatch;           ///< What objects am I subscribed to myself?
-    csArray<csTicks> destRangeTimer;       ///< Per-object timeout on dest range checks.
+    csArray<uint32> objectsThatIWatch_touched;        ///< Touch mark of each object I watch.
+    csHash<size_t, EID> objectsThatIWatch_index;      ///< Index in the arrays above by EID.
 
-    csArray<bool> objectsThatWatchMe_touched;
-    csArray<bool> objectsThatIWatch_touched;
+    uint32       touchGeneration;                     ///< Current touch mark.
 
     int          clientnum;
     bool         firstFrame;
@@ -78,7 +90,7 @@ protected:
 
     bool IsNear(iSector* sector,csVector3 &pos,gemObject* object,float radius);
     bool FindObject(gemObject* object);
-    PublishDestination* FindObjectThatWatchesMe(gemObject* object, uint &x);
+    PublishDestination* FindObjectThatWatchesMe(gemObject* object, size_t &x);
     bool FindObjectThatIWatch(gemObject* object);
 
     void TouchObjectThatWatchesMe(gemObject* object,float newrange);
@@ -87,7 +99,7 @@ protected:
     void UpdatePublishDestRange(PublishDestination* pd,
                                 gemObject* myself,
                                 gemObject* object,
-                                uint objIdx,
+                                size_t objIdx,
                                 float newrange);
 
 public:
@@ -126,11 +138,22 @@ public:
      */
     bool CheckUpdateRequired();
     float RangeTo(gemObject* object, bool ignoreY = false, bool ignoreInstance = false);
+
+    /**
+     * Refresh the range of all current watch relations of this object, without
+     * looking for new ones or removing any.
+     */
+    void UpdateWatcherRanges();
     void DebugDumpContents(csString &out);
 
+    /** Mark all entries as untouched, in constant time. */
     void ClearTouched();
-    bool GetUntouched_ObjectThatWatchesMe(gemObject* &object);
-    bool GetUntouched_ObjectThatIWatch(gemObject* &object);
+
+    /** Appends all objects that watch me and were not touched since the last ClearTouched() to the list. */
+    void GetUntouched_ObjectsThatWatchMe(csArray<gemObject*> &list);
+
+    /** Appends all objects I watch that were not touched since the last ClearTouched() to the list. */
+    void GetUntouched_ObjectsThatIWatch(csArray<gemObject*> &list);
 };
 
 #endif
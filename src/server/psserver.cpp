@@ -41,6 +41,7 @@
 #include "util/eventmanager.h"
 #include "util/log.h"
 #include "util/consoleout.h"
+#include "util/zoneprofiler.h"
 
 #include "net/msghandler.h"
 #include "net/messages.h"
@@ -78,6 +79,7 @@
 #include "marriagemanager.h"
 #include "minigamemanager.h"
 #include "netmanager.h"
+#include "multicastscheduler.h"
 #include "npcmanager.h"
 #include "playergroup.h"
 #include "progressionmanager.h"
@@ -281,6 +283,14 @@ bool psServer::Initialize(iObjectRegistry* object_reg)
     // Load the log settings
     LoadLogSettings();
 
+    // Register the zone profiler before the database plugin is loaded, so it records there too
+    if(configmanager->GetBool("PlaneShift.Server.Profiler.Zones", true))
+    {
+        zoneProfiler.AttachNew(new psZoneProfiler(configmanager->GetInt("PlaneShift.Server.Profiler.RingSize", 65536)));
+        zoneProfiler->Register(object_reg);
+        psZoneProfiler::SetThreadName("Main");
+    }
+
     // Initialise the CSV logger
     logcsv = new LogCSV(configmanager, vfs);
 
@@ -439,9 +449,25 @@ bool psServer::Initialize(iObjectRegistry* object_reg)
     // This gives access to msghandler to all message types
     psMessageCracker::msghandler = eventmanager;
 
+    eventmanager->SetEventStatsInterval(configmanager->GetInt("PlaneShift.Server.EventStats.Interval", 300) * 1000);
+
     if(!eventmanager->Initialize(netmanager, 1000))
         return false;
 
+    // Queued queries fall back to the main connection without workers
+    if(!database->StartWorkers(configmanager->GetInt("PlaneShift.Database.Workers", 2),
+                               configmanager->GetInt("PlaneShift.Database.CallbackInterval", 50)))
+    {
+        CPrintf(CON_WARNING, "Couldn't start the database workers: %s\n", database->GetLastError());
+    }
+
+    // Saves are written as they are made without the thread
+    if(!database->StartWriteBehind(configmanager->GetInt("PlaneShift.Database.WriteBehindWindow", 1000),
+                                   configmanager->GetInt("PlaneShift.Database.WriteBehindBatch", 500)))
+    {
+        CPrintf(CON_WARNING, "Couldn't start the write behind queue: %s\n", database->GetLastError());
+    }
+
     Debug1(LOG_STARTUP,0,"Started Event Manager Thread");
 
     if(!progression->Initialize(object_reg))
@@ -478,6 +504,7 @@ bool psServer::Initialize(iObjectRegistry* object_reg)
     entitymanager->SetReady(false);
     usermanager->Initialize(entitymanager->GetGEM());
     netmanager->SetEngine(entitymanager->GetEngine());
+    netmanager->GetMulticastScheduler()->Initialize(configmanager);
     Debug1(LOG_STARTUP,0,"Started CEL");
 
     // Start Combat Manager
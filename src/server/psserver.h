@@ -81,6 +81,7 @@ class  IntroductionManager;
 class  ServerSongManager;
 class  MiniGameManager;
 class  LogCSV;
+class  psZoneProfiler;
 class  iResultSet;
 class  csVector3;
 struct iVFS;
@@ -831,6 +832,7 @@ protected:
     csRef<ActionManager>            actionmanager;
     csRef<AuthenticationServer>   authserver;
     LogCSV*                         logcsv;
+    csRef<psZoneProfiler>           zoneProfiler;
     bool                            MapLoaded;
     csString                        motd;
     GMEventManager*                 gmeventManager;
@@ -62,6 +62,7 @@
 #include "globals.h"
 #include "scripting.h"
 #include "netmanager.h"
+#include "multicastscheduler.h"
 
 psServerDR::psServerDR(CacheManager* cachemanager, EntityManager* entitymanager)
 {
@@ -274,10 +275,10 @@ void psServerDR::HandleDeadReckoning(MsgEntry* me,Client* client)
     }
     */
 
-    // Now multicast to other clients
-    psserver->GetEventManager()->Multicast(me,
-                                           actor->GetMulticastClients(),
-                                           me->clientnum,PROX_LIST_ANY_RANGE);
+    // Now multicast to other clients, far away ones get fewer updates
+    psserver->GetNetManager()->GetMulticastScheduler()->Multicast(me, actor->GetEID(),
+            actor->GetMulticastClients(), me->clientnum,
+            actor->GetMode() == PSCHARACTER_MODE_COMBAT);
 
     paladin->CheckCollDetection(client, actor);
 
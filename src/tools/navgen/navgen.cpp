@@ -52,6 +52,7 @@ void NavGen::PrintHelp()
     csPrintf("  -meshes=dir     set mesh directory     (/planeshift/meshes/)\n");
     csPrintf("  -world=dir      set world directory    (/planeshift/world/)\n");
     csPrintf("  -output=dir     set output directory   (/planeshift/navmesh/)\n");
+    csPrintf("  -threads=n      set threads building the tiles of a sector (1)\n");
 }
 
 void NavGen::Run()
@@ -83,6 +84,12 @@ void NavGen::Run()
     if(output.IsEmpty())
         output = config->GetStr("NavGen.OutputDir", basePath+"navmesh");
 
+    int threads = config->GetInt("NavGen.Threads", 1);
+    csString threadOption = cmdline->GetOption("threads");
+    if(!threadOption.IsEmpty())
+        threads = atoi(threadOption);
+    threads = csMax(threads, 1);
+
     float height = config->GetFloat("NavGen.Agent.Height", 2.f);
     float width  = config->GetFloat("NavGen.Agent.Width", 0.5f);
     float slope  = config->GetFloat("NavGen.Agent.Slope", 45.f);
@@ -112,6 +119,7 @@ void NavGen::Run()
     csPrintf("NavGen.CellHeight: %f\n", cellHeight);
     csPrintf("NavGen.TileSize: %d\n", tileSize);
     csPrintf("NavGen.BorderSize: %d\n", borderSize);
+    csPrintf("NavGen.Threads: %d\n", threads);
     csPrintf("---\n");
 
     vc->Advance();
@@ -236,6 +244,7 @@ void NavGen::Run()
         parameters->SetCellHeight(cellHeight);
         parameters->SetBorderSize(borderSize);
         builder->SetNavMeshParams(parameters);
+        builder->SetThreadCount(threads);
 
         // get list of loaded sectors
         csRefArray<iSector> sectors;